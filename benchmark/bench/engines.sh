@@ -0,0 +1,86 @@
+#!/bin/bash
+
+# This script runs the benchmark driver of every engine (targets 'bench_*')
+# with the same number of lookups, batch size, warmup and repetitions, for a
+# number of threads, and writes one CSV line per run (see src/bench.c). The
+# data files are looked up in DATA_DIR (IPv4) and DATA6_DIR (IPv6).
+
+# Settings
+PROJECT_DIR=$(cd "$(dirname "$0")/.." && pwd)
+DATA_DIR=${DATA_DIR:-data/ipv4}
+DATA6_DIR=${DATA6_DIR:-data/ipv6}
+NUM_ADDRESSES=16777216
+BATCH_SIZE=64
+WARMUP=1
+REPETITIONS=5
+THREADS=(1 8 16 32)
+SCHED_CHUNKSIZE="dynamic,16"  # In batches.
+OUTPUT_FILE=bench/res/engines/lookup.csv # Benchmark output file.
+
+V4_OPTS="-d $DATA_DIR/distrib.txt -dla $DATA_DIR/dla.txt -g1 $DATA_DIR/g1.txt \
+-g2 $DATA_DIR/g2.txt -r $DATA_DIR/addrs.txt"
+MIHT_V4_OPTS="-p $DATA_DIR/prefixes.txt -r $DATA_DIR/addrs.txt"
+V6_OPTS="-d $DATA6_DIR/distrib.txt -p $DATA6_DIR/prefixes.txt -r $DATA6_DIR/addrs.txt"
+MIHT_V6_OPTS="-p $DATA6_DIR/prefixes.txt -r $DATA6_DIR/addrs.txt"
+
+ENGINES=(
+	"bench_baseline:$V4_OPTS"
+	"bench_bloomfwd_v4:$V4_OPTS"
+	"bench_bloomfwd_v4_batch:$V4_OPTS"
+	"bench_bloomfwd_v4_single_hash:$V4_OPTS"
+	"bench_bloomfwd_v4_cuckoo:$V4_OPTS"
+	"bench_bloomfwd_v4_perfect_hash:$V4_OPTS"
+	"bench_bloomfwd_v4_fused:$V4_OPTS"
+	"bench_bloomfwd_v4_fc:$V4_OPTS"
+	"bench_miht_v4:$MIHT_V4_OPTS"
+	"bench_bloomfwd_v6:$V6_OPTS"
+	"bench_bloomfwd_v6_batch:$V6_OPTS"
+	"bench_miht_v6:$MIHT_V6_OPTS"
+)
+
+# The drivers of an instruction set, only if the compiler had it (they were
+# built) and this CPU has it.
+isa_engines() {
+	local flag=$1
+	shift
+
+	grep -qw $flag /proc/cpuinfo || return
+	for e in "$@"
+	do
+		if [ -x "$PROJECT_DIR/bin/${e%%:*}" ]; then
+			ENGINES+=("$e")
+		fi
+	done
+}
+isa_engines avx2 "bench_bloomfwd_v6_batch_avx2:$V6_OPTS"
+isa_engines avx512f "bench_bloomfwd_v4_avx512:$V4_OPTS" \
+	"bench_bloomfwd_v6_batch_avx512:$V6_OPTS"
+
+cd $PROJECT_DIR
+mkdir -p bench/res/engines/
+
+# Clean old data files...
+data_files=$(ls bench/res/engines)
+if [ ${#data_files} -gt 0 ]; then
+	rm -f bench/res/engines/*
+fi
+
+export OMP_SCHEDULE="$SCHED_CHUNKSIZE"
+
+header=""
+for e in "${ENGINES[@]}"
+do
+	name=${e%%:*}
+	opts=${e#*:}
+
+	for t in "${THREADS[@]}"
+	do
+		export OMP_NUM_THREADS=$t
+		printf "$name, $t\n"
+
+		./bin/$name $opts -n $NUM_ADDRESSES -b $BATCH_SIZE -w $WARMUP \
+		-R $REPETITIONS $header >> $OUTPUT_FILE
+
+		header="--no-header"  # Only in the first line.
+	done
+done
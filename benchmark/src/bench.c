@@ -0,0 +1,410 @@
+/*
+ * bench.c
+ *
+ * Benchmark driver shared by all the lookup engines (see bench.h). The input
+ * addresses are looked up in batches by the OpenMP threads ($OMP_NUM_THREADS,
+ * scheduled by $OMP_SCHEDULE), after a number of warmup runs, and the run is
+ * repeated a number of times. It reports, as CSV or JSON on stdout:
+ *
+ * 	- the throughput in millions of lookups per second (median and best
+ * 	repetition);
+ * 	- the 50th, 99th and 99.9th percentiles of the latency of a batch, over
+ * 	all the repetitions;
+ * 	- the time stamp counter ticks per lookup (times the number of threads);
+ * 	- the core cycles, instructions, last level cache misses and branch
+ * 	misses per lookup, from the performance counters (null, or empty in
+ * 	CSV, when the PMU isn't accessible).
+ */
+
+#define _GNU_SOURCE  /* clock_gettime() */
+
+#include <omp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>  /* __rdtsc() */
+#define HAVE_TSC
+#endif
+
+#include "bench.h"
+#include "perfcounters.h"
+
+/* Handy macro to perform string comparison. */
+#define STREQ(s1, s2) (strcmp((s1), (s2)) == 0)
+
+#define DEFAULT_BATCH_SIZE 64
+#define DEFAULT_WARMUP 1
+#define DEFAULT_REPETITIONS 5
+
+enum output_format { OUTPUT_CSV, OUTPUT_JSON };
+
+struct options {
+	unsigned long count;  /* 0: every address once. */
+	unsigned long batch_size;
+	unsigned long warmup;
+	unsigned long repetitions;
+	enum output_format format;
+	bool header;  /* CSV only. */
+};
+
+struct result {
+	int threads;
+	unsigned long batch_size;
+	unsigned long lookups;  /* Per repetition. */
+	unsigned long repetitions;
+	double mlookups_median;
+	double mlookups_best;
+	double latency_p50;  /* Nanoseconds per batch. */
+	double latency_p99;
+	double latency_p999;
+	double tsc_per_lookup;  /* -1 if there is no TSC. */
+	long long counts[NUM_PERF_EVENTS];  /* All repetitions, -1 if none. */
+	uint64_t checksum;
+};
+
+void print_usage(char *argv[])
+{
+	printf("Usage: %s <engine options> -r <file> [-n <count>] [-b <size>] [-w <runs>] [-R <runs>] [-f csv|json] [--no-header]\n", argv[0]);
+	printf("\n");
+	printf("Engine options (%s):\n", engine.name);
+	printf("%s", engine.usage);
+	printf("\n");
+	printf("Options:\n");
+	printf("  -r --run-address-file  \t Addresses to look up, in the format of the engine.\n");
+	printf("  -n --num-addresses     \t Number of lookups per run (default: the file once).\n");
+	printf("  -b --batch-size        \t Lookups per batch (default: %d).\n", DEFAULT_BATCH_SIZE);
+	printf("  -w --warmup            \t Runs before measuring (default: %d).\n", DEFAULT_WARMUP);
+	printf("  -R --repetitions       \t Measured runs (default: %d).\n", DEFAULT_REPETITIONS);
+	printf("  -f --format            \t Output format: csv (default) or json.\n");
+	printf("     --no-header         \t Don't print the CSV header.\n");
+}
+
+static unsigned long ulong_option(int argc, char *argv[], const char *lopt,
+		const char *sopt, unsigned long def)
+{
+	int index = option_value(argc, argv, lopt, sopt);
+
+	return index == -1 ? def : strtoul(argv[index], NULL, 10);
+}
+
+static void read_options(int argc, char *argv[], struct options *opts)
+{
+	opts->count = ulong_option(argc, argv, "--num-addresses", "-n", 0);
+	opts->batch_size = ulong_option(argc, argv, "--batch-size", "-b",
+			DEFAULT_BATCH_SIZE);
+	opts->warmup = ulong_option(argc, argv, "--warmup", "-w",
+			DEFAULT_WARMUP);
+	opts->repetitions = ulong_option(argc, argv, "--repetitions", "-R",
+			DEFAULT_REPETITIONS);
+	opts->header = !option_flag(argc, argv, "--no-header", NULL);
+
+	opts->format = OUTPUT_CSV;
+	int index = option_value(argc, argv, "--format", "-f");
+	if (index != -1) {
+		if (STREQ(argv[index], "json")) {
+			opts->format = OUTPUT_JSON;
+		} else if (!STREQ(argv[index], "csv")) {
+			fprintf(stderr, "bench: Unknown output format: '%s'.\n",
+					argv[index]);
+			exit(1);
+		}
+	}
+
+	if (opts->batch_size == 0 || opts->repetitions == 0) {
+		fprintf(stderr, "bench: The batch size and the number of repetitions must be positive.\n");
+		exit(1);
+	}
+}
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t tsc(void)
+{
+#ifdef HAVE_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Repeat the first addresses after the last ones, so that the address array
+ * holds a whole number of batches and no batch wraps around its end. Return
+ * the new length.
+ */
+static unsigned long pad_addresses(void **addresses, unsigned long len,
+		unsigned long batch_size)
+{
+	unsigned long padded_len = (len + batch_size - 1) / batch_size *
+		batch_size;
+
+	uint8_t *addrs = realloc(*addresses, padded_len * engine.addr_size);
+	if (addrs == NULL) {
+		fprintf(stderr, "bench.pad_addresses: Could not realloc addresses.\n");
+		exit(1);
+	}
+
+	for (unsigned long i = len; i < padded_len; i++)
+		memcpy(addrs + i * engine.addr_size,
+				addrs + (i % len) * engine.addr_size,
+				engine.addr_size);
+
+	*addresses = addrs;
+
+	return padded_len;
+}
+
+/*
+ * Look 'num_batches' batches of 'batch_size' addresses up, taking them in
+ * order from 'addresses' (of length 'len') and going back to its beginning
+ * if needed. Store the latency of each batch in 'latencies', add the
+ * performance counters of all the threads to 'counts' and return the
+ * elapsed time in seconds.
+ */
+static double run(const void *fw_tbl, const uint8_t *addresses,
+		unsigned long len, unsigned long batch_size,
+		unsigned long num_batches, uint64_t *latencies,
+		long long counts[NUM_PERF_EVENTS], uint64_t *tsc_ticks,
+		uint64_t *checksum)
+{
+	double start = 0.0, end = 0.0;
+	uint64_t tsc_start = 0, tsc_end = 0;
+	uint64_t sum = 0;
+
+#pragma omp parallel reduction(+:sum)
+{
+	struct perf_counters counters;
+	perf_counters_start(&counters);
+
+#pragma omp single
+  {
+	start = omp_get_wtime();
+	tsc_start = tsc();
+  }
+
+#pragma omp for schedule(runtime)
+	for (unsigned long b = 0; b < num_batches; b++) {
+		const uint8_t *batch = addresses +
+			(b * batch_size % len) * engine.addr_size;
+
+		uint64_t t = now_ns();
+		sum += engine.lookup(fw_tbl, batch, batch_size);
+		latencies[b] = now_ns() - t;
+	}
+
+#pragma omp single nowait
+  {
+	end = omp_get_wtime();
+	tsc_end = tsc();
+  }
+
+	long long thread_counts[NUM_PERF_EVENTS];
+	perf_counters_stop(&counters, thread_counts);
+
+#pragma omp critical
+  {
+	for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+		if (thread_counts[e] == -1)
+			counts[e] = -1;
+		else if (counts[e] != -1)
+			counts[e] += thread_counts[e];
+	}
+  }
+}
+
+	*tsc_ticks += tsc_end - tsc_start;
+	*checksum = sum;
+
+	return end - start;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static int compare_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Return the 'q'-quantile of the sorted array 'values'. */
+static inline double percentile(const uint64_t *values, unsigned long n,
+		double q)
+{
+	unsigned long i = (unsigned long)(q * n);
+
+	return values[i < n ? i : n - 1];
+}
+
+static void benchmark(const void *fw_tbl, void *addresses, unsigned long len,
+		const struct options *opts, struct result *res)
+{
+	unsigned long count = opts->count == 0 ? len : opts->count;
+	unsigned long num_batches = (count + opts->batch_size - 1) /
+		opts->batch_size;
+
+	len = pad_addresses(&addresses, len, opts->batch_size);
+
+	uint64_t *latencies = malloc(num_batches * opts->repetitions *
+			sizeof(uint64_t));
+	double *mlookups = malloc(opts->repetitions * sizeof(double));
+	if (latencies == NULL || mlookups == NULL) {
+		fprintf(stderr, "bench.benchmark: Could not malloc latencies.\n");
+		exit(1);
+	}
+
+	res->threads = omp_get_max_threads();
+	res->batch_size = opts->batch_size;
+	res->lookups = num_batches * opts->batch_size;
+	res->repetitions = opts->repetitions;
+
+	long long counts[NUM_PERF_EVENTS] = { 0 };
+	uint64_t tsc_ticks = 0;
+
+	for (unsigned long r = 0; r < opts->warmup; r++)
+		run(fw_tbl, addresses, len, opts->batch_size, num_batches,
+				latencies, counts, &tsc_ticks, &res->checksum);
+
+	memset(res->counts, 0, sizeof(res->counts));
+	tsc_ticks = 0;
+	for (unsigned long r = 0; r < opts->repetitions; r++) {
+		double time = run(fw_tbl, addresses, len, opts->batch_size,
+				num_batches, latencies + r * num_batches,
+				res->counts, &tsc_ticks, &res->checksum);
+		mlookups[r] = res->lookups / time / 1e6;
+	}
+
+	qsort(mlookups, opts->repetitions, sizeof(double), compare_double);
+	res->mlookups_median = mlookups[opts->repetitions / 2];
+	res->mlookups_best = mlookups[opts->repetitions - 1];
+
+	unsigned long n = num_batches * opts->repetitions;
+	qsort(latencies, n, sizeof(uint64_t), compare_u64);
+	res->latency_p50 = percentile(latencies, n, 0.5);
+	res->latency_p99 = percentile(latencies, n, 0.99);
+	res->latency_p999 = percentile(latencies, n, 0.999);
+
+#ifdef HAVE_TSC
+	res->tsc_per_lookup = (double)tsc_ticks * res->threads /
+		(res->lookups * opts->repetitions);
+#else
+	res->tsc_per_lookup = -1.0;
+#endif
+
+	free(mlookups);
+	free(latencies);
+	free(addresses);
+}
+
+/* Print 'value', or 'null' (JSON) / nothing (CSV) if it is negative. */
+static void print_value(const char *sep, double value, enum output_format fmt)
+{
+	printf("%s", sep);
+	if (value >= 0.0)
+		printf("%.3lf", value);
+	else if (fmt == OUTPUT_JSON)
+		printf("null");
+}
+
+static void print_result(const struct result *res, const struct options *opts)
+{
+	double per_lookup[NUM_PERF_EVENTS];
+	for (int e = 0; e < NUM_PERF_EVENTS; e++)
+		per_lookup[e] = res->counts[e] == -1 ? -1.0 :
+			(double)res->counts[e] / (res->lookups * res->repetitions);
+
+	if (opts->format == OUTPUT_CSV) {
+		if (opts->header) {
+			printf("engine,threads,batch_size,lookups,repetitions,"
+					"mlookups_s,mlookups_s_best,p50_ns,p99_ns,"
+					"p999_ns,tsc_per_lookup");
+			for (int e = 0; e < NUM_PERF_EVENTS; e++)
+				printf(",%s_per_lookup", perf_event_names[e]);
+			printf(",checksum\n");
+		}
+
+		printf("%s,%d,%lu,%lu,%lu", engine.name, res->threads,
+				res->batch_size, res->lookups, res->repetitions);
+		print_value(",", res->mlookups_median, opts->format);
+		print_value(",", res->mlookups_best, opts->format);
+		print_value(",", res->latency_p50, opts->format);
+		print_value(",", res->latency_p99, opts->format);
+		print_value(",", res->latency_p999, opts->format);
+		print_value(",", res->tsc_per_lookup, opts->format);
+		for (int e = 0; e < NUM_PERF_EVENTS; e++)
+			print_value(",", per_lookup[e], opts->format);
+		printf(",%llu\n", (unsigned long long)res->checksum);
+	} else {
+		printf("{\"engine\": \"%s\", \"threads\": %d, \"batch_size\": %lu, "
+				"\"lookups\": %lu, \"repetitions\": %lu",
+				engine.name, res->threads, res->batch_size,
+				res->lookups, res->repetitions);
+		print_value(", \"mlookups_s\": ", res->mlookups_median,
+				opts->format);
+		print_value(", \"mlookups_s_best\": ", res->mlookups_best,
+				opts->format);
+		print_value(", \"p50_ns\": ", res->latency_p50, opts->format);
+		print_value(", \"p99_ns\": ", res->latency_p99, opts->format);
+		print_value(", \"p999_ns\": ", res->latency_p999, opts->format);
+		print_value(", \"tsc_per_lookup\": ", res->tsc_per_lookup,
+				opts->format);
+		for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+			printf(", \"%s_per_lookup\": ", perf_event_names[e]);
+			print_value("", per_lookup[e], opts->format);
+		}
+		printf(", \"checksum\": %llu}\n",
+				(unsigned long long)res->checksum);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3 || STREQ(argv[1], "--help")) {
+		print_usage(argv);
+		return 0;
+	}
+
+	struct options opts;
+	read_options(argc, argv, &opts);
+
+	FILE *input_addr = option_file(argc, argv, "--run-address-file", "-r");
+	if (input_addr == NULL) {
+		fprintf(stderr, "bench: Missing address file.\n");
+		exit(1);
+	}
+
+	void *fw_tbl = engine.load(argc, argv);
+
+	void *addresses = NULL;
+	unsigned long len = engine.read_addresses(input_addr, &addresses);
+	fclose(input_addr);
+	if (len == 0) {
+		fprintf(stderr, "bench: The address file is empty.\n");
+		exit(1);
+	}
+
+	struct result res;
+	benchmark(fw_tbl, addresses, len, &opts, &res);  /* Frees 'addresses'. */
+	print_result(&res, &opts);
+
+	if (engine.destroy != NULL)
+		engine.destroy(fw_tbl);
+
+	return 0;
+}
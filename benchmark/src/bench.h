@@ -0,0 +1,90 @@
+/*
+ * bench.h
+ *
+ * Interface between the benchmark driver (bench.c) and the lookup engines. Each
+ * 'engine_<name>.c' file wraps one algorithm of this repository and defines
+ * 'engine'; the driver is linked to a single engine (see src/CMakeLists.txt).
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+struct engine {
+	const char *name;
+
+	/* Engine specific options, printed by '--help'. */
+	const char *usage;
+
+	/*
+	 * Size of one address (and next hop): 4 bytes for IPv4, or 16 for IPv6,
+	 * as a pair of uint64_t (high and low halves).
+	 */
+	size_t addr_size;
+
+	/* Build the forwarding table from the options in 'argv'. */
+	void *(*load)(int argc, char *argv[]);
+
+	/*
+	 * Read the addresses in 'input_addr' (the format of the engine's own
+	 * '-r' option) into a new array and return how many.
+	 */
+	unsigned long (*read_addresses)(FILE *input_addr, void **addresses);
+
+	/*
+	 * Look up the 'n' addresses from 'addresses' and return a checksum of
+	 * the next hops found, so that the lookups can't be optimized out.
+	 */
+	uint64_t (*lookup)(const void *fw_tbl, const void *addresses,
+			unsigned long n);
+
+	/*
+	 * Look the 'n' addresses from 'addresses' up, storing whether each one
+	 * was found in 'found' and its next hop (an address) in 'next_hops'.
+	 */
+	void (*lookup_next_hops)(const void *fw_tbl, const void *addresses,
+			unsigned long n, bool *found, void *next_hops);
+
+	/*
+	 * Like 'lookup_next_hops', in the VRF 'vrfs[i]' for the i-th address, for
+	 * tables loaded with several VRFs (may be NULL if the engine has none).
+	 */
+	void (*lookup_next_hops_vrf)(const void *fw_tbl, const uint32_t *vrfs,
+			const void *addresses, unsigned long n, bool *found,
+			void *next_hops);
+
+	/*
+	 * Store the prefixes of the files in 'argv' (the options of 'load') in
+	 * the loaded table, updating the next hops of those already in it (may
+	 * be NULL if the engine has no updates).
+	 */
+	void (*update)(void *fw_tbl, int argc, char *argv[]);
+
+	/* Free the table (may be NULL if the engine has no such function). */
+	void (*destroy)(void *fw_tbl);
+};
+
+extern const struct engine engine;
+
+/* Command line helpers (options.c). */
+
+/*
+ * Return the index of the value of the option 'lopt' (or 'sopt') in 'argv',
+ * or -1 if the option is not present.
+ */
+int option_value(int argc, char *argv[], const char *lopt, const char *sopt);
+
+/* Return whether the flag 'lopt' (or 'sopt') is in 'argv'. */
+bool option_flag(int argc, char *argv[], const char *lopt, const char *sopt);
+
+/*
+ * Open the file named by the option 'lopt' (or 'sopt') for reading. Return
+ * NULL if the option is not present.
+ */
+FILE *option_file(int argc, char *argv[], const char *lopt, const char *sopt);
+
+#endif
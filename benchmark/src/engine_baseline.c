@@ -0,0 +1,109 @@
+/*
+ * engine_baseline.c
+ *
+ * Baseline Bloom filters algorithm for IPv4 (baseline).
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "bloomfwd_opt.h"
+
+static void load_prefixes_file(struct forwarding_table *fw_tbl, int argc,
+		char *argv[], const char *lopt, const char *sopt)
+{
+	FILE *prefixes = option_file(argc, argv, lopt, sopt);
+	if (prefixes == NULL) {
+		fprintf(stderr, "engine_baseline.load: Missing '%s'.\n", sopt);
+		exit(1);
+	}
+
+	load_prefixes(fw_tbl, prefixes);
+	fclose(prefixes);
+}
+
+static void *load(int argc, char *argv[])
+{
+	FILE *pfx_distribution = option_file(argc, argv, "--distribution-file",
+			"-d");
+	struct forwarding_table *fw_tbl = new_forwarding_table(pfx_distribution,
+			NULL);
+	if (pfx_distribution != NULL)
+		fclose(pfx_distribution);
+
+	load_prefixes_file(fw_tbl, argc, argv, "--dla-file", "-dla");
+	load_prefixes_file(fw_tbl, argc, argv, "--g1-file", "-g1");
+	load_prefixes_file(fw_tbl, argc, argv, "--g2-file", "-g2");
+
+	return fw_tbl;
+}
+
+static unsigned long read_addresses(FILE *input_addr, void **addresses)
+{
+	unsigned long len;
+	if (fscanf(input_addr, "%lu", &len) != 1)
+		return 0;
+
+	uint32_t *addrs = malloc(len * sizeof(uint32_t));
+	if (addrs == NULL) {
+		fprintf(stderr, "engine_baseline.read_addresses: Could not malloc addresses.\n");
+		exit(1);
+	}
+
+	uint8_t a, b, c, d;
+	for (unsigned long i = 0; i < len; i++) {
+		if (fscanf(input_addr,
+			"%" SCNu8 ".%" SCNu8 ".%" SCNu8 ".%" SCNu8,
+			&a, &b, &c, &d) != 4) {
+			fprintf(stderr, "engine_baseline.read_addresses: fscanf error.\n");
+			exit(1);
+		}
+		addrs[i] = new_ipv4_addr(a, b, c, d);
+	}
+
+	*addresses = addrs;
+
+	return len;
+}
+
+static uint64_t lookup(const void *fw_tbl, const void *addresses,
+		unsigned long n)
+{
+	const uint32_t *addrs = addresses;
+	uint64_t sum = 0;
+
+	for (unsigned long i = 0; i < n; i++) {
+		uint32_t next_hop;
+		if (lookup_address(fw_tbl, addrs[i], &next_hop))
+			sum += next_hop;
+	}
+
+	return sum;
+}
+
+static void lookup_next_hops(const void *fw_tbl, const void *addresses,
+		unsigned long n, bool *found, void *next_hops)
+{
+	const uint32_t *addrs = addresses;
+	uint32_t *nhs = next_hops;
+
+	for (unsigned long i = 0; i < n; i++)
+		found[i] = lookup_address(fw_tbl, addrs[i], &nhs[i]);
+}
+
+const struct engine engine = {
+	.name = "baseline",
+	.usage =
+	"  -d   --distribution-file\t Prefixes distribution.\n"
+	"  -dla --dla-file         \t Prefixes of the direct lookup array.\n"
+	"  -g1  --g1-file          \t Prefixes of group 1.\n"
+	"  -g2  --g2-file          \t Prefixes of group 2.\n",
+	.addr_size = sizeof(uint32_t),
+	.load = load,
+	.read_addresses = read_addresses,
+	.lookup = lookup,
+	.lookup_next_hops = lookup_next_hops,
+	.destroy = NULL  /* The baseline tables are never freed. */
+};
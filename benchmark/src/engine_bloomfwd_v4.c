@@ -0,0 +1,338 @@
+/*
+ * engine_bloomfwd_v4.c
+ *
+ * Bloomfwd for IPv4 (bloomfwd-v4), with scalar lookups, batched lookups with
+ * software prefetching when built with LOOKUP_BATCH, sixteen at a time with
+ * AVX-512F when built with LOOKUP_VEC_INTRIN (and -mavx512f), or scalar
+ * lookups behind a flow cache per thread when built with FLOW_CACHE.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "bloomfwd_opt.h"
+#include "config.h"  /* LOOKUP_BATCH, LOOKUP_PREFETCH_DISTANCE */
+#ifdef FLOW_CACHE
+#include "flowcache.h"
+#endif
+#include "hugepages.h"
+
+#ifdef LOOKUP_VEC_INTRIN
+/* Exit status of a run on a CPU without AVX-512F (skipped by ctest). */
+#define EXIT_UNSUPPORTED 77
+#endif
+
+static void load_prefixes_file(struct forwarding_table *fw_tbl, int argc,
+		char *argv[], const char *lopt, const char *sopt)
+{
+	FILE *prefixes = option_file(argc, argv, lopt, sopt);
+	if (prefixes == NULL) {
+		fprintf(stderr, "engine_bloomfwd_v4.load: Missing '%s'.\n", sopt);
+		exit(1);
+	}
+
+	load_prefixes(fw_tbl, prefixes);
+	fclose(prefixes);
+}
+
+/* Maximum length of the file names in the VRF file. */
+#define VRF_FILENAME_LEN 4096
+
+/*
+ * Read the next line of the VRF file, "<vrf> <dla-file> <g1-file> <g2-file>".
+ * Return false at the end of the file.
+ */
+static bool read_vrf(FILE *vrfs, uint32_t *vrf, char files[3][VRF_FILENAME_LEN])
+{
+	int rc = fscanf(vrfs, "%"SCNu32" %4095s %4095s %4095s", vrf, files[0],
+			files[1], files[2]);
+	if (rc == EOF)
+		return false;
+	if (rc != 4) {
+		fprintf(stderr, "engine_bloomfwd_v4.load: Couldn't read VRF file.\n");
+		exit(1);
+	}
+
+	return true;
+}
+
+/* Return the number of VRFs the table must hold for the VRF file 'vrfs'. */
+static uint32_t count_vrfs(FILE *vrfs)
+{
+	uint32_t vrf, num_vrfs = 0;
+	char files[3][VRF_FILENAME_LEN];
+	while (read_vrf(vrfs, &vrf, files))
+		if (vrf >= num_vrfs)
+			num_vrfs = vrf + 1;
+	if (num_vrfs == 0) {
+		fprintf(stderr, "engine_bloomfwd_v4.load: Empty VRF file.\n");
+		exit(1);
+	}
+	rewind(vrfs);
+
+	return num_vrfs;
+}
+
+/*
+ * Store the prefixes of the files of 'argv': those of the VRFs of '-v', or
+ * '-dla', '-g1' and '-g2'.
+ */
+static void store_files(struct forwarding_table *fw_tbl, int argc,
+		char *argv[])
+{
+	FILE *vrfs = option_file(argc, argv, "--vrf-file", "-v");
+	if (vrfs == NULL) {
+		load_prefixes_file(fw_tbl, argc, argv, "--dla-file", "-dla");
+		load_prefixes_file(fw_tbl, argc, argv, "--g1-file", "-g1");
+		load_prefixes_file(fw_tbl, argc, argv, "--g2-file", "-g2");
+		return;
+	}
+
+	uint32_t vrf;
+	char files[3][VRF_FILENAME_LEN];
+	while (read_vrf(vrfs, &vrf, files)) {
+		for (int i = 0; i < 3; i++) {
+			FILE *prefixes = fopen(files[i], "r");
+			if (prefixes == NULL) {
+				fprintf(stderr, "engine_bloomfwd_v4.load: Couldn't open '%s'.\n",
+						files[i]);
+				exit(1);
+			}
+			load_prefixes_vrf(fw_tbl, vrf, prefixes);
+			fclose(prefixes);
+		}
+	}
+	fclose(vrfs);
+}
+
+static void *load(int argc, char *argv[])
+{
+#ifdef LOOKUP_VEC_INTRIN
+	if (!__builtin_cpu_supports("avx512f")) {
+		fprintf(stderr, "engine_bloomfwd_v4.load: This CPU has no AVX-512F.\n");
+		exit(EXIT_UNSUPPORTED);
+	}
+#endif
+
+	if (option_flag(argc, argv, "--no-huge-pages", "-H"))
+		huge_pages_enabled = false;
+
+	/* The distribution file covers all the VRFs. */
+	uint32_t num_vrfs = 1;
+	FILE *vrfs = option_file(argc, argv, "--vrf-file", "-v");
+	if (vrfs != NULL) {
+		num_vrfs = count_vrfs(vrfs);
+		fclose(vrfs);
+	}
+
+	FILE *pfx_distribution = option_file(argc, argv, "--distribution-file",
+			"-d");
+	struct forwarding_table *fw_tbl = new_forwarding_table_vrf(
+			pfx_distribution, num_vrfs);
+	if (pfx_distribution != NULL)
+		fclose(pfx_distribution);
+
+	store_files(fw_tbl, argc, argv);
+	pack_forwarding_table(fw_tbl);  /* Chains in bucket order. */
+
+	return fw_tbl;
+}
+
+/*
+ * Store the prefixes of the files of 'argv' in the packed table: in the
+ * overlays of the snapshots (PERFECT_HASH) or in the slots of the fused
+ * filters (FUSED_FILTER), if not in place.
+ */
+static void update(void *fw_tbl, int argc, char *argv[])
+{
+	store_files(fw_tbl, argc, argv);
+}
+
+static unsigned long read_addresses(FILE *input_addr, void **addresses)
+{
+	unsigned long len;
+	if (fscanf(input_addr, "%lu", &len) != 1)
+		return 0;
+
+	uint32_t *addrs = malloc(len * sizeof(uint32_t));
+	if (addrs == NULL) {
+		fprintf(stderr, "engine_bloomfwd_v4.read_addresses: Could not malloc addresses.\n");
+		exit(1);
+	}
+
+	uint8_t a, b, c, d;
+	for (unsigned long i = 0; i < len; i++) {
+		if (fscanf(input_addr,
+			"%" SCNu8 ".%" SCNu8 ".%" SCNu8 ".%" SCNu8,
+			&a, &b, &c, &d) != 4) {
+			fprintf(stderr, "engine_bloomfwd_v4.read_addresses: fscanf error.\n");
+			exit(1);
+		}
+		addrs[i] = new_ipv4_addr(a, b, c, d);
+	}
+
+	*addresses = addrs;
+
+	return len;
+}
+
+#ifdef FLOW_CACHE
+/* The flow cache of the calling thread, created at its first lookup. */
+static _Thread_local struct flow_cache *flow_cache = NULL;
+#endif
+
+static inline bool lookup_one(const struct forwarding_table *fw_tbl,
+		uint32_t addr, uint32_t *next_hop)
+{
+#ifdef FLOW_CACHE
+	if (flow_cache == NULL)
+		flow_cache = new_flow_cache(fw_tbl);
+
+	return flow_cache_lookup(flow_cache, fw_tbl, 0, addr, next_hop);
+#else
+	return lookup_address(fw_tbl, addr, next_hop);
+#endif
+}
+
+#ifdef LOOKUP_VEC_INTRIN
+/*
+ * Look up the 'n' (at most sixteen) addresses of 'addrs' with
+ * 'lookup_address_intrin()', which takes sixteen aligned ones. Return the mask
+ * of the addresses that were found.
+ */
+static uint16_t lookup_sixteen(const struct forwarding_table *fw_tbl,
+		const uint32_t *addrs, unsigned long n, uint32_t next_hops[16])
+{
+	_Alignas(64) uint32_t keys[16] = { 0 };
+	_Alignas(64) uint32_t nhs[16];
+
+	for (unsigned long i = 0; i < n; i++)
+		keys[i] = addrs[i];
+	uint16_t found = lookup_address_intrin(fw_tbl, keys, nhs);
+	for (unsigned long i = 0; i < n; i++)
+		next_hops[i] = nhs[i];
+
+	return n == 16 ? found : found & ((1 << n) - 1);
+}
+#endif
+
+static uint64_t lookup(const void *fw_tbl, const void *addresses,
+		unsigned long n)
+{
+	const uint32_t *addrs = addresses;
+	uint64_t sum = 0;
+
+#if defined(LOOKUP_VEC_INTRIN)
+	uint32_t next_hops[16];
+
+	for (unsigned long i = 0; i < n; i += 16) {
+		unsigned long m = n - i < 16 ? n - i : 16;
+
+		uint16_t found = lookup_sixteen(fw_tbl, addrs + i, m, next_hops);
+		for (unsigned long j = 0; j < m; j++)
+			if (found >> j & 1)
+				sum += next_hops[j];
+	}
+#elif defined(LOOKUP_BATCH)
+	bool found[LOOKUP_PREFETCH_DISTANCE];
+	uint32_t next_hops[LOOKUP_PREFETCH_DISTANCE];
+
+	for (unsigned long i = 0; i < n; i += LOOKUP_PREFETCH_DISTANCE) {
+		uint32_t m = n - i < LOOKUP_PREFETCH_DISTANCE ?
+			n - i : LOOKUP_PREFETCH_DISTANCE;
+
+		lookup_address_batch(fw_tbl, m, addrs + i, found, next_hops);
+		for (uint32_t j = 0; j < m; j++)
+			if (found[j])
+				sum += next_hops[j];
+	}
+#else
+	for (unsigned long i = 0; i < n; i++) {
+		uint32_t next_hop;
+		if (lookup_one(fw_tbl, addrs[i], &next_hop))
+			sum += next_hop;
+	}
+#endif
+
+	return sum;
+}
+
+static void lookup_next_hops(const void *fw_tbl, const void *addresses,
+		unsigned long n, bool *found, void *next_hops)
+{
+	const uint32_t *addrs = addresses;
+	uint32_t *nhs = next_hops;
+
+#if defined(LOOKUP_VEC_INTRIN)
+	for (unsigned long i = 0; i < n; i += 16) {
+		unsigned long m = n - i < 16 ? n - i : 16;
+
+		uint16_t mask = lookup_sixteen(fw_tbl, addrs + i, m, nhs + i);
+		for (unsigned long j = 0; j < m; j++)
+			found[i + j] = mask >> j & 1;
+	}
+#elif defined(LOOKUP_BATCH)
+	lookup_address_batch(fw_tbl, n, addrs, found, nhs);
+#else
+	for (unsigned long i = 0; i < n; i++)
+		found[i] = lookup_one(fw_tbl, addrs[i], &nhs[i]);
+#endif
+}
+
+static void lookup_next_hops_vrf(const void *fw_tbl, const uint32_t *vrfs,
+		const void *addresses, unsigned long n, bool *found,
+		void *next_hops)
+{
+	const uint32_t *addrs = addresses;
+	uint32_t *nhs = next_hops;
+
+#if defined(LOOKUP_BATCH)
+	lookup_address_vrf_batch(fw_tbl, n, vrfs, addrs, found, nhs);
+#elif defined(FLOW_CACHE)
+	if (flow_cache == NULL)
+		flow_cache = new_flow_cache(fw_tbl);
+	for (unsigned long i = 0; i < n; i++)
+		found[i] = flow_cache_lookup(flow_cache, fw_tbl, vrfs[i],
+				addrs[i], &nhs[i]);
+#else
+	/* No VRFs in the AVX-512F lookups either. */
+	for (unsigned long i = 0; i < n; i++)
+		found[i] = lookup_address_vrf(fw_tbl, vrfs[i], addrs[i],
+				&nhs[i]);
+#endif
+}
+
+static void destroy(void *fw_tbl)
+{
+	free_forwarding_table(fw_tbl);
+}
+
+const struct engine engine = {
+#if defined(LOOKUP_VEC_INTRIN)
+	.name = "bloomfwd-v4-avx512",
+#elif defined(LOOKUP_BATCH)
+	.name = "bloomfwd-v4-batch",
+#elif defined(FLOW_CACHE)
+	.name = "bloomfwd-v4-fc",
+#else
+	.name = "bloomfwd-v4",
+#endif
+	.usage =
+	"  -d   --distribution-file\t Prefixes distribution.\n"
+	"  -dla --dla-file         \t Prefixes of the direct lookup array.\n"
+	"  -g1  --g1-file          \t Prefixes of group 1.\n"
+	"  -g2  --g2-file          \t Prefixes of group 2.\n"
+	"  -v   --vrf-file         \t VRFs, one per line, instead of -dla, -g1\n"
+	"                          \t and -g2: \"<vrf> <dla-file> <g1-file> <g2-file>\".\n"
+	"  -H   --no-huge-pages    \t Back the table with regular pages.\n",
+	.addr_size = sizeof(uint32_t),
+	.load = load,
+	.read_addresses = read_addresses,
+	.lookup = lookup,
+	.lookup_next_hops = lookup_next_hops,
+	.lookup_next_hops_vrf = lookup_next_hops_vrf,
+	.update = update,
+	.destroy = destroy
+};
@@ -0,0 +1,142 @@
+/*
+ * engine_bloomfwd_v6.c
+ *
+ * Bloomfwd for IPv6 (bloomfwd-v6), with scalar lookups, or batched lookups
+ * hashing sixteen keys at a time when built with LOOKUP_BATCH (with AVX2 or
+ * AVX-512F, if built for them).
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "bloomfwd_opt.h"
+#include "config.h"  /* LOOKUP_BATCH */
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+/* Exit status of a run on a CPU without the instruction set (skipped by ctest). */
+#define EXIT_UNSUPPORTED 77
+#endif
+
+static void *load(int argc, char *argv[])
+{
+#if defined(__AVX512F__)
+	if (!__builtin_cpu_supports("avx512f")) {
+		fprintf(stderr, "engine_bloomfwd_v6.load: This CPU has no AVX-512F.\n");
+		exit(EXIT_UNSUPPORTED);
+	}
+#elif defined(__AVX2__)
+	if (!__builtin_cpu_supports("avx2")) {
+		fprintf(stderr, "engine_bloomfwd_v6.load: This CPU has no AVX2.\n");
+		exit(EXIT_UNSUPPORTED);
+	}
+#endif
+
+	FILE *pfx_distribution = option_file(argc, argv, "--distribution-file",
+			"-d");
+	struct forwarding_table *fw_tbl = new_forwarding_table(pfx_distribution,
+			NULL);
+	if (pfx_distribution != NULL)
+		fclose(pfx_distribution);
+
+	FILE *prefixes = option_file(argc, argv, "--prefixes-file", "-p");
+	if (prefixes == NULL) {
+		fprintf(stderr, "engine_bloomfwd_v6.load: Missing '-p'.\n");
+		exit(1);
+	}
+	load_prefixes(fw_tbl, prefixes);
+	fclose(prefixes);
+
+	return fw_tbl;
+}
+
+static unsigned long read_addresses(FILE *input_addr, void **addresses)
+{
+	unsigned long len;
+	if (fscanf(input_addr, "%lu", &len) != 1)
+		return 0;
+
+	uint128 *addrs = malloc(len * sizeof(uint128));
+	if (addrs == NULL) {
+		fprintf(stderr, "engine_bloomfwd_v6.read_addresses: Could not malloc addresses.\n");
+		exit(1);
+	}
+
+	unsigned int a, b, c, d, e, f, g, h;
+	for (unsigned long i = 0; i < len; i++) {
+		if (fscanf(input_addr, "%x:%x:%x:%x:%x:%x:%x:%x",
+			&a, &b, &c, &d, &e, &f, &g, &h) != 8) {
+			fprintf(stderr, "engine_bloomfwd_v6.read_addresses: fscanf error.\n");
+			exit(1);
+		}
+		addrs[i] = new_ipv6_addr(a, b, c, d, e, f, g, h);
+	}
+
+	*addresses = addrs;
+
+	return len;
+}
+
+static uint64_t lookup(const void *fw_tbl, const void *addresses,
+		unsigned long n)
+{
+	const uint128 *addrs = addresses;
+	uint64_t sum = 0;
+
+#ifdef LOOKUP_BATCH
+	bool found[16];
+	uint128 next_hops[16];
+
+	for (unsigned long i = 0; i < n; i += 16) {
+		size_t m = n - i < 16 ? n - i : 16;
+
+		lookup_address_batch(fw_tbl, addrs + i, next_hops, found, m);
+		for (size_t j = 0; j < m; j++)
+			if (found[j])
+				sum += next_hops[j].hi ^ next_hops[j].lo;
+	}
+#else
+	for (unsigned long i = 0; i < n; i++) {
+		uint128 next_hop;
+		if (lookup_address(fw_tbl, addrs[i], &next_hop))
+			sum += next_hop.hi ^ next_hop.lo;
+	}
+#endif
+
+	return sum;
+}
+
+static void lookup_next_hops(const void *fw_tbl, const void *addresses,
+		unsigned long n, bool *found, void *next_hops)
+{
+	const uint128 *addrs = addresses;
+	uint128 *nhs = next_hops;
+
+#ifdef LOOKUP_BATCH
+	lookup_address_batch(fw_tbl, addrs, nhs, found, n);
+#else
+	for (unsigned long i = 0; i < n; i++)
+		found[i] = lookup_address(fw_tbl, addrs[i], &nhs[i]);
+#endif
+}
+
+const struct engine engine = {
+#if defined(LOOKUP_BATCH) && defined(__AVX512F__)
+	.name = "bloomfwd-v6-batch-avx512",
+#elif defined(LOOKUP_BATCH) && defined(__AVX2__)
+	.name = "bloomfwd-v6-batch-avx2",
+#elif defined(LOOKUP_BATCH)
+	.name = "bloomfwd-v6-batch",
+#else
+	.name = "bloomfwd-v6",
+#endif
+	.usage =
+	"  -d   --distribution-file\t Prefixes distribution.\n"
+	"  -p   --prefixes-file    \t Prefixes.\n",
+	.addr_size = sizeof(uint128),
+	.load = load,
+	.read_addresses = read_addresses,
+	.lookup = lookup,
+	.lookup_next_hops = lookup_next_hops,
+	.destroy = NULL  /* The bloomfwd-v6 tables are never freed. */
+};
@@ -0,0 +1,121 @@
+/*
+ * engine_miht_v4.c
+ *
+ * (k,m)-MIHT for IPv4 (miht-v4).
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "ip.h"
+#include "miht.h"
+
+#define DEFAULT_K 16
+#define DEFAULT_M 16
+
+static int int_option(int argc, char *argv[], const char *lopt,
+		const char *sopt, int def)
+{
+	int index = option_value(argc, argv, lopt, sopt);
+
+	return index == -1 ? def : (int)strtol(argv[index], NULL, 10);
+}
+
+static void *load(int argc, char *argv[])
+{
+	int k = int_option(argc, argv, "--key-length", "-k", DEFAULT_K);
+	int m = int_option(argc, argv, "--bplus-order", "-m", DEFAULT_M);
+
+	if (k < 1 || k > MIHT_MAX_K || m < MIHT_MIN_M) {
+		fprintf(stderr, "engine_miht_v4.load: 'k' must be in the range [1, %d] and 'm' at least %d.\n",
+				MIHT_MAX_K, MIHT_MIN_M);
+		exit(1);
+	}
+
+	FILE *prefixes = option_file(argc, argv, "--prefixes-file", "-p");
+	if (prefixes == NULL) {
+		fprintf(stderr, "engine_miht_v4.load: Missing '-p'.\n");
+		exit(1);
+	}
+
+	struct miht *miht = miht_create(k, m);
+	miht_load(miht, prefixes);
+	miht_pack(miht);  /* Tries in depth-first order. */
+	fclose(prefixes);
+
+	return miht;
+}
+
+static unsigned long read_addresses(FILE *input_addr, void **addresses)
+{
+	unsigned long len;
+	if (fscanf(input_addr, "%lu", &len) != 1)
+		return 0;
+
+	uint32_t *addrs = malloc(len * sizeof(uint32_t));
+	if (addrs == NULL) {
+		fprintf(stderr, "engine_miht_v4.read_addresses: Could not malloc addresses.\n");
+		exit(1);
+	}
+
+	uint8_t a, b, c, d;
+	for (unsigned long i = 0; i < len; i++) {
+		if (fscanf(input_addr,
+			"%" SCNu8 ".%" SCNu8 ".%" SCNu8 ".%" SCNu8,
+			&a, &b, &c, &d) != 4) {
+			fprintf(stderr, "engine_miht_v4.read_addresses: fscanf error.\n");
+			exit(1);
+		}
+		addrs[i] = ip_addr(a, b, c, d);
+	}
+
+	*addresses = addrs;
+
+	return len;
+}
+
+static uint64_t lookup(const void *fw_tbl, const void *addresses,
+		unsigned long n)
+{
+	const uint32_t *addrs = addresses;
+	uint64_t sum = 0;
+
+	for (unsigned long i = 0; i < n; i++) {
+		unsigned int next_hop;
+		if (miht_lookup(fw_tbl, addrs[i], 32, &next_hop))
+			sum += next_hop;
+	}
+
+	return sum;
+}
+
+static void lookup_next_hops(const void *fw_tbl, const void *addresses,
+		unsigned long n, bool *found, void *next_hops)
+{
+	const uint32_t *addrs = addresses;
+	unsigned int *nhs = next_hops;
+
+	for (unsigned long i = 0; i < n; i++)
+		found[i] = miht_lookup(fw_tbl, addrs[i], 32, &nhs[i]);
+}
+
+static void destroy(void *fw_tbl)
+{
+	miht_destroy(fw_tbl);
+}
+
+const struct engine engine = {
+	.name = "miht-v4",
+	.usage =
+	"  -p   --prefixes-file    \t Prefixes.\n"
+	"  -k   --key-length       \t Length of prefix keys (default: 16).\n"
+	"  -m   --bplus-order      \t Order of the B+ tree (default: 16).\n",
+	.addr_size = sizeof(uint32_t),
+	.load = load,
+	.read_addresses = read_addresses,
+	.lookup = lookup,
+	.lookup_next_hops = lookup_next_hops,
+	.destroy = destroy
+};
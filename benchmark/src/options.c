@@ -0,0 +1,66 @@
+/*
+ * options.c
+ *
+ * Command line helpers shared by the benchmark driver, the engines and the
+ * tests (see bench.h).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+/* Handy macro to perform string comparison. */
+#define STREQ(s1, s2) (strcmp((s1), (s2)) == 0)
+
+static inline int contains(int argc, char *argv[], const char *option)
+{
+	int index = -1;
+	for (int i = 1; (i < argc) && (index == -1); i++) {
+		if (STREQ(argv[i], option)) {
+			index = i;
+			break;
+		}
+	}
+
+	return index;
+}
+
+int option_value(int argc, char *argv[], const char *lopt, const char *sopt)
+{
+	int index;
+
+	if ((index = contains(argc, argv, lopt)) == -1 && sopt != NULL)
+		index = contains(argc, argv, sopt);
+
+	if (index == -1)
+		return -1;
+
+	if (index + 1 >= argc) {
+		fprintf(stderr, "options.option_value: Missing value for '%s'.\n", argv[index]);
+		exit(1);
+	}
+
+	return index + 1;
+}
+
+bool option_flag(int argc, char *argv[], const char *lopt, const char *sopt)
+{
+	return contains(argc, argv, lopt) != -1 ||
+		(sopt != NULL && contains(argc, argv, sopt) != -1);
+}
+
+FILE *option_file(int argc, char *argv[], const char *lopt, const char *sopt)
+{
+	int index = option_value(argc, argv, lopt, sopt);
+	if (index == -1)
+		return NULL;
+
+	FILE *fp = fopen(argv[index], "r");
+	if (fp == NULL) {
+		fprintf(stderr, "Couldn't open file: '%s'.\n", argv[index]);
+		exit(1);
+	}
+
+	return fp;
+}
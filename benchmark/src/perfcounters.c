@@ -0,0 +1,87 @@
+/*
+ * perfcounters.c
+ */
+
+#define _GNU_SOURCE  /* syscall() */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "perfcounters.h"
+
+const char *perf_event_names[NUM_PERF_EVENTS] = {
+	"cycles", "instructions", "llc_misses", "branch_misses"
+};
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+static const uint64_t event_configs[NUM_PERF_EVENTS] = {
+	PERF_COUNT_HW_CPU_CYCLES,
+	PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_CACHE_MISSES,  /* Last level cache. */
+	PERF_COUNT_HW_BRANCH_MISSES
+};
+
+void perf_counters_start(struct perf_counters *counters)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+		attr.config = event_configs[e];
+		counters->fds[e] = syscall(SYS_perf_event_open, &attr, 0, -1,
+				-1, 0);
+	}
+
+	/* Enable them last, so that opening isn't counted. */
+	for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+		if (counters->fds[e] == -1)
+			continue;
+		ioctl(counters->fds[e], PERF_EVENT_IOC_RESET, 0);
+		ioctl(counters->fds[e], PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+void perf_counters_stop(struct perf_counters *counters,
+		long long counts[NUM_PERF_EVENTS])
+{
+	for (int e = 0; e < NUM_PERF_EVENTS; e++)
+		if (counters->fds[e] != -1)
+			ioctl(counters->fds[e], PERF_EVENT_IOC_DISABLE, 0);
+
+	for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+		counts[e] = -1;
+		if (counters->fds[e] == -1)
+			continue;
+
+		uint64_t count;
+		if (read(counters->fds[e], &count, sizeof(count)) ==
+				sizeof(count))
+			counts[e] = count;
+		close(counters->fds[e]);
+	}
+}
+#else
+void perf_counters_start(struct perf_counters *counters)
+{
+	for (int e = 0; e < NUM_PERF_EVENTS; e++)
+		counters->fds[e] = -1;
+}
+
+void perf_counters_stop(struct perf_counters *counters,
+		long long counts[NUM_PERF_EVENTS])
+{
+	(void)counters;
+	for (int e = 0; e < NUM_PERF_EVENTS; e++)
+		counts[e] = -1;
+}
+#endif
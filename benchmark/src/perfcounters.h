@@ -0,0 +1,38 @@
+/*
+ * perfcounters.h
+ *
+ * Count hardware events of the calling thread with the Linux performance
+ * counters (perf_event_open(2)), in user mode only, so that it works with the
+ * default /proc/sys/kernel/perf_event_paranoid. Each event is opened on its
+ * own, so that a missing one doesn't disable the others.
+ */
+
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+enum perf_event {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_LLC_MISSES,
+	PERF_BRANCH_MISSES,
+	NUM_PERF_EVENTS
+};
+
+/* Names of the events, as in the CSV/JSON output. */
+extern const char *perf_event_names[NUM_PERF_EVENTS];
+
+struct perf_counters {
+	int fds[NUM_PERF_EVENTS];  /* -1 if the event isn't available. */
+};
+
+/* Start counting for the calling thread. */
+void perf_counters_start(struct perf_counters *counters);
+
+/*
+ * Stop 'counters' and store their counts in 'counts' (-1 for the events that
+ * aren't available, e.g. in most VMs or when not on Linux).
+ */
+void perf_counters_stop(struct perf_counters *counters,
+		long long counts[NUM_PERF_EVENTS]);
+
+#endif
@@ -0,0 +1,181 @@
+/*
+ * cuckoofilter_test.c
+ *
+ * Deletes of the cuckoo filter of bloomfwd-v4 (see cuckoofilter.h): a removed
+ * key's fingerprint leaves its buckets, and the keys that share them, or that
+ * were kicked around meanwhile, are still found. Failures are printed on stderr
+ * and make the program exit with status 1.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cuckoofilter.h"
+
+#define NUM_KEYS 100000
+#define FALSE_POSITIVE_RATIO 0.001
+
+static unsigned long failures = 0;
+
+static uint64_t rng_state = 1;
+
+/* splitmix64 */
+static uint64_t rand64(void)
+{
+	uint64_t z = (rng_state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+	return z ^ (z >> 31);
+}
+
+static void expect(bool condition, const char *what)
+{
+	if (!condition && failures++ < 10)
+		fprintf(stderr, "cuckoofilter_test: %s.\n", what);
+}
+
+/* 'h2' of fingerprint 'fp' in 'cf'. */
+static uint32_t fingerprint_hash(const struct cuckoo_filter *cf, uint16_t fp)
+{
+	return (uint32_t)fp << (32 - cf->fp_bits);
+}
+
+/* Both buckets of the key of hashes 'h1' and 'h2' lack its fingerprint. */
+static bool fingerprint_gone(const struct cuckoo_filter *cf, uint32_t h1,
+		uint32_t h2)
+{
+	uint16_t fp = cuckoo_fingerprint(cf, h2);
+	uint32_t i1 = cuckoo_range(h1, cf->num_buckets);
+
+	return !cuckoo_bucket_has(cf, i1, fp) &&
+		!cuckoo_bucket_has(cf, cuckoo_alt_bucket(cf, i1, fp), fp);
+}
+
+/* Keys of a single first bucket, which they fill. */
+static void test_shared_bucket(void)
+{
+	struct cuckoo_filter *cf = new_cuckoo_filter(1000,
+			FALSE_POSITIVE_RATIO);
+	uint32_t h1 = 0x12345678;
+
+	for (uint16_t fp = 1; fp <= CUCKOO_BUCKET_SIZE; fp++)
+		expect(cuckoo_insert(cf, h1, fingerprint_hash(cf, fp)),
+				"Insert into a bucket failed");
+
+	expect(cuckoo_remove(cf, h1, fingerprint_hash(cf, 2)),
+			"Remove of a stored key failed");
+	for (uint16_t fp = 1; fp <= CUCKOO_BUCKET_SIZE; fp++)
+		if (fp != 2)
+			expect(cuckoo_contains(cf, h1, fingerprint_hash(cf, fp)),
+					"Key of the bucket of a removed one lost");
+	expect(fingerprint_gone(cf, h1, fingerprint_hash(cf, 2)),
+			"Fingerprint of a removed key still in its buckets");
+	expect(!cuckoo_remove(cf, h1, fingerprint_hash(cf, 2)),
+			"Second remove of a key succeeded");
+	expect(cf->count == CUCKOO_BUCKET_SIZE - 1,
+			"Wrong count after a remove");
+
+	free_cuckoo_filter(cf);
+}
+
+/* A key inserted twice is removed once at a time. */
+static void test_duplicate(void)
+{
+	struct cuckoo_filter *cf = new_cuckoo_filter(1000,
+			FALSE_POSITIVE_RATIO);
+	uint32_t h1 = 0x9abcdef0, h2 = fingerprint_hash(cf, 7);
+
+	cuckoo_insert(cf, h1, h2);
+	cuckoo_insert(cf, h1, h2);
+	expect(cuckoo_remove(cf, h1, h2), "Remove of a duplicate failed");
+	expect(cuckoo_contains(cf, h1, h2), "Other copy of a key lost");
+	expect(cuckoo_remove(cf, h1, h2), "Remove of the other copy failed");
+	expect(fingerprint_gone(cf, h1, h2),
+			"Fingerprint of a removed duplicate still in its buckets");
+
+	free_cuckoo_filter(cf);
+}
+
+/*
+ * Remove every other one of NUM_KEYS random keys: none of the others may be
+ * lost, and the removed ones may only be found as false positives.
+ */
+static void test_random(void)
+{
+	struct cuckoo_filter *cf = new_cuckoo_filter(NUM_KEYS,
+			FALSE_POSITIVE_RATIO);
+	uint32_t *h1 = malloc(NUM_KEYS * sizeof(uint32_t));
+	uint32_t *h2 = malloc(NUM_KEYS * sizeof(uint32_t));
+	if (h1 == NULL || h2 == NULL) {
+		fprintf(stderr, "cuckoofilter_test: Could not malloc keys.\n");
+		exit(1);
+	}
+
+	for (int i = 0; i < NUM_KEYS; i++) {
+		uint64_t h = rand64();
+		h1[i] = h;
+		h2[i] = h >> 32;
+		expect(cuckoo_insert(cf, h1[i], h2[i]),
+				"Insert below capacity failed");
+	}
+	for (int i = 0; i < NUM_KEYS; i += 2)
+		expect(cuckoo_remove(cf, h1[i], h2[i]),
+				"Remove of a stored key failed");
+
+	unsigned long still_found = 0;
+	for (int i = 0; i < NUM_KEYS; i++) {
+		if (i % 2 == 1)
+			expect(cuckoo_contains(cf, h1[i], h2[i]),
+					"Key lost after removes");
+		else if (cuckoo_contains(cf, h1[i], h2[i]))
+			still_found++;
+	}
+	expect(still_found < NUM_KEYS / 2 * 5 * FALSE_POSITIVE_RATIO,
+			"Too many removed keys still found");
+	expect(cf->count == NUM_KEYS / 2, "Wrong count after removes");
+
+	free(h2);
+	free(h1);
+	free_cuckoo_filter(cf);
+}
+
+/* Once the filter is full, a remove makes room for the victim. */
+static void test_victim(void)
+{
+	struct cuckoo_filter *cf = new_cuckoo_filter(64, FALSE_POSITIVE_RATIO);
+	uint32_t h1[1024], h2[1024];
+	int n = 0;
+
+	while (!cf->has_victim && n < 1024) {
+		uint64_t h = rand64();
+		h1[n] = h;
+		h2[n] = h >> 32;
+		cuckoo_insert(cf, h1[n], h2[n]);
+		n++;
+	}
+	expect(cf->has_victim, "Filter never full");
+	expect(!cuckoo_insert(cf, 1, 1), "Insert into a full filter succeeded");
+
+	expect(cuckoo_remove(cf, h1[0], h2[0]), "Remove of a stored key failed");
+	for (int i = 1; i < n; i++)
+		expect(cuckoo_contains(cf, h1[i], h2[i]),
+				"Key lost after a remove from a full filter");
+	expect(cf->count == (uint32_t)n - 1, "Wrong count after a remove");
+
+	free_cuckoo_filter(cf);
+}
+
+int main(void)
+{
+	test_shared_bucket();
+	test_duplicate();
+	test_random();
+	test_victim();
+
+	printf("cuckoofilter_test: %lu failures.\n", failures);
+
+	return failures == 0 ? 0 : 1;
+}
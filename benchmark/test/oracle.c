@@ -0,0 +1,822 @@
+/*
+ * oracle.c
+ *
+ * Differential test of a lookup engine (see ../src/bench.h) against a binary
+ * trie, like 'btrie_node' in ip-helpers/cpe.c. A random table is generated
+ * from a seed, with nested prefixes and, unless '--no-default-route' is given,
+ * a default route, and written in the formats of all the engines:
+ *
+ * 	- IPv4: the prefixes file of MIHT, the DLA, G1 and G2 files of the BFs
+ * 	algorithms (the controlled prefix expansion of ip-helpers/cpe.c) and
+ * 	their distribution file;
+ * 	- IPv6: the prefixes file and the distribution file.
+ *
+ * The engine builds its table from those files and looks up random addresses
+ * and, for every prefix, its first and last addresses, the addresses just
+ * outside of it and one inside of it. Their next hops must be those of the
+ * longest matching prefixes in the trie. Mismatches are printed on stderr and
+ * make the program exit with status 1.
+ *
+ * With '--vrfs', one table (and trie) is generated per VRF, the IPv4 files of
+ * each VRF go to a directory of their own, listed in a VRF file, and every
+ * address is looked up in a VRF.
+ *
+ * With '--updates', once checked, a quarter as many prefixes are added to each
+ * table and as many next hops are changed. The files are written again, the
+ * engine stores them in its loaded table and the addresses of all the prefixes
+ * are checked again.
+ */
+
+#define _GNU_SOURCE  /* mkdtemp() */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>  /* mkdir() */
+#include <unistd.h>
+
+#include "bench.h"
+
+#define DEFAULT_SEED 1
+#define DEFAULT_NUM_PREFIXES 20000
+#define DEFAULT_NUM_ADDRESSES (1 << 20)  /* Random ones. */
+#define DEFAULT_NUM_VRFS 1
+
+#define LOOKUP_CHUNK 4096
+#define MAX_REPORTED_MISMATCHES 10
+
+/* An IPv4 next hop is held in 'lo'. */
+struct next_hop {
+	uint64_t hi;
+	uint64_t lo;
+};
+
+struct prefix {
+	uint64_t key;  /* Left aligned in 'key_bits' bits. */
+	int len;
+	struct next_hop next_hop;
+};
+
+struct btrie_node {
+	bool has_next_hop;
+	struct next_hop next_hop;
+	struct btrie_node *child[2];
+};
+
+/* 32 for IPv4 and 64 for IPv6 (only the high half of the address is keyed). */
+static int key_bits;
+
+static uint64_t rng_state;
+
+/* splitmix64 */
+static uint64_t rand64(void)
+{
+	uint64_t z = (rng_state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+	return z ^ (z >> 31);
+}
+
+/* Mask of the 'len' high bits of a key. */
+static inline uint64_t key_mask(int len)
+{
+	if (len == 0)
+		return 0;
+
+	return (~0ULL << (64 - len)) >> (64 - key_bits);
+}
+
+static inline int key_bit(uint64_t key, int index)
+{
+	return (key >> (key_bits - 1 - index)) & 1;
+}
+
+static struct btrie_node *btrie_node(void)
+{
+	struct btrie_node *node = calloc(1, sizeof(struct btrie_node));
+	if (node == NULL) {
+		fprintf(stderr, "oracle.btrie_node: Could not calloc node.\n");
+		exit(1);
+	}
+
+	return node;
+}
+
+/* Return false if the prefix was already in the trie (it isn't updated). */
+static bool btrie_insert(struct btrie_node *btrie, const struct prefix *pfx)
+{
+	for (int i = 0; i < pfx->len; i++) {
+		int bit = key_bit(pfx->key, i);
+		if (btrie->child[bit] == NULL)
+			btrie->child[bit] = btrie_node();
+		btrie = btrie->child[bit];
+	}
+
+	if (btrie->has_next_hop)
+		return false;
+
+	btrie->has_next_hop = true;
+	btrie->next_hop = pfx->next_hop;
+
+	return true;
+}
+
+/* Set the next hop of 'pfx', which is in the trie, to its own. */
+static void btrie_update(struct btrie_node *btrie, const struct prefix *pfx)
+{
+	for (int i = 0; i < pfx->len; i++)
+		btrie = btrie->child[key_bit(pfx->key, i)];
+
+	btrie->next_hop = pfx->next_hop;
+}
+
+/* Longest prefix match. */
+static bool btrie_lookup(const struct btrie_node *btrie, uint64_t key,
+		struct next_hop *next_hop)
+{
+	bool found = false;
+
+	for (int i = 0; btrie != NULL; i++) {
+		if (btrie->has_next_hop) {
+			*next_hop = btrie->next_hop;
+			found = true;
+		}
+		if (i == key_bits)
+			break;
+		btrie = btrie->child[key_bit(key, i)];
+	}
+
+	return found;
+}
+
+static void btrie_free(struct btrie_node *btrie)
+{
+	if (btrie == NULL)
+		return;
+
+	btrie_free(btrie->child[0]);
+	btrie_free(btrie->child[1]);
+	free(btrie);
+}
+
+static struct next_hop random_next_hop(void)
+{
+	struct next_hop nh = { 0, 0 };
+
+	/* 0.0.0.0 marks the empty slots of the DLA. */
+	if (key_bits == 32)
+		nh.lo = rand64() % 0xFFFFFFFEULL + 1;
+	else
+		nh = (struct next_hop){ rand64() | 1, rand64() };
+
+	return nh;
+}
+
+static int random_length(void)
+{
+	int r = rand64() % 100;
+
+	if (key_bits == 32) {
+		if (r < 40)
+			return 24;
+		if (r < 60)
+			return 25 + rand64() % 8;
+		if (r < 75)
+			return 21 + rand64() % 3;
+		if (r < 90)
+			return 9 + rand64() % 12;
+		if (r < 95)
+			return 1 + rand64() % 8;
+		return 32;
+	}
+
+	if (r < 30)
+		return 48;
+	if (r < 50)
+		return 64;
+	return 1 + rand64() % 64;
+}
+
+/*
+ * Generate 'n' distinct prefixes (plus the default route, if asked for) into
+ * the trie and after the 'count' ones of 'pfxs', and return the new count. A
+ * third of them are nested in previous ones.
+ */
+static unsigned long generate_prefixes(struct btrie_node *btrie,
+		struct prefix *pfxs, unsigned long count, unsigned long n,
+		bool default_route)
+{
+	if (default_route) {
+		pfxs[count] = (struct prefix){ 0, 0, random_next_hop() };
+		btrie_insert(btrie, &pfxs[count++]);
+	}
+
+	unsigned long last = count + n;
+	while (count < last) {
+		struct prefix pfx;
+
+		const struct prefix *parent = count == 0 ? NULL :
+			&pfxs[rand64() % count];
+		if (parent != NULL && parent->len < key_bits &&
+				rand64() % 3 == 0) {
+			pfx.len = parent->len + 1 +
+				rand64() % (key_bits - parent->len);
+			pfx.key = (parent->key | (rand64() &
+					~key_mask(parent->len))) &
+				key_mask(pfx.len);
+		} else {
+			pfx.len = random_length();
+			pfx.key = rand64() & key_mask(pfx.len);
+		}
+		pfx.next_hop = random_next_hop();
+
+		if (btrie_insert(btrie, &pfx))
+			pfxs[count++] = pfx;
+	}
+
+	return count;
+}
+
+/* Draw the next hops of 'n' random prefixes of 'pfxs' again. */
+static void change_next_hops(struct btrie_node *btrie, struct prefix *pfxs,
+		unsigned long count, unsigned long n)
+{
+	for (unsigned long i = 0; i < n && count > 0; i++) {
+		struct prefix *pfx = &pfxs[rand64() % count];
+		pfx->next_hop = random_next_hop();
+		btrie_update(btrie, pfx);
+	}
+}
+
+static FILE *create_file(const char *dir, const char *name, char *path)
+{
+	sprintf(path, "%s/%s", dir, name);
+
+	FILE *fp = fopen(path, "w");
+	if (fp == NULL) {
+		fprintf(stderr, "oracle.create_file: Couldn't create '%s'.\n",
+				path);
+		exit(1);
+	}
+
+	return fp;
+}
+
+static void print_ipv4(FILE *fp, uint32_t addr)
+{
+	fprintf(fp, "%u.%u.%u.%u", addr >> 24, (addr >> 16) & 0xFF,
+			(addr >> 8) & 0xFF, addr & 0xFF);
+}
+
+static void print_ipv6(FILE *fp, uint64_t hi, uint64_t lo)
+{
+	fprintf(fp, "%x:%x:%x:%x:%x:%x:%x:%x",
+			(unsigned)(hi >> 48), (unsigned)(hi >> 32) & 0xFFFF,
+			(unsigned)(hi >> 16) & 0xFFFF, (unsigned)hi & 0xFFFF,
+			(unsigned)(lo >> 48), (unsigned)(lo >> 32) & 0xFFFF,
+			(unsigned)(lo >> 16) & 0xFFFF, (unsigned)lo & 0xFFFF);
+}
+
+static void print_ipv4_prefix(FILE *fp, uint32_t key, int len,
+		const struct next_hop *nh)
+{
+	print_ipv4(fp, key);
+	fprintf(fp, "/%d ", len);
+	print_ipv4(fp, nh->lo);
+	fprintf(fp, "\n");
+}
+
+/*
+ * Write the prefixes of the trie 'btrie' (holding only lengths up to
+ * 'stride') expanded to length 'stride', and return how many.
+ */
+static unsigned long write_expanded(FILE *fp, const struct btrie_node *btrie,
+		int stride, uint32_t key, int len, const struct next_hop *nh)
+{
+	if (btrie != NULL && btrie->has_next_hop)
+		nh = &btrie->next_hop;
+
+	if (len == stride) {
+		if (nh == NULL)
+			return 0;
+		print_ipv4_prefix(fp, key << (32 - stride), stride, nh);
+		return 1;
+	}
+
+	unsigned long count = 0;
+	for (uint32_t bit = 0; bit < 2; bit++) {
+		const struct btrie_node *child = btrie == NULL ? NULL :
+			btrie->child[bit];
+		if (child != NULL || nh != NULL)
+			count += write_expanded(fp, child, stride,
+					(key << 1) | bit, len + 1, nh);
+	}
+
+	return count;
+}
+
+/*
+ * Write one group of the controlled prefix expansion (see ip-helpers/cpe.c):
+ * the prefixes of length [min_len, stride] expanded to 'stride'.
+ */
+static unsigned long write_group(FILE *fp, const struct prefix *pfxs,
+		unsigned long n, int min_len, int stride)
+{
+	struct btrie_node *group = btrie_node();
+	for (unsigned long i = 0; i < n; i++)
+		if (pfxs[i].len >= min_len && pfxs[i].len <= stride)
+			btrie_insert(group, &pfxs[i]);
+
+	unsigned long count = write_expanded(fp, group, stride, 0, 0, NULL);
+	btrie_free(group);
+
+	return count;
+}
+
+/*
+ * Write the table files to 'dir' and fill 'argv' with the options to load
+ * them. The sizes of the IPv4 groups (/20, /24 and /32 prefixes) go to
+ * 'group_sizes'. Return the number of options.
+ */
+static int write_table(const char *dir, const struct prefix *pfxs,
+		unsigned long n, char paths[5][256], char *argv[],
+		unsigned long group_sizes[3])
+{
+	int argc = 0;
+	argv[argc++] = "oracle";
+
+	FILE *fp = create_file(dir, "prefixes.txt", paths[0]);
+	for (unsigned long i = 0; i < n; i++) {
+		if (key_bits == 32) {
+			print_ipv4_prefix(fp, pfxs[i].key, pfxs[i].len,
+					&pfxs[i].next_hop);
+		} else {
+			print_ipv6(fp, pfxs[i].key, 0);
+			fprintf(fp, "/%d\n", pfxs[i].len);
+			print_ipv6(fp, pfxs[i].next_hop.hi, pfxs[i].next_hop.lo);
+			fprintf(fp, "\n");
+		}
+	}
+	fclose(fp);
+	argv[argc++] = "-p";
+	argv[argc++] = paths[0];
+
+	FILE *distrib = create_file(dir, "distrib.txt", paths[1]);
+	argv[argc++] = "-d";
+	argv[argc++] = paths[1];
+
+	if (key_bits == 64) {
+		unsigned long lengths[65] = { 0 };
+		for (unsigned long i = 0; i < n; i++)
+			lengths[pfxs[i].len]++;
+		for (int len = 1; len <= 64; len++)
+			if (lengths[len] > 0)
+				fprintf(distrib, "%d %lu\n", len, lengths[len]);
+		fclose(distrib);
+
+		return argc;
+	}
+
+	/* The default route goes with the DLA. */
+	fp = create_file(dir, "dla.txt", paths[2]);
+	if (n > 0 && pfxs[0].len == 0)
+		print_ipv4_prefix(fp, 0, 0, &pfxs[0].next_hop);
+	group_sizes[0] = write_group(fp, pfxs, n, 1, 20);
+	fprintf(distrib, "20 %lu\n", group_sizes[0]);
+	fclose(fp);
+
+	fp = create_file(dir, "g1.txt", paths[3]);
+	group_sizes[1] = write_group(fp, pfxs, n, 21, 24);
+	fprintf(distrib, "24 %lu\n", group_sizes[1]);
+	fclose(fp);
+
+	fp = create_file(dir, "g2.txt", paths[4]);
+	group_sizes[2] = write_group(fp, pfxs, n, 25, 32);
+	fprintf(distrib, "32 %lu\n", group_sizes[2]);
+	fclose(fp);
+	fclose(distrib);
+
+	argv[argc++] = "-dla";
+	argv[argc++] = paths[2];
+	argv[argc++] = "-g1";
+	argv[argc++] = paths[3];
+	argv[argc++] = "-g2";
+	argv[argc++] = paths[4];
+
+	return argc;
+}
+
+/*
+ * Write the IPv4 tables of 'num_vrfs' VRFs to the directories 'dir'/vrf<i>,
+ * and their VRF file and distribution file (the sum of theirs, without the
+ * /20 prefixes of VRF 0, which go to the DLA) to 'dir'. Fill 'argv' with the
+ * options to load them and return the number of options.
+ */
+static int write_vrfs(const char *dir, struct prefix *const *pfxs,
+		const unsigned long *n, int num_vrfs, char (*paths)[5][256],
+		char vrf_paths[2][256], char *argv[])
+{
+	unsigned long sizes[3] = { 0, 0, 0 };
+
+	FILE *vrfs = create_file(dir, "vrfs.txt", vrf_paths[0]);
+	for (int v = 0; v < num_vrfs; v++) {
+		char vrf_dir[256];
+		sprintf(vrf_dir, "%s/vrf%d", dir, v);
+		if (mkdir(vrf_dir, 0700) != 0) {
+			fprintf(stderr, "oracle.write_vrfs: Couldn't create '%s'.\n",
+					vrf_dir);
+			exit(1);
+		}
+
+		char *vrf_argv[16];
+		unsigned long group_sizes[3];
+		write_table(vrf_dir, pfxs[v], n[v], paths[v], vrf_argv,
+				group_sizes);
+		if (v > 0)
+			sizes[0] += group_sizes[0];
+		sizes[1] += group_sizes[1];
+		sizes[2] += group_sizes[2];
+		fprintf(vrfs, "%d %s %s %s\n", v, paths[v][2], paths[v][3],
+				paths[v][4]);
+	}
+	fclose(vrfs);
+
+	FILE *distrib = create_file(dir, "distrib.txt", vrf_paths[1]);
+	fprintf(distrib, "20 %lu\n24 %lu\n32 %lu\n", sizes[0], sizes[1],
+			sizes[2]);
+	fclose(distrib);
+
+	int argc = 0;
+	argv[argc++] = "oracle";
+	argv[argc++] = "-d";
+	argv[argc++] = vrf_paths[1];
+	argv[argc++] = "-v";
+	argv[argc++] = vrf_paths[0];
+
+	return argc;
+}
+
+/*
+ * Write the tables of the 'num_vrfs' VRFs to a new temporary directory, whose
+ * path goes to 'dir', like 'write_vrfs()' (or 'write_table()' for a single
+ * VRF). Return the number of options put in 'argv'.
+ */
+static int write_tables(char dir[32], struct prefix *const *pfxs,
+		const unsigned long *n, int num_vrfs, char (*paths)[5][256],
+		char vrf_paths[2][256], char *argv[])
+{
+	strcpy(dir, "/tmp/oracle.XXXXXX");
+	if (mkdtemp(dir) == NULL) {
+		fprintf(stderr, "oracle: Couldn't create a temporary directory.\n");
+		exit(1);
+	}
+
+	if (num_vrfs > 1)
+		return write_vrfs(dir, pfxs, n, num_vrfs, paths, vrf_paths,
+				argv);
+
+	unsigned long group_sizes[3];
+	return write_table(dir, pfxs[0], n[0], paths[0], argv, group_sizes);
+}
+
+/* Remove what 'write_tables()' wrote to 'dir', and 'dir'. */
+static void remove_tables(const char *dir, int num_vrfs,
+		char (*paths)[5][256], char vrf_paths[2][256])
+{
+	if (num_vrfs > 1) {
+		for (int v = 0; v < num_vrfs; v++) {
+			for (int i = 0; i < 5; i++)
+				unlink(paths[v][i]);
+			char vrf_dir[256];
+			sprintf(vrf_dir, "%s/vrf%d", dir, v);
+			rmdir(vrf_dir);
+		}
+		unlink(vrf_paths[0]);
+		unlink(vrf_paths[1]);
+	} else {
+		for (int i = 0; i < 5; i++)
+			unlink(paths[0][i]);
+	}
+	rmdir(dir);
+}
+
+/* Store 'key' (and 'lo', for IPv6) as the i-th address of 'addrs'. */
+static inline void set_address(void *addrs, unsigned long i, uint64_t key,
+		uint64_t lo)
+{
+	if (key_bits == 32) {
+		((uint32_t *)addrs)[i] = key;
+	} else {
+		((uint64_t *)addrs)[2 * i] = key;
+		((uint64_t *)addrs)[2 * i + 1] = lo;
+	}
+}
+
+static inline uint64_t get_key(const void *addrs, unsigned long i)
+{
+	if (key_bits == 32)
+		return ((const uint32_t *)addrs)[i];
+
+	return ((const uint64_t *)addrs)[2 * i];
+}
+
+/*
+ * Fill 'addrs' with 'n' random addresses followed by five addresses for each
+ * prefix: its first and last addresses, the ones just before and after it
+ * and a random one inside it. Return the number of addresses.
+ */
+static unsigned long generate_addresses(void *addrs, unsigned long n,
+		const struct prefix *pfxs, unsigned long num_pfxs)
+{
+	uint64_t all = key_mask(key_bits);
+	unsigned long count = 0;
+
+	for (unsigned long i = 0; i < n; i++)
+		set_address(addrs, count++, rand64() & all, rand64());
+
+	for (unsigned long i = 0; i < num_pfxs; i++) {
+		uint64_t first = pfxs[i].key;
+		uint64_t last = first | (all & ~key_mask(pfxs[i].len));
+
+		set_address(addrs, count++, first, 0);
+		set_address(addrs, count++, last, ~0ULL);
+		set_address(addrs, count++, (first - 1) & all, ~0ULL);
+		set_address(addrs, count++, (last + 1) & all, 0);
+		set_address(addrs, count++, first | (rand64() & (last ^ first)),
+				rand64());
+	}
+
+	return count;
+}
+
+static void print_address(FILE *fp, const void *addrs, unsigned long i)
+{
+	if (key_bits == 32)
+		print_ipv4(fp, ((const uint32_t *)addrs)[i]);
+	else
+		print_ipv6(fp, ((const uint64_t *)addrs)[2 * i],
+				((const uint64_t *)addrs)[2 * i + 1]);
+}
+
+static void print_next_hop(FILE *fp, bool found, const struct next_hop *nh)
+{
+	if (!found)
+		fprintf(fp, "(none)");
+	else if (key_bits == 32)
+		print_ipv4(fp, nh->lo);
+	else
+		print_ipv6(fp, nh->hi, nh->lo);
+}
+
+/*
+ * Fill 'addrs' with 'n' random addresses, which go to the VRFs in turn, and
+ * the addresses of the prefixes of each VRF (see 'generate_addresses()'),
+ * which go to that VRF. The VRFs go to 'vrfs'. Return the number of addresses.
+ */
+static unsigned long generate_vrf_addresses(void *addrs, uint32_t *vrfs,
+		unsigned long n, struct prefix *const *pfxs,
+		const unsigned long *num_pfxs, int num_vrfs)
+{
+	unsigned long count = 0;
+	for (int v = 0; v < num_vrfs; v++) {
+		uint8_t *first = (uint8_t *)addrs + count * engine.addr_size;
+		unsigned long m = generate_addresses(first, v == 0 ? n : 0,
+				pfxs[v], num_pfxs[v]);
+		for (unsigned long i = 0; i < m; i++)
+			vrfs[count + i] = v;
+		count += m;
+	}
+	for (unsigned long i = 0; i < n; i++)
+		vrfs[i] = i % num_vrfs;
+
+	return count;
+}
+
+/*
+ * Return the number of addresses whose next hop isn't the expected one. The
+ * i-th address is looked up in VRF 'vrfs[i]' (in the trie 'btries[vrfs[i]]'),
+ * or in the single table of the engine if 'vrfs' is NULL.
+ */
+static unsigned long check(const void *fw_tbl,
+		struct btrie_node *const *btries, const uint32_t *vrfs,
+		const void *addrs, unsigned long n)
+{
+	bool *found = malloc(LOOKUP_CHUNK * sizeof(bool));
+	uint8_t *next_hops = malloc(LOOKUP_CHUNK * engine.addr_size);
+	if (found == NULL || next_hops == NULL) {
+		fprintf(stderr, "oracle.check: Could not malloc results.\n");
+		exit(1);
+	}
+
+	unsigned long mismatches = 0;
+	for (unsigned long i = 0; i < n; i += LOOKUP_CHUNK) {
+		unsigned long m = n - i < LOOKUP_CHUNK ? n - i : LOOKUP_CHUNK;
+		const uint8_t *chunk = (const uint8_t *)addrs +
+			i * engine.addr_size;
+		if (vrfs != NULL)
+			engine.lookup_next_hops_vrf(fw_tbl, &vrfs[i], chunk, m,
+					found, next_hops);
+		else
+			engine.lookup_next_hops(fw_tbl, chunk, m, found,
+					next_hops);
+
+		for (unsigned long j = 0; j < m; j++) {
+			uint32_t vrf = vrfs != NULL ? vrfs[i + j] : 0;
+			struct next_hop expected, got = { 0, 0 };
+			bool expected_found = btrie_lookup(btries[vrf],
+					get_key(addrs, i + j), &expected);
+
+			if (key_bits == 32)
+				got.lo = ((uint32_t *)next_hops)[j];
+			else
+				memcpy(&got, next_hops + j * engine.addr_size,
+						sizeof(got));
+
+			if (found[j] == expected_found && (!found[j] ||
+					(got.hi == expected.hi &&
+					 got.lo == expected.lo)))
+				continue;
+
+			if (mismatches++ < MAX_REPORTED_MISMATCHES) {
+				fprintf(stderr, "oracle: %s: ", engine.name);
+				if (vrfs != NULL)
+					fprintf(stderr, "[%"PRIu32"] ", vrf);
+				print_address(stderr, addrs, i + j);
+				fprintf(stderr, " -> ");
+				print_next_hop(stderr, found[j], &got);
+				fprintf(stderr, ", expected ");
+				print_next_hop(stderr, expected_found,
+						&expected);
+				fprintf(stderr, ".\n");
+			}
+		}
+	}
+
+	free(next_hops);
+	free(found);
+
+	return mismatches;
+}
+
+void print_usage(char *argv[])
+{
+	printf("Usage: %s [-s <seed>] [-P <count>] [-n <count>] [-V <count>] [--updates] [--no-default-route] [--keep-files]\n", argv[0]);
+	printf("\n");
+	printf("Options:\n");
+	printf("  -s --seed              \t Seed of the table and the addresses (default: %d).\n", DEFAULT_SEED);
+	printf("  -P --num-prefixes      \t Number of prefixes (default: %d).\n", DEFAULT_NUM_PREFIXES);
+	printf("  -n --num-addresses     \t Number of random addresses (default: %d).\n", DEFAULT_NUM_ADDRESSES);
+	printf("  -V --vrfs              \t Number of VRFs, with a table of '-P' prefixes each (default: %d).\n", DEFAULT_NUM_VRFS);
+	printf("     --updates           \t Then add and change prefixes in the loaded table, and check it again.\n");
+	printf("     --no-default-route  \t Don't add a default route.\n");
+	printf("     --keep-files        \t Keep (and print the directory of) the table files.\n");
+}
+
+int main(int argc, char *argv[])
+{
+	if (option_flag(argc, argv, "--help", "-h")) {
+		print_usage(argv);
+		return 0;
+	}
+
+	int index;
+	unsigned long seed = DEFAULT_SEED;
+	unsigned long num_pfxs = DEFAULT_NUM_PREFIXES;
+	unsigned long num_addrs = DEFAULT_NUM_ADDRESSES;
+	int num_vrfs = DEFAULT_NUM_VRFS;
+
+	if ((index = option_value(argc, argv, "--seed", "-s")) != -1)
+		seed = strtoul(argv[index], NULL, 10);
+	if ((index = option_value(argc, argv, "--num-prefixes", "-P")) != -1)
+		num_pfxs = strtoul(argv[index], NULL, 10);
+	if ((index = option_value(argc, argv, "--num-addresses", "-n")) != -1)
+		num_addrs = strtoul(argv[index], NULL, 10);
+	if ((index = option_value(argc, argv, "--vrfs", "-V")) != -1)
+		num_vrfs = atoi(argv[index]);
+	bool default_route = !option_flag(argc, argv, "--no-default-route",
+			NULL);
+	bool keep_files = option_flag(argc, argv, "--keep-files", NULL);
+	bool updates = option_flag(argc, argv, "--updates", NULL);
+
+	key_bits = engine.addr_size == sizeof(uint32_t) ? 32 : 64;
+	rng_state = seed;
+
+	if (num_vrfs < 1 || (num_vrfs > 1 && (key_bits != 32 ||
+					engine.lookup_next_hops_vrf == NULL))) {
+		fprintf(stderr, "oracle: %s can't hold %d VRFs.\n", engine.name,
+				num_vrfs);
+		exit(1);
+	}
+	if (updates && engine.update == NULL) {
+		fprintf(stderr, "oracle: %s has no updates.\n", engine.name);
+		exit(1);
+	}
+
+	/* Tables, with room for the prefixes of the updates. */
+	unsigned long num_updates = updates ? num_pfxs / 4 : 0;
+	struct btrie_node **btries = malloc(num_vrfs *
+			sizeof(struct btrie_node *));
+	struct prefix **pfxs = malloc(num_vrfs * sizeof(struct prefix *));
+	unsigned long *n = malloc(num_vrfs * sizeof(unsigned long));
+	char (*paths)[5][256] = malloc(num_vrfs * sizeof(*paths));
+	if (btries == NULL || pfxs == NULL || n == NULL || paths == NULL) {
+		fprintf(stderr, "oracle: Could not malloc tables.\n");
+		exit(1);
+	}
+	unsigned long total = 0;
+	for (int v = 0; v < num_vrfs; v++) {
+		btries[v] = btrie_node();
+		pfxs[v] = malloc((num_pfxs + num_updates + 1) *
+				sizeof(struct prefix));
+		if (pfxs[v] == NULL) {
+			fprintf(stderr, "oracle: Could not malloc prefixes.\n");
+			exit(1);
+		}
+		n[v] = generate_prefixes(btries[v], pfxs[v], 0, num_pfxs,
+				default_route);
+		total += n[v];
+	}
+
+	char dir[32];
+	char vrf_paths[2][256];
+	char *table_argv[16];
+	int table_argc = write_tables(dir, pfxs, n, num_vrfs, paths, vrf_paths,
+			table_argv);
+	void *fw_tbl = engine.load(table_argc, table_argv);
+
+	if (keep_files)
+		printf("Table files: %s.\n", dir);
+	else
+		remove_tables(dir, num_vrfs, paths, vrf_paths);
+
+	/* Addresses. */
+	unsigned long max_addrs = num_addrs + 5 * (total +
+			num_vrfs * num_updates);
+	void *addrs = malloc(max_addrs * engine.addr_size);
+	uint32_t *vrfs = malloc(max_addrs * sizeof(uint32_t));
+	if (addrs == NULL || vrfs == NULL) {
+		fprintf(stderr, "oracle: Could not malloc addresses.\n");
+		exit(1);
+	}
+	unsigned long num_checked = generate_vrf_addresses(addrs, vrfs,
+			num_addrs, pfxs, n, num_vrfs);
+
+	unsigned long mismatches = check(fw_tbl, btries,
+			num_vrfs > 1 ? vrfs : NULL, addrs, num_checked);
+	printf("%s: %lu prefixes%s", engine.name, total,
+			default_route ? " (default route)" : "");
+	if (num_vrfs > 1)
+		printf(" in %d VRFs", num_vrfs);
+	printf(", %lu addresses, %lu mismatches.\n", num_checked, mismatches);
+
+	/*
+	 * Updates: the files hold all the prefixes again, as the keys that were
+	 * stored only get new next hops.
+	 */
+	if (updates) {
+		total = 0;
+		for (int v = 0; v < num_vrfs; v++) {
+			change_next_hops(btries[v], pfxs[v], n[v], num_updates);
+			n[v] = generate_prefixes(btries[v], pfxs[v], n[v],
+					num_updates, false);
+			total += n[v];
+		}
+
+		table_argc = write_tables(dir, pfxs, n, num_vrfs, paths,
+				vrf_paths, table_argv);
+		engine.update(fw_tbl, table_argc, table_argv);
+
+		if (keep_files)
+			printf("Updated table files: %s.\n", dir);
+		else
+			remove_tables(dir, num_vrfs, paths, vrf_paths);
+
+		num_checked = generate_vrf_addresses(addrs, vrfs, num_addrs,
+				pfxs, n, num_vrfs);
+		unsigned long update_mismatches = check(fw_tbl, btries,
+				num_vrfs > 1 ? vrfs : NULL, addrs, num_checked);
+		printf("%s: %lu prefixes after the updates, %lu addresses, %lu mismatches.\n",
+				engine.name, total, num_checked,
+				update_mismatches);
+		mismatches += update_mismatches;
+	}
+
+	if (engine.destroy != NULL)
+		engine.destroy(fw_tbl);
+	free(vrfs);
+	free(addrs);
+	for (int v = 0; v < num_vrfs; v++) {
+		free(pfxs[v]);
+		btrie_free(btries[v]);
+	}
+	free(paths);
+	free(n);
+	free(pfxs);
+	free(btries);
+
+	return mismatches == 0 ? 0 : 1;
+}
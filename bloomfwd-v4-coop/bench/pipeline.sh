@@ -0,0 +1,66 @@
+#!/bin/bash
+
+# This script measures the offload pipeline of 'bloomfwd_opt_coop' (build with
+# -DBENCHMARK=ON) for different numbers of buffers in flight ('-B'). All the
+# addresses go to the offload worker ('-z 1'), which is the local worker with
+# different injected latencies per batch. It outputs the execution times and
+# the achieved transfer/lookup overlap to a file in the CSV format.
+
+# Settings
+PROJECT_DIR=~/Development/c/bloomfwd/bloomfwd-v4-coop/
+PREFIXES_DISTRIBUTION_FILE=data/opt/distrib.txt
+DLA_FILE=data/opt/dla.txt
+G1_FILE=data/opt/g1.txt
+G2_FILE=data/opt/g2.txt
+IPV4_ADDRESSES_FILE=data/addresses.txt
+ADDRS_COUNT=67108864
+BUF_LEN=3904
+WORKER_THREADS=8
+LATENCIES=(0 500 2000 8000)  # Microseconds per batch.
+BUFFERS=(1 2 3 4)
+OUTPUT_FILE=bench/res/pipeline/lookup.csv # Benchmark output file.
+
+cd $PROJECT_DIR
+mkdir -p bench/res/pipeline/
+
+# Clean old data files...
+data_files=$(ls bench/res/pipeline)
+if [ ${#data_files} -gt 0 ]; then
+	rm -f bench/res/pipeline/*
+fi
+
+# Only the thread driving the worker runs on the host.
+export OMP_NUM_THREADS=1
+
+# Write headers to output file.
+printf "Latency (us), # Buffers, Execs..., Overlap\n" >> $OUTPUT_FILE
+
+for l in "${LATENCIES[@]}"
+do
+	for b in "${BUFFERS[@]}"
+	do
+		printf "$l, $b: "
+		printf "$l, $b" >> $OUTPUT_FILE
+
+		overlap="-"
+		for e in $(seq 1 3)  # Number of times to execute.
+		do
+			# The pipeline report is written to stderr.
+			exec_time=$(./bin/bloomfwd_opt_coop -w local -z 1 -B $b \
+			-T $WORKER_THREADS -L $l -b $BUF_LEN \
+			-d $PREFIXES_DISTRIBUTION_FILE -dla $DLA_FILE -g1 $G1_FILE \
+			-g2 $G2_FILE -r $IPV4_ADDRESSES_FILE -n $ADDRS_COUNT \
+			2> bench/res/pipeline/stderr.txt | head -n 1)
+
+			overlap=$(grep "Offload pipeline" bench/res/pipeline/stderr.txt | \
+				sed 's/.* \([0-9.]*\)% overlap.*/\1/')
+
+			printf "."
+			printf ", $exec_time" >> $OUTPUT_FILE
+		done
+		printf "\n"
+		printf ", $overlap\n" >> $OUTPUT_FILE
+	done
+done
+
+rm -f bench/res/pipeline/stderr.txt
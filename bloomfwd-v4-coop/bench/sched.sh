@@ -0,0 +1,72 @@
+#!/bin/bash
+
+# This script compares fixed CPU/offload splits ('-z') against the adaptive
+# scheduler (no '-z') of 'bloomfwd_opt_coop' (build with -DBENCHMARK=ON). The
+# offload side is the local worker ('-w local') with different injected
+# latencies per batch, which emulate slower or faster PCIe links. It outputs the
+# execution times and the share of addresses forwarded by the worker to a file
+# in the CSV format.
+
+# Settings
+PROJECT_DIR=~/Development/c/bloomfwd/bloomfwd-v4-coop/
+PREFIXES_DISTRIBUTION_FILE=data/opt/distrib.txt
+DLA_FILE=data/opt/dla.txt
+G1_FILE=data/opt/g1.txt
+G2_FILE=data/opt/g2.txt
+IPV4_ADDRESSES_FILE=data/addresses.txt
+ADDRS_COUNT=67108864
+BUF_LEN=3904
+NUM_THREADS=16
+WORKER_THREADS=8
+LATENCIES=(0 500 2000 8000)  # Microseconds per batch.
+MIC_RATIOS=("adaptive" 0.25 0.50 0.75)
+OUTPUT_FILE=bench/res/sched/lookup.csv # Benchmark output file.
+
+cd $PROJECT_DIR
+mkdir -p bench/res/sched/
+
+# Clean old data files...
+data_files=$(ls bench/res/sched)
+if [ ${#data_files} -gt 0 ]; then
+	rm -f bench/res/sched/*
+fi
+
+export OMP_NUM_THREADS=$NUM_THREADS
+
+# Write headers to output file.
+printf "Latency (us), Ratio, Execs..., Offload share\n" >> $OUTPUT_FILE
+
+for l in "${LATENCIES[@]}"
+do
+	for z in "${MIC_RATIOS[@]}"
+	do
+		ratio_opt=""
+		if [ "$z" != "adaptive" ]; then
+			ratio_opt="-z $z"
+		fi
+
+		printf "$l, $z: "
+		printf "$l, $z" >> $OUTPUT_FILE
+
+		share="-"
+		for e in $(seq 1 3)  # Number of times to execute.
+		do
+			# The scheduler report is written to stderr.
+			exec_time=$(./bin/bloomfwd_opt_coop -w local \
+			-T $WORKER_THREADS -L $l -b $BUF_LEN $ratio_opt \
+			-d $PREFIXES_DISTRIBUTION_FILE -dla $DLA_FILE -g1 $G1_FILE \
+			-g2 $G2_FILE -r $IPV4_ADDRESSES_FILE -n $ADDRS_COUNT \
+			2> bench/res/sched/stderr.txt | head -n 1)
+
+			share=$(grep "Offload" bench/res/sched/stderr.txt | \
+				sed 's/.*(\([0-9.]*\)%).*/\1/')
+
+			printf "."
+			printf ", $exec_time" >> $OUTPUT_FILE
+		done
+		printf "\n"
+		printf ", $share\n" >> $OUTPUT_FILE
+	done
+done
+
+rm -f bench/res/sched/stderr.txt
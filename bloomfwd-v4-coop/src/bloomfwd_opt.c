@@ -111,7 +111,7 @@ static bool store_next_hop(struct hash_table *tbl, uint32_t pfx_key,
 		uint32_t next_hop)
 {
 	uint32_t hash = HASHTBL_HASH_FUNCTION(pfx_key);
-	uint32_t idx = hash % tbl->range;
+	uint32_t idx = fastrange_32(hash, tbl->range);
 
 	/* Find key. */
 	struct hash_table_entry *entry;
@@ -152,7 +152,7 @@ static bool store_next_hop(struct hash_table *tbl, uint32_t pfx_key,
 static inline bool find_next_hop_with_hash(struct hash_table *tbl, uint32_t hash,
 		uint32_t pfx_key, uint32_t *next_hop)
 {
-	uint32_t idx = hash % tbl->range;
+	uint32_t idx = fastrange_32(hash, tbl->range);
 
 	struct hash_table_entry *entry;
 	for (entry = tbl->slots[idx]; entry != NULL; entry = entry->next) {
@@ -171,7 +171,7 @@ static bool find_next_hop(struct hash_table *tbl, uint32_t pfx_key,
 		uint32_t *next_hop)
 {
 	uint32_t hash = HASHTBL_HASH_FUNCTION(pfx_key);
-	uint32_t idx = hash % tbl->range;
+	uint32_t idx = fastrange_32(hash, tbl->range);
 
 	struct hash_table_entry *entry;
 	for (entry = tbl->slots[idx]; entry != NULL; entry = entry->next) {
@@ -376,7 +376,7 @@ static bool store_prefix(const struct ipv4_prefix *pfx)
 		uint32_t bitmap_idxs[num_hashes];
 		hashes(pfx->prefix, num_hashes, bitmap_idxs);
 		for (int i = 0; i < num_hashes; i++) {
-			uint32_t idx = bitmap_idxs[i] % bitmap_len;
+			uint32_t idx = fastrange_32(bitmap_idxs[i], bitmap_len);
 			bitmap[idx] = true;
 			counters[idx] += 1;
 		}
@@ -481,13 +481,13 @@ bool lookup_address(uint32_t addr, uint32_t *next_hop)
 
 	/* Calculate hash. */
 	uint32_t h1 = BLOOM_HASH_FUNCTION(pfx_key);
-	bool maybe = bitmap[h1 % bitmap_len];
+	bool maybe = bitmap[fastrange_32(h1, bitmap_len)];
 	if (maybe) {
 		if (num_hashes > 1) {
 			uint32_t h2 = BLOOM_HASH_FUNCTION(h1);
-			maybe = bitmap[h2 % bitmap_len];
+			maybe = bitmap[fastrange_32(h2, bitmap_len)];
 			for (int j = 2; maybe && j < num_hashes; j++) {
-				uint32_t idx = (h1 + j * h2) % bitmap_len;
+				uint32_t idx = fastrange_32(h1 + j * h2, bitmap_len);
 				maybe = bitmap[idx];
 			}
 		}
@@ -512,13 +512,13 @@ bool lookup_address(uint32_t addr, uint32_t *next_hop)
 
 		/* Calculate hash. */
 		h1 = BLOOM_HASH_FUNCTION(pfx_key);
-		maybe = bitmap[h1 % bitmap_len];
+		maybe = bitmap[fastrange_32(h1, bitmap_len)];
 		if (maybe) {
 			if (num_hashes > 1) {
 				uint32_t h2 = BLOOM_HASH_FUNCTION(h1);
-				maybe = bitmap[h2 % bitmap_len];
+				maybe = bitmap[fastrange_32(h2, bitmap_len)];
 				for (int j = 2; maybe && j < num_hashes; j++) {
-					uint32_t idx = (h1 + j * h2) % bitmap_len;
+					uint32_t idx = fastrange_32(h1 + j * h2, bitmap_len);
 					maybe = bitmap[idx];
 				}
 			}
@@ -548,6 +548,140 @@ bool lookup_address(uint32_t addr, uint32_t *next_hop)
 	return found;
 }
 
+static void flatten_hash_table(const struct hash_table *ht,
+		struct flat_forwarding_table *flat, int id)
+{
+	flat->range[id] = ht->range;
+	flat->total[id] = ht->total;
+	flat->slot_start[id] = malloc((ht->range + 1) * sizeof(uint32_t));
+	flat->entries[id] = malloc(
+			(ht->total > 0 ? ht->total : 1) *
+			sizeof(struct flat_hash_table_entry));
+	if (flat->slot_start[id] == NULL || flat->entries[id] == NULL) {
+		printf("flatten_hash_table: Couldn't malloc flat hash table.\n");
+		exit(1);
+	}
+
+	uint32_t k = 0;
+	for (uint32_t i = 0; i < ht->range; i++) {
+		flat->slot_start[id][i] = k;
+		for (struct hash_table_entry *e = ht->slots[i]; e != NULL;
+				e = e->next, k++) {
+			flat->entries[id][k].hash = e->hash;
+			flat->entries[id][k].prefix = e->prefix;
+			flat->entries[id][k].next_hop = e->next_hop;
+		}
+	}
+	flat->slot_start[id][ht->range] = k;
+}
+
+struct flat_forwarding_table *new_flat_forwarding_table()
+{
+	struct flat_forwarding_table *flat =
+		malloc(sizeof(struct flat_forwarding_table));
+	if (flat == NULL) {
+		printf("new_flat_forwarding_table: Couldn't malloc flat forwarding table.\n");
+		exit(1);
+	}
+
+	flat->has_default_route = fw_tbl->default_route != NULL;
+	flat->default_next_hop = flat->has_default_route ?
+		fw_tbl->default_route->next_hop : 0;
+
+	flat->dla = malloc(FLAT_DLA_LEN * sizeof(uint32_t));
+	if (flat->dla == NULL) {
+		printf("new_flat_forwarding_table: Couldn't malloc DLA.\n");
+		exit(1);
+	}
+	memcpy(flat->dla, fw_tbl->dla, FLAT_DLA_LEN * sizeof(uint32_t));
+
+	for (int i = 0; i < 2; i++) {
+		struct counting_bloom_filter *bf =
+			fw_tbl->counting_bloom_filters[i];
+		flat->bitmap_len[i] = bf->bitmap_len;
+		flat->num_hashes[i] = bf->num_hashes;
+		flat->bitmaps[i] = malloc(bf->bitmap_len * sizeof(bool));
+		if (flat->bitmaps[i] == NULL) {
+			printf("new_flat_forwarding_table: Couldn't malloc bitmap.\n");
+			exit(1);
+		}
+		memcpy(flat->bitmaps[i], bf->bitmap,
+				bf->bitmap_len * sizeof(bool));
+
+		flatten_hash_table(fw_tbl->hash_tables[i], flat, i);
+	}
+
+	return flat;
+}
+
+void free_flat_forwarding_table(struct flat_forwarding_table *flat)
+{
+	free(flat->dla);
+	for (int i = 0; i < 2; i++) {
+		free(flat->bitmaps[i]);
+		free(flat->slot_start[i]);
+		free(flat->entries[i]);
+	}
+	free(flat);
+}
+
+#pragma omp declare target
+static inline bool lookup_group_flat(const struct flat_forwarding_table *flat,
+		int id, uint32_t pfx_key, uint32_t *next_hop)
+{
+	const bool *bitmap = flat->bitmaps[id];
+	uint32_t bitmap_len = flat->bitmap_len[id];
+	uint8_t num_hashes = flat->num_hashes[id];
+
+	uint32_t h1 = BLOOM_HASH_FUNCTION(pfx_key);
+	bool maybe = bitmap[fastrange_32(h1, bitmap_len)];
+	if (maybe && num_hashes > 1) {
+		uint32_t h2 = BLOOM_HASH_FUNCTION(h1);
+		maybe = bitmap[fastrange_32(h2, bitmap_len)];
+		for (int j = 2; maybe && j < num_hashes; j++)
+			maybe = bitmap[fastrange_32(h1 + j * h2, bitmap_len)];
+	}
+	if (!maybe)
+		return false;
+
+#ifdef SAME_HASH_FUNCTIONS
+	uint32_t hash = h1;
+#else
+	uint32_t hash = HASHTBL_HASH_FUNCTION(pfx_key);
+#endif
+	uint32_t idx = fastrange_32(hash, flat->range[id]);
+	const struct flat_hash_table_entry *entries = flat->entries[id];
+	for (uint32_t k = flat->slot_start[id][idx];
+			k < flat->slot_start[id][idx + 1]; k++) {
+		if (entries[k].hash == hash && entries[k].prefix == pfx_key) {
+			*next_hop = entries[k].next_hop;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool lookup_address_flat(const struct flat_forwarding_table *flat,
+		uint32_t addr, uint32_t *next_hop)
+{
+	if (lookup_group_flat(flat, 0, addr, next_hop) ||
+			lookup_group_flat(flat, 1, addr & 0xffffff00, next_hop))
+		return true;
+
+	*next_hop = flat->dla[addr >> 12];
+	if (*next_hop != 0)
+		return true;
+
+	if (flat->has_default_route) {
+		*next_hop = flat->default_next_hop;
+		return true;
+	}
+
+	return false;
+}
+#pragma omp end declare target
+
 #ifdef __MIC__
 
 /*
@@ -586,12 +720,12 @@ void lookup_address_intrin(uint32_t g2_addrs[16], bool found[16],
 	uint32_t bitmap_len = bf->bitmap_len;
 	uint8_t num_hashes = bf->num_hashes;
 	for (int i = 0; i < 16; i++) {
-		bool maybe = bitmap[g2_h1[i] % bitmap_len];
+		bool maybe = bitmap[fastrange_32(g2_h1[i], bitmap_len)];
 		if (maybe) {
 			if (num_hashes > 1) {
-				maybe = bitmap[g2_h2[i] % bitmap_len];
+				maybe = bitmap[fastrange_32(g2_h2[i], bitmap_len)];
 				for (int j = 2; maybe && j < num_hashes; j++) {
-					uint32_t idx = (g2_h1[i] + j * g2_h2[i]) % bitmap_len;
+					uint32_t idx = fastrange_32(g2_h1[i] + j * g2_h2[i], bitmap_len);
 					maybe = bitmap[idx];
 				}
 			}
@@ -617,12 +751,12 @@ void lookup_address_intrin(uint32_t g2_addrs[16], bool found[16],
 		if (found[i])
 			continue;
 
-		bool maybe = bitmap[g1_h1[i] % bitmap_len];
+		bool maybe = bitmap[fastrange_32(g1_h1[i], bitmap_len)];
 		if (maybe) {
 			if (num_hashes > 1) {
-				maybe = bitmap[g1_h2[i] % bitmap_len];
+				maybe = bitmap[fastrange_32(g1_h2[i], bitmap_len)];
 				for (int j = 2; maybe && j < num_hashes; j++) {
-					uint32_t idx = (g1_h1[i] + j * g1_h2[i]) % bitmap_len;
+					uint32_t idx = fastrange_32(g1_h1[i] + j * g1_h2[i], bitmap_len);
 					maybe = bitmap[idx];
 				}
 			}
@@ -45,6 +45,32 @@ struct forwarding_table {
 /* Use for offloading */
 extern struct forwarding_table *fw_tbl;
 
+/*
+ * The forwarding table flattened into arrays, for devices that don't share the
+ * host's memory (see worker.h). The entries of each hash table are sorted by
+ * bucket: those of bucket 'i' are 'entries[slot_start[i]:slot_start[i + 1]]'.
+ */
+struct flat_hash_table_entry {
+	uint32_t hash;
+	uint32_t prefix;
+	uint32_t next_hop;
+};
+
+struct flat_forwarding_table {
+	bool has_default_route;
+	uint32_t default_next_hop;
+	uint32_t *dla;  /* FLAT_DLA_LEN elements. */
+	bool *bitmaps[2];  /* 0 -> G2, 1 -> G1 */
+	uint32_t bitmap_len[2];
+	uint8_t num_hashes[2];
+	uint32_t range[2];
+	uint32_t total[2];
+	uint32_t *slot_start[2];  /* 'range + 1' elements. */
+	struct flat_hash_table_entry *entries[2];  /* 'total' elements. */
+};
+
+#define FLAT_DLA_LEN (1 << 20)
+
 struct ipv4_prefix *new_ipv4_prefix(uint8_t a, uint8_t b, uint8_t c, uint8_t d,
 		uint8_t netmask, uint32_t next_hop);
 
@@ -52,12 +78,6 @@ uint32_t new_ipv4_addr(uint8_t a, uint8_t b, uint8_t c, uint8_t d);
 
 void init_fwtbl(const char *distrib_path, uint32_t *gw_def);
 
-void init_dla();
-
-void init_cbf(FILE *pfx_distribution);
-
-void init_ht();
-
 
 void load_prefixes(const char *pfxs_path);
 
@@ -67,6 +87,17 @@ bool lookup_address(uint32_t addr, uint32_t *next_hop);
 void lookup_address_intrin(uint32_t g2_addrs[16], bool found[16],
 		uint32_t next_hops[16]);
 
+/* Copy 'fw_tbl' into a new flat table in host memory. */
+struct flat_forwarding_table *new_flat_forwarding_table();
+
+void free_flat_forwarding_table(struct flat_forwarding_table *flat);
+
+/* Same as 'lookup_address()', on a flat table (also callable on devices). */
+#pragma omp declare target
+bool lookup_address_flat(const struct flat_forwarding_table *flat,
+		uint32_t addr, uint32_t *next_hop);
+#pragma omp end declare target
+
 #pragma offload_attribute(pop)
 
 #endif
@@ -90,6 +90,32 @@
 //#define LOOKUP_ADDRESS lookup_address
 //#endif
 
+/*
+ * Number of addresses claimed at a time by each host thread in the cooperative
+ * lookup (see scheduler.h). Small chunks let the host threads steal work from
+ * the offload worker's end of the queue with fine granularity.
+ *
+ * Default: 256.
+ */
+#ifndef HOST_CHUNK_LEN
+#define HOST_CHUNK_LEN 256
+#endif
+
+/*
+ * Number of batches the offload worker keeps in flight (see worker.h). With
+ * one, each batch is copied in, looked up and copied out before the next one
+ * is submitted; with two or more, the transfers overlap the lookups.
+ *
+ * Default: 2 if ASYNC_OFFLOAD is defined, 1 otherwise.
+ */
+#ifndef OFFLOAD_BUFFERS
+#ifdef ASYNC_OFFLOAD
+#define OFFLOAD_BUFFERS 2
+#else
+#define OFFLOAD_BUFFERS 1
+#endif
+#endif
+
 /*
  * Enable or disable benchmark.
  *
@@ -4,6 +4,7 @@
 #include <stdint.h>
 
 #pragma offload_attribute (push,target(mic))
+#pragma omp declare target
 
 /*
  * Scalar version of MurmurHash3 in plain C.
@@ -56,6 +57,19 @@ extern inline uint32_t h2hash_32(uint32_t key)
 	return key;
 }
 
+/*
+ * Map the hash 'x' to [0, len) with the high half of 'x * len' instead of
+ * 'x % len', which takes an integer division on every probe. As with the
+ * modulo, each index gets floor(2^32 / len) or ceil(2^32 / len) of the hash
+ * values, so the false positive ratio of a filter of 'len' bits is unchanged;
+ * the index comes from the high bits of the hash rather than the low ones.
+ * See: https://lemire.me/blog/2016/06/27/a-fast-alternative-to-the-modulo-reduction/
+ */
+extern inline uint32_t fastrange_32(uint32_t x, uint32_t len)
+{
+	return ((uint64_t)x * len) >> 32;
+}
+
 #ifdef __MIC__
 #include <immintrin.h>
 
@@ -216,6 +230,7 @@ extern inline void h2hash_32_vec512(uint32_t *keys, uint32_t *hashes)
 
 #endif
 
+#pragma omp end declare target
 #pragma offload_attribute(pop)
 
 #endif
@@ -6,21 +6,29 @@
  * Copyright (C) 2016  Alexandre Lucchesi <alexandrelucchesi@gmail.com> 
  */
 
+#define _GNU_SOURCE  /* sched_setaffinity() */
+
 #include <assert.h>
 
 #include <ctype.h>
+#include <immintrin.h>  /* _mm_malloc(), _mm_free() */
 #include <inttypes.h>
 #include <omp.h>
+#include <sched.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef __INTEL_OFFLOAD
 #include <offload.h>
+#endif
 
 #include "bloomfwd_opt.h"
-#include "config.h"  /* LOOKUP_PARALLEL, LOOKUP_ADDRESS() */
+#include "config.h"  /* HOST_CHUNK_LEN, OFFLOAD_BUFFERS */
 #include "prettyprint.h"
+#include "scheduler.h"
+#include "worker.h"
 
 /* Execution control macros. */
 #ifdef NOPRINTF
@@ -32,7 +40,8 @@
 
 void print_usage(char *argv[])
 {
-	printf("Usage: %s -d <file1> -D <file2> -dla <file3> -DLA <file4> -g1 <file5> -G1 <file6> -g2 <file7> -G2 <file8> -r <file9> [-b <buffer length>] -n <count1> -N <count2>]\n", argv[0]);
+	printf("Usage: %s -d <file1> -D <file2> -dla <file3> -DLA <file4> -g1 <file5> -G1 <file6> -g2 <file7> -G2 <file8> -r <file9> [-b <buffer length>] [-B <buffers>] -n <count1> -N <count2>]\n", argv[0]);
+	printf("       %s -w target|local -d <file1> -dla <file2> -g1 <file3> -g2 <file4> -r <file5> [-B <buffers>] [-T <threads>] [-L <latency>] [-n <count>]\n", argv[0]);
 	printf("\n");
 	printf("Options:\n");
 	printf("  -d   \t [CPU] Distribution of prefixes according to size (netmask).\n");
@@ -44,9 +53,14 @@ void print_usage(char *argv[])
 	printf("  -g2  \t [CPU] Prefixes to initialize G2 in the forwarding table.\n");
 	printf("  -G2  \t [MIC] Prefixes to initialize G2 in the forwarding table.\n");
 	printf("  -r   \t Forward IPv4 addresses in a dry-run fashion.\n");
-	printf("  -b   \t Size of buffer in address for each offload (must be a multiple of 16 and, optimally, a multiple of 3904).\n");
+	printf("  -b   \t Maximum size of buffer in address for each offload (must be a multiple of 16 and, optimally, a multiple of 3904).\n");
+	printf("  -B   \t Number of offload buffers in flight (default: %d).\n", OFFLOAD_BUFFERS);
 	printf("  -n   \t Number of addresses to forward.\n");
-	printf("  -z   \t Offload addresses ratio.\n");
+	printf("  -z   \t Fixed offload addresses ratio (default: adaptive split with work stealing).\n");
+	printf("  -w   \t Offload worker: 'mic' (Xeon Phi), 'target' (OpenMP default device) or 'local' (virtual device on host threads). Only 'mic' uses the -D, -DLA, -G1 and -G2 files.\n");
+	printf("  -T   \t [Local] Number of worker threads (default: 1).\n");
+	printf("  -L   \t [Local] Injected latency per batch, in microseconds (default: 0).\n");
+	printf("  -c   \t Pin the thread driving the worker to this CPU.\n");
 }
 
 /*
@@ -83,6 +97,24 @@ static unsigned long read_addresses(FILE *input_addr, uint32_t **addresses)
 
 	return len;
 }
+/*
+ * Pin the calling thread to 'cpu' (if not negative).
+ */
+static void pin_thread(int cpu)
+{
+	if (cpu < 0)
+		return;
+
+	cpu_set_t mask;
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+	if (sched_setaffinity(0, sizeof(cpu_set_t), &mask) != 0) {
+		fprintf(stderr, "main.pin_thread: Couldn't pin thread to CPU %d.\n",
+				cpu);
+		exit(1);
+	}
+}
+
 /*
  * Simply forward IPv4 addresses read from 'input_addr' file 'count' times. If
  * the number of addresses in the file is smaller than 'count', this function
@@ -93,9 +125,13 @@ static unsigned long read_addresses(FILE *input_addr, uint32_t **addresses)
  * 	- First line is the number of addresses in the file;
  * 	- Remaining lines are addresses in the form A.B.C.D, where A, B, C and D
  * 	are numbers from 0 to 255.
+ *
+ * One host thread drives the offload worker 'w' (pinned to 'worker_cpu', if
+ * not negative) and the others look addresses up; the addresses are split by
+ * the scheduler (see scheduler.h), adaptively if 'offload_ratio' is negative.
  */
-void forward(const char *addrs_path, unsigned long buf_len,
-		unsigned long count, double mic_ratio)
+void forward(const char *addrs_path, struct offload_worker *w,
+		unsigned long count, double offload_ratio, int worker_cpu)
 {
 	if (fw_tbl == NULL) {
 		fprintf(stderr, "forward: 'fw_tbl' is NULL.\n");
@@ -110,8 +146,7 @@ void forward(const char *addrs_path, unsigned long buf_len,
 	}
 
 	uint32_t *addresses = NULL;
-	static unsigned long len;
-	len = read_addresses(input_addr, &addresses);
+	unsigned long len = read_addresses(input_addr, &addresses);
 	if (count == 0)
 		count = len;
 
@@ -120,400 +155,98 @@ void forward(const char *addrs_path, unsigned long buf_len,
 #ifndef NDEBUG
 	printf("Number of addresses is %lu.\n", len);
 	printf("Forwarding %.2lf times (%lu addresses).\n", (double)count / len, count);
+	printf("offload_ratio = %lf\n", offload_ratio);
+	printf("count = %lu\n", count);
+	printf("max_batch = %zu\n", w->max_batch);
+	printf("num_buffers = %d\n", w->num_buffers);
 #endif
-	/* 
-	 * `buffer_len` must be a multiple of 16 and optimally a multiple of 
-	 * 244 threads * 16 addresses = 3904 for better resource usage on Phi.
-	 */
-	static size_t buffer_len = 3904;
-	if (buf_len > 0)
-		buffer_len = buf_len;
-
-///	/* CPU processes first half of `addresses` */
-/////	size_t i_cpu = 0;
-/////	size_t j_cpu = count / 2 + ((count / 2) % buffer_len) ;
-/////	size_t len_cpu = j_cpu - i_cpu;
-///	size_t i_cpu = 0;
-///	size_t j_cpu = 0;
-///	size_t len_cpu = j_cpu - i_cpu;
-///
-///	/* MIC processes the remaining addresses */
-///	size_t i_mic = j_cpu;
-///	size_t j_mic = count;
-///	static size_t len_mic;
-///	len_mic = j_mic - i_mic;
-
-//	/* Percent of addresses to be processed in MIC */
-//	/* TODO: Config using preprocessor! */
-//	double mic_ratio = 1.0;
-//	size_t mic_count = mic_ratio * count;
-//	size_t mic_len = mic_ratio * len;
-//	size_t cpu_count = count - mic_count;
-//	size_t cpu_len = len - mic_len;
-//	/* CPU processes addresses in the second part */
-//	size_t cpu_offset = mic_count;
-
-	size_t mic_count = mic_ratio * count;
-	mic_count -= mic_count % buffer_len; 
-
-
-	/* Output buffer (must have the same size as the `addresses` input buffer) */
-	bool *found;
-	uint32_t *next_hops;
 
-#ifndef NDEBUG
-	printf("mic_ratio = %lf\n", mic_ratio);
-	printf("mic_count = %zu\n", mic_count);
-	printf("len = %zu\n", len);
-	printf("count = %zu\n", count);
-	printf("buffer_len = %zu\n", buffer_len);
-#endif
+	struct work_queue wq;
+	work_queue_init(&wq, count, offload_ratio);
 
-	/*
-	 * Total number of addresses must be a multiple of `buffer_len` because
-	 * there's no peeling loop implemented yet.
-	 */
-	if (mic_count % buffer_len != 0 || buffer_len % 16 != 0) {
-		printf("forward: mic_count `mod` buffer_len != 0 || buffer_len `mod` 16 != 0\n");
-		exit(1);
-	}
-
-	/* Allocate buffers on CPU */
-	next_hops = _mm_malloc(buffer_len * sizeof(uint32_t), 64);
-	found = _mm_malloc(buffer_len * sizeof(bool), 64);
-	/* Allocate buffers on MIC */
-	#pragma offload_transfer target(mic:0) \
-		nocopy(addresses : length(buffer_len) alloc_if(1) free_if(0)) \
-		nocopy(found : length(buffer_len) alloc_if(1) free_if(0)) \
-		nocopy(next_hops : length(buffer_len) alloc_if(1) free_if(0))
-	
-	int mic_thread_id = -1;
-	int max_proc = kmp_get_affinity_max_proc();
+	/* Time with batches in flight on the worker. */
+	double busy_time = 0.0;
 
 	double total_exec_time = omp_get_wtime();
 
-#pragma omp parallel num_threads(31)
+#pragma omp parallel
 {
 #ifndef NDEBUG
 	char addr_str[16];
 	char next_hop_str[16];
 #endif
-	/* MIC */
+	/* Offload worker */
 	#pragma omp single nowait
 	{
-		mic_thread_id = omp_get_thread_num();
-
-		kmp_affinity_mask_t mask;
-		kmp_create_affinity_mask(&mask);
-		for (int i = 0; i < max_proc; i++)
-			kmp_unset_affinity_mask_proc(i, &mask);
-		kmp_set_affinity_mask_proc(15, &mask);
-		kmp_set_affinity_mask_proc(31, &mask);
-		kmp_set_affinity(&mask);
-
-		for (size_t i = 0; i < mic_count; i += buffer_len) {
-			#pragma offload target(mic:0) \
-				in(addresses[(i % len):buffer_len] : into(addresses[0:buffer_len]) alloc_if(0) free_if(0)) \
-				out(found : length(buffer_len) alloc_if(0) free_if(0)) \
-				out(next_hops : length(buffer_len) alloc_if(0) free_if(0))
-			{
-				/* 
-				 * IMPORTANT: `buffer_len` must be a multiple of
-				 * 16 so that this loop works correctly!
-				 */
-				#pragma omp parallel for schedule(dynamic, 1) num_threads(244)
-				for (unsigned long i = 0; i < buffer_len; i += 16)
-					lookup_address_intrin(&addresses[i], &found[i], &next_hops[i]);
-			}
-	
-			#ifndef NDEBUG
-			for (int j = 0; j < buffer_len; j++) {
-				/* I/O. */
-				straddr(addresses[(i % len) + j], addr_str);
-				straddr(next_hops[j], next_hop_str);
-				#pragma omp critical
-				{
-					if (!found[j])
-						printf("MIC: \t%s -> (none)\n", addr_str);
-					else
-						printf("MIC: \t%s -> %s.\n", addr_str, next_hop_str);
-	  			}
-			}
-			#endif
-		}
-	}
-
-	/* CPU */
-	if (omp_get_thread_num() != mic_thread_id) {
-		kmp_affinity_mask_t mask;
-		kmp_create_affinity_mask(&mask);
-		for (int i = 0; i <= max_proc; i++)
-			kmp_set_affinity_mask_proc(i, &mask);
-		kmp_unset_affinity_mask_proc(15, &mask);
-		kmp_unset_affinity_mask_proc(31, &mask);
-		kmp_set_affinity(&mask);
-
-		#pragma omp for schedule(dynamic, 1) nowait
-		for (size_t i = mic_count; i < count; i++) {
-			/* Decode address. */
-			uint32_t addr = addresses[i % len];
-
-			/* Lookup */
-			uint32_t next_hop;
-		#ifndef NDEBUG
-			bool found = lookup_address(addr, &next_hop);
-		#else
-			lookup_address(addr, &next_hop);
-		#endif
-
-		#ifndef NDEBUG
-			/* I/O. */
-			straddr(addr, addr_str);
-			straddr(next_hop, next_hop_str);
-			#pragma omp critical
-			{
-				if (!found)
-					printf("\t%s -> (none)\n", addr_str);
-				else
-					printf("\t%s -> %s.\n", addr_str, next_hop_str);
-			}
-		#endif
-		}
-	}
-
-}
-
-	total_exec_time = omp_get_wtime() - total_exec_time;
-
-#ifdef BENCHMARK
-	printf("%lf", total_exec_time);
-#endif
-
-	/* Free allocated memory */
-	_mm_free(addresses);
-	_mm_free(next_hops);
-	_mm_free(found);
-	#pragma offload_transfer target(mic:0) \
-		nocopy(addresses : length(buffer_len) alloc_if(0) free_if(1)) \
-		nocopy(found : length(buffer_len) alloc_if(0) free_if(1)) \
-		nocopy(next_hops : length(buffer_len) alloc_if(0) free_if(1))
-}
-
-void forward_async(const char *addrs_path, unsigned long buf_len,
-		unsigned long count, double mic_ratio)
-{
-	if (fw_tbl == NULL) {
-		fprintf(stderr, "forward: 'fw_tbl' is NULL.\n");
-		exit(1);
-	}
-
-	FILE *input_addr = fopen(addrs_path, "r");
-	if (input_addr == NULL) {
-		fprintf(stderr, "Couldn't open input addresses file: '%s'.\n",
-				addrs_path);
-		exit(1);
-	}
-
-	uint32_t *addresses = NULL;
-	static unsigned long len;
-	len = read_addresses(input_addr, &addresses);
-	if (count == 0)
-		count = len;
-
-	fclose(input_addr);
-
-#ifndef NDEBUG
-	printf("Number of addresses is %lu.\n", len);
-	printf("Forwarding %.2lf times (%lu addresses).\n", (double)count / len, count);
-#endif
-	/* 
-	 * `buffer_len` must be a multiple of 16 and optimally a multiple of 
-	 * 244 threads * 16 addresses = 3904 for better resource usage on Phi.
-	 */
-	static size_t buffer_len = 3904;
-	if (buf_len > 0)
-		buffer_len = buf_len;
-
-	/* Percent of addresses to be processed in MIC */
-	/* TODO: Config using preprocessor! */
-//	double mic_ratio = 3.0 / 4.0; /* Assuming Phi is ~ 3x faster than CPU */
-//	double mic_ratio = 4.0 / 5.0; /* Assuming Phi is ~ 4x faster than CPU */
-//	double mic_ratio = 5.0 / 6.0; /* Assuming Phi is ~ 5x faster than CPU */
-//	double mic_ratio = 6.0 / 7.0; /* Assuming Phi is ~ 6x faster than CPU */
-//	double mic_ratio = 7.0 / 8.0; /* Assuming Phi is ~ 7x faster than CPU */
-//	double mic_ratio = 9.0 / 10.0; /* Assuming Phi is ~ 9x faster than CPU */
-//	double mic_ratio = 10.0 / 11.0; /* Assuming Phi is ~ 10x faster than CPU */
-//	double mic_ratio = 12.0 / 13.0; /* Assuming Phi is ~ 12x faster than CPU */
-//	double mic_ratio = 21.0 / 22.0; /* Assuming Phi is ~ 21x faster than CPU */
-//	double mic_ratio = 1.0; /* Assuming Phi is infinitely faster than CPU */
-	size_t mic_count = mic_ratio * count;
-	mic_count -= mic_count % buffer_len; 
-
-	/* Phi processes the first part: 0 -> mic_count */
-	/* CPU processes the second part: mic_count -> count */
-
-	/* Buffers (must have the same size as the `addresses` input buffer) */
-	uint32_t *addresses_1;
-	uint32_t *addresses_2;
-	bool *found_1;
-	bool *found_2;
-	uint32_t *next_hops_1;
-	uint32_t *next_hops_2;
-
-#ifndef NDEBUG
-	printf("mic_ratio = %lf\n", mic_ratio);
-	printf("mic_count = %zu\n", mic_count);
-	printf("len = %zu\n", len);
-	printf("count = %zu\n", count);
-	printf("buffer_len = %zu\n", buffer_len);
-#endif
-
-	/*
-	 * Total number of addresses must be a multiple of `buffer_len` because
-	 * there's no peeling loop implemented yet.
-	 */
-	if (mic_count % buffer_len != 0 || buffer_len % 16 != 0) {
-		printf("forward: mic_count `mod` buffer_len != 0 || buffer_len `mod` 16 != 0\n");
-		exit(1);
-	}
-
-	/* Allocate buffers on CPU */
-	found_1 = _mm_malloc(buffer_len * sizeof(bool), 64);
-	found_2 = _mm_malloc(buffer_len * sizeof(bool), 64);
-	next_hops_1 = _mm_malloc(buffer_len * sizeof(uint32_t), 64);
-	next_hops_2 = _mm_malloc(buffer_len * sizeof(uint32_t), 64);
-	/* Signals used to synchronize execution using double buffers */
-	addresses_1 = next_hops_1;
-	addresses_2 = next_hops_2;
-	/* Allocate buffers on MIC */
-	#pragma offload_transfer target(mic:0) \
-		nocopy(addresses_1 : length(buffer_len) alloc_if(1) free_if(0)) \
-		nocopy(addresses_2 : length(buffer_len) alloc_if(1) free_if(0)) \
-		nocopy(found_1 : length(buffer_len) alloc_if(1) free_if(0)) \
-		nocopy(found_2 : length(buffer_len) alloc_if(1) free_if(0)) \
-		nocopy(next_hops_1 : length(buffer_len) alloc_if(1) free_if(0)) \
-		nocopy(next_hops_2 : length(buffer_len) alloc_if(1) free_if(0))
-
-	int mic_thread_id = -1;
-	int max_proc = kmp_get_affinity_max_proc();
-
-	double total_exec_time = omp_get_wtime();
-//	double cpu_exec_time = 0.0;
-//	double mic_exec_time = 0.0;
-
-//cpu_exec_time = omp_get_wtime();
-
-
-#pragma omp parallel num_threads(31)
-{
-#ifndef NDEBUG
-	char addr_str[16];
-	char next_hop_str[16];
-#endif
-	/* MIC */
-	#pragma omp single nowait
-	{
-		mic_thread_id = omp_get_thread_num();
-
-		kmp_affinity_mask_t mask;
-		kmp_create_affinity_mask(&mask);
-		for (int i = 0; i < max_proc; i++)
-			kmp_unset_affinity_mask_proc(i, &mask);
-		kmp_set_affinity_mask_proc(15, &mask);
-		kmp_set_affinity_mask_proc(31, &mask);
-		kmp_set_affinity(&mask);
-
-		#pragma offload_transfer target(mic:0) if(mic_count > 0) \
-			in(addresses[0:buffer_len] : into(addresses_1[0:buffer_len]) alloc_if(0) free_if(0)) \
-			signal(addresses_1)
-		for (size_t i = buffer_len, j = 0; i <= mic_count; i += buffer_len, j++) {
-			if (j % 2 == 0) {
-				#pragma offload_transfer target(mic:0) if(i < mic_count) \
-					in(addresses[(i % len):buffer_len] : into(addresses_2[0:buffer_len]) alloc_if(0) free_if(0)) \
-					signal(addresses_2)
-
-				#pragma offload target(mic:0) \
-					wait(addresses_1) \
-					nocopy(addresses_1 : length(buffer_len) alloc_if(0) free_if(0)) \
-					out(found_1 : length(buffer_len) alloc_if(0) free_if(0)) \
-					out(next_hops_1 : length(buffer_len) alloc_if(0) free_if(0))
-				{
-					/* 
-					 * IMPORTANT: `buffer_len` must be a multiple of
-					 * 16 so that this loop works correctly!
-					 */
-					#pragma omp parallel for schedule(dynamic, 1) num_threads(244)
-					for (unsigned long i = 0; i < buffer_len; i += 16) {
-						lookup_address_intrin(&addresses_1[i], &found_1[i], &next_hops_1[i]);
-					}
-				}
+		pin_thread(worker_cpu);
+
+		/* Length of the batch in flight in each buffer. */
+		size_t batch_len[w->num_buffers];
+		for (int b = 0; b < w->num_buffers; b++)
+			batch_len[b] = 0;
+		int in_flight = 0;
+		double last_done = omp_get_wtime();
+
+		for (int b = 0; ; b = (b + 1) % w->num_buffers) {
+			struct offload_buffer *buf = &w->buffers[b];
+
+			/* Collect the results of the batch in this buffer. */
+			if (batch_len[b] > 0) {
+				w->collect(w, b);
+				double now = omp_get_wtime();
+				double since = buf->submit_time > last_done ?
+					buf->submit_time : last_done;
+				work_queue_offload_done(&wq, batch_len[b], now - since);
+				last_done = now;
 
 				#ifndef NDEBUG
-				for (int k = 0; k < buffer_len; k++) {
+				for (size_t j = 0; j < batch_len[b]; j++) {
 					/* I/O. */
-					straddr(addresses[((i - buffer_len) % len) + k], addr_str);
-					straddr(next_hops_1[k], next_hop_str);
+					straddr(buf->addrs[j], addr_str);
+					straddr(buf->next_hops[j], next_hop_str);
 					#pragma omp critical
 					{
-						if (!found_1[k])
-							printf("B1: \t%s -> (none)\n", addr_str);
+						if (!buf->found[j])
+							printf("%s: \t%s -> (none)\n", w->name, addr_str);
 						else
-							printf("B1: \t%s -> %s.\n", addr_str, next_hop_str);
+							printf("%s: \t%s -> %s.\n", w->name, addr_str, next_hop_str);
 					}
 				}
 				#endif
-			} else {
-				#pragma offload_transfer target(mic:0) if(i < mic_count) \
-					in(addresses[(i % len):buffer_len] : into(addresses_1[0:buffer_len]) alloc_if(0) free_if(0)) \
-					signal(addresses_1)
-
-				#pragma offload target(mic:0) \
-					wait(addresses_2) \
-					nocopy(addresses_2 : length(buffer_len) alloc_if(0) free_if(0)) \
-					out(found_2 : length(buffer_len) alloc_if(0) free_if(0)) \
-					out(next_hops_2 : length(buffer_len) alloc_if(0) free_if(0))
-				{
-					/* 
-					 * IMPORTANT: `buffer_len` must be a multiple of
-					 * 16 so that this loop works correctly!
-					 */
-					#pragma omp parallel for schedule(dynamic, 1) num_threads(244)
-					for (unsigned long i = 0; i < buffer_len; i += 16) {
-						lookup_address_intrin(&addresses_2[i], &found_2[i], &next_hops_2[i]);
-					}
-				}
 
-				#ifndef NDEBUG
-				for (int k = 0; k < buffer_len; k++) {
-					/* I/O. */
-					straddr(addresses[((i - buffer_len) % len) + k], addr_str);
-					straddr(next_hops_2[k], next_hop_str);
-					#pragma omp critical
-					{
-						if (!found_2[k])
-							printf("B2: \t%s -> (none)\n", addr_str);
-						else
-							printf("B2: \t%s -> %s.\n", addr_str, next_hop_str);
-					}
-				}
-				#endif
+				batch_len[b] = 0;
+				if (--in_flight == 0)
+					busy_time += now;
 			}
+
+			size_t start, n = work_queue_take_offload(&wq,
+					w->max_batch, &start);
+			if (n == 0) {
+				if (in_flight == 0)
+					break;
+				continue;  /* Drain the other buffers first. */
+			}
+
+			/* Stage the batch, padded to full vectors. */
+			size_t padded = (n + 15) & ~(size_t)15;
+			for (size_t j = 0; j < n; j++)
+				buf->addrs[j] = addresses[(start + j) % len];
+			for (size_t j = n; j < padded; j++)
+				buf->addrs[j] = 0;
+
+			if (in_flight == 0)
+				busy_time -= omp_get_wtime();
+			w->transfer(w, b, padded);
+			w->launch(w, b);
+			batch_len[b] = n;
+			in_flight++;
 		}
-//		mic_exec_time = omp_get_wtime() - mic_exec_time;
 	}
 
-	/* CPU */
-	if (omp_get_thread_num() != mic_thread_id) {
-		kmp_affinity_mask_t mask;
-		kmp_create_affinity_mask(&mask);
-		for (int i = 0; i <= max_proc; i++)
-			kmp_set_affinity_mask_proc(i, &mask);
-		kmp_unset_affinity_mask_proc(15, &mask);
-		kmp_unset_affinity_mask_proc(31, &mask);
-		kmp_set_affinity(&mask);
-
-		#pragma omp for schedule(dynamic, 1) nowait
-		for (size_t i = mic_count; i < count; i++) {
+	/* CPU (the worker's thread joins in once it runs out of batches) */
+	size_t start, n;
+	while ((n = work_queue_take_host(&wq, HOST_CHUNK_LEN, &start)) > 0) {
+		for (size_t i = start; i < start + n; i++) {
 			/* Decode address. */
 			uint32_t addr = addresses[i % len];
 
@@ -538,32 +271,24 @@ void forward_async(const char *addrs_path, unsigned long buf_len,
 			}
 		#endif
 		}
-	}
 
+		work_queue_host_done(&wq, n);
+	}
 }
 
-//	cpu_exec_time = omp_get_wtime() - cpu_exec_time;
 	total_exec_time = omp_get_wtime() - total_exec_time;
 
 #ifdef BENCHMARK
-//	printf("%lf", mic_exec_time);
-//	printf("%lf", cpu_exec_time);
 	printf("%lf", total_exec_time);
 #endif
 
+	/* On stderr, so that the bench scripts can keep reading the time. */
+	work_queue_report(&wq, w->name);
+	offload_worker_report(w, busy_time);
+	work_queue_destroy(&wq);
+
 	/* Free allocated memory */
 	_mm_free(addresses);
-	_mm_free(found_1);
-	_mm_free(found_2);
-	_mm_free(next_hops_1);
-	_mm_free(next_hops_2);
-	#pragma offload_transfer target(mic:0) \
-		nocopy(addresses_1 : length(buffer_len) alloc_if(0) free_if(1)) \
-		nocopy(addresses_2 : length(buffer_len) alloc_if(0) free_if(1)) \
-		nocopy(found_1 : length(buffer_len) alloc_if(0) free_if(1)) \
-		nocopy(found_2 : length(buffer_len) alloc_if(0) free_if(1)) \
-		nocopy(next_hops_1 : length(buffer_len) alloc_if(0) free_if(1)) \
-		nocopy(next_hops_2 : length(buffer_len) alloc_if(0) free_if(1))
 }
 
 static inline int contains(int argc, char *argv[], const char *option)
@@ -579,13 +304,58 @@ static inline int contains(int argc, char *argv[], const char *option)
 	return index;
 }
 
+/*
+ * Option: -w <mic|target|local>. The Xeon Phi worker is the default when built by
+ * an offload compiler, and the local one otherwise.
+ */
+static const char *worker_option(int argc, char *argv[])
+{
+	int index = contains(argc, argv, "-w");
+
+	if (index == -1) {
+#ifdef __INTEL_OFFLOAD
+		return "mic";
+#else
+		return "local";
+#endif
+	}
+
+	if (index + 1 >= argc) {
+		print_usage(argv);
+		exit(1);
+	}
+
+	const char *worker = argv[index + 1];
+	if (!STREQ(worker, "mic") && !STREQ(worker, "target") &&
+	    !STREQ(worker, "local")) {
+		fprintf(stderr, "Unknown offload worker: '%s'.\n", worker);
+		exit(1);
+	}
+
+#ifndef __INTEL_OFFLOAD
+	if (STREQ(worker, "mic")) {
+		fprintf(stderr, "The 'mic' worker requires an offload compiler.\n");
+		exit(1);
+	}
+#endif
+
+#if !defined(_OPENMP) || _OPENMP < 201511
+	if (STREQ(worker, "target")) {
+		fprintf(stderr, "The 'target' worker requires OpenMP 4.5.\n");
+		exit(1);
+	}
+#endif
+
+	return worker;
+}
+
 /* Options:
  * 	CPU:
  * 		-d <distrib file>
- * 	MIC:
+ * 	MIC (only for the 'mic' worker):
  * 		-D <distrib file>
  */
-static void allocate_forwarding_table(int argc, char *argv[])
+static void allocate_forwarding_table(int argc, char *argv[], bool mic)
 {
 	int index_d;
 	int index_D;
@@ -593,23 +363,50 @@ static void allocate_forwarding_table(int argc, char *argv[])
 	index_d = contains(argc, argv, "-d");
 	index_D = contains(argc, argv, "-D");
 
-	if (index_d != -1 && index_D != -1) {
-		if (index_d + 1 < argc && index_D + 1 < argc) {
-			const char *path_d = argv[index_d + 1];
-			const char *path_D = argv[index_D + 1];
-			/* CPU */
-			init_fwtbl(path_d, NULL);
-			/* MIC */
-#pragma offload target(mic:0) in(path_D)
-			init_fwtbl(path_D, NULL);
-		} else {
-			print_usage(argv);
-			exit(1);
-		}
-	} else {
+	if (index_d == -1 || index_d + 1 >= argc ||
+	    (mic && (index_D == -1 || index_D + 1 >= argc))) {
 		print_usage(argv);
 		exit(1);
 	}
+
+	const char *path_d = argv[index_d + 1];
+	/* CPU */
+	init_fwtbl(path_d, NULL);
+#ifdef __INTEL_OFFLOAD
+	if (mic) {
+		const char *path_D = argv[index_D + 1];
+		/* MIC */
+#pragma offload target(mic:0) in(path_D)
+		init_fwtbl(path_D, NULL);
+	}
+#endif
+}
+
+/*
+ * Load the prefixes file given by option 'opt' on CPU and, if 'mic', the one
+ * given by option 'mic_opt' on MIC.
+ */
+static void load_prefixes_files(int argc, char *argv[], const char *opt,
+		const char *mic_opt, bool mic)
+{
+	int index = contains(argc, argv, opt);
+	int mic_index = contains(argc, argv, mic_opt);
+
+	if (index == -1 || index + 1 >= argc ||
+	    (mic && (mic_index == -1 || mic_index + 1 >= argc)))
+		return;
+
+	const char *path = argv[index + 1];
+	/* CPU */
+	load_prefixes(path);
+#ifdef __INTEL_OFFLOAD
+	if (mic) {
+		const char *mic_path = argv[mic_index + 1];
+		/* MIC */
+#pragma offload target(mic:0) in(mic_path)
+		load_prefixes(mic_path);
+	}
+#endif
 }
 
 /* Options:
@@ -617,127 +414,120 @@ static void allocate_forwarding_table(int argc, char *argv[])
  * 		-dla <DLA file>
  * 		-g1  <G1 file>
  * 		-g2  <G2 file>
- * 	MIC:
+ * 	MIC (only for the 'mic' worker):
  * 		-DLA <DLA file>
  * 		-G1  <G1 file>
  * 		-G2  <G2 file>
  */
-static void initialize_forwarding_table(int argc, char *argv[])
+static void initialize_forwarding_table(int argc, char *argv[], bool mic)
 {
-	int index_dla, index_g1, index_g2;
-	int index_DLA, index_G1, index_G2;
-
-	index_dla = contains(argc, argv, "-dla");
-	index_g1 = contains(argc, argv, "-g1");
-	index_g2 = contains(argc, argv, "-g2");
-	index_DLA = contains(argc, argv, "-DLA");
-	index_G1 = contains(argc, argv, "-G1");
-	index_G2 = contains(argc, argv, "-G2");
-
-	if (index_dla != -1 && index_g1 != -1 && index_g2 != -1 &&
-	    index_DLA != -1 && index_G1 != -1 && index_G2 != -1) {
-		if (index_dla + 1 < argc && index_DLA + 1 < argc) {
-			const char *path_dla = argv[index_dla + 1];
-			const char *path_DLA = argv[index_DLA + 1];
-			/* CPU */
-			load_prefixes(path_dla);
-			/* MIC */
-#pragma offload target(mic:0) in(path_DLA)
-			load_prefixes(path_DLA);
-		}
-		if (index_g1 + 1 < argc && index_G1 + 1 < argc) {
-			const char *path_g1 = argv[index_g1 + 1];
-			const char *path_G1 = argv[index_G1 + 1];
-			/* CPU */
-			load_prefixes(path_g1);
-			/* MIC */
-#pragma offload target(mic:0) in(path_G1)
-			load_prefixes(path_G1);
-		}
-		if (index_g2 + 1 < argc && index_G2 + 1 < argc) {
-			const char *path_g2 = argv[index_g2 + 1];
-			const char *path_G2 = argv[index_G2 + 1];
-			/* CPU */
-			load_prefixes(path_g2);
-			/* MIC */
-#pragma offload target(mic:0) in(path_G2)
-			load_prefixes(path_G2);
-		}
+	load_prefixes_files(argc, argv, "-dla", "-DLA", mic);
+	load_prefixes_files(argc, argv, "-g1", "-G1", mic);
+	load_prefixes_files(argc, argv, "-g2", "-G2", mic);
+}
+
+/*
+ * Return the value of option 'opt' as an unsigned integer, or 'def' if it's
+ * not given.
+ */
+static unsigned long ulong_option(int argc, char *argv[], const char *opt,
+		unsigned long def)
+{
+	int index = contains(argc, argv, opt);
+
+	if (index == -1)
+		return def;
+
+	if (index + 1 >= argc) {
+		print_usage(argv);
+		exit(1);
 	}
+
+	return strtoul(argv[index + 1], NULL, 10);
 }
 
 /* Options:
  * 	Both CPU and MIC:
  * 		-r <address file> 
  * 		[-n <number of addresses to forward>]
+ * 		[-b <batch length>]
+ * 		[-B <buffers in flight>]
+ * 		[-z <offload ratio>]
+ * 		[-c <CPU of the thread driving the worker>]
+ * 	Local worker:
+ * 		[-T <threads>]
+ * 		[-L <latency per batch in microseconds>]
  */
-static void run(int argc, char *argv[])
+static void run(int argc, char *argv[], const char *worker)
 {
-	int index_r, index_b, index_n, index_z;
+	int index_r, index_z, index_c;
 
 	index_r = contains(argc, argv, "-r");
-	index_b = contains(argc, argv, "-b");
-	index_n = contains(argc, argv, "-n");
 	index_z = contains(argc, argv, "-z");
+	index_c = contains(argc, argv, "-c");
 
 	if (index_r != -1) {
 		if (index_r + 1 < argc) {
-			size_t buffer_len = 0;
-			index_b = contains(argc, argv, "-b");
-			if (index_b != -1) {
-				if (index_b + 1 < argc) {
-					buffer_len = (size_t)strtoul(argv[index_b + 1], NULL, 10);
+			/* 
+			 * The batch length must be a multiple of 16 and
+			 * optimally a multiple of 244 threads * 16 addresses =
+			 * 3904 for better resource usage on Phi.
+			 */
+			size_t buffer_len = ulong_option(argc, argv, "-b", 3904);
+			unsigned long count = ulong_option(argc, argv, "-n", 0);
+
+			/* Adaptive split, unless a fixed ratio is given. */
+			double offload_ratio = -1.0;
+			if (index_z != -1) {
+				if (index_z + 1 < argc) {
+					offload_ratio = strtod(argv[index_z + 1], NULL);
 				} else {
 					print_usage(argv);
 					exit(1);
 				}
-			}
 
-			unsigned long count = 0;
-			index_n = contains(argc, argv, "-n");
-			if (index_n != -1) {
-				if (index_n + 1 < argc) {
-					count = strtoul(argv[index_n + 1], NULL, 10);
-				} else {
-					print_usage(argv);
-					exit(1);
-				}
+				if (offload_ratio < 0.0)
+					offload_ratio = 0.0;
+
+				if (offload_ratio > 1.0)
+					offload_ratio = 1.0;
 			}
 
-			double mic_ratio = 0.9;
-			if (index_z != -1) {
-				if (index_z + 1 < argc) {
-					mic_ratio = strtod(argv[index_z + 1], NULL);
+			int worker_cpu = -1;
+			if (index_c != -1) {
+				if (index_c + 1 < argc) {
+					worker_cpu = atoi(argv[index_c + 1]);
 				} else {
 					print_usage(argv);
 					exit(1);
 				}
-
-				if (mic_ratio < 0.0)
-					mic_ratio = 0.0;
-
-				if (mic_ratio > 1.0)
-					mic_ratio = 1.0;
 			}
 
 			const char *path_r = argv[index_r + 1];
-#ifdef ASYNC_OFFLOAD
-//			double numers[] = { 3.0, 4.0, 5.0, 6.0, 7.0, 9.0, 10.0, 12.0, 15.0, 21.0, 1.0 };
-//			double denoms[] = { 4.0, 5.0, 6.0, 7.0, 8.0, 10.0, 11.0, 13.0, 16.0, 22.0, 1.0 };
-//			size_t len = 11;
-//			for (int i = 0; i < len; i++) {
-//				double mic_ratio = numers[i] / denoms[i];
-//				for (int j = 0; j < 3; j++) {
-//					forward_async(path_r, buffer_len, count, mic_ratio);
-//					printf(" ");
-//				}
-//				printf("\n");
-//			}
-//
-			forward_async(path_r, buffer_len, count, mic_ratio);
-#else
-			forward(path_r, buffer_len, count, mic_ratio);
+			int num_buffers = ulong_option(argc, argv, "-B",
+					OFFLOAD_BUFFERS);
+
+			struct offload_worker *w;
+#ifdef __INTEL_OFFLOAD
+			if (STREQ(worker, "mic"))
+				w = new_mic_worker(buffer_len, num_buffers);
+			else
+#endif
+#if defined(_OPENMP) && _OPENMP >= 201511
+			if (STREQ(worker, "target"))
+				w = new_target_worker(buffer_len, num_buffers,
+						omp_get_default_device());
+			else
 #endif
+				w = new_local_worker(buffer_len, num_buffers,
+						ulong_option(argc, argv, "-T", 1),
+						ulong_option(argc, argv, "-L", 0));
+
+			if (w->load_table != NULL)
+				w->load_table(w);
+
+			forward(path_r, w, count, offload_ratio, worker_cpu);
+			free_offload_worker(w);
 		} else {
 			print_usage(argv);
 			exit(1);
@@ -754,11 +544,12 @@ int main(int argc, char *argv[])
 		return 0;
 	}
 
+	const char *worker = worker_option(argc, argv);
+	bool mic = STREQ(worker, "mic");
 
-	allocate_forwarding_table(argc, argv);  /* Prefixes distrib. */
-	initialize_forwarding_table(argc, argv);  /* Load prefixes. */
-	run(argc, argv);  /* Dry-run only. */
+	allocate_forwarding_table(argc, argv, mic);  /* Prefixes distrib. */
+	initialize_forwarding_table(argc, argv, mic);  /* Load prefixes. */
+	run(argc, argv, worker);  /* Dry-run only. */
 
 	return 0;
 }
-
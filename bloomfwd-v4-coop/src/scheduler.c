@@ -0,0 +1,129 @@
+/*
+ * scheduler.c
+ */
+
+#include <stdio.h>
+
+#include "scheduler.h"
+
+/* Weight of the last batch in the worker's moving average throughput. */
+#define OFFLOAD_RATE_WEIGHT 0.25
+
+void work_queue_init(struct work_queue *wq, size_t count, double offload_ratio)
+{
+	wq->head = 0;
+	wq->tail = count;
+	wq->adaptive = offload_ratio < 0.0;
+	wq->split = wq->adaptive ? 0 : offload_ratio * count;
+	omp_init_lock(&wq->lock);
+
+	wq->start_time = omp_get_wtime();
+	wq->host_done = 0;
+	wq->offload_claimed = 0;
+	wq->offload_done = 0;
+	wq->offload_batches = 0;
+	wq->offload_time = 0.0;
+	wq->offload_rate = 0.0;
+}
+
+void work_queue_destroy(struct work_queue *wq)
+{
+	omp_destroy_lock(&wq->lock);
+}
+
+static inline size_t min_size(size_t a, size_t b)
+{
+	return a < b ? a : b;
+}
+
+size_t work_queue_take_offload(struct work_queue *wq, size_t max_batch,
+		size_t *start)
+{
+	size_t n;
+
+	omp_set_lock(&wq->lock);
+
+	if (!wq->adaptive) {
+		n = wq->head < wq->split ? min_size(max_batch, wq->split - wq->head) : 0;
+	} else {
+		/*
+		 * Take the share of the remaining addresses that the worker
+		 * finishes at the same time as the host threads finish the rest
+		 * (half of them until both throughputs are known). The batches
+		 * in flight count as part of the worker's share.
+		 */
+		double elapsed = omp_get_wtime() - wq->start_time;
+		double host_rate = wq->host_done > 0 && elapsed > 0.0 ?
+			wq->host_done / elapsed : 0.0;
+		double share = 0.5;
+		if (wq->offload_rate > 0.0 && host_rate > 0.0)
+			share = wq->offload_rate / (wq->offload_rate + host_rate);
+
+		size_t pending = wq->offload_claimed - wq->offload_done;
+		double target = (wq->tail - wq->head + pending) * share;
+		n = target > pending ?
+			min_size(max_batch, target - pending) : 0;
+		n -= n % 16;  /* Full vectors only: the host takes the leftovers. */
+	}
+
+	*start = wq->head;
+	wq->head += n;
+	wq->offload_claimed += n;
+
+	omp_unset_lock(&wq->lock);
+
+	return n;
+}
+
+void work_queue_offload_done(struct work_queue *wq, size_t n, double seconds)
+{
+	omp_set_lock(&wq->lock);
+
+	wq->offload_done += n;
+	wq->offload_batches++;
+	wq->offload_time += seconds;
+	if (seconds > 0.0) {
+		double rate = n / seconds;
+		wq->offload_rate = wq->offload_rate == 0.0 ? rate :
+			(1.0 - OFFLOAD_RATE_WEIGHT) * wq->offload_rate +
+			OFFLOAD_RATE_WEIGHT * rate;
+	}
+
+	omp_unset_lock(&wq->lock);
+}
+
+size_t work_queue_take_host(struct work_queue *wq, size_t chunk_len,
+		size_t *start)
+{
+	omp_set_lock(&wq->lock);
+
+	size_t low = wq->adaptive ? wq->head : wq->split;
+	size_t n = wq->tail > low ? min_size(chunk_len, wq->tail - low) : 0;
+	wq->tail -= n;
+	*start = wq->tail;
+
+	omp_unset_lock(&wq->lock);
+
+	return n;
+}
+
+void work_queue_host_done(struct work_queue *wq, size_t n)
+{
+	#pragma omp atomic
+	wq->host_done += n;
+}
+
+void work_queue_report(struct work_queue *wq, const char *worker_name)
+{
+	double elapsed = omp_get_wtime() - wq->start_time;
+	size_t total = wq->offload_done + wq->host_done;
+
+	fprintf(stderr, "Offload (%s): %zu addresses (%.2lf%%) in %zu batches, %.0lf addresses/s; host: %zu addresses, %.0lf addresses/s.\n",
+			worker_name, wq->offload_done,
+			total > 0 ? 100.0 * wq->offload_done / total : 0.0,
+			wq->offload_batches,
+			wq->offload_time > 0.0 ?
+				wq->offload_done / wq->offload_time : 0.0,
+			wq->host_done,
+			elapsed > 0.0 ? wq->host_done / elapsed : 0.0);
+}
@@ -0,0 +1,71 @@
+/*
+ * scheduler.h
+ *
+ * Splits the addresses to forward between the host threads and the offload
+ * worker. The unclaimed addresses form a range [head, tail): the worker claims
+ * batches from the front and the host threads claim small chunks from the back,
+ * so each side keeps stealing work from the other until they meet.
+ *
+ * The worker's batches are sized online. The throughput of each side is
+ * measured as chunks complete, and the worker only claims the share of the
+ * remaining addresses (counting its batches still in flight) it is expected to
+ * finish by the time the host finishes the rest. With a fixed ratio instead,
+ * the split is static (no stealing).
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <omp.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct work_queue {
+	size_t head;  /* First unclaimed address. */
+	size_t tail;  /* One past the last unclaimed address. */
+	bool adaptive;
+	size_t split;  /* Static split point (the worker gets [0, split)). */
+	omp_lock_t lock;
+
+	double start_time;
+	size_t host_done;
+	size_t offload_claimed;  /* Including the batches still in flight. */
+	size_t offload_done;
+	size_t offload_batches;
+	double offload_time;  /* Seconds spent by the worker on its batches. */
+	double offload_rate;  /* Moving average (addresses per second). */
+};
+
+/*
+ * Schedule 'count' addresses. If 'offload_ratio' is negative, split them
+ * adaptively; otherwise, the worker gets the first 'offload_ratio' of them.
+ */
+void work_queue_init(struct work_queue *wq, size_t count, double offload_ratio);
+
+void work_queue_destroy(struct work_queue *wq);
+
+/*
+ * Claim up to 'max_batch' addresses for the worker. Return the number of
+ * addresses claimed and set '*start'. The worker should stop when it gets 0
+ * with no batches in flight.
+ */
+size_t work_queue_take_offload(struct work_queue *wq, size_t max_batch,
+		size_t *start);
+
+/*
+ * Report that the worker finished a batch of 'n' addresses 'seconds' after
+ * the previous one (or after it was submitted, if later). With several batches
+ * in flight, that is the throughput of the whole pipeline.
+ */
+void work_queue_offload_done(struct work_queue *wq, size_t n, double seconds);
+
+/* Like 'work_queue_take_offload()', for the host threads. */
+size_t work_queue_take_host(struct work_queue *wq, size_t chunk_len,
+		size_t *start);
+
+void work_queue_host_done(struct work_queue *wq, size_t n);
+
+/* Print the split and the throughput of both sides to stderr. */
+void work_queue_report(struct work_queue *wq, const char *worker_name);
+
+#endif
@@ -0,0 +1,605 @@
+/*
+ * worker.c
+ */
+
+#define _POSIX_C_SOURCE 200112L  /* nanosleep() */
+
+#include <immintrin.h>  /* _mm_malloc(), _mm_free() */
+#include <omp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bloomfwd_opt.h"
+#include "worker.h"
+
+static struct offload_worker *new_offload_worker(const char *name,
+		size_t max_batch, int num_buffers)
+{
+	if (max_batch == 0 || max_batch % 16 != 0) {
+		fprintf(stderr, "worker.new_offload_worker: Batch length must be a positive multiple of 16.\n");
+		exit(1);
+	}
+
+	if (num_buffers < 1) {
+		fprintf(stderr, "worker.new_offload_worker: Invalid number of buffers: %d.\n",
+				num_buffers);
+		exit(1);
+	}
+
+	struct offload_worker *w = malloc(sizeof(struct offload_worker));
+	if (w != NULL)
+		w->buffers = malloc(num_buffers * sizeof(struct offload_buffer));
+	if (w == NULL || w->buffers == NULL) {
+		fprintf(stderr, "worker.new_offload_worker: Couldn't malloc worker.\n");
+		exit(1);
+	}
+
+	w->name = name;
+	w->max_batch = max_batch;
+	w->num_buffers = num_buffers;
+	for (int b = 0; b < num_buffers; b++) {
+		struct offload_buffer *buf = &w->buffers[b];
+		buf->addrs = _mm_malloc(max_batch * sizeof(uint32_t), 64);
+		buf->found = _mm_malloc(max_batch * sizeof(bool), 64);
+		buf->next_hops = _mm_malloc(max_batch * sizeof(uint32_t), 64);
+		if (buf->addrs == NULL || buf->found == NULL ||
+				buf->next_hops == NULL) {
+			fprintf(stderr, "worker.new_offload_worker: Couldn't allocate buffers of %zu addresses.\n",
+					max_batch);
+			exit(1);
+		}
+		buf->len = 0;
+		buf->submit_time = 0.0;
+		buf->device_time = 0.0;
+	}
+	w->load_table = NULL;
+	w->data = NULL;
+	w->transfer_time = 0.0;
+	w->compute_time = 0.0;
+
+	return w;
+}
+
+void free_offload_worker(struct offload_worker *w)
+{
+	if (w->free != NULL)
+		w->free(w);
+
+	for (int b = 0; b < w->num_buffers; b++) {
+		_mm_free(w->buffers[b].addrs);
+		_mm_free(w->buffers[b].found);
+		_mm_free(w->buffers[b].next_hops);
+	}
+	free(w->buffers);
+	free(w->data);
+	free(w);
+}
+
+void offload_worker_report(struct offload_worker *w, double busy_time)
+{
+	/*
+	 * Without overlap, the worker is busy for the sum of both times: report
+	 * how much of it was hidden (at most 1 - 1/#stages, with equal stages).
+	 */
+	double serial_time = w->transfer_time + w->compute_time;
+	double overlap = serial_time > 0.0 ?
+		(serial_time - busy_time) / serial_time : 0.0;
+	if (overlap < 0.0)
+		overlap = 0.0;
+
+	fprintf(stderr, "Offload pipeline (%s, %d buffers): transfers %.6lf s, lookups %.6lf s, busy %.6lf s, %.2lf%% overlap.\n",
+			w->name, w->num_buffers, w->transfer_time,
+			w->compute_time, busy_time, 100.0 * overlap);
+}
+
+#ifdef __INTEL_OFFLOAD
+/*
+ * The copy in is signaled by 'addrs' and the lookup, which waits for it and
+ * copies the results out, by 'found'.
+ */
+static void mic_transfer(struct offload_worker *w, int b, size_t n)
+{
+	struct offload_buffer *buf = &w->buffers[b];
+	uint32_t *addrs = buf->addrs;
+
+	buf->len = n;
+	buf->submit_time = omp_get_wtime();
+
+	#pragma offload_transfer target(mic:0) \
+		in(addrs : length(n) alloc_if(0) free_if(0)) \
+		signal(addrs)
+}
+
+static void mic_launch(struct offload_worker *w, int b)
+{
+	struct offload_buffer *buf = &w->buffers[b];
+	uint32_t *addrs = buf->addrs;
+	bool *found = buf->found;
+	uint32_t *next_hops = buf->next_hops;
+	double *device_time = &buf->device_time;
+	size_t n = buf->len;
+
+	#pragma offload target(mic:0) \
+		wait(addrs) signal(found) \
+		nocopy(addrs : length(n) alloc_if(0) free_if(0)) \
+		out(found : length(n) alloc_if(0) free_if(0)) \
+		out(next_hops : length(n) alloc_if(0) free_if(0)) \
+		out(device_time : length(1))
+	{
+		double t = omp_get_wtime();
+
+		#pragma omp parallel for schedule(dynamic, 1) num_threads(244)
+		for (size_t i = 0; i < n; i += 16)
+			lookup_address_intrin(&addrs[i], &found[i], &next_hops[i]);
+
+		*device_time = omp_get_wtime() - t;
+	}
+}
+
+static void mic_collect(struct offload_worker *w, int b)
+{
+	struct offload_buffer *buf = &w->buffers[b];
+	bool *found = buf->found;
+
+	#pragma offload_wait target(mic:0) wait(found)
+
+	/*
+	 * Only the lookup is timed on the card: the rest of the round trip is
+	 * accounted as transfers (an upper bound, since it also includes the
+	 * time queued behind the other buffers).
+	 */
+	double round_trip = omp_get_wtime() - buf->submit_time;
+	w->compute_time += buf->device_time;
+	if (round_trip > buf->device_time)
+		w->transfer_time += round_trip - buf->device_time;
+}
+
+static void mic_free(struct offload_worker *w)
+{
+	size_t len = w->max_batch;
+
+	for (int b = 0; b < w->num_buffers; b++) {
+		uint32_t *addrs = w->buffers[b].addrs;
+		bool *found = w->buffers[b].found;
+		uint32_t *next_hops = w->buffers[b].next_hops;
+
+		#pragma offload_transfer target(mic:0) \
+			nocopy(addrs : length(len) alloc_if(0) free_if(1)) \
+			nocopy(found : length(len) alloc_if(0) free_if(1)) \
+			nocopy(next_hops : length(len) alloc_if(0) free_if(1))
+	}
+}
+
+struct offload_worker *new_mic_worker(size_t max_batch, int num_buffers)
+{
+	struct offload_worker *w = new_offload_worker("MIC", max_batch,
+			num_buffers);
+	w->transfer = mic_transfer;
+	w->launch = mic_launch;
+	w->collect = mic_collect;
+	w->free = mic_free;
+
+	/* Allocate the buffers on MIC. */
+	for (int b = 0; b < num_buffers; b++) {
+		uint32_t *addrs = w->buffers[b].addrs;
+		bool *found = w->buffers[b].found;
+		uint32_t *next_hops = w->buffers[b].next_hops;
+
+		#pragma offload_transfer target(mic:0) \
+			nocopy(addrs : length(max_batch) alloc_if(1) free_if(0)) \
+			nocopy(found : length(max_batch) alloc_if(1) free_if(0)) \
+			nocopy(next_hops : length(max_batch) alloc_if(1) free_if(0))
+	}
+
+	return w;
+}
+#endif
+
+#if defined(_OPENMP) && _OPENMP >= 201511
+/*
+ * The staging buffers are mapped on the device once, and each batch is a chain
+ * of target tasks (copy in, lookup) ordered by a dependence on its buffer, so
+ * that the chains of different buffers can overlap. The copy out is undeferred:
+ * it waits for the lookup of its buffer only (OpenMP 4.5 has no 'taskwait
+ * depend').
+ */
+struct target_worker {
+	int device;
+	struct flat_forwarding_table *host_table;
+	struct flat_forwarding_table table;  /* With the device's pointers. */
+};
+
+static void *new_device_copy(const void *src, size_t size, int device)
+{
+	void *dst = omp_target_alloc(size > 0 ? size : 1, device);
+	if (dst == NULL) {
+		fprintf(stderr, "worker.new_device_copy: Couldn't allocate %zu bytes on device %d.\n",
+				size, device);
+		exit(1);
+	}
+
+	if (size > 0 && omp_target_memcpy(dst, (void *)src, size, 0, 0,
+				device, omp_get_initial_device()) != 0) {
+		fprintf(stderr, "worker.new_device_copy: Couldn't copy %zu bytes to device %d.\n",
+				size, device);
+		exit(1);
+	}
+
+	return dst;
+}
+
+static void target_load_table(struct offload_worker *w)
+{
+	struct target_worker *tw = w->data;
+	struct flat_forwarding_table *host = new_flat_forwarding_table();
+	struct flat_forwarding_table *dev = &tw->table;
+	int d = tw->device;
+
+	*dev = *host;
+	dev->dla = new_device_copy(host->dla, FLAT_DLA_LEN * sizeof(uint32_t), d);
+	for (int i = 0; i < 2; i++) {
+		dev->bitmaps[i] = new_device_copy(host->bitmaps[i],
+				host->bitmap_len[i] * sizeof(bool), d);
+		dev->slot_start[i] = new_device_copy(host->slot_start[i],
+				(host->range[i] + 1) * sizeof(uint32_t), d);
+		dev->entries[i] = new_device_copy(host->entries[i],
+				host->total[i] * sizeof(struct flat_hash_table_entry), d);
+	}
+	tw->host_table = host;
+}
+
+static void target_transfer(struct offload_worker *w, int b, size_t n)
+{
+	struct target_worker *tw = w->data;
+	struct offload_buffer *buf = &w->buffers[b];
+
+	buf->len = n;
+	buf->submit_time = omp_get_wtime();
+
+	#pragma omp target update device(tw->device) to(buf->addrs[0:n]) \
+		nowait depend(inout: buf[0])
+}
+
+static void target_launch(struct offload_worker *w, int b)
+{
+	struct target_worker *tw = w->data;
+	struct offload_buffer *buf = &w->buffers[b];
+	struct flat_forwarding_table table = tw->table;
+	uint32_t *addrs = buf->addrs;
+	bool *found = buf->found;
+	uint32_t *next_hops = buf->next_hops;
+	size_t n = buf->len;
+
+	#pragma omp target teams distribute parallel for device(tw->device) \
+		firstprivate(table) \
+		map(alloc: addrs[0:n], found[0:n], next_hops[0:n]) \
+		nowait depend(inout: buf[0])
+	for (size_t i = 0; i < n; i++)
+		found[i] = lookup_address_flat(&table, addrs[i], &next_hops[i]);
+}
+
+static void target_collect(struct offload_worker *w, int b)
+{
+	struct target_worker *tw = w->data;
+	struct offload_buffer *buf = &w->buffers[b];
+	size_t n = buf->len;
+
+	#pragma omp target update device(tw->device) \
+		from(buf->found[0:n], buf->next_hops[0:n]) depend(inout: buf[0])
+
+	w->compute_time += omp_get_wtime() - buf->submit_time;
+}
+
+static void target_free(struct offload_worker *w)
+{
+	struct target_worker *tw = w->data;
+	int d = tw->device;
+	size_t len = w->max_batch;
+
+	for (int b = 0; b < w->num_buffers; b++) {
+		#pragma omp target exit data device(d) \
+			map(delete: w->buffers[b].addrs[0:len], \
+					w->buffers[b].found[0:len], \
+					w->buffers[b].next_hops[0:len])
+	}
+
+	if (tw->host_table != NULL) {
+		omp_target_free(tw->table.dla, d);
+		for (int i = 0; i < 2; i++) {
+			omp_target_free(tw->table.bitmaps[i], d);
+			omp_target_free(tw->table.slot_start[i], d);
+			omp_target_free(tw->table.entries[i], d);
+		}
+		free_flat_forwarding_table(tw->host_table);
+	}
+}
+
+struct offload_worker *new_target_worker(size_t max_batch, int num_buffers,
+		int device)
+{
+	if (device < 0 || device >= omp_get_num_devices()) {
+		fprintf(stderr, "worker.new_target_worker: Invalid device: %d (%d available).\n",
+				device, omp_get_num_devices());
+		exit(1);
+	}
+
+	struct offload_worker *w = new_offload_worker("TARGET", max_batch,
+			num_buffers);
+	w->load_table = target_load_table;
+	w->transfer = target_transfer;
+	w->launch = target_launch;
+	w->collect = target_collect;
+	w->free = target_free;
+
+	struct target_worker *tw = malloc(sizeof(struct target_worker));
+	if (tw == NULL) {
+		fprintf(stderr, "worker.new_target_worker: Couldn't malloc worker.\n");
+		exit(1);
+	}
+	tw->device = device;
+	tw->host_table = NULL;
+	w->data = tw;
+
+	/* Allocate the buffers on the device. */
+	for (int b = 0; b < num_buffers; b++) {
+		#pragma omp target enter data device(device) \
+			map(alloc: w->buffers[b].addrs[0:max_batch], \
+					w->buffers[b].found[0:max_batch], \
+					w->buffers[b].next_hops[0:max_batch])
+	}
+
+	return w;
+}
+#endif
+
+/*
+ * The local worker is a virtual device: a queue of three stages (copy in,
+ * lookup and copy out), each run by its own thread, like the copy and compute
+ * engines of a device, with memory of its own. The i-th transferred batch sits
+ * at 'order[i % num_buffers]' and has gone through stage 's' once
+ * 'stage_done[s] > i'; it is looked up once it has also been launched.
+ */
+#define LOCAL_STAGES 3
+
+struct local_stage {
+	struct offload_worker *w;
+	int stage;
+	pthread_t thread;
+};
+
+struct local_worker {
+	int num_threads;
+	unsigned long latency_us;
+
+	/* Device memory. */
+	struct flat_forwarding_table *table;
+	struct offload_buffer *buffers;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool stop;
+	unsigned long transferred;
+	unsigned long launched;
+	unsigned long stage_done[LOCAL_STAGES];
+	int *order;
+	unsigned long *ticket;  /* Transfer number of each buffer. */
+	struct local_stage stages[LOCAL_STAGES];
+};
+
+static void sleep_us(unsigned long us)
+{
+	if (us == 0)
+		return;
+
+	struct timespec ts;
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = (us % 1000000) * 1000;
+	nanosleep(&ts, NULL);
+}
+
+static void local_run_stage(struct offload_worker *w, int s, int b)
+{
+	struct local_worker *lw = w->data;
+	struct offload_buffer *buf = &w->buffers[b];
+	struct offload_buffer *dev = &lw->buffers[b];
+	size_t n = buf->len;
+
+	switch (s) {
+	case 0:
+		memcpy(dev->addrs, buf->addrs, n * sizeof(uint32_t));
+		sleep_us(lw->latency_us / 2);
+		break;
+	case 1:
+		#pragma omp parallel for schedule(static) num_threads(lw->num_threads)
+		for (size_t i = 0; i < n; i++)
+			dev->found[i] = lookup_address_flat(lw->table,
+					dev->addrs[i], &dev->next_hops[i]);
+		break;
+	default:
+		memcpy(buf->found, dev->found, n * sizeof(bool));
+		memcpy(buf->next_hops, dev->next_hops, n * sizeof(uint32_t));
+		sleep_us(lw->latency_us / 2);
+		break;
+	}
+}
+
+static void *local_stage_run(void *arg)
+{
+	struct local_stage *ls = arg;
+	struct offload_worker *w = ls->w;
+	struct local_worker *lw = w->data;
+	int s = ls->stage;
+
+	pthread_mutex_lock(&lw->lock);
+	for (;;) {
+		unsigned long ready = s == 0 ? lw->transferred :
+			lw->stage_done[s - 1];
+		if (s == 1 && lw->launched < ready)
+			ready = lw->launched;
+		if (lw->stage_done[s] == ready) {
+			if (lw->stop)
+				break;
+			pthread_cond_wait(&lw->cond, &lw->lock);
+			continue;
+		}
+
+		int b = lw->order[lw->stage_done[s] % w->num_buffers];
+		pthread_mutex_unlock(&lw->lock);
+
+		double t = omp_get_wtime();
+		local_run_stage(w, s, b);
+		t = omp_get_wtime() - t;
+
+		pthread_mutex_lock(&lw->lock);
+		if (s == 1)
+			w->compute_time += t;
+		else
+			w->transfer_time += t;
+		lw->stage_done[s]++;
+		pthread_cond_broadcast(&lw->cond);
+	}
+	pthread_mutex_unlock(&lw->lock);
+
+	return NULL;
+}
+
+static void local_load_table(struct offload_worker *w)
+{
+	struct local_worker *lw = w->data;
+
+	lw->table = new_flat_forwarding_table();
+}
+
+static void local_transfer(struct offload_worker *w, int b, size_t n)
+{
+	struct local_worker *lw = w->data;
+
+	pthread_mutex_lock(&lw->lock);
+	w->buffers[b].len = n;
+	w->buffers[b].submit_time = omp_get_wtime();
+	lw->ticket[b] = lw->transferred;
+	lw->order[lw->transferred % w->num_buffers] = b;
+	lw->transferred++;
+	pthread_cond_broadcast(&lw->cond);
+	pthread_mutex_unlock(&lw->lock);
+}
+
+static void local_launch(struct offload_worker *w, int b)
+{
+	struct local_worker *lw = w->data;
+
+	if (lw->table == NULL) {
+		fprintf(stderr, "worker.local_launch: The table wasn't loaded.\n");
+		exit(1);
+	}
+
+	/* Batches are launched in the order they were transferred. */
+	pthread_mutex_lock(&lw->lock);
+	lw->launched++;
+	pthread_cond_broadcast(&lw->cond);
+	pthread_mutex_unlock(&lw->lock);
+}
+
+static void local_collect(struct offload_worker *w, int b)
+{
+	struct local_worker *lw = w->data;
+
+	pthread_mutex_lock(&lw->lock);
+	while (lw->stage_done[LOCAL_STAGES - 1] <= lw->ticket[b])
+		pthread_cond_wait(&lw->cond, &lw->lock);
+	pthread_mutex_unlock(&lw->lock);
+}
+
+static void local_free(struct offload_worker *w)
+{
+	struct local_worker *lw = w->data;
+
+	pthread_mutex_lock(&lw->lock);
+	lw->stop = true;
+	pthread_cond_broadcast(&lw->cond);
+	pthread_mutex_unlock(&lw->lock);
+
+	for (int s = 0; s < LOCAL_STAGES; s++)
+		pthread_join(lw->stages[s].thread, NULL);
+
+	pthread_mutex_destroy(&lw->lock);
+	pthread_cond_destroy(&lw->cond);
+	if (lw->table != NULL)
+		free_flat_forwarding_table(lw->table);
+	for (int b = 0; b < w->num_buffers; b++) {
+		_mm_free(lw->buffers[b].addrs);
+		_mm_free(lw->buffers[b].found);
+		_mm_free(lw->buffers[b].next_hops);
+	}
+	free(lw->buffers);
+	free(lw->order);
+	free(lw->ticket);
+}
+
+struct offload_worker *new_local_worker(size_t max_batch, int num_buffers,
+		int num_threads, unsigned long latency_us)
+{
+	if (num_threads < 1) {
+		fprintf(stderr, "worker.new_local_worker: Invalid number of threads: %d.\n",
+				num_threads);
+		exit(1);
+	}
+
+	struct offload_worker *w = new_offload_worker("LOCAL", max_batch,
+			num_buffers);
+	w->load_table = local_load_table;
+	w->transfer = local_transfer;
+	w->launch = local_launch;
+	w->collect = local_collect;
+	w->free = local_free;
+
+	struct local_worker *lw = malloc(sizeof(struct local_worker));
+	if (lw != NULL) {
+		lw->buffers = malloc(num_buffers * sizeof(struct offload_buffer));
+		lw->order = malloc(num_buffers * sizeof(int));
+		lw->ticket = malloc(num_buffers * sizeof(unsigned long));
+	}
+	if (lw == NULL || lw->buffers == NULL || lw->order == NULL ||
+			lw->ticket == NULL) {
+		fprintf(stderr, "worker.new_local_worker: Couldn't malloc worker.\n");
+		exit(1);
+	}
+	for (int b = 0; b < num_buffers; b++) {
+		struct offload_buffer *dev = &lw->buffers[b];
+		dev->addrs = _mm_malloc(max_batch * sizeof(uint32_t), 64);
+		dev->found = _mm_malloc(max_batch * sizeof(bool), 64);
+		dev->next_hops = _mm_malloc(max_batch * sizeof(uint32_t), 64);
+		if (dev->addrs == NULL || dev->found == NULL ||
+				dev->next_hops == NULL) {
+			fprintf(stderr, "worker.new_local_worker: Couldn't allocate device buffers of %zu addresses.\n",
+					max_batch);
+			exit(1);
+		}
+	}
+	lw->num_threads = num_threads;
+	lw->latency_us = latency_us;
+	lw->table = NULL;
+	pthread_mutex_init(&lw->lock, NULL);
+	pthread_cond_init(&lw->cond, NULL);
+	lw->stop = false;
+	lw->transferred = 0;
+	lw->launched = 0;
+	for (int s = 0; s < LOCAL_STAGES; s++)
+		lw->stage_done[s] = 0;
+	w->data = lw;
+
+	for (int s = 0; s < LOCAL_STAGES; s++) {
+		lw->stages[s].w = w;
+		lw->stages[s].stage = s;
+		if (pthread_create(&lw->stages[s].thread, NULL, local_stage_run,
+					&lw->stages[s]) != 0) {
+			fprintf(stderr, "worker.new_local_worker: Couldn't create stage thread.\n");
+			exit(1);
+		}
+	}
+
+	return w;
+}
@@ -0,0 +1,102 @@
+/*
+ * worker.h
+ *
+ * The offload worker looks batches of addresses up on behalf of the host. It
+ * is a small device interface (load the table, transfer a batch, launch its
+ * lookup and collect the results) with several backends:
+ *
+ * 	- 'mic': Xeon Phi through Intel LEO (only when built by an offload
+ * 	compiler), which builds its own table from the -D/-DLA/-G1/-G2 files;
+ * 	- 'target': any OpenMP 4.5 'target' device (or the host, if there is
+ * 	none), which gets a flat copy of the table;
+ * 	- 'local': a virtual device run by host threads, with its own flat copy
+ * 	of the table and an injected delay per batch that emulates the PCIe
+ * 	transfers. It lets the cooperative scheduler and the device code path be
+ * 	developed and tested without an accelerator.
+ *
+ * Batches go through the worker in order, each one in one of 'num_buffers'
+ * buffer sets: copy in, look up and copy out. With two or more buffers, the
+ * copy in of a batch overlaps the lookup of the previous one and the copy out
+ * of the one before it.
+ */
+
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct offload_buffer {
+	/*
+	 * Staging buffers of 'max_batch' elements (64-byte aligned): the host
+	 * fills in 'addrs' and reads the results from 'found' and 'next_hops'.
+	 */
+	uint32_t *addrs;
+	bool *found;
+	uint32_t *next_hops;
+
+	size_t len;  /* Addresses transferred (a multiple of 16). */
+	double submit_time;
+	double device_time;  /* Lookup time measured by the device. */
+};
+
+struct offload_worker {
+	const char *name;
+	size_t max_batch;  /* Multiple of 16. */
+	int num_buffers;
+	struct offload_buffer *buffers;
+
+	/* Copy 'fw_tbl' to the device (NULL if the device builds its own). */
+	void (*load_table)(struct offload_worker *w);
+	/*
+	 * Start copying the first 'n' addresses staged in buffer 'b' to the
+	 * device ('n' is a multiple of 16). The buffer must not be in flight.
+	 */
+	void (*transfer)(struct offload_worker *w, int b, size_t n);
+	/*
+	 * Start looking buffer 'b' up once its transfer is done, and copying
+	 * the results back once the lookup is done.
+	 */
+	void (*launch)(struct offload_worker *w, int b);
+	/* Block until the results of buffer 'b' are back on the host. */
+	void (*collect)(struct offload_worker *w, int b);
+	void (*free)(struct offload_worker *w);
+	void *data;
+
+	/* Seconds spent copying batches in and out and looking them up. */
+	double transfer_time;
+	double compute_time;
+};
+
+#ifdef __INTEL_OFFLOAD
+/* The table must already be loaded on 'mic:0'. */
+struct offload_worker *new_mic_worker(size_t max_batch, int num_buffers);
+#endif
+
+#if defined(_OPENMP) && _OPENMP >= 201511
+/*
+ * A worker on OpenMP device 'device'. The stages aren't timed separately: the
+ * round trip of each batch is accounted as lookup time.
+ */
+struct offload_worker *new_target_worker(size_t max_batch, int num_buffers,
+		int device);
+#endif
+
+/*
+ * A virtual device running the lookups on 'num_threads' host threads, which
+ * sleeps 'latency_us' microseconds per batch (half in each transfer).
+ */
+struct offload_worker *new_local_worker(size_t max_batch, int num_buffers,
+		int num_threads, unsigned long latency_us);
+
+void free_offload_worker(struct offload_worker *w);
+
+/*
+ * Print the transfer and lookup times to stderr, and the share of their sum
+ * hidden by overlapping them, given that the worker had batches in flight for
+ * 'busy_time' seconds.
+ */
+void offload_worker_report(struct offload_worker *w, double busy_time);
+
+#endif
@@ -12,10 +12,13 @@ IPV4_ADDRESSES_FILE=data/addresses.txt
 ALGS_PARALLEL=("bloomfwd_par")
 #THREADS=(2 4 8 16 24 32)
 NUM_THREADS=32
-FALSEP_RATIO=(0.01 0.02 0.05 0.1 0.2 0.4 0.8)
+FALSEP_RATIO=(0.001 0.01 0.02 0.05 0.1 0.2 0.4 0.8)
+FILTERS=(OFF ON)  # -DCUCKOO_FILTER: counting Bloom filters, then cuckoo filters.
+BUILD_DIR=build-falsep
 
 SCHED_CHUNKSIZE="dynamic,1"
 OUTPUT_FILE=bench/res-falsep/cpu/lookup_falsep.csv # Benchmark output file.
+MEMORY_FILE=bench/res-falsep/cpu/memory_falsep.txt # Size of the filters.
 
 cd $BLOOMFWD_DIR
 mkdir -p bench/res-falsep/cpu/
@@ -31,7 +34,7 @@ export OMP_NUM_THREADS=$NUM_THREADS
 export OMP_SCHEDULE="$SCHED_CHUNKSIZE"
 
 # Write headers to output file.
-printf "Algorithm, # False Positive Ratio, Execs...\n" >> $OUTPUT_FILE
+printf "Algorithm, Cuckoo filters, # False Positive Ratio, Execs...\n" >> $OUTPUT_FILE
 
 # Write data to output file.
 # Serial
@@ -54,21 +57,27 @@ do
 done
 
 # Parallel
+for f in "${FILTERS[@]}"
+do
+	cmake -S . -B $BUILD_DIR -DBENCHMARK=ON -DCUCKOO_FILTER=$f > /dev/null
+	cmake --build $BUILD_DIR > /dev/null
+
 for a in "${ALGS_PARALLEL[@]}"
 do
 	for t in "${FALSEP_RATIO[@]}"
 	do
-		# Recompile for each ratio.
-		cd build/
-		cmake -DCMAKE_BUILD_TYPE=Release -DBENCHMARK=1 -DFALSE_POSITIVE_RATIO=$t -DHASH_FUNCTION=H2_HASH .. &> /dev/null
-		make &> /dev/null
-		cd ..
-
+		# The ratio of both filters is set at runtime ('-f').
 #		./bin/$a -d $PREFIXES_DISTRIBUTION_FILE \
 #		-p $PREFIXES_FILE -r $IPV4_ADDRESSES_FILE -n 16777216
 
-		printf "$a, $t: "
-		printf "$a, $t" >> $OUTPUT_FILE
+		# The size of the filters is reported along with '-t'.
+		printf "$a, $f, $t: " >> $MEMORY_FILE
+		./bin/$a -d $PREFIXES_DISTRIBUTION_FILE -p $PREFIXES_FILE \
+			-r $IPV4_ADDRESSES_FILE -n 1 -f $t -t 2>&1 > /dev/null | \
+			grep "filters:" >> $MEMORY_FILE
+
+		printf "$a, $f, $t: "
+		printf "$a, $f, $t" >> $OUTPUT_FILE
 			for e in $(seq 1 5)  # Number of times to execute.
 			do
 				# Assure the OpenMP environment variables are set and non-empty.
@@ -77,7 +86,7 @@ do
 
 				# Execute for input size 2^24 (16,777,216).
 				exec_time=$(./bin/$a -d $PREFIXES_DISTRIBUTION_FILE \
-				-p $PREFIXES_FILE -r $IPV4_ADDRESSES_FILE -n 16777216)
+				-p $PREFIXES_FILE -r $IPV4_ADDRESSES_FILE -n 16777216 -f $t)
 
 				printf "."
 				printf ", $exec_time" >> $OUTPUT_FILE
@@ -86,4 +95,5 @@ do
 		printf "\n" >> $OUTPUT_FILE
 	done
 done
+done
 
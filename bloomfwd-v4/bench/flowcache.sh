@@ -0,0 +1,82 @@
+#!/bin/bash
+
+# This script compares 'bloomfwd' with and without the per-thread flow cache
+# (targets 'bloomfwd_opt_par' and 'bloomfwd_opt_par_fc') on random addresses
+# generated by 'ipgen' and on a CAIDA trace (build with -DBENCHMARK=ON). It
+# outputs the execution times and the flow cache hit rates to a file in the CSV
+# format.
+
+# Settings
+PROJECT_DIR=~/Development/c/bloomfwd/bloomfwd-v4/
+IPGEN=../ip-helpers/ipgen  # Build with: cc -o ipgen ipgen.c
+PREFIXES_DISTRIBUTION_FILE=data/opt/distrib.txt
+DLA_FILE=data/opt/dla.txt
+G1_FILE=data/opt/g1.txt
+G2_FILE=data/opt/g2.txt
+RANDOM_ADDRESSES_FILE=data/randomAddrs.txt
+CAIDA_ADDRESSES_FILE=data/caidaAddrs.txt
+ALGS=("bloomfwd_opt_par" "bloomfwd_opt_par_fc")
+THREADS=(1 8 16 32)
+SCHED_CHUNKSIZE="dynamic,64"
+OUTPUT_FILE=bench/res/flowcache/lookup.csv # Benchmark output file.
+
+cd $PROJECT_DIR
+mkdir -p bench/res/flowcache/
+
+# Clean old data files...
+data_files=$(ls bench/res/flowcache)
+if [ ${#data_files} -gt 0 ]; then
+	rm -f bench/res/flowcache/*
+fi
+
+# Generate 2^24 random addresses (no locality at all).
+if [ ! -f $RANDOM_ADDRESSES_FILE ]; then
+	$IPGEN 16777216 > $RANDOM_ADDRESSES_FILE
+fi
+
+export OMP_SCHEDULE="$SCHED_CHUNKSIZE"
+
+# Write headers to output file.
+printf "Trace, Algorithm, # Threads, Execs..., Hit rate\n" >> $OUTPUT_FILE
+
+for trace in "random:$RANDOM_ADDRESSES_FILE" "caida:$CAIDA_ADDRESSES_FILE"
+do
+	name=${trace%%:*}
+	addrs=${trace#*:}
+
+	for a in "${ALGS[@]}"
+	do
+		for t in "${THREADS[@]}"
+		do
+			export OMP_NUM_THREADS=$t
+			printf "$name, $a, $t: "
+			printf "$name, $a, $t" >> $OUTPUT_FILE
+
+			hit_rate="-"
+			for e in $(seq 1 3)  # Number of times to execute.
+			do
+				# Assure the OpenMP environment variables are set and non-empty.
+				: ${OMP_SCHEDULE:?"Need to set OMP_SCHEDULE non-empty."}
+				: ${OMP_NUM_THREADS:?"Need to set OMP_NUM_THREADS non-empty."}
+
+				# Execute for input size 2^26 (67,108,864). The flow
+				# cache statistics are written to stderr.
+				exec_time=$(./bin/$a -d $PREFIXES_DISTRIBUTION_FILE \
+				-dla $DLA_FILE -g1 $G1_FILE -g2 $G2_FILE -r $addrs \
+				-n 67108864 2> bench/res/flowcache/stderr.txt | head -n 1)
+
+				fc_stats=$(grep "Flow cache" bench/res/flowcache/stderr.txt)
+				if [ -n "$fc_stats" ]; then
+					hit_rate=$(echo "$fc_stats" | sed 's/.* \([0-9.]*\)% hit rate.*/\1/')
+				fi
+
+				printf "."
+				printf ", $exec_time" >> $OUTPUT_FILE
+			done
+			printf "\n"
+			printf ", $hit_rate\n" >> $OUTPUT_FILE
+		done
+	done
+done
+
+rm -f bench/res/flowcache/stderr.txt
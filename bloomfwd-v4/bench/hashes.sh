@@ -0,0 +1,44 @@
+#!/bin/bash
+
+# This script runs 'hashbench' (or 'hashbench_avx512', which also times the
+# sixteen-lane functions) on the keys of the G1 and G2 files, for a number of
+# false positive ratios. It outputs, for every hash function, the nanoseconds
+# per hash, the achieved and theoretical false positive ratios of the Bloom
+# filter and the hash table chain lengths to a file in the CSV format (see
+# src/hashbench.c).
+
+# Settings
+PROJECT_DIR=~/Development/c/bloomfwd/bloomfwd-v4/
+HASHBENCH=hashbench_avx512
+G1_FILE=data/opt/g1.txt
+G2_FILE=data/opt/g2.txt
+FALSE_POSITIVE_RATIOS=(0.01 0.1 0.3 0.6)
+OUTPUT_FILE=bench/res/hashes/hashes.csv # Benchmark output file.
+
+cd $PROJECT_DIR
+mkdir -p bench/res/hashes/
+
+# Clean old data files...
+data_files=$(ls bench/res/hashes)
+if [ ${#data_files} -gt 0 ]; then
+	rm -f bench/res/hashes/*
+fi
+
+header=""
+for g in "G1:$G1_FILE" "G2:$G2_FILE"
+do
+	group=${g%%:*}
+	file=${g#*:}
+
+	for f in "${FALSE_POSITIVE_RATIOS[@]}"
+	do
+		printf "$group, $f\n"
+
+		# Prefix every line with the group (and the header with "group").
+		./bin/$HASHBENCH -p $file -f $f $header | \
+			sed -e "1s/^function/group,function/" -e "/^group/!s/^/$group,/" \
+			>> $OUTPUT_FILE
+
+		header="--no-header"  # Only in the first line.
+	done
+done
@@ -0,0 +1,83 @@
+#!/bin/bash
+
+# This script compares 'bloomfwd' with the forwarding table backed by huge
+# pages (default) and by regular pages ('--no-huge-pages'), on random
+# addresses generated by 'ipgen' (build with -DBENCHMARK=ON). It outputs the
+# execution times and the dTLB load misses per lookup ('--tlb-misses', which
+# needs access to the performance counters) to a file in the CSV format.
+
+# Settings
+PROJECT_DIR=~/Development/c/bloomfwd/bloomfwd-v4/
+IPGEN=../ip-helpers/ipgen  # Build with: cc -o ipgen ipgen.c
+PREFIXES_DISTRIBUTION_FILE=data/opt/distrib.txt
+DLA_FILE=data/opt/dla.txt
+G1_FILE=data/opt/g1.txt
+G2_FILE=data/opt/g2.txt
+RANDOM_ADDRESSES_FILE=data/randomAddrs.txt
+ALGS=("bloomfwd_opt_par" "bloomfwd_opt_par_avx512_intrin")
+PAGES=("huge:" "regular:--no-huge-pages")
+THREADS=(1 8 16 32)
+SCHED_CHUNKSIZE="dynamic,64"
+OUTPUT_FILE=bench/res/hugepages/lookup.csv # Benchmark output file.
+
+cd $PROJECT_DIR
+mkdir -p bench/res/hugepages/
+
+# Clean old data files...
+data_files=$(ls bench/res/hugepages)
+if [ ${#data_files} -gt 0 ]; then
+	rm -f bench/res/hugepages/*
+fi
+
+# Generate 2^24 random addresses (no locality at all).
+if [ ! -f $RANDOM_ADDRESSES_FILE ]; then
+	$IPGEN 16777216 > $RANDOM_ADDRESSES_FILE
+fi
+
+export OMP_SCHEDULE="$SCHED_CHUNKSIZE"
+
+# Write headers to output file.
+printf "Pages, Algorithm, # Threads, Execs..., dTLB misses/lookup\n" >> $OUTPUT_FILE
+
+for p in "${PAGES[@]}"
+do
+	name=${p%%:*}
+	option=${p#*:}
+
+	for a in "${ALGS[@]}"
+	do
+		for t in "${THREADS[@]}"
+		do
+			export OMP_NUM_THREADS=$t
+			printf "$name, $a, $t: "
+			printf "$name, $a, $t" >> $OUTPUT_FILE
+
+			tlb_misses="-"
+			for e in $(seq 1 3)  # Number of times to execute.
+			do
+				# Assure the OpenMP environment variables are set and non-empty.
+				: ${OMP_SCHEDULE:?"Need to set OMP_SCHEDULE non-empty."}
+				: ${OMP_NUM_THREADS:?"Need to set OMP_NUM_THREADS non-empty."}
+
+				# Execute for input size 2^26 (67,108,864). The dTLB
+				# misses are written to stderr.
+				exec_time=$(./bin/$a -d $PREFIXES_DISTRIBUTION_FILE \
+				-dla $DLA_FILE -g1 $G1_FILE -g2 $G2_FILE \
+				-r $RANDOM_ADDRESSES_FILE -n 67108864 --tlb-misses \
+				$option 2> bench/res/hugepages/stderr.txt | head -n 1)
+
+				tlb_stats=$(grep "per lookup" bench/res/hugepages/stderr.txt)
+				if [ -n "$tlb_stats" ]; then
+					tlb_misses=$(echo "$tlb_stats" | sed 's/.*(\([0-9.]*\) per lookup.*/\1/')
+				fi
+
+				printf "."
+				printf ", $exec_time" >> $OUTPUT_FILE
+			done
+			printf "\n"
+			printf ", $tlb_misses\n" >> $OUTPUT_FILE
+		done
+	done
+done
+
+rm -f bench/res/hugepages/stderr.txt
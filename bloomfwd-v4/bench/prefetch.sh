@@ -0,0 +1,76 @@
+#!/bin/bash
+
+# This script compares the per-address scalar lookups of 'bloomfwd' (target
+# 'bloomfwd_opt_par') with the batched lookups with software prefetching
+# (target 'bloomfwd_opt_par_batch'), rebuilding the latter for each prefetch
+# distance (-DLOOKUP_PREFETCH_DISTANCE) with -DBENCHMARK=ON. It outputs the
+# corresponding execution times to a file in the CSV format.
+
+# Settings
+PROJECT_DIR=~/Development/c/bloomfwd/bloomfwd-v4/
+BUILD_DIR=build-prefetch
+PREFIXES_DISTRIBUTION_FILE=data/opt/distrib.txt
+DLA_FILE=data/opt/dla.txt
+G1_FILE=data/opt/g1.txt
+G2_FILE=data/opt/g2.txt
+IPV4_ADDRESSES_FILE=data/randomAddrs.txt
+DISTANCES=(4 8 16 32 64)
+THREADS=(1 8 16 32)
+SCHED_CHUNKSIZE="dynamic,64"
+OUTPUT_FILE=bench/res/prefetch/lookup.csv # Benchmark output file.
+
+cd $PROJECT_DIR
+mkdir -p bench/res/prefetch/
+
+# Clean old data files...
+data_files=$(ls bench/res/prefetch)
+if [ ${#data_files} -gt 0 ]; then
+	rm -f bench/res/prefetch/*
+fi
+
+export OMP_SCHEDULE="$SCHED_CHUNKSIZE"
+
+# Write headers to output file.
+printf "Algorithm, Distance, # Threads, Execs...\n" >> $OUTPUT_FILE
+
+run() {
+	a=$1
+	d=$2
+
+	for t in "${THREADS[@]}"
+	do
+		export OMP_NUM_THREADS=$t
+		printf "$a, $d, $t: "
+		printf "$a, $d, $t" >> $OUTPUT_FILE
+
+		for e in $(seq 1 3)  # Number of times to execute.
+		do
+			# Assure the OpenMP environment variables are set and non-empty.
+			: ${OMP_SCHEDULE:?"Need to set OMP_SCHEDULE non-empty."}
+			: ${OMP_NUM_THREADS:?"Need to set OMP_NUM_THREADS non-empty."}
+
+			# Execute for input size 2^26 (67,108,864).
+			exec_time=$(./bin/$a -d $PREFIXES_DISTRIBUTION_FILE \
+			-dla $DLA_FILE -g1 $G1_FILE -g2 $G2_FILE \
+			-r $IPV4_ADDRESSES_FILE -n 67108864 2> /dev/null | head -n 1)
+
+			printf "."
+			printf ", $exec_time" >> $OUTPUT_FILE
+		done
+		printf "\n"
+		printf "\n" >> $OUTPUT_FILE
+	done
+}
+
+for d in "${DISTANCES[@]}"
+do
+	cmake -S . -B $BUILD_DIR -DBENCHMARK=ON \
+		-DLOOKUP_PREFETCH_DISTANCE=$d > /dev/null
+	cmake --build $BUILD_DIR > /dev/null
+
+	# The per-address lookups don't depend on the distance.
+	if [ $d -eq ${DISTANCES[0]} ]; then
+		run bloomfwd_opt_par -
+	fi
+	run bloomfwd_opt_par_batch $d
+done
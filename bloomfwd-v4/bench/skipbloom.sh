@@ -0,0 +1,70 @@
+#!/bin/bash
+
+# This script compares, for each RouteViews and RIPE table, looking the
+# matching and the CAIDA addresses up with both Bloom filters, without the
+# filter of G2 or G1 (false positive ratio 1, the hash table is probed
+# directly), without any, and with the ratios chosen by '-a' (target
+# 'bloomfwd_opt_par', built with -DBENCHMARK=ON). It outputs the corresponding
+# execution times to a file in the CSV format, and the ratios chosen by '-a'
+# to another.
+
+# Settings
+PROJECT_DIR=~/Development/c/bloomfwd/bloomfwd-v4/
+DATA_DIRS=(~/ip-datasets/routeviews ~/ip-datasets/ripe)
+ADDRS_FILES=(~/ip-datasets/ipv4/addrs/matching-80.txt
+	~/ip-datasets/ipv4/addrs/caidaAddrs.txt)
+ALG=bloomfwd_opt_par
+FPRS=("-f 0.01" "-f 1,0.01" "-f 0.01,1" "-f 1" "-a")
+NUM_THREADS=32
+SCHED_CHUNKSIZE="dynamic,64"
+OUTPUT_FILE=bench/res/skipbloom/lookup.csv # Benchmark output file.
+TUNING_FILE=bench/res/skipbloom/tuning.txt # Ratios chosen by '-a'.
+
+cd $PROJECT_DIR
+mkdir -p bench/res/skipbloom/
+
+# Clean old data files...
+data_files=$(ls bench/res/skipbloom)
+if [ ${#data_files} -gt 0 ]; then
+	rm -f bench/res/skipbloom/*
+fi
+
+export OMP_NUM_THREADS=$NUM_THREADS
+export OMP_SCHEDULE="$SCHED_CHUNKSIZE"
+
+# Write headers to output file.
+printf "Table, Addresses, Ratios, Execs...\n" >> $OUTPUT_FILE
+
+for dir in "${DATA_DIRS[@]}"
+do
+	for d in $(ls $dir)
+	do
+		distrib=$dir/$d/opt/distrib.txt
+		dla=$dir/$d/opt/dla.txt
+		g1=$dir/$d/opt/g1.txt
+		g2=$dir/$d/opt/g2.txt
+
+		for r in "${ADDRS_FILES[@]}"
+		do
+			for f in "${FPRS[@]}"
+			do
+				printf "$d, $(basename $r), $f: "
+				printf "$d, $(basename $r), $f" >> $OUTPUT_FILE
+				for e in $(seq 1 3)  # Number of times to execute.
+				do
+					# Execute for input size 2^26 (67,108,864).
+					exec_time=$(./bin/$ALG -d $distrib -dla $dla \
+						-g1 $g1 -g2 $g2 -r $r -n 67108864 $f \
+						2> >(grep "^Bloom filters" | \
+						sed "s|^|$d, $(basename $r): |" >> $TUNING_FILE) | \
+						head -n 1)
+
+					printf "."
+					printf ", $exec_time" >> $OUTPUT_FILE
+				done
+				printf "\n"
+				printf "\n" >> $OUTPUT_FILE
+			done
+		done
+	done
+done
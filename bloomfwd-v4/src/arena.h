@@ -0,0 +1,43 @@
+/*
+ * arena.h
+ *
+ * Region allocator for the small nodes of a table (hash table entries, trie
+ * nodes, ...). Nodes are carved one after the other out of big blocks, so
+ * that nodes allocated in sequence share cache lines and pages instead of
+ * being scattered over the heap with a malloc() header each. There is no way
+ * to free a single node: the whole region is freed at once, one free() per
+ * block.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+struct arena_block;
+
+struct arena {
+	struct arena_block *blocks;  /* Most recent first. */
+	size_t block_size;
+	size_t used;  /* Bytes handed out, padding included. */
+};
+
+/* A region that grows by blocks of (at least) 'block_size' bytes. */
+struct arena *new_arena(size_t block_size);
+
+/*
+ * Return 'size' bytes, aligned to a pointer (not to 'max_align_t', which would
+ * round 24 byte nodes up to 32). Exit if there is no memory left.
+ */
+void *arena_alloc(struct arena *arena, size_t size);
+
+/* Same, aligned to 'align' bytes (a power of two). */
+void *arena_alloc_aligned(struct arena *arena, size_t size, size_t align);
+
+/* Bytes of a block taken by a node of 'size' bytes (padding included). */
+size_t arena_node_size(size_t size);
+
+/* Free 'arena' and every node allocated from it. */
+void free_arena(struct arena *arena);
+
+#endif
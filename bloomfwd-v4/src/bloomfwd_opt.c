@@ -20,12 +20,15 @@
 #include <inttypes.h>
 #include <math.h>
 #include <omp.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "bloomfwd_opt.h"
 #include "config.h"
+#include "hugepages.h"
+#include "lookupstats.h"
 #include "prettyprint.h"
 #include "hashfunctions.h"
 
@@ -40,6 +43,15 @@ static inline bool is_prefix_valid(const struct ipv4_prefix *pfx)
 	return pfx != NULL && pfx->netmask >= 0 && pfx->netmask <= 32;
 }
 
+static inline void init_ipv4_prefix(struct ipv4_prefix *pfx, uint8_t a,
+		uint8_t b, uint8_t c, uint8_t d, uint8_t netmask, uint32_t next_hop)
+{
+	pfx->prefix = (a << 24 | b << 16 | c << 8 | d) &
+		(0xffffffff << (32 - netmask));
+	pfx->netmask = netmask;
+	pfx->next_hop = next_hop;
+}
+
 struct ipv4_prefix *new_ipv4_prefix(uint8_t a, uint8_t b, uint8_t c, uint8_t d,
 		uint8_t netmask, uint32_t next_hop)
 {
@@ -49,10 +61,7 @@ struct ipv4_prefix *new_ipv4_prefix(uint8_t a, uint8_t b, uint8_t c, uint8_t d,
 		exit(1);
 	}
 
-	pfx->prefix = (a << 24 | b << 16 | c << 8 | d) &
-		(0xffffffff << (32 - netmask));
-	pfx->netmask = netmask;
-	pfx->next_hop = next_hop;
+	init_ipv4_prefix(pfx, a, b, c, d, netmask, next_hop);
 
 	if (!is_prefix_valid(pfx)) {
 		free(pfx);
@@ -62,6 +71,53 @@ struct ipv4_prefix *new_ipv4_prefix(uint8_t a, uint8_t b, uint8_t c, uint8_t d,
 	return pfx;
 }
 
+/*
+ * Key under which the prefix 'pfx_key' of VRF 'vrf' is hashed. Mixing the VRF
+ * id in keeps the keys of different VRFs apart in the shared Bloom filters,
+ * while leaving VRF 0 keys untouched.
+ */
+static inline uint32_t vrf_key(uint32_t vrf, uint32_t pfx_key)
+{
+	return pfx_key ^ (vrf * 0x9e3779b1);
+}
+
+/*
+ * First Bloom filter hash of 'key'. 'h' keeps what 'bloom_hash2()' needs, so
+ * that h2 is only computed if the first bit is set.
+ */
+static inline uint32_t bloom_hash1(uint32_t key, uint64_t *h)
+{
+#ifdef SINGLE_HASH
+	*h = SINGLE_HASH_FUNCTION(key);
+	return *h >> 32;
+#else
+	uint32_t h1 = BLOOM_HASH_FUNCTION(key);
+	*h = h1;
+	return h1;
+#endif
+}
+
+/*
+ * Second Bloom filter hash, from the result of 'bloom_hash1()'.
+ */
+static inline uint32_t bloom_hash2(uint64_t h)
+{
+#ifdef SINGLE_HASH
+	return (uint32_t)h;
+#else
+	return BLOOM_HASH_FUNCTION((uint32_t)h);
+#endif
+}
+
+static inline uint32_t hashtbl_hash(uint32_t key)
+{
+#ifdef SINGLE_HASH
+	return SINGLE_HASH_FUNCTION(key) >> 32;
+#else
+	return HASHTBL_HASH_FUNCTION(key);
+#endif
+}
+
 static struct hash_table *new_hash_table(uint32_t capacity)
 {
 	assert(capacity > 0);
@@ -85,8 +141,8 @@ static struct hash_table *new_hash_table(uint32_t capacity)
 		exit(1);
 	}
 
-	/* Allocate table space. */
-	tbl->slots = (struct hash_table_entry **)malloc(
+	/* Allocate table space (NULL initialized). */
+	tbl->slots = (struct hash_table_entry **)huge_alloc(
 			range * sizeof(struct hash_table_entry *));
 	if (tbl->slots == NULL) {
 		fprintf(stderr, "hash_table.new_hash_table: Couldn't allocate memory for 'tbl->slots'.\n");
@@ -94,8 +150,6 @@ static struct hash_table *new_hash_table(uint32_t capacity)
 	}
 
 	/* Initialize table data. */
-	for (uint32_t i = 0; i < range; i++)
-		tbl->slots[i] = NULL;
 	tbl->total = 0;
 	tbl->range = range;
 
@@ -103,30 +157,28 @@ static struct hash_table *new_hash_table(uint32_t capacity)
 }
 
 
-static bool store_next_hop(struct hash_table *tbl, uint32_t pfx_key,
-		uint32_t next_hop)
+static bool store_next_hop(struct hash_table *tbl, struct arena *arena,
+		uint32_t vrf, uint32_t pfx_key, uint32_t next_hop)
 {
-	uint32_t hash = HASHTBL_HASH_FUNCTION(pfx_key);
-	uint32_t idx = hash % tbl->range;
+	uint32_t hash = hashtbl_hash(vrf_key(vrf, pfx_key));
+	uint32_t idx = fastrange_32(hash, tbl->range);
 
 	/* Find key. */
 	struct hash_table_entry *entry;
 	for (entry = tbl->slots[idx]; entry != NULL; entry = entry->next) {
-		if (entry->hash == hash && entry->prefix == pfx_key)
+		if (entry->hash == hash && entry->prefix == pfx_key &&
+				entry->vrf == vrf)
 			break;
 	}
 
 	bool create = entry == NULL;
 	if (create) { /* Create */
-		entry = malloc(sizeof(struct hash_table_entry));
-		if (entry == NULL) {
-			fprintf(stderr, "qhashtbl.qhashtbl_put: Couldn't allocate memory.\n");
-			exit(1);
-		}
+		entry = arena_alloc(arena, sizeof(struct hash_table_entry));
 
 		/* Set key data. */
 		entry->hash = hash;
 		entry->prefix = pfx_key;
+		entry->vrf = vrf;
 
 		/* Always insert new entryects at the beginning of the list. */
 		entry->next = tbl->slots[idx];
@@ -146,16 +198,23 @@ static bool store_next_hop(struct hash_table *tbl, uint32_t pfx_key,
  * Useful for reusing precomputed hash.
  */
 static inline bool find_next_hop_with_hash(struct hash_table *tbl, uint32_t hash,
-		uint32_t pfx_key, uint32_t *next_hop)
+		uint32_t vrf, uint32_t pfx_key, uint32_t *next_hop)
 {
-	uint32_t idx = hash % tbl->range;
+	uint32_t idx = fastrange_32(hash, tbl->range);
+
+	unsigned int steps = 0;
 
 	struct hash_table_entry *entry;
 	for (entry = tbl->slots[idx]; entry != NULL; entry = entry->next) {
-		if (entry->hash == hash && entry->prefix == pfx_key)
+		steps++;
+		if (entry->hash == hash && entry->prefix == pfx_key &&
+				entry->vrf == vrf)
 			break;
 	}
 
+	LOOKUP_STATS_THREAD();
+	LOOKUP_STATS_ADD(chain_steps, steps);
+
 	bool found = entry != NULL;
 	if (found)
 		*next_hop = entry->next_hop;
@@ -163,18 +222,25 @@ static inline bool find_next_hop_with_hash(struct hash_table *tbl, uint32_t hash
 	return found;
 }
 #else
-static bool find_next_hop(struct hash_table *tbl, uint32_t pfx_key,
-		uint32_t *next_hop)
+static bool find_next_hop(struct hash_table *tbl, uint32_t vrf,
+		uint32_t pfx_key, uint32_t *next_hop)
 {
-	uint32_t hash = HASHTBL_HASH_FUNCTION(pfx_key);
-	uint32_t idx = hash % tbl->range;
+	uint32_t hash = hashtbl_hash(vrf_key(vrf, pfx_key));
+	uint32_t idx = fastrange_32(hash, tbl->range);
+
+	unsigned int steps = 0;
 
 	struct hash_table_entry *entry;
 	for (entry = tbl->slots[idx]; entry != NULL; entry = entry->next) {
-		if (entry->hash == hash && entry->prefix == pfx_key)
+		steps++;
+		if (entry->hash == hash && entry->prefix == pfx_key &&
+				entry->vrf == vrf)
 			break;
 	}
 
+	LOOKUP_STATS_THREAD();
+	LOOKUP_STATS_ADD(chain_steps, steps);
+
 	bool found = entry != NULL;
 	if (found)
 		*next_hop = entry->next_hop;
@@ -183,60 +249,143 @@ static bool find_next_hop(struct hash_table *tbl, uint32_t pfx_key,
 }
 #endif
 
-static struct counting_bloom_filter *new_counting_bloom_filter(uint32_t capacity)
+/*
+ * Look (vrf, pfx_key) up in group 'g': in its snapshot, if it has one, then in
+ * its hash table ('hash' is the key's hash table hash), unless that is empty.
+ */
+static inline bool find_next_hop_group(const struct forwarding_table *fw_tbl,
+		int g, uint32_t hash, uint32_t vrf, uint32_t pfx_key,
+		uint32_t *next_hop)
+{
+	struct hash_table *ht = fw_tbl->hash_tables[g];
+	const struct perfect_hash *ph = fw_tbl->perfect_hashes[g];
+	if (ph != NULL) {
+		const struct perfect_hash_entry *entry = perfect_hash_get(ph, vrf,
+				pfx_key);
+
+		LOOKUP_STATS_THREAD();
+		LOOKUP_STATS_ADD(chain_steps, 1);
+
+		if (entry != NULL) {
+			*next_hop = entry->next_hop;
+			return true;
+		}
+		if (ht->total == 0)
+			return false;
+	}
+
+#ifdef SAME_HASH_FUNCTIONS
+	return find_next_hop_with_hash(ht, hash, vrf, pfx_key, next_hop);
+#else
+	return find_next_hop(ht, vrf, pfx_key, next_hop);
+#endif
+}
+
+static struct counting_bloom_filter *new_counting_bloom_filter(uint32_t capacity,
+		double fpr)
 {
+	assert(fpr > 0.0 && fpr <= 1.0);
+
 	struct counting_bloom_filter *bf =
 		malloc(sizeof(struct counting_bloom_filter));
 	if (bf == NULL) {
 		fprintf(stderr, "bloomfwd.new_counting_bloom_filter: Couldn't malloc bloom filter.\n");
 		exit(1);
 	}
+	bf->capacity = capacity;
+	bf->false_positive_ratio = fpr;
+
+	bf->bitmap = NULL;
+	bf->bitmap_len = 0;
+	bf->num_hashes = 0;
+	bf->cuckoo = NULL;
+	bf->fused = NULL;
+	bf->counters = NULL;
+	bf->saturated = 0;
+
+	/* Every key is a "maybe": skip the filter, keep no bitmap. */
+	if (fpr == 1.0 || capacity == 0)
+		return bf;
+
+#ifdef CUCKOO_FILTER
+	bf->cuckoo = new_cuckoo_filter(capacity, fpr);
+	return bf;
+#elif defined(FUSED_FILTER)
+	bf->fused = new_fused_filter(capacity);
+	return bf;
+#endif
 
 	/*
 	 * These formulas give the optimal bitmap size (len) and number of
 	 * hashes (bf_num_hashes) based on the amount of elements do be stored
-	 * (capacity) and the desired false positive ratio
-	 * (FALSE_POSITIVE_RATIO).
+	 * (capacity) and the desired false positive ratio (fpr).
 	 */
-	uint32_t bitmap_len = ceil((capacity *  log2(1.0 / FALSE_POSITIVE_RATIO)) / log(2.0)); 
+	uint32_t bitmap_len = ceil((capacity *  log2(1.0 / fpr)) / log(2.0)); 
 	bf->num_hashes = ceil(log(2.0) * bitmap_len / capacity);
 
-	bf->bitmap = malloc(bitmap_len * sizeof(bool));
+	/*
+	 * The AVX-512F lookup gathers 32-bit words, so it may read up to three
+	 * bytes past the last bit.
+	 */
+	bf->bitmap = huge_alloc(bitmap_len * sizeof(bool) + 3);
 	if (bf->bitmap == NULL) {
 		fprintf(stderr, "bloomfwd.new_counting_bloom_filter: Could not calloc bitmap array of size: %"PRIu32".\n", bitmap_len);
 		exit(1);
 	}
-	/* Initialize array elements to `false`. */
-	memset(bf->bitmap, false, bitmap_len * sizeof(bool));
+	/* Array elements are initialized to `false`. */
 
-	/* Initialize counters to 0. */
-	bf->counters = calloc(bitmap_len, sizeof(uint8_t));
+	/* Initialize counters to 0. Lookups don't read them: no huge pages. */
+	bf->counters = calloc((bitmap_len + 1) / 2, sizeof(uint8_t));
 	if (bf->counters == NULL) {
 		fprintf(stderr, "bloomfwd.new_counting_bloom_filter: Could not calloc counters array of size: %"PRIu32".\n", bitmap_len);
 		exit(1);
 	}
 	bf->bitmap_len = bitmap_len;
-	bf->capacity = capacity;
 
 	return bf;
 }
 
-static inline bool set_default_route(struct forwarding_table *fw_tbl, uint32_t gw_def)
+static void free_counting_bloom_filter(struct counting_bloom_filter *bf)
+{
+	huge_free(bf->bitmap);
+	free_cuckoo_filter(bf->cuckoo);
+	free_fused_filter(bf->fused);
+	free(bf->counters);
+	free(bf);
+}
+
+static inline uint8_t bloom_counter(const struct counting_bloom_filter *bf,
+		uint32_t idx)
+{
+	return (bf->counters[idx / 2] >> (idx % 2 * 4)) & 0xf;
+}
+
+static inline void increment_bloom_counter(struct counting_bloom_filter *bf,
+		uint32_t idx)
 {
-	bool create = fw_tbl->default_route == NULL;
+	uint8_t x = bloom_counter(bf, idx);
+	if (x == BLOOM_COUNTER_MAX)
+		return;
+
+	bf->counters[idx / 2] += 1 << (idx % 2 * 4);
+	if (x + 1 == BLOOM_COUNTER_MAX)
+		bf->saturated++;
+}
+
+static inline bool set_default_route(struct forwarding_table *fw_tbl,
+		uint32_t vrf, uint32_t gw_def)
+{
+	bool create = fw_tbl->default_routes[vrf] == NULL;
 	if (create) {  /* Create default route. */
-		struct ipv4_prefix *def_route = malloc(sizeof(struct ipv4_prefix));
-		if (def_route == NULL) {
-			fprintf(stderr, "bloomfwd.set_default_route: Could not malloc default route.");
-			exit(1);
-		}
+		struct ipv4_prefix *def_route =
+			arena_alloc(fw_tbl->arena, sizeof(struct ipv4_prefix));
 
 		def_route->prefix = 0;
 		def_route->netmask = 0;
 		def_route->next_hop = gw_def;
-		fw_tbl->default_route = def_route;
+		fw_tbl->default_routes[vrf] = def_route;
 	} else {  /* Update default route. */
-		fw_tbl->default_route->next_hop = gw_def;
+		fw_tbl->default_routes[vrf]->next_hop = gw_def;
 	}
 
 	return create;
@@ -246,7 +395,7 @@ static inline void init_hash_tables_array(struct forwarding_table *fw_tbl)
 {
 	struct hash_table **hash_tables = fw_tbl->hash_tables;
 	struct counting_bloom_filter **bfs = fw_tbl->counting_bloom_filters;
-	for (int i = 0; i < 2; i++) {
+	for (int i = 0; i < 3; i++) {
 		if (bfs[i] != NULL)
 			hash_tables[i] = new_hash_table(bfs[i]->capacity);
 		else
@@ -256,14 +405,20 @@ static inline void init_hash_tables_array(struct forwarding_table *fw_tbl)
 
 static inline int bloom_filter_id(const struct ipv4_prefix *pfx)
 {
-	return pfx->netmask == 32 ? 0 : 1; /* 0 -> G2, 1 -> G1 */
+	if (pfx->netmask == 32)
+		return 0;  /* G2 */
+	else if (pfx->netmask == 20)
+		return 2;  /* G0 (VRFs other than 0) */
+	else
+		return 1;  /* G1 */
 }
 
 /*
  * The parameters 'start' and 'end' define the inclusive range of prefixes that
  * must be grouped together in the same Bloom filter.
  */
-static void init_counting_bloom_filters_array(FILE *pfx_distribution, struct forwarding_table *fw_tbl)
+static void init_counting_bloom_filters_array(FILE *pfx_distribution,
+		struct forwarding_table *fw_tbl, const double fprs[3])
 {
 	//uint32_t total = 0;
 
@@ -283,11 +438,15 @@ static void init_counting_bloom_filters_array(FILE *pfx_distribution, struct for
 				exit(1);
 			}
 
-			if (netmask == 32) {
-				fw_tbl->counting_bloom_filters[0] = new_counting_bloom_filter(quantity);
+			if (quantity == 0) {
+				continue;  /* Empty group: no filter. */
+			} else if (netmask == 32) {
+				fw_tbl->counting_bloom_filters[0] = new_counting_bloom_filter(quantity, fprs[0]);
 			} else if (netmask == 24) {
-				fw_tbl->counting_bloom_filters[1] = new_counting_bloom_filter(quantity);
+				fw_tbl->counting_bloom_filters[1] = new_counting_bloom_filter(quantity, fprs[1]);
 
+			} else if (netmask == 20 && fw_tbl->num_vrfs > 1) {
+				fw_tbl->counting_bloom_filters[2] = new_counting_bloom_filter(quantity, fprs[2]);
 			}
 		}
 	}
@@ -313,35 +472,337 @@ static void init_counting_bloom_filters_array(FILE *pfx_distribution, struct for
  */
 static void init_direct_lookup_array(uint32_t **dla)
 {
-	*dla = calloc(pow(2, 20), sizeof(uint32_t));
+	*dla = huge_alloc(pow(2, 20) * sizeof(uint32_t));
 	assert((*dla) != NULL);
 }
 
 
-struct forwarding_table *new_forwarding_table(FILE *pfx_distribution,
-		uint32_t *gw_def)
+struct forwarding_table *new_forwarding_table_fpr(FILE *pfx_distribution,
+		uint32_t num_vrfs, const double fprs[3])
 {
+	assert(num_vrfs > 0);
+
 	struct forwarding_table *fw_tbl = malloc(sizeof(struct forwarding_table));
 	if (fw_tbl == NULL) {
 		fprintf(stderr, "bloomfwd.new_forwarding_table: Could not malloc forwarding table.\n");
 		exit(1);
 	}
 
-	fw_tbl->default_route = NULL;  /* Init default route. */
+	atomic_init(&fw_tbl->generation, 0);
+	fw_tbl->num_vrfs = num_vrfs;
+	/* Init default routes. */
+	fw_tbl->default_routes = calloc(num_vrfs, sizeof(struct ipv4_prefix *));
+	if (fw_tbl->default_routes == NULL) {
+		fprintf(stderr, "bloomfwd.new_forwarding_table: Could not calloc default routes.\n");
+		exit(1);
+	}
+	fw_tbl->arena = new_arena(TABLE_ARENA_BLOCK_SIZE);
+	for (int i = 0; i < 3; i++) {
+		fw_tbl->counting_bloom_filters[i] = NULL;
+		fw_tbl->perfect_hashes[i] = NULL;
+	}
 	init_direct_lookup_array(&fw_tbl->dla);
-	init_counting_bloom_filters_array(pfx_distribution, fw_tbl);
+	init_counting_bloom_filters_array(pfx_distribution, fw_tbl, fprs);
 	init_hash_tables_array(fw_tbl);
 
 	return fw_tbl;
 }
 
+struct forwarding_table *new_forwarding_table_vrf(FILE *pfx_distribution,
+		uint32_t num_vrfs)
+{
+	const double fprs[3] = {
+		FALSE_POSITIVE_RATIO, FALSE_POSITIVE_RATIO, FALSE_POSITIVE_RATIO
+	};
+
+	return new_forwarding_table_fpr(pfx_distribution, num_vrfs, fprs);
+}
+
+struct forwarding_table *new_forwarding_table(FILE *pfx_distribution,
+		uint32_t *gw_def)
+{
+	return new_forwarding_table_vrf(pfx_distribution, 1);
+}
+
+static struct counting_bloom_filter *copy_counting_bloom_filter(
+		const struct counting_bloom_filter *src)
+{
+	struct counting_bloom_filter *bf = new_counting_bloom_filter(src->capacity,
+			src->false_positive_ratio);
+	assert(bf->bitmap_len == src->bitmap_len);
+	bf->num_hashes = src->num_hashes;
+
+	if (src->bitmap_len > 0)
+		memcpy(bf->bitmap, src->bitmap, src->bitmap_len * sizeof(bool));
+	if (src->cuckoo != NULL) {
+		free_cuckoo_filter(bf->cuckoo);
+		bf->cuckoo = copy_cuckoo_filter(src->cuckoo);
+	}
+	if (src->fused != NULL) {
+		free_fused_filter(bf->fused);
+		bf->fused = copy_fused_filter(src->fused);
+	}
+	if (src->counters != NULL) {
+		memcpy(bf->counters, src->counters,
+				(src->bitmap_len + 1) / 2 * sizeof(uint8_t));
+		bf->saturated = src->saturated;
+	} else {
+		free(bf->counters);
+		bf->counters = NULL;
+	}
+
+	return bf;
+}
+
+/*
+ * Copy the entries of 'src' to 'arena', bucket after bucket, into the buckets
+ * of 'dst' (which may be 'src' itself).
+ */
+static void copy_hash_table_entries(struct hash_table *dst,
+		const struct hash_table *src, struct arena *arena)
+{
+	/* Keep the order of the chains. */
+	for (uint32_t i = 0; i < src->range; i++) {
+		struct hash_table_entry *e = src->slots[i];
+		struct hash_table_entry **tail = &dst->slots[i];
+		for (; e != NULL; e = e->next) {
+			struct hash_table_entry *entry = arena_alloc(arena,
+					sizeof(struct hash_table_entry));
+			*entry = *e;
+			*tail = entry;
+			tail = &entry->next;
+		}
+		*tail = NULL;
+	}
+	dst->total = src->total;
+}
+
+static struct hash_table *copy_hash_table(const struct hash_table *src,
+		struct arena *arena)
+{
+	struct hash_table *tbl = new_hash_table(src->range);
+	copy_hash_table_entries(tbl, src, arena);
+
+	return tbl;
+}
+
+/* Bytes taken by the entries and default routes of 'fw_tbl' in an arena. */
+static size_t packed_size(const struct forwarding_table *fw_tbl)
+{
+	size_t entry = arena_node_size(sizeof(struct hash_table_entry));
+	size_t route = arena_node_size(sizeof(struct ipv4_prefix));
+
+	size_t size = fw_tbl->num_vrfs * route;
+	for (int i = 0; i < 3; i++) {
+		if (fw_tbl->hash_tables[i] != NULL)
+			size += fw_tbl->hash_tables[i]->total * entry;
+	}
+
+	return size;
+}
+
+/* Copy the default routes of 'src' to the arena of 'dst'. */
+static void copy_default_routes(struct forwarding_table *dst,
+		const struct forwarding_table *src)
+{
+	for (uint32_t vrf = 0; vrf < src->num_vrfs; vrf++) {
+		const struct ipv4_prefix *def_route = src->default_routes[vrf];
+		dst->default_routes[vrf] = NULL;
+		if (def_route != NULL)
+			set_default_route(dst, vrf, def_route->next_hop);
+	}
+}
+
+#ifdef PERFECT_HASH
+/*
+ * Move the keys of group 'g', its snapshot's and its hash table's, to a new
+ * snapshot, and give the group an empty hash table for the keys stored from
+ * now on (a fraction of the size: it only takes the updates). The keys in the
+ * slots of a fused filter stay there.
+ */
+static void snapshot_group(struct forwarding_table *fw_tbl, int g)
+{
+	struct hash_table *ht = fw_tbl->hash_tables[g];
+	struct perfect_hash *old = fw_tbl->perfect_hashes[g];
+	uint32_t count = ht->total + (old != NULL ? old->count : 0);
+	if (count == 0)
+		return;
+
+	struct perfect_hash_entry *entries = malloc(count *
+			sizeof(struct perfect_hash_entry));
+	if (entries == NULL) {
+		fprintf(stderr, "bloomfwd.snapshot_group: Couldn't malloc %"PRIu32" entries.\n",
+				count);
+		exit(1);
+	}
+
+	uint32_t n = 0;
+	if (old != NULL) {
+		memcpy(entries, old->entries,
+				old->count * sizeof(struct perfect_hash_entry));
+		n = old->count;
+	}
+	for (uint32_t i = 0; i < ht->range; i++) {
+		for (const struct hash_table_entry *e = ht->slots[i]; e != NULL;
+				e = e->next) {
+			entries[n].prefix = e->prefix;
+			entries[n].vrf = e->vrf;
+			entries[n].next_hop = e->next_hop;
+			n++;
+		}
+	}
+
+	fw_tbl->perfect_hashes[g] = new_perfect_hash(entries, count);
+	free_perfect_hash(old);
+	free(entries);
+
+	/* The entries stay in the old arena, which 'pack' frees. */
+	fw_tbl->hash_tables[g] = new_hash_table(count / PERFECT_HASH_OVERLAY + 1);
+	huge_free(ht->slots);
+	free(ht);
+}
+#endif
+
+void pack_forwarding_table(struct forwarding_table *fw_tbl)
+{
+#ifdef PERFECT_HASH
+	for (int i = 0; i < 3; i++) {
+		if (fw_tbl->hash_tables[i] != NULL)
+			snapshot_group(fw_tbl, i);
+	}
+#endif
+
+	struct arena *old = fw_tbl->arena;
+
+	/* One block for everything: later stores get blocks of their own. */
+	fw_tbl->arena = new_arena(packed_size(fw_tbl));
+	copy_default_routes(fw_tbl, fw_tbl);
+	for (int i = 0; i < 3; i++) {
+		if (fw_tbl->hash_tables[i] != NULL)
+			copy_hash_table_entries(fw_tbl->hash_tables[i],
+					fw_tbl->hash_tables[i], fw_tbl->arena);
+	}
+	fw_tbl->arena->block_size = TABLE_ARENA_BLOCK_SIZE;
+
+	free_arena(old);
+}
+
+uint32_t group_num_keys(const struct forwarding_table *fw_tbl, int g)
+{
+	uint32_t count = 0;
+	if (fw_tbl->hash_tables[g] != NULL)
+		count += fw_tbl->hash_tables[g]->total;
+	if (fw_tbl->perfect_hashes[g] != NULL)
+		count += fw_tbl->perfect_hashes[g]->count;
+	const struct counting_bloom_filter *bf = fw_tbl->counting_bloom_filters[g];
+	if (bf != NULL && bf->fused != NULL)
+		count += bf->fused->count;
+
+	return count;
+}
+
+size_t membership_filters_size(const struct forwarding_table *fw_tbl)
+{
+	size_t size = 0;
+	for (int i = 0; i < 3; i++) {
+		const struct counting_bloom_filter *bf =
+			fw_tbl->counting_bloom_filters[i];
+		if (bf == NULL)
+			continue;
+
+		size += bf->bitmap_len * sizeof(bool);
+		if (bf->cuckoo != NULL)
+			size += cuckoo_filter_size(bf->cuckoo);
+		if (bf->fused != NULL)
+			size += fused_filter_size(bf->fused);
+	}
+
+	return size;
+}
+
+void drop_bloom_counters(struct forwarding_table *fw_tbl)
+{
+	for (int i = 0; i < 3; i++) {
+		struct counting_bloom_filter *bf = fw_tbl->counting_bloom_filters[i];
+		if (bf != NULL) {
+			free(bf->counters);
+			bf->counters = NULL;
+			bf->saturated = 0;
+		}
+	}
+}
+
+struct forwarding_table *copy_forwarding_table(
+		const struct forwarding_table *src)
+{
+	struct forwarding_table *fw_tbl = malloc(sizeof(struct forwarding_table));
+	if (fw_tbl == NULL) {
+		fprintf(stderr, "bloomfwd.copy_forwarding_table: Could not malloc forwarding table.\n");
+		exit(1);
+	}
+
+	atomic_init(&fw_tbl->generation, atomic_load_explicit(&src->generation,
+				memory_order_acquire));
+	fw_tbl->num_vrfs = src->num_vrfs;
+	fw_tbl->default_routes = calloc(src->num_vrfs,
+			sizeof(struct ipv4_prefix *));
+	if (fw_tbl->default_routes == NULL) {
+		fprintf(stderr, "bloomfwd.copy_forwarding_table: Could not calloc default routes.\n");
+		exit(1);
+	}
+	fw_tbl->arena = new_arena(packed_size(src));
+	copy_default_routes(fw_tbl, src);
+
+	init_direct_lookup_array(&fw_tbl->dla);
+	memcpy(fw_tbl->dla, src->dla, (1 << 20) * sizeof(uint32_t));
+
+	for (int i = 0; i < 3; i++) {
+		fw_tbl->counting_bloom_filters[i] =
+			src->counting_bloom_filters[i] != NULL ?
+			copy_counting_bloom_filter(src->counting_bloom_filters[i]) :
+			NULL;
+		fw_tbl->hash_tables[i] = src->hash_tables[i] != NULL ?
+			copy_hash_table(src->hash_tables[i], fw_tbl->arena) :
+			NULL;
+		fw_tbl->perfect_hashes[i] = src->perfect_hashes[i] != NULL ?
+			copy_perfect_hash(src->perfect_hashes[i]) : NULL;
+	}
+	fw_tbl->arena->block_size = TABLE_ARENA_BLOCK_SIZE;
+
+	return fw_tbl;
+}
+
+void free_forwarding_table(struct forwarding_table *fw_tbl)
+{
+	if (fw_tbl == NULL)
+		return;
+
+	for (int i = 0; i < 3; i++) {
+		struct counting_bloom_filter *bf = fw_tbl->counting_bloom_filters[i];
+		if (bf != NULL)
+			free_counting_bloom_filter(bf);
+
+		struct hash_table *ht = fw_tbl->hash_tables[i];
+		if (ht != NULL) {
+			huge_free(ht->slots);
+			free(ht);
+		}
+		free_perfect_hash(fw_tbl->perfect_hashes[i]);
+	}
+	huge_free(fw_tbl->dla);
+	free_arena(fw_tbl->arena);  /* Entries and default routes. */
+	free(fw_tbl->default_routes);
+	free(fw_tbl);
+}
+
 static inline void hashes(uint32_t key, uint8_t num_hashes, uint32_t *result)
 {
 	assert(result != NULL);
 
-	result[0] = BLOOM_HASH_FUNCTION(key); 
+	uint64_t h;
+	result[0] = bloom_hash1(key, &h);
 	if (num_hashes > 1) {
-		result[1] = BLOOM_HASH_FUNCTION(result[0]); 
+		result[1] = bloom_hash2(h);
 
 		/*
 		 * The technique below allows us to produce multiple hash values without
@@ -354,7 +815,110 @@ static inline void hashes(uint32_t key, uint8_t num_hashes, uint32_t *result)
 	}
 }
 
-static bool store_prefix(struct forwarding_table *fw_tbl,
+/* Return false if 'bf' is a cuckoo filter and it is full. */
+static bool bloom_insert(struct counting_bloom_filter *bf, uint32_t key)
+{
+#ifdef CUCKOO_FILTER
+	if (bf->cuckoo != NULL) {
+		uint32_t h[2];
+		hashes(key, 2, h);
+		return cuckoo_insert(bf->cuckoo, h[0], h[1]);
+	}
+#elif defined(FUSED_FILTER)
+	if (bf->fused != NULL) {
+		fused_add_overflow(bf->fused, key);
+		return true;
+	}
+#endif
+	if (bf->num_hashes == 0)
+		return true;
+
+	uint32_t bitmap_idxs[bf->num_hashes];
+	hashes(key, bf->num_hashes, bitmap_idxs);
+	for (int i = 0; i < bf->num_hashes; i++) {
+		uint32_t idx = fastrange_32(bitmap_idxs[i], bf->bitmap_len);
+		bf->bitmap[idx] = true;
+		if (bf->counters != NULL)
+			increment_bloom_counter(bf, idx);
+	}
+
+	return true;
+}
+
+/*
+ * Replace the filter of group 'g' with one for 'capacity' keys and a ratio of
+ * 'fpr', filled from the keys of its hash table. A cuckoo filter that fills up
+ * is made bigger.
+ */
+static void rebuild_bloom_filter(struct forwarding_table *fw_tbl, int g,
+		uint32_t capacity, double fpr)
+{
+	struct counting_bloom_filter *old = fw_tbl->counting_bloom_filters[g];
+	const struct hash_table *ht = fw_tbl->hash_tables[g];
+	const struct perfect_hash *ph = fw_tbl->perfect_hashes[g];
+
+	struct counting_bloom_filter *bf;
+	bool full;
+	do {
+		bf = new_counting_bloom_filter(capacity, fpr);
+		if (old->counters == NULL) {  /* Dropped: keep it that way. */
+			free(bf->counters);
+			bf->counters = NULL;
+		}
+
+		full = false;
+		for (uint32_t i = 0; !full && ph != NULL && i < ph->count; i++)
+			full = !bloom_insert(bf, vrf_key(ph->entries[i].vrf,
+						ph->entries[i].prefix));
+		for (uint32_t i = 0; !full && i < ht->range; i++) {
+			for (const struct hash_table_entry *e = ht->slots[i];
+					!full && e != NULL; e = e->next)
+				full = !bloom_insert(bf, vrf_key(e->vrf, e->prefix));
+		}
+
+		if (full) {
+			free_counting_bloom_filter(bf);
+			capacity += capacity / 4 + 1;
+		}
+	} while (full);
+
+	fw_tbl->counting_bloom_filters[g] = bf;
+	free_counting_bloom_filter(old);
+}
+
+#ifdef FUSED_FILTER
+/*
+ * Store (vrf, pfx_key) in a slot of the fused filter of 'bf' if it has one
+ * already, or if it is new and its block has a free slot ('*created' tells
+ * which). Return false if it goes to the hash table 'ht' instead.
+ */
+static bool fused_store(struct counting_bloom_filter *bf,
+		const struct hash_table *ht, uint32_t vrf, uint32_t pfx_key,
+		uint32_t next_hop, bool *created)
+{
+	if (bf->fused == NULL || vrf != 0)
+		return false;
+
+	if (fused_update(bf->fused, pfx_key, next_hop)) {
+		*created = false;
+		return true;
+	}
+
+	/* Its block was full when it was stored. */
+	uint32_t hash = hashtbl_hash(pfx_key);
+	for (const struct hash_table_entry *e =
+			ht->slots[fastrange_32(hash, ht->range)]; e != NULL;
+			e = e->next) {
+		if (e->hash == hash && e->prefix == pfx_key && e->vrf == 0)
+			return false;
+	}
+
+	*created = fused_insert(bf->fused, pfx_key, next_hop);
+	return *created;
+}
+#endif
+
+static bool store_prefix(struct forwarding_table *fw_tbl, uint32_t vrf,
 		const struct ipv4_prefix *pfx)
 {
 	if (!is_prefix_valid(pfx)) {
@@ -365,41 +929,71 @@ static bool store_prefix(struct forwarding_table *fw_tbl,
 		exit(1);
 	}
 
-	if (pfx->netmask == 0)
-		return set_default_route(fw_tbl, pfx->next_hop);
-
 	bool created;
-	if (pfx->netmask == 20) {
+	if (pfx->netmask == 0) {
+		created = set_default_route(fw_tbl, vrf, pfx->next_hop);
+	} else if (pfx->netmask == 20 && vrf == 0) {
 		uint32_t index = pfx->prefix >> (32 - pfx->netmask);
 		created = fw_tbl->dla[index] == 0;
 		fw_tbl->dla[index] = pfx->next_hop;
+	} else if (pfx->netmask == 20 && pfx->next_hop == 0) {
+		/* Like an empty DLA slot, there is nothing to store in G0. */
+		created = false;
 	} else {
 		int id = bloom_filter_id(pfx);
 		struct counting_bloom_filter *bf = fw_tbl->counting_bloom_filters[id];
 		struct hash_table *hash_tbl = fw_tbl->hash_tables[id];
-		bool *bitmap = bf->bitmap;
-		uint32_t bitmap_len = bf->bitmap_len;
-		uint8_t *counters = bf->counters;
-		uint8_t num_hashes = bf->num_hashes;
-
-		created = store_next_hop(hash_tbl, pfx->prefix, pfx->next_hop);
-
-		uint32_t bitmap_idxs[num_hashes];
-		hashes(pfx->prefix, num_hashes, bitmap_idxs);
-		for (int i = 0; i < num_hashes; i++) {
-			uint32_t idx = bitmap_idxs[i] % bitmap_len;
-			bitmap[idx] = true;
-			counters[idx] += 1;
+		if (bf == NULL) {
+			char *prefix_str = strpfx(pfx);
+			fprintf(stderr, "bloomfwd.store_prefix: No Bloom filter for prefix: %s (check the distribution file).\n",
+					prefix_str);
+			free(prefix_str);
+			exit(1);
+		}
+		struct perfect_hash_entry *entry =
+			fw_tbl->perfect_hashes[id] != NULL ?
+			perfect_hash_get(fw_tbl->perfect_hashes[id], vrf,
+					pfx->prefix) : NULL;
+		if (entry != NULL) {  /* Update, in place. */
+			entry->next_hop = pfx->next_hop;
+			created = false;
+#ifdef FUSED_FILTER
+		} else if (fused_store(bf, hash_tbl, vrf, pfx->prefix,
+					pfx->next_hop, &created)) {
+			/* In a slot of its block. */
+#endif
+		} else {
+			created = store_next_hop(hash_tbl, fw_tbl->arena, vrf,
+					pfx->prefix, pfx->next_hop);
+			if (created && !bloom_insert(bf, vrf_key(vrf, pfx->prefix)))
+				rebuild_bloom_filter(fw_tbl, id,
+						bf->capacity + bf->capacity / 4 + 1,
+						bf->false_positive_ratio);
 		}
 	}
 
+	/* Invalidate the flow caches, once the update is visible. */
+	atomic_fetch_add_explicit(&fw_tbl->generation, 1, memory_order_release);
+
 	return created;
 }
 
+void resize_bloom_filter(struct forwarding_table *fw_tbl, int g, double fpr)
+{
+#ifdef FUSED_FILTER
+	fprintf(stderr, "bloomfwd.resize_bloom_filter: The keys in fused filters aren't in the hash tables (built with FUSED_FILTER).\n");
+	exit(1);
+#else
+	struct counting_bloom_filter *old = fw_tbl->counting_bloom_filters[g];
+	if (old != NULL)
+		rebuild_bloom_filter(fw_tbl, g, old->capacity, fpr);
+#endif
+}
+
 unsigned long long calc_num_collisions_hashtbl(const struct forwarding_table *fw_tbl)
 {
 	unsigned long long num_collisions = 0;
-	for (int i = 0; i < 2; i++) {
+	for (int i = 0; i < 3; i++) {
 		struct hash_table *ht =
 			fw_tbl->hash_tables[i];
 		if (ht == NULL)
@@ -422,14 +1016,14 @@ unsigned long long calc_num_collisions_hashtbl(const struct forwarding_table *fw
 unsigned long long calc_num_collisions_bloomf(const struct forwarding_table *fw_tbl)
 {
 	unsigned long long num_collisions = 0;
-	for (int i = 0; i < 2; i++) {
+	for (int i = 0; i < 3; i++) {
 		struct counting_bloom_filter *bf =
 			fw_tbl->counting_bloom_filters[i];
-		if (bf == NULL)
+		if (bf == NULL || bf->counters == NULL)
 			continue;
 
 		for (uint32_t j = 0; j < bf->bitmap_len; j++) {
-			int x = bf->counters[i];
+			int x = bloom_counter(bf, j);
 			if (x > 1)
 				num_collisions += x;
 		}
@@ -440,9 +1034,21 @@ unsigned long long calc_num_collisions_bloomf(const struct forwarding_table *fw_
 }
 
 void load_prefixes(struct forwarding_table *fw_tbl, FILE *pfxs)
+{
+	load_prefixes_vrf(fw_tbl, 0, pfxs);
+}
+
+void load_prefixes_vrf(struct forwarding_table *fw_tbl, uint32_t vrf,
+		FILE *pfxs)
 {
 	assert(pfxs != NULL);
 
+	if (vrf >= fw_tbl->num_vrfs) {
+		fprintf(stderr, "bloomfwd.load_prefixes_vrf: Invalid VRF: %"PRIu32".\n",
+				vrf);
+		exit(1);
+	}
+
 	uint8_t a0, b0, c0, d0, len;
 	uint8_t a1, b1, c1, d1;
 	while(fscanf(pfxs,"%"SCNu8".%"SCNu8".%"SCNu8".%"SCNu8,
@@ -466,9 +1072,9 @@ void load_prefixes(struct forwarding_table *fw_tbl, FILE *pfxs)
 			exit(1);
 		}
 		uint32_t next_hop = new_ipv4_addr(a1, b1, c1, d1);
-		struct ipv4_prefix *pfx =
-			new_ipv4_prefix(a0, b0, c0, d0, len, next_hop);
-		store_prefix(fw_tbl, pfx);
+		struct ipv4_prefix pfx;
+		init_ipv4_prefix(&pfx, a0, b0, c0, d0, len, next_hop);
+		store_prefix(fw_tbl, vrf, &pfx);
 	}
 
 #ifndef NDEBUG
@@ -476,117 +1082,103 @@ void load_prefixes(struct forwarding_table *fw_tbl, FILE *pfxs)
 	printf("Number of keys whose hash collided for Bloom filters: %llu\n", num_collisions);
 	num_collisions = calc_num_collisions_hashtbl(fw_tbl);
 	printf("Number of keys whose hash collided for hash tables: %llu\n", num_collisions);
+	for (int i = 0; i < 3; i++) {
+		struct counting_bloom_filter *bf = fw_tbl->counting_bloom_filters[i];
+		if (bf != NULL)
+			printf("Saturated counters of Bloom filter %d: %"PRIu32"\n",
+					i, bf->saturated);
+	}
 #endif
 }
 
-#ifndef NDEBUG
-struct addr_list *bloomf_match_addrs[2];
-
-unsigned long long bloomf_match_addrs_count[2];
-
-struct addr_list *bloomf_maybe_addrs[2];
-
-unsigned long long bloomf_maybe_addrs_count[2];
-#endif
-
-/* Optimized serial implementation! */
-/* Compiler is not vectorizing anything! */
-bool lookup_address(const struct forwarding_table *fw_tbl, uint32_t addr,
-		uint32_t *next_hop)
+/*
+ * Probe 'bf' for the key whose first hash is 'h1' ('h' as 'bloom_hash1()' left
+ * it): h2 is only computed if the first bit is set, or for a cuckoo filter.
+ */
+static inline bool bloom_maybe(const struct counting_bloom_filter *bf,
+		uint32_t h1, uint64_t h)
 {
-	bool found = false;
-	/* Query G2 */
-	struct counting_bloom_filter *bf = fw_tbl->counting_bloom_filters[0];
-	uint32_t pfx_key = addr; //& (0xffffffff << i);
-	bool *bitmap = bf->bitmap;
+#ifdef CUCKOO_FILTER
+	return bf->cuckoo == NULL || cuckoo_contains(bf->cuckoo, h1,
+			bloom_hash2(h));
+#else
+	const bool *bitmap = bf->bitmap;
 	uint32_t bitmap_len = bf->bitmap_len;
 	uint8_t num_hashes = bf->num_hashes;
 
-	/* Calculate hash. */
-	uint32_t h1 = BLOOM_HASH_FUNCTION(pfx_key);
-	bool maybe = bitmap[h1 % bitmap_len];
-	if (maybe) {
-		if (num_hashes > 1) {
-			uint32_t h2 = BLOOM_HASH_FUNCTION(h1);
-			maybe = bitmap[h2 % bitmap_len];
-			for (int j = 2; maybe && j < num_hashes; j++) {
-				uint32_t idx = (h1 + j * h2) % bitmap_len;
-				maybe = bitmap[idx];
-			}
+	bool maybe = num_hashes == 0 || bitmap[fastrange_32(h1, bitmap_len)];
+	if (maybe && num_hashes > 1) {
+		uint32_t h2 = bloom_hash2(h);
+		maybe = bitmap[fastrange_32(h2, bitmap_len)];
+		for (int j = 2; maybe && j < num_hashes; j++) {
+			uint32_t idx = fastrange_32(h1 + j * h2, bitmap_len);
+			maybe = bitmap[idx];
 		}
-		if (maybe) {
-			struct hash_table *ht = fw_tbl->hash_tables[0];
-#ifdef SAME_HASH_FUNCTIONS
-			found = find_next_hop_with_hash(ht, h1, pfx_key,
-					next_hop);
-#else
-			found = find_next_hop(ht, pfx_key, next_hop);
-#endif
+	}
 
-#ifndef NDEBUG
-			bloomf_maybe_addrs_count[0]++;
-			struct addr_list *a = malloc(sizeof(struct addr_list));
-			a->addr = addr;
-			a->next = bloomf_maybe_addrs[0];
-			bloomf_maybe_addrs[0] = a;
-			if (found) {
-				bloomf_match_addrs_count[0]++;
-				a = malloc(sizeof(struct addr_list));
-				a->addr = addr;
-				a->next = bloomf_match_addrs[0];
-				bloomf_match_addrs[0] = a;
-			}
+	return maybe;
 #endif
-		}
-	}
+}
 
+/*
+ * Query the group 'g' (0 = G2, 1 = G1 or 2 = G0) for the prefix 'pfx_key' of
+ * VRF 'vrf'. A NULL Bloom filter means the group is empty.
+ */
+static inline bool lookup_group(const struct forwarding_table *fw_tbl, int g,
+		uint32_t vrf, uint32_t pfx_key, uint32_t *next_hop)
+{
+	const struct counting_bloom_filter *bf = fw_tbl->counting_bloom_filters[g];
+	if (bf == NULL)
+		return false;
+
+	LOOKUP_STATS_THREAD();
+	LOOKUP_STATS_ADD(bf_queries[g], 1);
+
+	/* Calculate hash. */
+	uint64_t h;
+	uint32_t h1;
+	bool found = false;
+#ifdef FUSED_FILTER
+	/* The block holds the next hop, or tells whether to go on. */
+	bool maybe = true;
+	if (bf->fused != NULL)
+		found = fused_find(bf->fused, vrf_key(vrf, pfx_key), vrf == 0,
+				next_hop, &maybe);
+	if (!maybe)
+		return false;
 	if (!found) {
-		/* Query G1 */
-		bf = fw_tbl->counting_bloom_filters[1];
-		pfx_key = addr & 0xffffff00;
-		bitmap = bf->bitmap;
-		bitmap_len = bf->bitmap_len;
-		num_hashes = bf->num_hashes;
-
-		/* Calculate hash. */
-		h1 = BLOOM_HASH_FUNCTION(pfx_key);
-		maybe = bitmap[h1 % bitmap_len];
-		if (maybe) {
-			if (num_hashes > 1) {
-				uint32_t h2 = BLOOM_HASH_FUNCTION(h1);
-				maybe = bitmap[h2 % bitmap_len];
-				for (int j = 2; maybe && j < num_hashes; j++) {
-					uint32_t idx = (h1 + j * h2) % bitmap_len;
-					maybe = bitmap[idx];
-				}
-			}
-			if (maybe) {
-				struct hash_table *ht = fw_tbl->hash_tables[1];
-#ifdef SAME_HASH_FUNCTIONS
-				found = find_next_hop_with_hash(ht, h1, pfx_key,
-						next_hop);
+		h1 = bloom_hash1(vrf_key(vrf, pfx_key), &h);
+		found = find_next_hop_group(fw_tbl, g, h1, vrf, pfx_key,
+				next_hop);
+	}
 #else
-				found = find_next_hop(ht, pfx_key, next_hop);
-#endif
+	h1 = bloom_hash1(vrf_key(vrf, pfx_key), &h);
+	if (!bloom_maybe(bf, h1, h))
+		return false;
 
-#ifndef NDEBUG
-				bloomf_maybe_addrs_count[1]++;
-				struct addr_list *a = malloc(sizeof(struct addr_list));
-				a->addr = addr;
-				a->next = bloomf_maybe_addrs[1];
-				bloomf_maybe_addrs[1] = a;
-				if (found) {
-					bloomf_match_addrs_count[1]++;
-					a = malloc(sizeof(struct addr_list));
-					a->addr = addr;
-					a->next = bloomf_match_addrs[1];
-					bloomf_match_addrs[1] = a;
-				}
+	found = find_next_hop_group(fw_tbl, g, h1, vrf, pfx_key, next_hop);
 #endif
-			}
-		}
 
-	}
+	LOOKUP_STATS_ADD(bf_maybes[g], 1);
+	if (found)
+		LOOKUP_STATS_ADD(ht_hits[g], 1);
+	else
+		LOOKUP_STATS_ADD(false_positives[g], 1);
+
+	return found;
+}
+
+/* Optimized serial implementation! */
+/* Compiler is not vectorizing anything! */
+bool lookup_address(const struct forwarding_table *fw_tbl, uint32_t addr,
+		uint32_t *next_hop)
+{
+	LOOKUP_STATS_THREAD();
+	LOOKUP_STATS_ADD(lookups, 1);
+
+	/* Query G2, then G1. */
+	bool found = lookup_group(fw_tbl, 0, 0, addr, next_hop) ||
+		lookup_group(fw_tbl, 1, 0, addr & 0xffffff00, next_hop);
 
 	/* Counters */
 	//static unsigned int def = 0;
@@ -596,9 +1188,11 @@ bool lookup_address(const struct forwarding_table *fw_tbl, uint32_t addr,
 		*next_hop = fw_tbl->dla[addr >> 12];
 		if ((*next_hop) != 0) {
 			found = true;
-		} else if (fw_tbl->default_route != NULL) {
-			*next_hop = fw_tbl->default_route->next_hop;
+			LOOKUP_STATS_ADD(dla_hits, 1);
+		} else if (fw_tbl->default_routes[0] != NULL) {
+			*next_hop = fw_tbl->default_routes[0]->next_hop;
 			found = true;
+			LOOKUP_STATS_ADD(default_route_hits, 1);
 			/* TEMP */
 			//printf("|*| ");
 			//def++;
@@ -612,130 +1206,627 @@ bool lookup_address(const struct forwarding_table *fw_tbl, uint32_t addr,
 	/* TEMP */
 	//printf("(/%2d) { def = %u, others = %u }\n", i == 32 ? 0 : 32 - (i - 1), def, othrs);
 
+	if (!found)
+		LOOKUP_STATS_ADD(misses, 1);
+
 	return found;
 }
 
-// Initialize in main()
-struct stats stats;
+bool lookup_address_vrf(const struct forwarding_table *fw_tbl, uint32_t vrf,
+		uint32_t addr, uint32_t *next_hop)
+{
+	assert(vrf < fw_tbl->num_vrfs);
+
+	LOOKUP_STATS_THREAD();
+	LOOKUP_STATS_ADD(lookups, 1);
 
-#ifdef __MIC__
+	if (lookup_group(fw_tbl, 0, vrf, addr, next_hop))
+		return true;
+
+	if (lookup_group(fw_tbl, 1, vrf, addr & 0xffffff00, next_hop))
+		return true;
+
+	if (vrf == 0) {
+		*next_hop = fw_tbl->dla[addr >> 12];
+		if ((*next_hop) != 0) {
+			LOOKUP_STATS_ADD(dla_hits, 1);
+			return true;
+		}
+	} else if (lookup_group(fw_tbl, 2, vrf, addr & 0xfffff000, next_hop)) {
+		return true;
+	}
+
+	if (fw_tbl->default_routes[vrf] != NULL) {
+		*next_hop = fw_tbl->default_routes[vrf]->next_hop;
+		LOOKUP_STATS_ADD(default_route_hits, 1);
+		return true;
+	}
+
+	LOOKUP_STATS_ADD(misses, 1);
+	return false;
+}
 
-#if defined(LOOKUP_VEC_INTRIN)
 /*
- * found[16]: must be a false initialized array.
+ * Scratch state of an address in 'lookup_address_batch()': groups are indexed
+ * like the Bloom filters (0 = G2, 1 = G1, 2 = G0).
  */
-void lookup_address_intrin(const struct forwarding_table *fw_tbl,
-		uint32_t g2_addrs[16], bool found[16], uint32_t next_hops[16])
+struct batch_lookup {
+	uint32_t vrf;
+	int num_groups;  /* G0 is only probed outside VRF 0. */
+	uint32_t h1[3];
+	uint32_t h2[3];
+	bool maybe[3];
+	bool in_slot[3];  /* Found in its fused filter block. */
+	uint32_t slot_next_hop[3];
+	bool chained[3];  /* The hash table is probed. */
+	uint32_t ht_hash[3];
+	struct hash_table_entry *const *slot[3];
+	uint64_t ph_hash[3];
+	const struct perfect_hash_entry *ph_entry[3];
+};
+
+/* Test the bits of the key hashed to 'h1' and 'h2' in 'bf'. */
+static inline bool bloom_probe(const struct counting_bloom_filter *bf,
+		uint32_t h1, uint32_t h2)
 {
-	__declspec(align(64)) uint32_t g1_addrs[16];
-	__declspec(align(64)) uint32_t g2_h1[16];
-	__declspec(align(64)) uint32_t g2_h2[16];
-	__declspec(align(64)) uint32_t g1_h1[16];
-	__declspec(align(64)) uint32_t g1_h2[16];
+#ifdef CUCKOO_FILTER
+	return bf->cuckoo == NULL || cuckoo_contains(bf->cuckoo, h1, h2);
+#else
+	const bool *bitmap = bf->bitmap;
+	uint32_t bitmap_len = bf->bitmap_len;
 
-	/* To be autovectorized */
-	for (int i = 0; i < 16; i++) {
-		g1_addrs[i] = g2_addrs[i] & 0xffffff00;
+	bool maybe = bf->num_hashes == 0 || bitmap[fastrange_32(h1, bitmap_len)];
+	if (maybe && bf->num_hashes > 1) {
+		maybe = bitmap[fastrange_32(h2, bitmap_len)];
+		for (int j = 2; maybe && j < bf->num_hashes; j++)
+			maybe = bitmap[fastrange_32(h1 + j * h2, bitmap_len)];
 	}
 
-	for (int i = 0; i < 16; i++) {
-		found[i] = false;
+	return maybe;
+#endif
+}
+
+/* Walk the chain at 'slot' for ('vrf', 'pfx_key'), whose hash is 'hash'. */
+static inline bool find_in_chain(struct hash_table_entry *const *slot,
+		uint32_t hash, uint32_t vrf, uint32_t pfx_key,
+		uint32_t *next_hop)
+{
+	unsigned int steps = 0;
+
+	const struct hash_table_entry *entry;
+	for (entry = *slot; entry != NULL; entry = entry->next) {
+		steps++;
+		if (entry->hash == hash && entry->prefix == pfx_key &&
+				entry->vrf == vrf)
+			break;
 	}
 
-	/* Calculate hashes. */
-	/* G2 */
-	BLOOM_HASH_FUNCTION_INTRIN(g2_addrs, g2_h1);
-	BLOOM_HASH_FUNCTION_INTRIN(g2_h1, g2_h2);
-	/* G1 */
-	BLOOM_HASH_FUNCTION_INTRIN(g1_addrs, g1_h1);
-	BLOOM_HASH_FUNCTION_INTRIN(g1_h1, g1_h2);
+	LOOKUP_STATS_THREAD();
+	LOOKUP_STATS_ADD(chain_steps, steps);
 
-	/* Query G2 */
-	struct counting_bloom_filter *bf = fw_tbl->counting_bloom_filters[0];
-	struct hash_table *ht = fw_tbl->hash_tables[0];
-	bool *bitmap = bf->bitmap;
-	uint32_t bitmap_len = bf->bitmap_len;
-	uint8_t num_hashes = bf->num_hashes;
-	for (int i = 0; i < 16; i++) {
-		bool maybe = bitmap[g2_h1[i] % bitmap_len];
-		if (maybe) {
-			if (num_hashes > 1) {
-				maybe = bitmap[g2_h2[i] % bitmap_len];
-				for (int j = 2; maybe && j < num_hashes; j++) {
-					uint32_t idx = (g2_h1[i] + j * g2_h2[i]) % bitmap_len;
-					maybe = bitmap[idx];
-				}
-			}
+	bool found = entry != NULL;
+	if (found)
+		*next_hop = entry->next_hop;
 
-			if (maybe) {
-                #pragma omp critical
-                stats.bf_match = stats.bf_match + 1;
+	return found;
+}
+
+/*
+ * Look up a window of at most LOOKUP_PREFETCH_DISTANCE addresses in stages, so
+ * that the cache misses of different addresses overlap:
+ *
+ * 	1. hash every address and prefetch its first two bits in the Bloom
+ * 	filters and its DLA slot;
+ * 	2. probe the filters and prefetch the buckets of the "maybes" (and the
+ * 	pilots of the snapshots);
+ * 	3. prefetch the head entries of those buckets (and the snapshot
+ * 	entries);
+ * 	4. walk the chains (G2, G1, then G0) and fall back to the DLA and the
+ * 	default route, like 'lookup_address_vrf()'.
+ *
+ * The i-th address is looked up in VRF 'vrfs[i]', or 0 if 'vrfs' is NULL
+ * (always inlined, so that the VRF handling folds away then). G1 (and G0) are
+ * probed even for the addresses that G2 will match, which is cheap as /32
+ * routes are rare.
+ */
+static inline __attribute__((always_inline)) void lookup_window(
+		const struct forwarding_table *fw_tbl,
+		uint32_t n, const uint32_t *vrfs, const uint32_t *addrs,
+		bool *found, uint32_t *next_hops)
+{
+	static const uint32_t masks[3] = { 0xffffffff, 0xffffff00, 0xfffff000 };
+
+	struct batch_lookup lk[LOOKUP_PREFETCH_DISTANCE];
+
+	/* Stage 1. */
+	for (uint32_t i = 0; i < n; i++) {
+		lk[i].vrf = vrfs != NULL ? vrfs[i] : 0;
+		assert(lk[i].vrf < fw_tbl->num_vrfs);
+		lk[i].num_groups = lk[i].vrf == 0 ? 2 : 3;
+		for (int g = 0; g < lk[i].num_groups; g++) {
+			const struct counting_bloom_filter *bf =
+				fw_tbl->counting_bloom_filters[g];
+			if (bf == NULL)  /* Empty group. */
+				continue;
+			uint32_t key = vrf_key(lk[i].vrf, addrs[i] & masks[g]);
+			uint64_t h;
+			uint32_t h1 = bloom_hash1(key, &h);
+			uint32_t h2 = bloom_hash2(h);
+			lk[i].h1[g] = h1;
+			lk[i].h2[g] = h2;
+#ifdef CUCKOO_FILTER
+			if (bf->cuckoo != NULL)
+				cuckoo_prefetch(bf->cuckoo, h1, h2);
+#elif defined(FUSED_FILTER)
+			if (bf->fused != NULL)
+				fused_prefetch(bf->fused, key);
+#else
+			if (bf->num_hashes == 0)
+				continue;
+			__builtin_prefetch(&bf->bitmap[fastrange_32(h1, bf->bitmap_len)]);
+			__builtin_prefetch(&bf->bitmap[fastrange_32(h2, bf->bitmap_len)]);
+#endif
+		}
+		if (lk[i].vrf == 0)
+			__builtin_prefetch(&fw_tbl->dla[addrs[i] >> 12]);
+	}
+
+	/* Stage 2. */
+	for (uint32_t i = 0; i < n; i++) {
+		for (int g = 0; g < lk[i].num_groups; g++) {
+			const struct counting_bloom_filter *bf =
+				fw_tbl->counting_bloom_filters[g];
+			lk[i].in_slot[g] = false;
+			if (bf == NULL) {
+				lk[i].maybe[g] = false;
+				continue;
+			}
+#ifdef FUSED_FILTER
+			lk[i].maybe[g] = true;
+			if (bf->fused != NULL)
+				lk[i].in_slot[g] = fused_find(bf->fused,
+						vrf_key(lk[i].vrf, addrs[i] & masks[g]),
+						lk[i].vrf == 0,
+						&lk[i].slot_next_hop[g],
+						&lk[i].maybe[g]);
+#else
+			lk[i].maybe[g] = bloom_probe(bf, lk[i].h1[g],
+					lk[i].h2[g]);
+#endif
+			if (!lk[i].maybe[g] || lk[i].in_slot[g])
+				continue;
+
+			const struct perfect_hash *ph = fw_tbl->perfect_hashes[g];
+			if (ph != NULL) {
+				lk[i].ph_hash[g] = perfect_hash_hash(ph,
+						lk[i].vrf, addrs[i] & masks[g]);
+				__builtin_prefetch(perfect_hash_pilot(ph,
+							lk[i].ph_hash[g]));
+			}
 
+			const struct hash_table *ht = fw_tbl->hash_tables[g];
+			lk[i].chained[g] = ph == NULL || ht->total > 0;
+			if (!lk[i].chained[g])
+				continue;
 #ifdef SAME_HASH_FUNCTIONS
-				found[i] = find_next_hop_with_hash(ht, g2_h1[i], g2_addrs[i],
-						&next_hops[i]);
+			uint32_t hash = lk[i].h1[g];
 #else
-				found[i] = find_next_hop(ht, g2_addrs[i], &next_hops[i]);
+			uint32_t hash = HASHTBL_HASH_FUNCTION(vrf_key(lk[i].vrf,
+						addrs[i] & masks[g]));
 #endif
+			lk[i].ht_hash[g] = hash;
+			lk[i].slot[g] = &ht->slots[fastrange_32(hash, ht->range)];
+			__builtin_prefetch(lk[i].slot[g]);
+		}
+	}
 
-                if (found[i]) {
-                    #pragma omp critical
-                    stats.ht_match = stats.ht_match + 1;
-                }
+	/* Stage 3. */
+	for (uint32_t i = 0; i < n; i++) {
+		for (int g = 0; g < lk[i].num_groups; g++) {
+			if (!lk[i].maybe[g] || lk[i].in_slot[g])
+				continue;
+
+			const struct perfect_hash *ph = fw_tbl->perfect_hashes[g];
+			if (ph != NULL) {
+				lk[i].ph_entry[g] = perfect_hash_slot(ph,
+						lk[i].ph_hash[g]);
+				__builtin_prefetch(lk[i].ph_entry[g]);
 			}
+			if (lk[i].chained[g] && *lk[i].slot[g] != NULL)
+				__builtin_prefetch(*lk[i].slot[g]);
 		}
 	}
 
-	/* Query G1 */
-	bf = fw_tbl->counting_bloom_filters[1];
-	ht = fw_tbl->hash_tables[1];
-	bitmap = bf->bitmap;
-	bitmap_len = bf->bitmap_len;
-	num_hashes = bf->num_hashes;
-	for (int i = 0; i < 16; i++) {
-		if (found[i])
-			continue;
+	/* Stage 4. */
+	LOOKUP_STATS_THREAD();
+	for (uint32_t i = 0; i < n; i++) {
+		uint32_t vrf = lk[i].vrf;
+
+		LOOKUP_STATS_ADD(lookups, 1);
+		for (int g = 0; g < lk[i].num_groups; g++)  /* All, in stage 2. */
+			if (fw_tbl->counting_bloom_filters[g] != NULL)
+				LOOKUP_STATS_ADD(bf_queries[g], 1);
+
+		bool hit = false;
+		for (int g = 0; !hit && g < lk[i].num_groups; g++) {
+			if (!lk[i].maybe[g])
+				continue;
+
+			uint32_t pfx_key = addrs[i] & masks[g];
+			if (lk[i].in_slot[g]) {
+				hit = true;
+				next_hops[i] = lk[i].slot_next_hop[g];
+			} else if (fw_tbl->perfect_hashes[g] != NULL) {
+				LOOKUP_STATS_ADD(chain_steps, 1);
+				hit = perfect_hash_match(lk[i].ph_entry[g], vrf,
+						pfx_key);
+				if (hit)
+					next_hops[i] = lk[i].ph_entry[g]->next_hop;
+			}
+			if (!hit && lk[i].chained[g])
+				hit = find_in_chain(lk[i].slot[g],
+						lk[i].ht_hash[g], vrf, pfx_key,
+						&next_hops[i]);
 
-		bool maybe = bitmap[g1_h1[i] % bitmap_len];
-		if (maybe) {
-			if (num_hashes > 1) {
-				maybe = bitmap[g1_h2[i] % bitmap_len];
-				for (int j = 2; maybe && j < num_hashes; j++) {
-					uint32_t idx = (g1_h1[i] + j * g1_h2[i]) % bitmap_len;
-					maybe = bitmap[idx];
-				}
+			LOOKUP_STATS_ADD(bf_maybes[g], 1);
+			if (hit)
+				LOOKUP_STATS_ADD(ht_hits[g], 1);
+			else
+				LOOKUP_STATS_ADD(false_positives[g], 1);
+		}
+
+		if (!hit && vrf == 0) {
+			next_hops[i] = fw_tbl->dla[addrs[i] >> 12];
+			if (next_hops[i] != 0) {
+				hit = true;
+				LOOKUP_STATS_ADD(dla_hits, 1);
 			}
+		}
+		if (!hit && fw_tbl->default_routes[vrf] != NULL) {
+			next_hops[i] = fw_tbl->default_routes[vrf]->next_hop;
+			hit = true;
+			LOOKUP_STATS_ADD(default_route_hits, 1);
+		}
+
+		if (!hit)
+			LOOKUP_STATS_ADD(misses, 1);
+		found[i] = hit;
+	}
+}
+
+void lookup_address_batch(const struct forwarding_table *fw_tbl, uint32_t n,
+		const uint32_t *addrs, bool *found, uint32_t *next_hops)
+{
+	for (uint32_t i = 0; i < n; i += LOOKUP_PREFETCH_DISTANCE) {
+		uint32_t len = n - i < LOOKUP_PREFETCH_DISTANCE ?
+			n - i : LOOKUP_PREFETCH_DISTANCE;
+		lookup_window(fw_tbl, len, NULL, &addrs[i], &found[i],
+				&next_hops[i]);
+	}
+}
+
+void lookup_address_vrf_batch(const struct forwarding_table *fw_tbl,
+		uint32_t n, const uint32_t *vrfs, const uint32_t *addrs,
+		bool *found, uint32_t *next_hops)
+{
+	for (uint32_t i = 0; i < n; i += LOOKUP_PREFETCH_DISTANCE) {
+		uint32_t len = n - i < LOOKUP_PREFETCH_DISTANCE ?
+			n - i : LOOKUP_PREFETCH_DISTANCE;
+		lookup_window(fw_tbl, len, &vrfs[i], &addrs[i], &found[i],
+				&next_hops[i]);
+	}
+}
+
+#if defined(__MIC__) || defined(__AVX512F__)
+
+#if defined(LOOKUP_VEC_INTRIN)
+#include <immintrin.h>
+
+/* 'fastrange_32()' for sixteen lanes. */
+static inline __m512i mm512_fastrange_epu32(__m512i x, uint32_t len)
+{
+	__m512i l = _mm512_set1_epi32(len);
+#if defined(__MIC__)
+	return _mm512_mulhi_epu32(x, l);
+#else
+	/* 32 x 32 -> 64-bit products of the even lanes, then the odd ones. */
+	__m512i even = _mm512_srli_epi64(_mm512_mul_epu32(x, l), 32);
+	__m512i odd = _mm512_mul_epu32(_mm512_srli_epi64(x, 32), l);
+
+	return _mm512_mask_blend_epi32(0xaaaa, even, odd);
+#endif
+}
+
+/*
+ * Gather 'bitmap[idx[i]]' for the lanes set in 'mask' (zero elsewhere). The
+ * AVX-512F gather reads four bytes, hence the padding after the bitmap.
+ */
+static inline __m512i mm512_gather_bits(__mmask16 mask, __m512i idx,
+		const bool *bitmap)
+{
+#if defined(__MIC__)
+	return _mm512_mask_i32extgather_epi32(_mm512_setzero_epi32(), mask, idx,
+			bitmap, _MM_UPCONV_EPI32_UINT8, 1, _MM_HINT_NONE);
+#else
+	__m512i words = _mm512_mask_i32gather_epi32(_mm512_setzero_epi32(),
+			mask, idx, bitmap, 1);
+	return _mm512_and_epi32(words, _mm512_set1_epi32(0xff));
+#endif
+}
+
+/*
+ * Probe 'bf' for the lanes set in 'mask', with the same k indexes as
+ * 'hashes()': h1, h2, h1 + 2 * h2, ... Return the "maybe" lanes.
+ */
+static inline __mmask16 bloom_probe_intrin(const struct counting_bloom_filter *bf,
+		__mmask16 mask, __m512i h1, __m512i h2)
+{
+	if (bf == NULL)  /* Empty group. */
+		return 0;
+
+#ifdef CUCKOO_FILTER
+	/* One lane at a time: a bucket is a bit field of a 64-bit word. */
+	if (bf->cuckoo != NULL) {
+		_Alignas(64) uint32_t h1s[16];
+		_Alignas(64) uint32_t h2s[16];
+		_mm512_store_epi32(h1s, h1);
+		_mm512_store_epi32(h2s, h2);
+		for (int i = 0; i < 16; i++) {
+			if ((mask >> i & 1) &&
+					!cuckoo_contains(bf->cuckoo, h1s[i], h2s[i]))
+				mask &= ~(1 << i);
+		}
+	}
+#else
+	for (int j = 0; mask != 0 && j < bf->num_hashes; j++) {
+		__m512i idx;
+		if (j == 0)
+			idx = h1;
+		else if (j == 1)
+			idx = h2;
+		else
+			idx = _mm512_add_epi32(h1,
+					_mm512_mullo_epi32(_mm512_set1_epi32(j), h2));
+		idx = mm512_fastrange_epu32(idx, bf->bitmap_len);
+
+		__m512i bits = mm512_gather_bits(mask, idx, bf->bitmap);
+		mask = _mm512_mask_test_epi32_mask(mask, bits, bits);
+	}
+#endif
+
+	return mask;
+}
+
+#if defined(__AVX512F__)
+/*
+ * Insert 'y' as the 'half'-th 256-bit half of 'x'. The intrinsic wants an
+ * immediate, which a loop counter only becomes once the loop is unrolled (not
+ * at -O0).
+ */
+static inline __m512i mm512_insert_half(__m512i x, __m256i y, int half)
+{
+	return half == 0 ? _mm512_inserti64x4(x, y, 0) :
+		_mm512_inserti64x4(x, y, 1);
+}
+#endif
+
+/*
+ * Look the 'mask' lanes of 'keys' (VRF 0) up in 'ht', whose hashes are 'h',
+ * and store the next hops of the matches. With AVX-512F, the head entry of
+ * every bucket is checked with gathers; only the lanes whose head doesn't
+ * match but has a successor (overflow chains, which are rare with 'range' =
+ * 'capacity') walk the chain in scalar code. Return the matching lanes.
+ */
+static inline __mmask16 find_next_hops_intrin(struct hash_table *ht,
+		__mmask16 mask, __m512i keys, __m512i h, uint32_t next_hops[16])
+{
+	__mmask16 found = 0;
+	__mmask16 chained = mask;
+
+#if defined(__AVX512F__)
+	__m512i idx = mm512_fastrange_epu32(h, ht->range);
+	__m512i zero = _mm512_setzero_epi32();
+	__m256i none = _mm256_setzero_si256();
+
+	/* Gather the head entries of the buckets, eight (pointers) at a time. */
+	__m512i entries[2];
+	__mmask8 m[2];
+	__m512i e_hash = zero, e_prefix = zero, e_vrf = zero;
+	for (int half = 0; half < 2; half++) {
+		__m256i idx_half = half == 0 ? _mm512_castsi512_si256(idx) :
+			_mm512_extracti64x4_epi64(idx, 1);
+		m[half] = (__mmask8)(mask >> (8 * half));
+		entries[half] = _mm512_mask_i32gather_epi64(zero, m[half],
+				idx_half, ht->slots, 8);
+		m[half] = _mm512_mask_test_epi64_mask(m[half], entries[half],
+				entries[half]);
+
+		e_hash = mm512_insert_half(e_hash, _mm512_mask_i64gather_epi32(
+					none, m[half], entries[half],
+					(void *)offsetof(struct hash_table_entry, hash),
+					1), half);
+		e_prefix = mm512_insert_half(e_prefix, _mm512_mask_i64gather_epi32(
+					none, m[half], entries[half],
+					(void *)offsetof(struct hash_table_entry, prefix),
+					1), half);
+		e_vrf = mm512_insert_half(e_vrf, _mm512_mask_i64gather_epi32(
+					none, m[half], entries[half],
+					(void *)offsetof(struct hash_table_entry, vrf),
+					1), half);
+	}
+
+	__mmask16 heads = (__mmask16)m[0] | ((__mmask16)m[1] << 8);
+	found = _mm512_mask_cmpeq_epi32_mask(heads, e_hash, h);
+	found = _mm512_mask_cmpeq_epi32_mask(found, e_prefix, keys);
+	found = _mm512_mask_cmpeq_epi32_mask(found, e_vrf, zero);
+
+	/* Fetch the matches and find which mismatching heads have successors. */
+	__m512i nh = zero;
+	chained = 0;
+	for (int half = 0; half < 2; half++) {
+		__mmask8 match = (__mmask8)(found >> (8 * half));
+		__mmask8 miss = m[half] & ~match;
+
+		nh = mm512_insert_half(nh, _mm512_mask_i64gather_epi32(none,
+					match, entries[half],
+					(void *)offsetof(struct hash_table_entry, next_hop),
+					1), half);
+
+		__m512i e_next = _mm512_mask_i64gather_epi64(zero, miss,
+				entries[half],
+				(void *)offsetof(struct hash_table_entry, next), 1);
+		chained |= (__mmask16)_mm512_mask_test_epi64_mask(miss, e_next,
+				e_next) << (8 * half);
+	}
 
-			if (maybe) {
-                #pragma omp critical
-                stats.bf_match = stats.bf_match + 1;
+	_mm512_mask_store_epi32(next_hops, found, nh);
 
+	LOOKUP_STATS_THREAD();
+	LOOKUP_STATS_ADD(chain_steps, __builtin_popcount(heads & ~chained));
+#endif
+
+	_Alignas(64) uint32_t k[16];
 #ifdef SAME_HASH_FUNCTIONS
-				found[i] = find_next_hop_with_hash(ht, g1_h1[i], g1_addrs[i],
-						&next_hops[i]);
+	_Alignas(64) uint32_t hs[16];
+	_mm512_store_epi32(hs, h);
+#endif
+	_mm512_store_epi32(k, keys);
+	while (chained != 0) {
+		int i = __builtin_ctz(chained);
+		chained &= chained - 1;
+#ifdef SAME_HASH_FUNCTIONS
+		if (find_next_hop_with_hash(ht, hs[i], 0, k[i], &next_hops[i]))
 #else
-				found[i] = find_next_hop(ht, g1_addrs[i], &next_hops[i]);
+		if (find_next_hop(ht, 0, k[i], &next_hops[i]))
 #endif
+			found |= 1 << i;
+	}
 
-                if (found[i]) {
-                    #pragma omp critical
-                    stats.ht_match = stats.ht_match + 1;
-                }
-			}
+	return found;
+}
+
+/*
+ * Query the group 'g' (0 = G2 or 1 = G1) for the 'mask' lanes of 'keys'. A
+ * NULL Bloom filter means the group is empty.
+ */
+static inline __mmask16 lookup_group_intrin(const struct forwarding_table *fw_tbl,
+		int g, __mmask16 mask, uint32_t keys[16], uint32_t next_hops[16])
+{
+	const struct counting_bloom_filter *bf = fw_tbl->counting_bloom_filters[g];
+	if (bf == NULL)  /* Empty group. */
+		return 0;
+
+	_Alignas(64) uint32_t h1[16];
+	_Alignas(64) uint32_t h2[16];
+
+	/* Calculate hashes. */
+#ifdef SINGLE_HASH
+	SINGLE_HASH_FUNCTION_INTRIN(keys, h1, h2);
+#else
+	BLOOM_HASH_FUNCTION_INTRIN(keys, h1);
+	BLOOM_HASH_FUNCTION_INTRIN(h1, h2);
+#endif
+
+	LOOKUP_STATS_THREAD();
+	LOOKUP_STATS_ADD(bf_queries[g], __builtin_popcount(mask));
+
+	__mmask16 in_slots = 0;
+#ifdef FUSED_FILTER
+	/* One lane at a time, the hits in the blocks apart. */
+	__mmask16 maybe = mask;
+	if (bf->fused != NULL) {
+		maybe = 0;
+		for (__mmask16 rest = mask; rest != 0; rest &= rest - 1) {
+			int i = __builtin_ctz(rest);
+			bool m;
+			if (fused_find(bf->fused, keys[i], true, &next_hops[i], &m))
+				in_slots |= 1 << i;
+			else if (m)
+				maybe |= 1 << i;
 		}
+	}
+#else
+	__mmask16 maybe = bloom_probe_intrin(bf, mask, _mm512_load_epi32(h1),
+			_mm512_load_epi32(h2));
+#endif
+	if ((maybe | in_slots) == 0)
+		return 0;
 
-		if (!found[i]) {
-			next_hops[i] = fw_tbl->dla[g2_addrs[i] >> 12];
-			if (next_hops[i] != 0) {
-				found[i] = true;
-			} else if (fw_tbl->default_route != NULL) {
-				next_hops[i] = fw_tbl->default_route->next_hop;
-				found[i] = true;
-			}
+#ifdef SAME_HASH_FUNCTIONS
+	__m512i h = _mm512_load_epi32(h1);
+#else
+	_Alignas(64) uint32_t ht_h[16];
+	HASHTBL_HASH_FUNCTION_INTRIN(keys, ht_h);
+	__m512i h = _mm512_load_epi32(ht_h);
+#endif
+
+	__mmask16 found = 0;
+	if (maybe != 0 && fw_tbl->perfect_hashes[g] != NULL) {
+		/* One lane at a time: there is no bucket to gather. */
+		for (__mmask16 rest = maybe; rest != 0; rest &= rest - 1) {
+			int i = __builtin_ctz(rest);
+			if (find_next_hop_group(fw_tbl, g, h1[i], 0, keys[i],
+						&next_hops[i]))
+				found |= 1 << i;
 		}
+	} else if (maybe != 0) {
+		found = find_next_hops_intrin(fw_tbl->hash_tables[g], maybe,
+				_mm512_load_epi32(keys), h, next_hops);
 	}
+
+	found |= in_slots;
+	LOOKUP_STATS_ADD(bf_maybes[g], __builtin_popcount(maybe | in_slots));
+	LOOKUP_STATS_ADD(ht_hits[g], __builtin_popcount(found));
+	LOOKUP_STATS_ADD(false_positives[g], __builtin_popcount(maybe & ~found));
+
+	return found;
 }
-#endif
 
+uint16_t lookup_address_intrin(const struct forwarding_table *fw_tbl,
+		uint32_t g2_addrs[16], uint32_t next_hops[16])
+{
+	_Alignas(64) uint32_t g1_addrs[16];
+
+	__m512i addrs = _mm512_load_epi32(g2_addrs);
+	_mm512_store_epi32(g1_addrs,
+			_mm512_and_epi32(addrs, _mm512_set1_epi32(0xffffff00)));
+
+	LOOKUP_STATS_THREAD();
+	LOOKUP_STATS_ADD(lookups, 16);
+
+	/* Query G2 */
+	__mmask16 found = lookup_group_intrin(fw_tbl, 0, 0xffff, g2_addrs,
+			next_hops);
+
+	/* Query G1 */
+	if (found != 0xffff)
+		found |= lookup_group_intrin(fw_tbl, 1, (__mmask16)~found,
+				g1_addrs, next_hops);
+
+	/* Query DLA */
+	__mmask16 rest = ~found;
+	if (rest != 0) {
+		__m512i nh = _mm512_mask_i32gather_epi32(_mm512_setzero_epi32(),
+				rest, _mm512_srli_epi32(addrs, 12), fw_tbl->dla, 4);
+		__mmask16 hit = _mm512_mask_test_epi32_mask(rest, nh, nh);
+		_mm512_mask_store_epi32(next_hops, hit, nh);
+		found |= hit;
+		rest &= ~hit;
+		LOOKUP_STATS_ADD(dla_hits, __builtin_popcount(hit));
+
+		if (rest != 0 && fw_tbl->default_routes[0] != NULL) {
+			_mm512_mask_store_epi32(next_hops, rest, _mm512_set1_epi32(
+					fw_tbl->default_routes[0]->next_hop));
+			found |= rest;
+			LOOKUP_STATS_ADD(default_route_hits,
+					__builtin_popcount(rest));
+		} else {
+			LOOKUP_STATS_ADD(misses, __builtin_popcount(rest));
+		}
+	}
+
+	return found;
+}
 #endif
 
+#endif
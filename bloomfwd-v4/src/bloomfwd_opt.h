@@ -1,25 +1,16 @@
 #ifndef BLOOMFWD_OPT_H
 #define BLOOMFWD_OPT_H
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 
+#include "arena.h"
 #include "config.h"
-
-#ifndef NDEBUG
-struct addr_list {
-	uint32_t addr;
-	struct addr_list *next;
-};
-
-extern struct addr_list *bloomf_match_addrs[2];
-
-extern unsigned long long bloomf_match_addrs_count[2];
-
-extern struct addr_list *bloomf_maybe_addrs[2];
-
-extern unsigned long long bloomf_maybe_addrs_count[2];
-#endif
+#include "cuckoofilter.h"
+#include "fusedfilter.h"
+#include "perfecthash.h"
 
 struct ipv4_prefix {
 	uint32_t next_hop;
@@ -27,23 +18,47 @@ struct ipv4_prefix {
 	uint8_t netmask;
 };
 
-extern struct stats {
-    unsigned long long bf_match;
-    unsigned long long ht_match;
-} stats;
-
+/*
+ * A filter sized for a false positive ratio of 1 has no bitmap and no hashes:
+ * lookups go straight to the hash table of its group.
+ *
+ * Lookups only read the fields before 'counters'. The counters are 4-bit, two
+ * per byte (position i in the low half of byte i / 2 if i is even), in an
+ * allocation of their own. A counter saturates at BLOOM_COUNTER_MAX: it no
+ * longer tells how many keys set its position, which must then stay set.
+ *
+ * In CUCKOO_FILTER builds, a cuckoo filter sized for the same ratio takes the
+ * place of the bitmap and the counters, which are left empty (as is 'cuckoo'
+ * for a ratio of 1).
+ *
+ * In FUSED_FILTER builds, a fused filter takes their place likewise, and also
+ * holds the next hops of the keys of VRF 0 that fit in its blocks: only the
+ * others are stored in the hash table of the group. The ratio only tells
+ * whether there is a filter (its overflow bits are per block). It can't be
+ * resized: the hash table doesn't have all the keys.
+ */
 struct counting_bloom_filter {
 	bool *bitmap;
 	uint32_t bitmap_len;
-	uint8_t *counters;  /* This array is as long as 'bitmap'. */
+	uint8_t num_hashes;  /* 0 if there is no bitmap. */
+	struct cuckoo_filter *cuckoo;  /* CUCKOO_FILTER builds only. */
+	struct fused_filter *fused;  /* FUSED_FILTER builds only. */
+	uint8_t *counters;  /* NULL if dropped (see 'drop_bloom_counters()'). */
+	uint32_t saturated;  /* Number of counters at BLOOM_COUNTER_MAX. */
 	uint32_t capacity;
-	uint8_t num_hashes;
+	double false_positive_ratio;  /* The one it was sized for. */
 };
 
+#define BLOOM_COUNTER_MAX 15
+
+/* Keys of a snapshot per bucket of the hash table that takes its updates. */
+#define PERFECT_HASH_OVERLAY 16
+
 struct hash_table_entry {
     uint32_t hash;
     uint32_t prefix;
     uint32_t next_hop;
+    uint32_t vrf;  /* Fits in the padding before 'next'. */
     struct hash_table_entry *next;
 };
 
@@ -53,11 +68,26 @@ struct hash_table {
     struct hash_table_entry **slots;
 };
 
+/*
+ * Multi-VRF tables share a single set of Bloom filters and hash tables, keyed
+ * by (vrf, prefix). VRF 0 keeps the DLA for the first 20 prefixes lengths; the
+ * other VRFs store their /20 (CPE'd) prefixes in G0 instead, so that memory
+ * grows with the total number of routes rather than with the number of VRFs.
+ *
+ * In PERFECT_HASH builds, 'pack_forwarding_table()' moves the keys of each
+ * group to a minimal perfect hash table (see perfecthash.h), the snapshot: the
+ * hash table of the group is emptied, and only holds the keys stored since (the
+ * overlay). A key is in either one, never both.
+ */
 struct forwarding_table {
-	struct ipv4_prefix *default_route;  /* 0.0.0.0/0. */
-	uint32_t *dla; /* For the first 20 prefixes lengths. */
-	struct counting_bloom_filter *counting_bloom_filters[2]; /* 0 -> G2, 1 -> G1 */
-	struct hash_table *hash_tables[2]; /* 0 -> G2, 1 -> G1 */
+	_Atomic uint32_t generation;  /* Bumped after every update (see flowcache.h). */
+	uint32_t num_vrfs;
+	struct ipv4_prefix **default_routes;  /* 0.0.0.0/0, one per VRF. */
+	uint32_t *dla; /* For the first 20 prefixes lengths (VRF 0). */
+	struct counting_bloom_filter *counting_bloom_filters[3]; /* 0 -> G2, 1 -> G1, 2 -> G0 */
+	struct hash_table *hash_tables[3]; /* 0 -> G2, 1 -> G1, 2 -> G0 */
+	struct perfect_hash *perfect_hashes[3];  /* NULL if not packed (or empty). */
+	struct arena *arena;  /* Hash table entries and default routes. */
 };
 
 struct ipv4_prefix *new_ipv4_prefix(uint8_t a, uint8_t b, uint8_t c, uint8_t d,
@@ -68,13 +98,100 @@ uint32_t new_ipv4_addr(uint8_t a, uint8_t b, uint8_t c, uint8_t d);
 struct forwarding_table *new_forwarding_table(FILE *pfx_distribution,
 		uint32_t *gw_def);
 
+/*
+ * Allocate a table for 'num_vrfs' VRFs. The distribution file gives the total
+ * number of /32 and /24 prefixes over all VRFs, and the number of /20
+ * prefixes over VRFs other than 0.
+ */
+struct forwarding_table *new_forwarding_table_vrf(FILE *pfx_distribution,
+		uint32_t num_vrfs);
+
+/*
+ * Like 'new_forwarding_table_vrf()', with the false positive ratio of each
+ * Bloom filter in 'fprs' (indexed like them) instead of FALSE_POSITIVE_RATIO.
+ * A ratio of 1 leaves the group without a filter.
+ */
+struct forwarding_table *new_forwarding_table_fpr(FILE *pfx_distribution,
+		uint32_t num_vrfs, const double fprs[3]);
+
+/*
+ * Resize the Bloom filter of group 'g' for the false positive ratio 'fpr' and
+ * fill it again from the keys of its hash table. Lookups must not run
+ * meanwhile. Not in FUSED_FILTER builds.
+ */
+void resize_bloom_filter(struct forwarding_table *fw_tbl, int g, double fpr);
+
+/* Bytes of the Bloom filters (or cuckoo filters) of 'fw_tbl' that lookups read. */
+size_t membership_filters_size(const struct forwarding_table *fw_tbl);
+
+/*
+ * Number of keys of group 'g', in its snapshot and its hash table (and in its
+ * fused filter).
+ */
+uint32_t group_num_keys(const struct forwarding_table *fw_tbl, int g);
+
+/*
+ * Free the counters of the Bloom filters of 'fw_tbl', leaving only what
+ * lookups read, for tables that won't be updated (e.g. NUMA replicas). Stores
+ * still set the bitmaps; copies and resized filters have no counters either.
+ */
+void drop_bloom_counters(struct forwarding_table *fw_tbl);
+
+/*
+ * Return a deep copy of 'src', allocated (and first touched) by the calling
+ * thread.
+ */
+struct forwarding_table *copy_forwarding_table(
+		const struct forwarding_table *src);
+
+/*
+ * Move the hash table entries (and default routes) of 'fw_tbl' to a single
+ * block of memory, in bucket order, so that the entries of a chain are next
+ * to each other. Call it once the table is loaded. In PERFECT_HASH builds,
+ * the keys of each group (the overlay included) go to a new snapshot instead.
+ */
+void pack_forwarding_table(struct forwarding_table *fw_tbl);
+
+/* Free 'fw_tbl' (the nodes all at once, with its arena). */
+void free_forwarding_table(struct forwarding_table *fw_tbl);
+
+/*
+ * Store the prefixes of 'pfxs', updating the next hops of those already
+ * stored. No lookup may run on 'fw_tbl' meanwhile; the flow caches drop their
+ * entries at their next lookup (see flowcache.h).
+ */
 void load_prefixes(struct forwarding_table *fw_tbl, FILE *pfxs);
 
+void load_prefixes_vrf(struct forwarding_table *fw_tbl, uint32_t vrf,
+		FILE *pfxs);
+
 /* Scalar */
 bool lookup_address(const struct forwarding_table *fw_tbl,
 		uint32_t addr, uint32_t *next_hop);
 
-void lookup_address_intrin(const struct forwarding_table *fw_tbl,
-		uint32_t g2_addrs[16], bool found[16], uint32_t next_hops[16]);
+bool lookup_address_vrf(const struct forwarding_table *fw_tbl, uint32_t vrf,
+		uint32_t addr, uint32_t *next_hop);
+
+/*
+ * Look up 'n' (vrf, addr) pairs, which may belong to different VRFs, in
+ * windows like 'lookup_address_batch()'.
+ */
+void lookup_address_vrf_batch(const struct forwarding_table *fw_tbl,
+		uint32_t n, const uint32_t *vrfs, const uint32_t *addrs,
+		bool *found, uint32_t *next_hops);
+
+/*
+ * Look up 'n' addresses (VRF 0), with the memory accesses of up to
+ * LOOKUP_PREFETCH_DISTANCE addresses in flight at a time.
+ */
+void lookup_address_batch(const struct forwarding_table *fw_tbl, uint32_t n,
+		const uint32_t *addrs, bool *found, uint32_t *next_hops);
+
+/*
+ * Look up sixteen addresses (VRF 0) at once. Both arrays must be 64-byte
+ * aligned. Return the mask of the addresses that were found.
+ */
+uint16_t lookup_address_intrin(const struct forwarding_table *fw_tbl,
+		uint32_t g2_addrs[16], uint32_t next_hops[16]);
 #endif
 
@@ -0,0 +1,143 @@
+/*
+ * bloomtune.c
+ */
+
+#include <math.h>
+#include <stdint.h>
+
+#include "bloomtune.h"
+#include "config.h"  /* FALSE_POSITIVE_RATIO */
+
+/* No filter, then 1, 1 + 1 / BLOOM_TUNE_STEPS, ..., BLOOM_TUNE_MAX_BITS. */
+#define NUM_CHOICES ((BLOOM_TUNE_MAX_BITS - 1) * BLOOM_TUNE_STEPS + 2)
+
+/*
+ * Expected memory accesses of the choice of 'b' positions per key and 'k'
+ * hashes ('b' = 0 for no filter).
+ */
+static double group_cost(double queries, double hits, double ht_cost,
+		double b, int k)
+{
+	if (b == 0.0)
+		return queries * ht_cost;
+
+	double p = 1.0 - exp(-k / b);
+	double fpr = pow(p, k);
+	double negative = (1.0 - fpr) / (1.0 - p);  /* Positions read. */
+
+	return (queries - hits) * (negative + fpr * ht_cost) +
+		hits * (k + ht_cost);
+}
+
+/* Positions per key of the choice 'i'. */
+static double choice_bits(int i)
+{
+	return i == 0 ? 0.0 : 1.0 + (double)(i - 1) / BLOOM_TUNE_STEPS;
+}
+
+/* Number of hashes of a filter of 'b' positions per key. */
+static int num_hashes(double b)
+{
+	return ceil(log(2.0) * b);
+}
+
+size_t bloom_filters_len(const struct forwarding_table *fw_tbl)
+{
+	size_t len = 0;
+	for (int g = 0; g < 3; g++) {
+		if (fw_tbl->counting_bloom_filters[g] != NULL)
+			len += fw_tbl->counting_bloom_filters[g]->bitmap_len;
+	}
+
+	return len;
+}
+
+void tune_bloom_filters(const struct forwarding_table *fw_tbl,
+		const struct lookup_stats *stats, size_t budget,
+		struct bloom_tuning *tuning)
+{
+	if (budget == 0)
+		budget = bloom_filters_len(fw_tbl);
+
+	/* A probe reads the slot, then the entries of its chain. */
+	unsigned long long maybes = 0;
+	for (int g = 0; g < 3; g++)
+		maybes += stats->bf_maybes[g];
+	double ht_cost = maybes > 0 ? 1.0 + (double)stats->chain_steps / maybes :
+		2.0;
+	double lookups = stats->lookups > 0 ? stats->lookups : 1;
+
+	/* Cost and length of each choice, by group (one choice if empty). */
+	double costs[3][NUM_CHOICES];
+	size_t lens[3][NUM_CHOICES];
+	int num_choices[3];
+	tuning->cost_before = 0.0;
+	for (int g = 0; g < 3; g++) {
+		const struct counting_bloom_filter *bf =
+			fw_tbl->counting_bloom_filters[g];
+		if (bf == NULL || bf->capacity == 0) {
+			costs[g][0] = 0.0;
+			lens[g][0] = 0;
+			num_choices[g] = 1;
+			continue;
+		}
+
+		double queries = stats->bf_queries[g] / lookups;
+		double hits = stats->ht_hits[g] / lookups;
+		for (int i = 0; i < NUM_CHOICES; i++) {
+			double b = choice_bits(i);
+			costs[g][i] = group_cost(queries, hits, ht_cost, b,
+					num_hashes(b));
+			lens[g][i] = ceil(bf->capacity * b);
+		}
+		num_choices[g] = NUM_CHOICES;
+
+		tuning->cost_before += group_cost(queries, hits, ht_cost,
+				(double)bf->bitmap_len / bf->capacity,
+				bf->num_hashes);
+	}
+
+	/* There are three groups at most: try every combination. */
+	int best[3] = { 0, 0, 0 };
+	double best_cost = INFINITY;
+	size_t best_len = 0;
+	for (int i = 0; i < num_choices[0]; i++) {
+		for (int j = 0; j < num_choices[1]; j++) {
+			size_t len = lens[0][i] + lens[1][j];
+			if (len > budget)
+				break;
+
+			for (int l = 0; l < num_choices[2]; l++) {
+				if (len + lens[2][l] > budget)
+					break;
+
+				double cost = costs[0][i] + costs[1][j] +
+					costs[2][l];
+				if (cost < best_cost || (cost == best_cost &&
+							len + lens[2][l] < best_len)) {
+					best_cost = cost;
+					best_len = len + lens[2][l];
+					best[0] = i;
+					best[1] = j;
+					best[2] = l;
+				}
+			}
+		}
+	}
+
+	/* As 'new_counting_bloom_filter()' sizes a filter from its ratio. */
+	tuning->cost = 0.0;
+	tuning->bitmap_len = 0;
+	for (int g = 0; g < 3; g++) {
+		const struct counting_bloom_filter *bf =
+			fw_tbl->counting_bloom_filters[g];
+		double b = choice_bits(best[g]);
+		if (num_choices[g] > 1)
+			tuning->fprs[g] = pow(2.0, -b * log(2.0));  /* 1 if b = 0. */
+		else
+			tuning->fprs[g] = bf != NULL ? bf->false_positive_ratio :
+				FALSE_POSITIVE_RATIO;
+		tuning->cost += costs[g][best[g]];
+		tuning->bitmap_len += lens[g][best[g]];
+	}
+}
@@ -0,0 +1,59 @@
+/*
+ * bloomtune.h
+ *
+ * Choice of the false positive ratio of each Bloom filter from the observed
+ * query mix (see lookupstats.h), for a total bitmap budget.
+ *
+ * Group g holds K_g keys and is probed by a fraction Q_g of the lookups, H_g
+ * of which find their key in the hash table. With b_g bitmap positions per key,
+ * the filter has k_g = ceil(b_g ln 2) hashes (as 'new_counting_bloom_filter()'
+ * computes them), a fraction p_g = 1 - e^(-k_g / b_g) of its positions set and
+ * a false positive ratio f_g = p_g^k_g. The expected number of memory accesses
+ * per lookup of the group is then:
+ *
+ * 	(Q_g - H_g) ((1 - p_g^k_g) / (1 - p_g) + f_g C) + H_g (k_g + C)
+ *
+ * that is, a negative stops at the first position that is not set and only
+ * goes on to the hash table on a false positive, while a hit reads all of its
+ * positions and the hash table. C is the cost of a hash table probe: the slot
+ * plus the entries visited per probe, as measured.
+ *
+ * Without a filter (b_g = 0), every lookup of the group probes the hash table:
+ * Q_g C. That wins when most of the lookups that reach the group hit it.
+ *
+ * The sum over the groups is minimized under sum K_g b_g <= budget, with b_g
+ * either 0 or searched in steps of 1/BLOOM_TUNE_STEPS between 1 and
+ * BLOOM_TUNE_MAX_BITS.
+ */
+
+#ifndef BLOOMTUNE_H
+#define BLOOMTUNE_H
+
+#include <stddef.h>
+
+#include "bloomfwd_opt.h"
+#include "lookupstats.h"
+
+#define BLOOM_TUNE_STEPS 4
+#define BLOOM_TUNE_MAX_BITS 32
+
+struct bloom_tuning {
+	double fprs[3];  /* Indexed like the Bloom filters (1: no filter). */
+	size_t bitmap_len;  /* Total of the filters. */
+	double cost;  /* Expected memory accesses per lookup. */
+	double cost_before;  /* ... with the filters of the table. */
+};
+
+/* Total length of the bitmaps of 'fw_tbl' (one byte per position). */
+size_t bloom_filters_len(const struct forwarding_table *fw_tbl);
+
+/*
+ * Choose the false positive ratios of the filters of 'fw_tbl' for the lookups
+ * counted in 'stats' and a total bitmap length 'budget' (0 keeps the current
+ * one). A group that no lookup probed gets no filter.
+ */
+void tune_bloom_filters(const struct forwarding_table *fw_tbl,
+		const struct lookup_stats *stats, size_t budget,
+		struct bloom_tuning *tuning);
+
+#endif
@@ -25,7 +25,8 @@
 #endif
 
 /*
- * Set the hash function to be used.
+ * Set the hash function to be used: MurmurHash3, Knuth's multiplicative hash,
+ * H2, CRC-32C or XXH32 (see hashfunctions.h and 'hashbench').
  *
  * Default: MurmurHash3
  */
@@ -37,6 +38,14 @@
 #define BLOOM_HASH_FUNCTION knuthhash_32
 #define BLOOM_HASH_FUNCTION_INTRIN knuthhash_32_vec512
 #define BLOOM_HASH_FUNCTION_KNUTH
+#elif defined(BLOOM_CRC32C_HASH)
+#define BLOOM_HASH_FUNCTION crc32chash_32
+#define BLOOM_HASH_FUNCTION_INTRIN crc32chash_32_vec512
+#define BLOOM_HASH_FUNCTION_CRC32C
+#elif defined(BLOOM_XXHASH_HASH)
+#define BLOOM_HASH_FUNCTION xxhash_32
+#define BLOOM_HASH_FUNCTION_INTRIN xxhash_32_vec512
+#define BLOOM_HASH_FUNCTION_XXHASH
 #else  /* if defined(BLOOM_MURMUR_HASH) */
 #define BLOOM_HASH_FUNCTION murmurhash3_32
 #define BLOOM_HASH_FUNCTION_INTRIN murmurhash3_32_vec512_v3
@@ -55,6 +64,18 @@
 #ifdef BLOOM_HASH_FUNCTION_KNUTH
 #define SAME_HASH_FUNCTIONS
 #endif
+#elif defined(HASHTBL_CRC32C_HASH)
+#define HASHTBL_HASH_FUNCTION crc32chash_32
+#define HASHTBL_HASH_FUNCTION_INTRIN crc32chash_32_vec512
+#ifdef BLOOM_HASH_FUNCTION_CRC32C
+#define SAME_HASH_FUNCTIONS
+#endif
+#elif defined(HASHTBL_XXHASH_HASH)
+#define HASHTBL_HASH_FUNCTION xxhash_32
+#define HASHTBL_HASH_FUNCTION_INTRIN xxhash_32_vec512
+#ifdef BLOOM_HASH_FUNCTION_XXHASH
+#define SAME_HASH_FUNCTIONS
+#endif
 #else  /* if defined(HASHTBL_MURMUR_HASH) */
 #define HASHTBL_HASH_FUNCTION murmurhash3_32
 #define HASHTBL_HASH_FUNCTION_INTRIN murmurhash3_32_vec512_v3
@@ -63,6 +84,57 @@
 #endif
 #endif
 
+/*
+ * Derive all the hashes of a key from a single 64-bit hash, 'mixhash_64()'
+ * (see hashfunctions.h), instead of computing h2 as the hash of h1: h1 is its
+ * high half, h2 its low half and the hash tables use h1. Overrides the hash
+ * functions above.
+ *
+ * Default: disable.
+ */
+#ifdef SINGLE_HASH
+#define SINGLE_HASH_FUNCTION mixhash_64
+#define SINGLE_HASH_FUNCTION_INTRIN mixhash_64_vec512
+#ifndef SAME_HASH_FUNCTIONS
+#define SAME_HASH_FUNCTIONS
+#endif
+#endif
+
+/*
+ * Enable or disable cuckoo filters (see cuckoofilter.h) in place of the
+ * counting Bloom filters of the groups, sized for the same false positive
+ * ratios. Their bucket comes from h1 and their fingerprint from h2.
+ *
+ * Default: disable.
+ */
+#ifndef CUCKOO_FILTER
+#undef CUCKOO_FILTER
+#endif
+
+/*
+ * Enable or disable fused filters (see fusedfilter.h) in place of the counting
+ * Bloom filters of the groups: blocks of one cache line that hold the keys of
+ * VRF 0 with their next hops, and overflow to the hash tables. A hit takes one
+ * memory access. Not with CUCKOO_FILTER.
+ *
+ * Default: disable.
+ */
+#ifndef FUSED_FILTER
+#undef FUSED_FILTER
+#endif
+
+/*
+ * Enable or disable the snapshot of each group in a minimal perfect hash table
+ * (see perfecthash.h) when the forwarding table is packed: a Bloom "maybe"
+ * then reads a pilot and one entry instead of a bucket and its chain. Stores
+ * after that update the snapshot in place, or go to the (emptied) hash table.
+ *
+ * Default: disable.
+ */
+#ifndef PERFECT_HASH
+#undef PERFECT_HASH
+#endif
+
 
 /*
  * Enable or disable vectorization in lookup (set the lookup variant to be used).
@@ -86,6 +158,76 @@
 #define LOOKUP_ADDRESS lookup_address
 #endif
 
+/*
+ * Enable or disable batched scalar lookups (see 'lookup_address_batch()'):
+ * 'forward()' looks the addresses up LOOKUP_PREFETCH_DISTANCE at a time, with
+ * the memory accesses of the whole window issued ahead of their use. In
+ * multi-VRF mode, the windows go through 'lookup_address_vrf_batch()' and may
+ * mix VRFs.
+ *
+ * Default: disable; windows of 16 addresses when enabled.
+ */
+#ifndef LOOKUP_BATCH
+#undef LOOKUP_BATCH
+#endif
+
+#ifndef LOOKUP_PREFETCH_DISTANCE
+#define LOOKUP_PREFETCH_DISTANCE 16
+#endif
+
+#if defined(LOOKUP_BATCH) && !defined(LOOKUP_SCALAR)
+#error "LOOKUP_BATCH requires scalar lookups."
+#endif
+
+/*
+ * Enable or disable the per-thread flow cache in front of LOOKUP_ADDRESS (see
+ * flowcache.h). Only scalar lookups are supported.
+ *
+ * Default: disable; 2^12 sets of 5 ways (256 KiB per thread) when enabled.
+ */
+#ifndef FLOW_CACHE
+#undef FLOW_CACHE
+#endif
+
+#ifndef FLOW_CACHE_SETS_LOG2
+#define FLOW_CACHE_SETS_LOG2 12
+#endif
+
+#define FLOW_CACHE_WAYS 5
+
+#if defined(FLOW_CACHE) && !defined(LOOKUP_SCALAR)
+#error "FLOW_CACHE requires scalar lookups."
+#endif
+
+#if defined(FLOW_CACHE) && defined(LOOKUP_BATCH)
+#error "FLOW_CACHE and LOOKUP_BATCH are exclusive."
+#endif
+
+/*
+ * Enable or disable the per-thread lookup counters (see lookupstats.h). The
+ * threads that look addresses up after LOOKUP_STATS_MAX_THREADS - 1 others
+ * share the last block of counters, with atomic adds.
+ *
+ * Default: disable (CMake enables it); 256 threads.
+ */
+#ifndef LOOKUP_STATS
+#undef LOOKUP_STATS
+#endif
+
+#ifndef LOOKUP_STATS_MAX_THREADS
+#define LOOKUP_STATS_MAX_THREADS 256
+#endif
+
+/*
+ * Size of the blocks the hash table entries and default routes are allocated
+ * from while a table is loaded (see arena.h).
+ *
+ * Default: 1 MiB.
+ */
+#ifndef TABLE_ARENA_BLOCK_SIZE
+#define TABLE_ARENA_BLOCK_SIZE (1 << 20)
+#endif
+
 /*
  * Enable or disable benchmark.
  *
@@ -0,0 +1,212 @@
+/*
+ * cuckoofilter.c
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cuckoofilter.h"
+#include "hugepages.h"
+
+/* Bytes of the buckets, plus what the 64-bit read of the last one overruns. */
+static size_t buckets_size(uint32_t num_buckets, uint8_t fp_bits)
+{
+	return ((uint64_t)num_buckets * CUCKOO_BUCKET_SIZE * fp_bits + 7) / 8 +
+		sizeof(uint64_t);
+}
+
+struct cuckoo_filter *new_cuckoo_filter(uint32_t capacity, double fpr)
+{
+	struct cuckoo_filter *cf = malloc(sizeof(struct cuckoo_filter));
+	if (cf == NULL) {
+		fprintf(stderr, "cuckoofilter.new_cuckoo_filter: Couldn't malloc cuckoo filter.\n");
+		exit(1);
+	}
+
+	int fp_bits = ceil(log2(2.0 * CUCKOO_BUCKET_SIZE / fpr));
+	if (fp_bits < 4)
+		fp_bits = 4;
+	else if (fp_bits > 14)
+		fp_bits = 16;  /* Then a bucket is a whole word. */
+	cf->fp_bits = fp_bits;
+
+	cf->num_buckets = ceil(capacity / (CUCKOO_BUCKET_SIZE * CUCKOO_MAX_LOAD));
+	if (cf->num_buckets == 0)
+		cf->num_buckets = 1;
+
+	cf->buckets = huge_alloc(buckets_size(cf->num_buckets, cf->fp_bits));
+	if (cf->buckets == NULL) {
+		fprintf(stderr, "cuckoofilter.new_cuckoo_filter: Couldn't allocate %"PRIu32" buckets.\n",
+				cf->num_buckets);
+		exit(1);
+	}
+	cf->has_victim = false;
+	cf->victim_fp = 0;
+	cf->victim_bucket = 0;
+	cf->count = 0;
+	cf->seed = 0x9e3779b9;
+
+	return cf;
+}
+
+struct cuckoo_filter *copy_cuckoo_filter(const struct cuckoo_filter *src)
+{
+	struct cuckoo_filter *cf = malloc(sizeof(struct cuckoo_filter));
+	if (cf == NULL) {
+		fprintf(stderr, "cuckoofilter.copy_cuckoo_filter: Couldn't malloc cuckoo filter.\n");
+		exit(1);
+	}
+	*cf = *src;
+
+	size_t size = buckets_size(src->num_buckets, src->fp_bits);
+	cf->buckets = huge_alloc(size);
+	if (cf->buckets == NULL) {
+		fprintf(stderr, "cuckoofilter.copy_cuckoo_filter: Couldn't allocate %"PRIu32" buckets.\n",
+				src->num_buckets);
+		exit(1);
+	}
+	memcpy(cf->buckets, src->buckets, size);
+
+	return cf;
+}
+
+void free_cuckoo_filter(struct cuckoo_filter *cf)
+{
+	if (cf == NULL)
+		return;
+
+	huge_free(cf->buckets);
+	free(cf);
+}
+
+size_t cuckoo_filter_size(const struct cuckoo_filter *cf)
+{
+	return buckets_size(cf->num_buckets, cf->fp_bits);
+}
+
+static inline uint16_t get_slot(const struct cuckoo_filter *cf, uint32_t i,
+		int j)
+{
+	unsigned int shift;
+	uint64_t word;
+	memcpy(&word, cuckoo_bucket_ptr(cf, i, &shift), sizeof(word));
+
+	return (word >> (shift + j * cf->fp_bits)) &
+		((UINT64_C(1) << cf->fp_bits) - 1);
+}
+
+static inline void set_slot(struct cuckoo_filter *cf, uint32_t i, int j,
+		uint16_t fp)
+{
+	unsigned int shift;
+	uint8_t *p = (uint8_t *)cuckoo_bucket_ptr(cf, i, &shift);
+	uint64_t word;
+	memcpy(&word, p, sizeof(word));
+
+	shift += j * cf->fp_bits;
+	uint64_t mask = ((UINT64_C(1) << cf->fp_bits) - 1) << shift;
+	word = (word & ~mask) | ((uint64_t)fp << shift);
+	memcpy(p, &word, sizeof(word));
+}
+
+/* Store 'fp' in a free slot of bucket 'i', if it has one. */
+static bool bucket_insert(struct cuckoo_filter *cf, uint32_t i, uint16_t fp)
+{
+	for (int j = 0; j < CUCKOO_BUCKET_SIZE; j++) {
+		if (get_slot(cf, i, j) == 0) {
+			set_slot(cf, i, j, fp);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Clear a slot of bucket 'i' that holds 'fp', if there is one. */
+static bool bucket_remove(struct cuckoo_filter *cf, uint32_t i, uint16_t fp)
+{
+	for (int j = 0; j < CUCKOO_BUCKET_SIZE; j++) {
+		if (get_slot(cf, i, j) == fp) {
+			set_slot(cf, i, j, 0);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* xorshift32: which slot to kick. */
+static inline uint32_t next_random(struct cuckoo_filter *cf)
+{
+	uint32_t x = cf->seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	cf->seed = x;
+
+	return x;
+}
+
+/* Store 'fp', whose buckets are 'i' and its alternate, or make it the victim. */
+static void insert_fingerprint(struct cuckoo_filter *cf, uint32_t i,
+		uint16_t fp)
+{
+	if (bucket_insert(cf, i, fp))
+		return;
+
+	i = cuckoo_alt_bucket(cf, i, fp);
+	for (int kick = 0; kick < CUCKOO_MAX_KICKS; kick++) {
+		if (bucket_insert(cf, i, fp))
+			return;
+
+		int j = next_random(cf) % CUCKOO_BUCKET_SIZE;
+		uint16_t evicted = get_slot(cf, i, j);
+		set_slot(cf, i, j, fp);
+		fp = evicted;
+		i = cuckoo_alt_bucket(cf, i, fp);
+	}
+
+	cf->has_victim = true;
+	cf->victim_fp = fp;
+	cf->victim_bucket = i;
+}
+
+bool cuckoo_insert(struct cuckoo_filter *cf, uint32_t h1, uint32_t h2)
+{
+	if (cf->has_victim)
+		return false;
+
+	insert_fingerprint(cf, cuckoo_range(h1, cf->num_buckets),
+			cuckoo_fingerprint(cf, h2));
+	cf->count++;
+
+	return true;
+}
+
+bool cuckoo_remove(struct cuckoo_filter *cf, uint32_t h1, uint32_t h2)
+{
+	uint16_t fp = cuckoo_fingerprint(cf, h2);
+	uint32_t i1 = cuckoo_range(h1, cf->num_buckets);
+	uint32_t i2 = cuckoo_alt_bucket(cf, i1, fp);
+
+	if (cf->has_victim && cf->victim_fp == fp &&
+			(cf->victim_bucket == i1 || cf->victim_bucket == i2)) {
+		cf->has_victim = false;
+		cf->count--;
+		return true;
+	}
+
+	if (!bucket_remove(cf, i1, fp) && !bucket_remove(cf, i2, fp))
+		return false;
+	cf->count--;
+
+	/* A slot is free now: give the victim another try. */
+	if (cf->has_victim) {
+		cf->has_victim = false;
+		insert_fingerprint(cf, cf->victim_bucket, cf->victim_fp);
+	}
+
+	return true;
+}
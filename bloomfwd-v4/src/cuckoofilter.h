@@ -0,0 +1,146 @@
+/*
+ * cuckoofilter.h
+ *
+ * Cuckoo filter ("Cuckoo Filter: Practically Better Than Bloom", Fan et al.),
+ * the membership filter of the groups in CUCKOO_FILTER builds (see
+ * bloomfwd_opt.h). A key is stored as an 'fp_bits' fingerprint in one of two
+ * buckets of CUCKOO_BUCKET_SIZE slots: i1 and i2 = x - i1 (mod the number of
+ * buckets), where x is a hash of the fingerprint, so that either bucket gives
+ * the other one without the key (partial-key cuckoo hashing) and the number of
+ * buckets needs not be a power of two. Inserts evict ("kick") fingerprints to
+ * their other bucket until one lands in a free slot; the last one that
+ * doesn't is kept aside as the victim, after which the filter is full.
+ *
+ * The false positive ratio is about 2 CUCKOO_BUCKET_SIZE / 2^fp_bits, e.g. 13
+ * bits (13.7 per key at CUCKOO_MAX_LOAD) for 0.1%. Unlike a Bloom filter, keys
+ * are removed exactly, without counters. A probe reads the first bucket and,
+ * unless it holds the fingerprint, the second one: both hashes are needed up
+ * front, one for the bucket and the other for the fingerprint.
+ *
+ * The buckets are bit-packed (little-endian), 4 'fp_bits' bits each, and read
+ * as one 64-bit word: 'fp_bits' is at most 14, or 16.
+ */
+
+#ifndef CUCKOOFILTER_H
+#define CUCKOOFILTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define CUCKOO_BUCKET_SIZE 4
+#define CUCKOO_MAX_LOAD 0.95  /* Keys per slot the filter is sized for. */
+#define CUCKOO_MAX_KICKS 500
+
+struct cuckoo_filter {
+	uint8_t *buckets;
+	uint32_t num_buckets;
+	uint8_t fp_bits;
+	bool has_victim;
+	uint16_t victim_fp;
+	uint32_t victim_bucket;
+	uint32_t count;  /* Stored fingerprints, the victim included. */
+	uint32_t seed;  /* Of the slots to kick from. */
+};
+
+/*
+ * A filter for 'capacity' keys and a false positive ratio of about 'fpr'
+ * (0 < fpr < 1).
+ */
+struct cuckoo_filter *new_cuckoo_filter(uint32_t capacity, double fpr);
+
+struct cuckoo_filter *copy_cuckoo_filter(const struct cuckoo_filter *src);
+
+void free_cuckoo_filter(struct cuckoo_filter *cf);
+
+/* Bytes taken by the buckets of 'cf'. */
+size_t cuckoo_filter_size(const struct cuckoo_filter *cf);
+
+/*
+ * Insert the key of hashes 'h1' and 'h2'. Return false, leaving 'cf' as it
+ * was, if it is full: it must then be rebuilt bigger.
+ */
+bool cuckoo_insert(struct cuckoo_filter *cf, uint32_t h1, uint32_t h2);
+
+/* Remove one copy of the key of hashes 'h1' and 'h2', if there is one. */
+bool cuckoo_remove(struct cuckoo_filter *cf, uint32_t h1, uint32_t h2);
+
+/*
+ * Map 'x' to [0, len) like 'fastrange_32()' (hashfunctions.h has external
+ * definitions, so it is included by bloomfwd_opt.c only).
+ */
+static inline uint32_t cuckoo_range(uint32_t x, uint32_t len)
+{
+	return ((uint64_t)x * len) >> 32;
+}
+
+static inline uint16_t cuckoo_fingerprint(const struct cuckoo_filter *cf,
+		uint32_t h2)
+{
+	uint16_t fp = h2 >> (32 - cf->fp_bits);
+
+	return fp != 0 ? fp : 1;  /* 0 is a free slot. */
+}
+
+static inline uint32_t cuckoo_alt_bucket(const struct cuckoo_filter *cf,
+		uint32_t i, uint16_t fp)
+{
+	uint32_t x = cuckoo_range((uint32_t)fp * 0x5bd1e995, cf->num_buckets);
+
+	return x >= i ? x - i : x + cf->num_buckets - i;
+}
+
+/* Byte of the first slot of bucket 'i', and the bit of it in that byte. */
+static inline const uint8_t *cuckoo_bucket_ptr(const struct cuckoo_filter *cf,
+		uint32_t i, unsigned int *shift)
+{
+	uint64_t bit = (uint64_t)i * CUCKOO_BUCKET_SIZE * cf->fp_bits;
+	*shift = bit % 8;
+
+	return &cf->buckets[bit / 8];
+}
+
+static inline bool cuckoo_bucket_has(const struct cuckoo_filter *cf,
+		uint32_t i, uint16_t fp)
+{
+	unsigned int shift;
+	uint64_t word;
+	memcpy(&word, cuckoo_bucket_ptr(cf, i, &shift), sizeof(word));
+	word >>= shift;
+
+	uint64_t mask = (UINT64_C(1) << cf->fp_bits) - 1;
+	bool has = false;
+	for (int j = 0; j < CUCKOO_BUCKET_SIZE; j++)
+		has |= ((word >> (j * cf->fp_bits)) & mask) == fp;
+
+	return has;
+}
+
+static inline bool cuckoo_contains(const struct cuckoo_filter *cf,
+		uint32_t h1, uint32_t h2)
+{
+	uint16_t fp = cuckoo_fingerprint(cf, h2);
+	uint32_t i1 = cuckoo_range(h1, cf->num_buckets);
+	if (cuckoo_bucket_has(cf, i1, fp))
+		return true;
+
+	uint32_t i2 = cuckoo_alt_bucket(cf, i1, fp);
+	return cuckoo_bucket_has(cf, i2, fp) || (cf->has_victim &&
+			cf->victim_fp == fp && (cf->victim_bucket == i1 ||
+				cf->victim_bucket == i2));
+}
+
+/* Prefetch both buckets of the key of hashes 'h1' and 'h2'. */
+static inline void cuckoo_prefetch(const struct cuckoo_filter *cf,
+		uint32_t h1, uint32_t h2)
+{
+	unsigned int shift;
+	uint32_t i1 = cuckoo_range(h1, cf->num_buckets);
+	__builtin_prefetch(cuckoo_bucket_ptr(cf, i1, &shift));
+	__builtin_prefetch(cuckoo_bucket_ptr(cf,
+				cuckoo_alt_bucket(cf, i1, cuckoo_fingerprint(cf, h2)),
+				&shift));
+}
+
+#endif
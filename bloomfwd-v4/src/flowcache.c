@@ -0,0 +1,49 @@
+/*
+ * flowcache.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flowcache.h"
+
+#define FLOW_CACHE_SETS (1u << FLOW_CACHE_SETS_LOG2)
+
+struct flow_cache *new_flow_cache(const struct forwarding_table *fw_tbl)
+{
+	struct flow_cache *fc = malloc(sizeof(struct flow_cache));
+	if (fc == NULL) {
+		fprintf(stderr, "flowcache.new_flow_cache: Couldn't malloc flow cache.\n");
+		exit(1);
+	}
+
+	fc->sets = aligned_alloc(64, FLOW_CACHE_SETS *
+			sizeof(struct flow_cache_set));
+	if (fc->sets == NULL) {
+		fprintf(stderr, "flowcache.new_flow_cache: Couldn't allocate %u sets.\n",
+				FLOW_CACHE_SETS);
+		exit(1);
+	}
+
+	memset(fc->sets, 0, FLOW_CACHE_SETS * sizeof(struct flow_cache_set));
+	fc->generation = atomic_load_explicit(&fw_tbl->generation,
+			memory_order_acquire);
+	fc->hits = 0;
+	fc->misses = 0;
+	fc->invalidations = 0;
+
+	return fc;
+}
+
+void free_flow_cache(struct flow_cache *fc)
+{
+	free(fc->sets);
+	free(fc);
+}
+
+void flow_cache_invalidate(struct flow_cache *fc)
+{
+	memset(fc->sets, 0, FLOW_CACHE_SETS * sizeof(struct flow_cache_set));
+	fc->invalidations++;
+}
@@ -0,0 +1,102 @@
+/*
+ * flowcache.h
+ *
+ * A small set-associative cache of lookup results (destination address -> next
+ * hop) placed in front of LOOKUP_ADDRESS. Real traffic has a lot of address
+ * locality, so most packets can skip the DLA/G1/G2 path altogether.
+ *
+ * Each thread owns its cache: there is no locking at all. Entries are tagged
+ * with the (vrf, addr) pair and the whole cache is invalidated whenever the
+ * generation of the forwarding table changes (i.e. after any prefix update).
+ * The update bumps the generation with release semantics once it's done, and
+ * the lookups read it with acquire semantics, so a cache never keeps entries
+ * older than the updates its thread can see. That doesn't make updates and
+ * lookups safe to run concurrently on the table itself (see 'load_prefixes()').
+ */
+
+#ifndef FLOWCACHE_H
+#define FLOWCACHE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bloomfwd_opt.h"
+#include "config.h"  /* FLOW_CACHE_SETS_LOG2, FLOW_CACHE_WAYS */
+
+/* One set fills a cache line (5 ways of 12 bytes, plus 3 bytes). */
+struct flow_cache_set {
+	uint32_t addrs[FLOW_CACHE_WAYS];
+	uint32_t vrfs[FLOW_CACHE_WAYS];
+	uint32_t next_hops[FLOW_CACHE_WAYS];
+	uint8_t valid;  /* Bit i is set if way i holds an entry. */
+	uint8_t found;  /* Bit i is set if way i holds a match (not "none"). */
+	uint8_t victim;  /* Next way to be replaced (round-robin). */
+} __attribute__((aligned(64)));
+
+struct flow_cache {
+	struct flow_cache_set *sets;
+	uint32_t generation;  /* Generation of the table the entries came from. */
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long invalidations;
+};
+
+struct flow_cache *new_flow_cache(const struct forwarding_table *fw_tbl);
+
+void free_flow_cache(struct flow_cache *fc);
+
+/* Drop every entry. */
+void flow_cache_invalidate(struct flow_cache *fc);
+
+static inline uint32_t flow_cache_set_idx(uint32_t vrf, uint32_t addr)
+{
+	/* Fibonacci hashing: the upper bits are the best mixed ones. */
+	return ((addr ^ (vrf * 0x85ebca6b)) * 0x9e3779b1) >>
+		(32 - FLOW_CACHE_SETS_LOG2);
+}
+
+/*
+ * Look 'addr' up in VRF 'vrf', going through the cache first. On a miss, the
+ * result of the full lookup (including "none") is cached.
+ */
+static inline bool flow_cache_lookup(struct flow_cache *fc,
+		const struct forwarding_table *fw_tbl, uint32_t vrf,
+		uint32_t addr, uint32_t *next_hop)
+{
+	uint32_t generation = atomic_load_explicit(&fw_tbl->generation,
+			memory_order_acquire);
+	if (fc->generation != generation) {
+		flow_cache_invalidate(fc);
+		fc->generation = generation;
+	}
+
+	struct flow_cache_set *set = &fc->sets[flow_cache_set_idx(vrf, addr)];
+	for (int i = 0; i < FLOW_CACHE_WAYS; i++) {
+		if ((set->valid & (1 << i)) && set->addrs[i] == addr &&
+				set->vrfs[i] == vrf) {
+			fc->hits++;
+			*next_hop = set->next_hops[i];
+			return set->found & (1 << i);
+		}
+	}
+
+	fc->misses++;
+	bool found = vrf == 0 ? LOOKUP_ADDRESS(fw_tbl, addr, next_hop) :
+		lookup_address_vrf(fw_tbl, vrf, addr, next_hop);
+
+	int way = set->victim;
+	set->victim = (way + 1) % FLOW_CACHE_WAYS;
+	set->addrs[way] = addr;
+	set->vrfs[way] = vrf;
+	set->next_hops[way] = *next_hop;
+	set->valid |= 1 << way;
+	if (found)
+		set->found |= 1 << way;
+	else
+		set->found &= ~(1 << way);
+
+	return found;
+}
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * fusedfilter.c
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fusedfilter.h"
+#include "hugepages.h"
+
+struct fused_filter *new_fused_filter(uint32_t capacity)
+{
+	struct fused_filter *ff = malloc(sizeof(struct fused_filter));
+	if (ff == NULL) {
+		fprintf(stderr, "fusedfilter.new_fused_filter: Couldn't malloc fused filter.\n");
+		exit(1);
+	}
+
+	ff->num_blocks = ceil(capacity / (FUSED_SLOTS * FUSED_MAX_LOAD));
+	if (ff->num_blocks == 0)
+		ff->num_blocks = 1;
+
+	/* Zeroed: every slot is free. */
+	ff->blocks = huge_alloc(ff->num_blocks * sizeof(struct fused_block));
+	if (ff->blocks == NULL) {
+		fprintf(stderr, "fusedfilter.new_fused_filter: Couldn't allocate %"PRIu32" blocks.\n",
+				ff->num_blocks);
+		exit(1);
+	}
+	ff->count = 0;
+	ff->overflowed = 0;
+
+	return ff;
+}
+
+struct fused_filter *copy_fused_filter(const struct fused_filter *src)
+{
+	struct fused_filter *ff = malloc(sizeof(struct fused_filter));
+	if (ff == NULL) {
+		fprintf(stderr, "fusedfilter.copy_fused_filter: Couldn't malloc fused filter.\n");
+		exit(1);
+	}
+	*ff = *src;
+
+	ff->blocks = huge_alloc(fused_filter_size(src));
+	if (ff->blocks == NULL) {
+		fprintf(stderr, "fusedfilter.copy_fused_filter: Couldn't allocate %"PRIu32" blocks.\n",
+				src->num_blocks);
+		exit(1);
+	}
+	memcpy(ff->blocks, src->blocks, fused_filter_size(src));
+
+	return ff;
+}
+
+void free_fused_filter(struct fused_filter *ff)
+{
+	if (ff == NULL)
+		return;
+
+	huge_free(ff->blocks);
+	free(ff);
+}
+
+size_t fused_filter_size(const struct fused_filter *ff)
+{
+	return ff->num_blocks * sizeof(struct fused_block);
+}
+
+bool fused_insert(struct fused_filter *ff, uint32_t key, uint32_t next_hop)
+{
+	uint32_t h = fused_hash(key);
+	if (h == 0)
+		return false;
+
+	struct fused_block *b = fused_block(ff, h);
+	for (int i = 0; i < FUSED_SLOTS; i++) {
+		if (b->hashes[i] == 0) {
+			b->hashes[i] = h;
+			b->next_hops[i] = next_hop;
+			ff->count++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool fused_update(struct fused_filter *ff, uint32_t key, uint32_t next_hop)
+{
+	uint32_t h = fused_hash(key);
+	if (h == 0)
+		return false;
+
+	struct fused_block *b = fused_block(ff, h);
+	for (int i = 0; i < FUSED_SLOTS; i++) {
+		if (b->hashes[i] == h) {
+			b->next_hops[i] = next_hop;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void fused_add_overflow(struct fused_filter *ff, uint32_t key)
+{
+	uint32_t h = fused_hash(key);
+	fused_block(ff, h)->overflow |= fused_overflow_bits(h);
+	ff->overflowed++;
+}
@@ -0,0 +1,133 @@
+/*
+ * fusedfilter.h
+ *
+ * Fused filter: the membership filter and the values of a group in one array
+ * of cache line sized blocks, in FUSED_FILTER builds (see bloomfwd_opt.h). A
+ * key goes to the block of its hash, where it takes one of FUSED_SLOTS slots:
+ * its hash and its next hop. The hash is a bijection of the key, so that a
+ * slot matches a single key (an exact match, unlike a fingerprint) and a hit
+ * needs no other memory access. The keys that don't find a free slot (and
+ * those of VRFs other than 0, whose keys aren't unique) go to the hash table
+ * of the group, the overflow, and set FUSED_OVERFLOW_HASHES bits of the
+ * 64-bit Bloom filter of their block: a lookup only probes the hash table if
+ * those are set.
+ *
+ * Sized for FUSED_MAX_LOAD keys per slot (3.5 per block), about 1% of the keys
+ * overflow, for 18 bytes per key with the next hops.
+ */
+
+#ifndef FUSEDFILTER_H
+#define FUSEDFILTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FUSED_SLOTS 7
+#define FUSED_MAX_LOAD 0.5  /* Keys per slot the filter is sized for. */
+#define FUSED_OVERFLOW_HASHES 3
+
+/* 64 bytes. A slot is free if its hash is 0 (see 'fused_hash()'). */
+struct fused_block {
+	uint32_t hashes[FUSED_SLOTS];
+	uint32_t next_hops[FUSED_SLOTS];
+	uint64_t overflow;
+};
+
+struct fused_filter {
+	struct fused_block *blocks;
+	uint32_t num_blocks;
+	uint32_t count;  /* Keys in the slots. */
+	uint32_t overflowed;  /* Keys in the overflow bits. */
+};
+
+/* A filter of about 'capacity' keys in the slots. */
+struct fused_filter *new_fused_filter(uint32_t capacity);
+
+struct fused_filter *copy_fused_filter(const struct fused_filter *src);
+
+void free_fused_filter(struct fused_filter *ff);
+
+/* Bytes of the blocks of 'ff'. */
+size_t fused_filter_size(const struct fused_filter *ff);
+
+/*
+ * Store 'key' and its next hop in a free slot of its block. Return false if
+ * there is none: the key must then go to the overflow.
+ */
+bool fused_insert(struct fused_filter *ff, uint32_t key, uint32_t next_hop);
+
+/* Set the next hop of 'key' if it has a slot. Return whether it has one. */
+bool fused_update(struct fused_filter *ff, uint32_t key, uint32_t next_hop);
+
+/* Set the overflow bits of 'key' in its block. */
+void fused_add_overflow(struct fused_filter *ff, uint32_t key);
+
+/*
+ * The finalizer of MurmurHash3, a bijection, of the complement of 'key': only
+ * the key 255.255.255.255 hashes to 0, and it always overflows.
+ */
+static inline uint32_t fused_hash(uint32_t key)
+{
+	uint32_t h = ~key;
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+
+	return h;
+}
+
+static inline struct fused_block *fused_block(const struct fused_filter *ff,
+		uint32_t h)
+{
+	return &ff->blocks[((uint64_t)h * ff->num_blocks) >> 32];
+}
+
+/* Overflow bits of the key hashed to 'h' (from another mix of 'h'). */
+static inline uint64_t fused_overflow_bits(uint32_t h)
+{
+	uint32_t g = (h ^ (h >> 15)) * 0x2c1b3c6d;
+	g ^= g >> 12;
+
+	uint64_t bits = 0;
+	for (int j = 0; j < FUSED_OVERFLOW_HASHES; j++)
+		bits |= UINT64_C(1) << ((g >> (6 * j)) & 63);
+
+	return bits;
+}
+
+/*
+ * Look 'key' up in its block. Return true if a slot holds it (and only look
+ * at the slots if 'in_slots'), with its next hop in 'next_hop'. Otherwise,
+ * '*maybe' tells whether the overflow may hold it.
+ */
+static inline bool fused_find(const struct fused_filter *ff, uint32_t key,
+		bool in_slots, uint32_t *next_hop, bool *maybe)
+{
+	uint32_t h = fused_hash(key);
+	const struct fused_block *b = fused_block(ff, h);
+
+	if (in_slots && h != 0) {
+		for (int i = 0; i < FUSED_SLOTS; i++) {
+			if (b->hashes[i] == h) {
+				*next_hop = b->next_hops[i];
+				*maybe = true;
+				return true;
+			}
+		}
+	}
+
+	uint64_t bits = fused_overflow_bits(h);
+	*maybe = (b->overflow & bits) == bits;
+
+	return false;
+}
+
+static inline void fused_prefetch(const struct fused_filter *ff, uint32_t key)
+{
+	__builtin_prefetch(fused_block(ff, fused_hash(key)));
+}
+
+#endif
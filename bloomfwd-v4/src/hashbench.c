@@ -0,0 +1,561 @@
+/*
+ * hashbench.c
+ *
+ * Cost and quality of the hash functions in hashfunctions.h (selected by
+ * BLOOM_HASH_FUNCTION and HASHTBL_HASH_FUNCTION, see config.h) for the keys of
+ * a prefixes file. For each function, one CSV line holds:
+ *
+ * 	- the nanoseconds per hash of the scalar function and, when built with
+ * 	AVX-512F (target 'hashbench_avx512'), of its sixteen-lane version. The
+ * 	Bloom filters take two hashes per key, h1 = f(key) and h2 = f(h1),
+ * 	except for 'mix64' ('mixhash_64()', see SINGLE_HASH), whose single
+ * 	64-bit hash gives both;
+ * 	- the false positive ratio of a Bloom filter sized for the keys as in
+ * 	'new_counting_bloom_filter()' and probed as in 'lookup_address()', for
+ * 	random keys of the same lengths that are not in the file, next to the
+ * 	ratio predicted by (1 - e^(-k * n / m))^k;
+ * 	- the chain lengths of a hash table of 'range' = #keys buckets, as in
+ * 	'new_hash_table()': the number of buckets holding 0, 1, ..., 7 and 8 or
+ * 	more keys, the longest chain and the mean number of entries visited by
+ * 	a lookup that hits.
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <omp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"  /* FALSE_POSITIVE_RATIO */
+#include "hashfunctions.h"
+
+/* Handy macro to perform string comparison. */
+#define STREQ(s1, s2) (strcmp((s1), (s2)) == 0)
+
+/* Chain lengths counted separately; longer ones are counted together. */
+#define MAX_CHAIN_LEN 8
+
+/*
+ * Keep gcc from vectorizing the scalar timing loops, so that they time the
+ * scalar functions.
+ */
+#if defined(__GNUC__) && !defined(__INTEL_COMPILER)
+#define NO_VECTORIZE __attribute__((optimize("no-tree-vectorize")))
+#else
+#define NO_VECTORIZE
+#endif
+
+#if defined(__MIC__) || defined(__AVX512F__)
+#define HASH_VEC512
+#endif
+
+/* Written by the timing loops, so that the hashes can't be optimized out. */
+static volatile uint32_t hash_sink;
+
+/*
+ * Define 'time_<f>()', which hashes the 'n' keys (a multiple of 16) of 'keys'
+ * with 'f()' over and over, until at least 'count' hashes have been computed,
+ * and returns the nanoseconds per hash, and 'time_<f>_vec512()', which does
+ * the same with 'f_vec()', sixteen keys at a time.
+ */
+#define DEFINE_TIME_SCALAR(f) \
+NO_VECTORIZE static double time_##f(const uint32_t *keys, unsigned long n, \
+		unsigned long count) \
+{ \
+	uint64_t sink = 0; \
+	unsigned long rounds = (count + n - 1) / n; \
+	double t = omp_get_wtime(); \
+	for (unsigned long r = 0; r < rounds; r++) { \
+		for (unsigned long i = 0; i < n; i++) \
+			sink ^= f(keys[i]); \
+	} \
+	t = omp_get_wtime() - t; \
+	hash_sink = sink ^ (sink >> 32); \
+\
+	return t * 1e9 / (rounds * n); \
+}
+
+#ifdef HASH_VEC512
+#define DEFINE_TIME_VEC512(f, f_vec) \
+static double time_##f##_vec512(uint32_t *keys, unsigned long n, \
+		unsigned long count) \
+{ \
+	_Alignas(64) uint32_t hashes[16]; \
+	__m512i sink = _mm512_setzero_epi32(); \
+	unsigned long rounds = (count + n - 1) / n; \
+	double t = omp_get_wtime(); \
+	for (unsigned long r = 0; r < rounds; r++) { \
+		for (unsigned long i = 0; i < n; i += 16) { \
+			f_vec(&keys[i], hashes); \
+			sink = _mm512_xor_epi32(sink, \
+					_mm512_load_epi32(hashes)); \
+		} \
+	} \
+	t = omp_get_wtime() - t; \
+	_mm512_store_epi32(hashes, sink); \
+	hash_sink = hashes[0]; \
+\
+	return t * 1e9 / (rounds * n); \
+}
+#else
+#define DEFINE_TIME_VEC512(f, f_vec)
+#endif
+
+#define DEFINE_TIME(f, f_vec) \
+	DEFINE_TIME_SCALAR(f) \
+	DEFINE_TIME_VEC512(f, f_vec)
+
+DEFINE_TIME(murmurhash3_32, murmurhash3_32_vec512_v3)
+DEFINE_TIME(knuthhash_32, knuthhash_32_vec512)
+DEFINE_TIME(h2hash_32, h2hash_32_vec512)
+DEFINE_TIME(crc32chash_32, crc32chash_32_vec512)
+DEFINE_TIME(xxhash_32, xxhash_32_vec512)
+DEFINE_TIME_SCALAR(mixhash_64)
+
+#ifdef HASH_VEC512
+static double time_mixhash_64_vec512(uint32_t *keys, unsigned long n,
+		unsigned long count)
+{
+	_Alignas(64) uint32_t h1[16];
+	_Alignas(64) uint32_t h2[16];
+	__m512i sink = _mm512_setzero_epi32();
+	unsigned long rounds = (count + n - 1) / n;
+	double t = omp_get_wtime();
+	for (unsigned long r = 0; r < rounds; r++) {
+		for (unsigned long i = 0; i < n; i += 16) {
+			mixhash_64_vec512(&keys[i], h1, h2);
+			sink = _mm512_xor_epi32(sink, _mm512_xor_epi32(
+						_mm512_load_epi32(h1),
+						_mm512_load_epi32(h2)));
+		}
+	}
+	t = omp_get_wtime() - t;
+	_mm512_store_epi32(h1, sink);
+	hash_sink = h1[0];
+
+	return t * 1e9 / (rounds * n);
+}
+#endif
+
+/*
+ * Define 'hashes_<f>()', which stores the first two Bloom filter hashes of
+ * 'key' in 'h1' and 'h2', as 'hashes()' in bloomfwd_opt.c. The hash tables use
+ * 'h1'.
+ */
+#define DEFINE_HASHES(f) \
+static void hashes_##f(uint32_t key, uint32_t *h1, uint32_t *h2) \
+{ \
+	*h1 = f(key); \
+	*h2 = f(*h1); \
+}
+
+DEFINE_HASHES(murmurhash3_32)
+DEFINE_HASHES(knuthhash_32)
+DEFINE_HASHES(h2hash_32)
+DEFINE_HASHES(crc32chash_32)
+DEFINE_HASHES(xxhash_32)
+
+static void hashes_mixhash_64(uint32_t key, uint32_t *h1, uint32_t *h2)
+{
+	uint64_t h = mixhash_64(key);
+	*h1 = h >> 32;
+	*h2 = h;
+}
+
+struct hash_function {
+	const char *name;
+	void (*hashes)(uint32_t key, uint32_t *h1, uint32_t *h2);
+	double (*time)(const uint32_t *keys, unsigned long n,
+			unsigned long count);
+#ifdef HASH_VEC512
+	double (*time_vec512)(uint32_t *keys, unsigned long n,
+			unsigned long count);
+#endif
+};
+
+#ifdef HASH_VEC512
+#define HASH_FUNCTION(name, f) \
+	{ name, hashes_##f, time_##f, time_##f##_vec512 }
+#else
+#define HASH_FUNCTION(name, f) { name, hashes_##f, time_##f }
+#endif
+
+static const struct hash_function hash_functions[] = {
+	HASH_FUNCTION("murmur", murmurhash3_32),
+	HASH_FUNCTION("knuth", knuthhash_32),
+	HASH_FUNCTION("h2", h2hash_32),
+	HASH_FUNCTION("crc32c", crc32chash_32),
+	HASH_FUNCTION("xxhash", xxhash_32),
+	HASH_FUNCTION("mix64", mixhash_64),
+};
+
+#define NUM_HASH_FUNCTIONS \
+	(sizeof(hash_functions) / sizeof(hash_functions[0]))
+
+/* Distinct keys of the prefixes file, sorted, and their lengths. */
+struct key_set {
+	uint32_t *keys;
+	uint8_t *netmasks;
+	unsigned long n;
+};
+
+void print_usage(char *argv[])
+{
+	printf("Usage: %s -p <file> [options]\n", argv[0]);
+	printf("\n");
+	printf("Options:\n");
+	printf("  -p --prefixes-file     \t Prefixes whose keys are hashed (e.g. a G1 or G2 file).\n");
+	printf("  -f --false-positive-ratio\t Ratio the Bloom filter is sized for (default: %g).\n",
+			FALSE_POSITIVE_RATIO);
+	printf("  -n --num-hashes        \t Number of hashes timed per function (default: 2^26).\n");
+	printf("  -q --num-queries       \t Number of keys looked up in the Bloom filter (default: 2^22).\n");
+	printf("  -s --seed              \t Seed of the random keys (default: 1).\n");
+	printf("  --no-header            \t Don't print the CSV header.\n");
+}
+
+static inline int contains(int argc, char *argv[], const char *option)
+{
+	int index = -1;
+	for (int i = 1; (i < argc) && (index == -1); i++) {
+		if (STREQ(argv[i], option)) {
+			index = i;
+			break;
+		}
+	}
+
+	return index;
+}
+
+/*
+ * Return the value of the option 'lopt' (or 'sopt'), or NULL if the option is
+ * not present.
+ */
+static const char *option_value(int argc, char *argv[], const char *lopt,
+		const char *sopt)
+{
+	int index;
+	if ((index = contains(argc, argv, lopt)) == -1)
+		index = contains(argc, argv, sopt);
+	if (index == -1)
+		return NULL;
+
+	if (index + 1 >= argc) {
+		fprintf(stderr, "hashbench.option_value: Missing value of '%s'.\n",
+				argv[index]);
+		exit(1);
+	}
+
+	return argv[index + 1];
+}
+
+static int compare_keys(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static bool has_key(const struct key_set *set, uint32_t key)
+{
+	return bsearch(&key, set->keys, set->n, sizeof(uint32_t),
+			compare_keys) != NULL;
+}
+
+/*
+ * Read the prefixes (in the format of 'load_prefixes()') into 'set', keyed as
+ * in the hash tables (the prefix bits, the others cleared). The default route
+ * isn't hashed and is skipped, as are the keys found more than once.
+ */
+static void read_keys(FILE *pfxs, struct key_set *set)
+{
+	unsigned long cap = 1 << 16;
+	uint64_t *entries = malloc(cap * sizeof(uint64_t));
+	if (entries == NULL) {
+		fprintf(stderr, "hashbench.read_keys: Couldn't malloc keys.\n");
+		exit(1);
+	}
+
+	unsigned long n = 0;
+	uint8_t a0, b0, c0, d0, len;
+	uint8_t a1, b1, c1, d1;
+	while (fscanf(pfxs, "%"SCNu8".%"SCNu8".%"SCNu8".%"SCNu8,
+				&a0, &b0, &c0, &d0) == 4) {
+		if (fscanf(pfxs, "/%"SCNu8, &len) != 1) {
+			len = 0;
+			if (d0 > 0)
+				len = 32;
+			else if (c0 > 0)
+				len = 24;
+			else if (b0 > 0)
+				len = 16;
+			else if (a0 > 0)
+				len = 8;
+		}
+		if (fscanf(pfxs, " %"SCNu8".%"SCNu8".%"SCNu8".%"SCNu8,
+					&a1, &b1, &c1, &d1) != 4 || len > 32) {
+			fprintf(stderr, "hashbench.read_keys: Couldn't parse network prefix: "
+					"%"PRIu8".%"PRIu8".%"PRIu8".%"PRIu8"/%"PRIu8".\n",
+					a0, b0, c0, d0, len);
+			exit(1);
+		}
+		if (len == 0)
+			continue;
+
+		if (n == cap) {
+			cap *= 2;
+			entries = realloc(entries, cap * sizeof(uint64_t));
+			if (entries == NULL) {
+				fprintf(stderr, "hashbench.read_keys: Couldn't realloc keys.\n");
+				exit(1);
+			}
+		}
+		uint32_t key = (a0 << 24 | b0 << 16 | c0 << 8 | d0) &
+			(0xffffffff << (32 - len));
+		entries[n++] = (uint64_t)key << 8 | len;
+	}
+
+	/* Sort by key (then length) and keep the first of each key. */
+	qsort(entries, n, sizeof(uint64_t), compare_entries);
+
+	set->keys = malloc(n * sizeof(uint32_t));
+	set->netmasks = malloc(n * sizeof(uint8_t));
+	if (set->keys == NULL || set->netmasks == NULL) {
+		fprintf(stderr, "hashbench.read_keys: Couldn't malloc key set.\n");
+		exit(1);
+	}
+	set->n = 0;
+	for (unsigned long i = 0; i < n; i++) {
+		uint32_t key = entries[i] >> 8;
+		if (set->n > 0 && set->keys[set->n - 1] == key)
+			continue;
+		set->keys[set->n] = key;
+		set->netmasks[set->n] = entries[i] & 0xff;
+		set->n++;
+	}
+
+	free(entries);
+}
+
+/* splitmix64: the random keys only need to be reproducible. */
+static inline uint64_t next_random(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+
+	return z ^ (z >> 31);
+}
+
+/*
+ * Build a Bloom filter for the keys of 'set' with 'hashes', sized for the false
+ * positive ratio 'fpr', and look 'num_queries' random keys that are not in
+ * 'set' up in it. Each random key has the length of a random key of 'set', so
+ * that it has as many trailing zeros. Store the bitmap length and number of
+ * hashes in 'bitmap_len' and 'num_hashes' and return the ratio of "maybes".
+ */
+static double bloom_fpr(const struct key_set *set,
+		void (*hashes)(uint32_t, uint32_t *, uint32_t *), double fpr,
+		unsigned long num_queries, uint64_t seed, uint32_t *bitmap_len,
+		uint8_t *num_hashes)
+{
+	/* As in 'new_counting_bloom_filter()'. */
+	uint32_t m = ceil((set->n * log2(1.0 / fpr)) / log(2.0));
+	uint8_t k = ceil(log(2.0) * m / set->n);
+	bool *bitmap = calloc(m, sizeof(bool));
+	if (bitmap == NULL) {
+		fprintf(stderr, "hashbench.bloom_fpr: Couldn't calloc bitmap.\n");
+		exit(1);
+	}
+
+	/* As in 'hashes()' and 'lookup_address()'. */
+	for (unsigned long i = 0; i < set->n; i++) {
+		uint32_t h1, h2;
+		hashes(set->keys[i], &h1, &h2);
+		for (int j = 0; j < k; j++) {
+			uint32_t h = j == 0 ? h1 : j == 1 ? h2 : h1 + j * h2;
+			bitmap[fastrange_32(h, m)] = true;
+		}
+	}
+
+	unsigned long maybes = 0;
+	for (unsigned long q = 0; q < num_queries; q++) {
+		uint32_t key;
+		do {
+			uint64_t r = next_random(&seed);
+			uint8_t len = set->netmasks[(r >> 32) % set->n];
+			key = (uint32_t)r & (0xffffffff << (32 - len));
+		} while (has_key(set, key));
+
+		uint32_t h1, h2;
+		hashes(key, &h1, &h2);
+		bool maybe = true;
+		for (int j = 0; maybe && j < k; j++) {
+			uint32_t h = j == 0 ? h1 : j == 1 ? h2 : h1 + j * h2;
+			maybe = bitmap[fastrange_32(h, m)];
+		}
+		maybes += maybe;
+	}
+
+	free(bitmap);
+	*bitmap_len = m;
+	*num_hashes = k;
+
+	return (double)maybes / num_queries;
+}
+
+/*
+ * Hash the keys of 'set' with 'hashes' (h1) into 'range' = #keys buckets, as in
+ * 'new_hash_table()' and 'store_next_hop()'. Count the buckets by number of
+ * entries into 'buckets' (the last one counting MAX_CHAIN_LEN or more), store
+ * the longest chain in 'max_chain' and return the mean number of entries
+ * visited to find a key (i.e. its position in its chain).
+ */
+static double chain_lengths(const struct key_set *set,
+		void (*hashes)(uint32_t, uint32_t *, uint32_t *),
+		unsigned long buckets[MAX_CHAIN_LEN + 1], uint32_t *max_chain)
+{
+	uint32_t range = set->n;
+	uint32_t *chains = calloc(range, sizeof(uint32_t));
+	if (chains == NULL) {
+		fprintf(stderr, "hashbench.chain_lengths: Couldn't calloc chains.\n");
+		exit(1);
+	}
+
+	for (unsigned long i = 0; i < set->n; i++) {
+		uint32_t h1, h2;
+		hashes(set->keys[i], &h1, &h2);
+		chains[fastrange_32(h1, range)]++;
+	}
+
+	unsigned long visits = 0;
+	*max_chain = 0;
+	memset(buckets, 0, (MAX_CHAIN_LEN + 1) * sizeof(unsigned long));
+	for (uint32_t i = 0; i < range; i++) {
+		uint32_t len = chains[i];
+		buckets[len < MAX_CHAIN_LEN ? len : MAX_CHAIN_LEN]++;
+		if (len > *max_chain)
+			*max_chain = len;
+		visits += (unsigned long)len * (len + 1) / 2;
+	}
+
+	free(chains);
+
+	return (double)visits / set->n;
+}
+
+static void print_header(void)
+{
+	printf("function,keys,ns_per_hash,ns_per_hash_vec512,bitmap_len,"
+			"num_hashes,fpr_target,fpr_theoretical,fpr_measured,"
+			"buckets");
+	for (int i = 0; i < MAX_CHAIN_LEN; i++)
+		printf(",chains_%d", i);
+	printf(",chains_%d_plus,max_chain,visits_per_hit\n", MAX_CHAIN_LEN);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3 || contains(argc, argv, "--help") != -1 ||
+			contains(argc, argv, "-h") != -1) {
+		print_usage(argv);
+		exit(1);
+	}
+
+	const char *value = option_value(argc, argv, "--prefixes-file", "-p");
+	if (value == NULL) {
+		fprintf(stderr, "main: Missing prefixes file.\n");
+		exit(1);
+	}
+	FILE *pfxs = fopen(value, "r");
+	if (pfxs == NULL) {
+		fprintf(stderr, "main: Couldn't open file '%s'.\n", value);
+		exit(1);
+	}
+
+	double fpr = FALSE_POSITIVE_RATIO;
+	if ((value = option_value(argc, argv, "--false-positive-ratio",
+					"-f")) != NULL)
+		fpr = atof(value);
+	if (fpr <= 0.0 || fpr >= 1.0) {
+		fprintf(stderr, "main: Invalid false positive ratio: %g.\n", fpr);
+		exit(1);
+	}
+
+	unsigned long num_hashes = 1ul << 26;
+	if ((value = option_value(argc, argv, "--num-hashes", "-n")) != NULL)
+		num_hashes = strtoul(value, NULL, 0);
+
+	unsigned long num_queries = 1ul << 22;
+	if ((value = option_value(argc, argv, "--num-queries", "-q")) != NULL)
+		num_queries = strtoul(value, NULL, 0);
+
+	uint64_t seed = 1;
+	if ((value = option_value(argc, argv, "--seed", "-s")) != NULL)
+		seed = strtoull(value, NULL, 0);
+
+	struct key_set set;
+	read_keys(pfxs, &set);
+	fclose(pfxs);
+	if (set.n == 0) {
+		fprintf(stderr, "main: No keys in the prefixes file.\n");
+		exit(1);
+	}
+
+	/* The timed keys, repeated up to a multiple of 16 for the vectors. */
+	unsigned long n = (set.n + 15) / 16 * 16;
+	uint32_t *keys = aligned_alloc(64, n * sizeof(uint32_t));
+	if (keys == NULL) {
+		fprintf(stderr, "main: Couldn't allocate the timed keys.\n");
+		exit(1);
+	}
+	for (unsigned long i = 0; i < n; i++)
+		keys[i] = set.keys[i % set.n];
+
+	if (contains(argc, argv, "--no-header") == -1)
+		print_header();
+
+	for (unsigned int f = 0; f < NUM_HASH_FUNCTIONS; f++) {
+		const struct hash_function *hf = &hash_functions[f];
+
+		printf("%s,%lu,%.3f,", hf->name, set.n,
+				hf->time(keys, n, num_hashes));
+#ifdef HASH_VEC512
+		printf("%.3f", hf->time_vec512(keys, n, num_hashes));
+#endif
+
+		uint32_t bitmap_len;
+		uint8_t k;
+		double measured = bloom_fpr(&set, hf->hashes, fpr, num_queries,
+				seed, &bitmap_len, &k);
+		double theoretical = pow(1.0 - exp(-(double)k * set.n /
+					bitmap_len), k);
+		printf(",%"PRIu32",%"PRIu8",%g,%.6f,%.6f,%lu", bitmap_len, k,
+				fpr, theoretical, measured, set.n);
+
+		unsigned long buckets[MAX_CHAIN_LEN + 1];
+		uint32_t max_chain;
+		double visits = chain_lengths(&set, hf->hashes, buckets,
+				&max_chain);
+		for (int i = 0; i <= MAX_CHAIN_LEN; i++)
+			printf(",%lu", buckets[i]);
+		printf(",%"PRIu32",%.4f\n", max_chain, visits);
+	}
+
+	free(keys);
+	free(set.keys);
+	free(set.netmasks);
+
+	return 0;
+}
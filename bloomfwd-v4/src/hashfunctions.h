@@ -3,6 +3,10 @@
 
 #include <stdint.h>
 
+#ifdef __SSE4_2__
+#include <nmmintrin.h>  /* _mm_crc32_u32() */
+#endif
+
 /*
  * Scalar version of MurmurHash3 in plain C.
  *
@@ -54,9 +58,86 @@ extern inline uint32_t h2hash_32(uint32_t key)
 	return key;
 }
 
-#ifdef __MIC__
+/*
+ * CRC-32C (Castagnoli polynomial, no inversions) of the key: the SSE 4.2
+ * 'crc32' instruction when available, one bit at a time otherwise. CRCs are
+ * linear over GF(2), i.e. crc(a ^ b) = crc(a) ^ crc(b), so keys that differ
+ * in the same bits get hashes that differ in the same bits.
+ */
+extern inline uint32_t crc32chash_32(uint32_t key)
+{
+#ifdef __SSE4_2__
+	return _mm_crc32_u32(0, key);
+#else
+	for (int i = 0; i < 32; i++)
+		key = (key >> 1) ^ (0x82f63b78 & -(key & 1));
+
+	return key;
+#endif
+}
+
+/*
+ * XXH32 of the four bytes of the key (little endian), with seed 0: one round
+ * of multiply-rotate followed by the xorshift-multiply avalanche of xxHash.
+ * See: https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+ */
+extern inline uint32_t xxhash_32(uint32_t key)
+{
+	uint32_t h = 0x165667b1 + 4;  /* PRIME32_5 + input length. */
+	h += key * 0xc2b2ae3d;  /* 0xc2b2ae3d is PRIME32_3. */
+	h = ((h << 17) | (h >> 15)) * 0x27d4eb2f;  /* PRIME32_4. */
+
+	h ^= h >> 15;
+	h *= 0x85ebca77;  /* PRIME32_2. */
+	h ^= h >> 13;
+	h *= 0xc2b2ae3d;
+	h ^= h >> 16;
+
+	return h;
+}
+
+/*
+ * 64-bit hash of the key: two rounds of 64-bit multiply and xorshift (with
+ * the multipliers of splitmix64 and MurmurHash3's fmix64). Both halves are
+ * well mixed, so that a single call gives the two hashes of a Bloom filter
+ * (see SINGLE_HASH in config.h).
+ */
+extern inline uint64_t mixhash_64(uint32_t key)
+{
+	uint64_t h = key * 0x9e3779b97f4a7c15;
+	h ^= h >> 32;
+	h *= 0xc4ceb9fe1a85ec53;
+	h ^= h >> 32;
+
+	return h;
+}
+
+/*
+ * Map the hash 'x' to [0, len) with the high half of 'x * len' instead of
+ * 'x % len', which takes an integer division on every probe. As with the
+ * modulo, each index gets floor(2^32 / len) or ceil(2^32 / len) of the hash
+ * values, so the false positive ratio of a filter of 'len' bits is unchanged;
+ * the index comes from the high bits of the hash rather than the low ones.
+ * See: https://lemire.me/blog/2016/06/27/a-fast-alternative-to-the-modulo-reduction/
+ */
+extern inline uint32_t fastrange_32(uint32_t x, uint32_t len)
+{
+	return ((uint64_t)x * len) >> 32;
+}
+
+#if defined(__MIC__) || defined(__AVX512F__)
 #include <immintrin.h>
 
+/*
+ * KNC has a native 32-bit integer multiply-add; AVX-512F hasn't.
+ */
+#ifdef __MIC__
+#define MM512_FMADD_EPI32(a, b, c) _mm512_fmadd_epi32(a, b, c)
+#else
+#define MM512_FMADD_EPI32(a, b, c) \
+	_mm512_add_epi32(_mm512_mullo_epi32(a, b), c)
+#endif
+
 /*
  * This function expects as input a 64-byte aligned array containing sixteen
  * 32-bit integer keys. It returns a pointer to sixteen 32-bit hash values.
@@ -79,7 +160,7 @@ extern inline void murmurhash3_32_vec512(uint32_t *keys, uint32_t *hashes)
 	h = _mm512_or_epi32(h1, h2);
 	__m512i five = _mm512_set1_epi32(5);
 	__m512i c3 = _mm512_set1_epi32(0xe6546b64);
-	h = _mm512_fmadd_epi32(h, five, c3);
+	h = MM512_FMADD_EPI32(h, five, c3);
 
 	__m512i four = _mm512_set1_epi32(4);
 	h = _mm512_xor_epi32(h, four);
@@ -120,7 +201,7 @@ extern inline void murmurhash3_32_vec512_v2(uint32_t *keys, uint32_t *hashes)
 	h = _mm512_or_epi32(h1, h2);
 	n = _mm512_set1_epi32(5);  /* n = 5 */
 	c = _mm512_set1_epi32(0xe6546b64);  /* c = 0xe6546b64 (c3) */
-	h = _mm512_fmadd_epi32(h, n, c);
+	h = MM512_FMADD_EPI32(h, n, c);
 
 	n = _mm512_set1_epi32(4);  /* n = 4 */
 	h = _mm512_xor_epi32(h, n);
@@ -162,7 +243,7 @@ extern inline void murmurhash3_32_vec512_v3(uint32_t *keys, uint32_t *hashes)
 	r2 = _mm512_or_epi32(r0, r1);
 	r0 = _mm512_set1_epi32(5);  /* n = 5 */
 	r1 = _mm512_set1_epi32(0xe6546b64);  /* c = 0xe6546b64 (c3) */
-	r2 = _mm512_fmadd_epi32(r2, r0, r1);
+	r2 = MM512_FMADD_EPI32(r2, r0, r1);
 
 	r0 = _mm512_set1_epi32(4);  /* n = 4 */
 	r1 = _mm512_xor_epi32(r2, r0);
@@ -212,7 +293,109 @@ extern inline void h2hash_32_vec512(uint32_t *keys, uint32_t *hashes)
 	_mm512_store_epi32(hashes, r2);
 }
 
+
+extern inline void xxhash_32_vec512(uint32_t *keys, uint32_t *hashes)
+{
+	__m512i r0 = _mm512_load_epi32(keys);
+	__m512i r1 = _mm512_set1_epi32(0xc2b2ae3d);  /* PRIME32_3 */
+	__m512i r2 = _mm512_set1_epi32(0x165667b1 + 4);
+	r2 = MM512_FMADD_EPI32(r0, r1, r2);
+	r0 = _mm512_slli_epi32(r2, 17);
+	r1 = _mm512_srli_epi32(r2, 15);
+	r2 = _mm512_or_epi32(r0, r1);
+	r0 = _mm512_set1_epi32(0x27d4eb2f);  /* PRIME32_4 */
+	r1 = _mm512_mullo_epi32(r2, r0);
+
+	r0 = _mm512_srli_epi32(r1, 15);
+	r2 = _mm512_xor_epi32(r0, r1);
+	r0 = _mm512_set1_epi32(0x85ebca77);  /* PRIME32_2 */
+	r1 = _mm512_mullo_epi32(r2, r0);
+	r0 = _mm512_srli_epi32(r1, 13);
+	r2 = _mm512_xor_epi32(r0, r1);
+	r0 = _mm512_set1_epi32(0xc2b2ae3d);  /* PRIME32_3 */
+	r1 = _mm512_mullo_epi32(r2, r0);
+	r0 = _mm512_srli_epi32(r1, 16);
+	r2 = _mm512_xor_epi32(r0, r1);
+
+	/* Return the calculated hashes. */
+	_mm512_store_epi32(hashes, r2);
+}
+
+/*
+ * There is no vector CRC instruction: the sixteen keys are hashed one at a
+ * time.
+ */
+extern inline void crc32chash_32_vec512(uint32_t *keys, uint32_t *hashes)
+{
+	for (int i = 0; i < 16; i++)
+		hashes[i] = crc32chash_32(keys[i]);
+}
+
+
+#if defined(__AVX512F__)
+/*
+ * Low 64 bits of 'x * c' for eight lanes. AVX-512F only multiplies 32-bit
+ * halves (AVX-512DQ has the full multiply).
+ */
+static inline __m512i mm512_mullo_epi64_c(__m512i x, uint64_t c)
+{
+#if defined(__AVX512DQ__)
+	return _mm512_mullo_epi64(x, _mm512_set1_epi64(c));
+#else
+	__m512i c_lo = _mm512_set1_epi64(c & 0xffffffff);
+	__m512i c_hi = _mm512_set1_epi64(c >> 32);
+	__m512i lo = _mm512_mul_epu32(x, c_lo);
+	__m512i cross = _mm512_add_epi64(
+			_mm512_mul_epu32(_mm512_srli_epi64(x, 32), c_lo),
+			_mm512_mul_epu32(x, c_hi));
+
+	return _mm512_add_epi64(lo, _mm512_slli_epi64(cross, 32));
+#endif
+}
+
+static inline __m512i mm512_mixhash_64(__m512i h)
+{
+	h = mm512_mullo_epi64_c(h, 0x9e3779b97f4a7c15);
+	h = _mm512_xor_epi64(h, _mm512_srli_epi64(h, 32));
+	h = mm512_mullo_epi64_c(h, 0xc4ceb9fe1a85ec53);
+	h = _mm512_xor_epi64(h, _mm512_srli_epi64(h, 32));
+
+	return h;
+}
+
+/*
+ * 'mixhash_64()' of sixteen keys (a 64-byte aligned array): the high halves
+ * of the hashes are stored in 'h1' and the low halves in 'h2'.
+ */
+extern inline void mixhash_64_vec512(uint32_t *keys, uint32_t *h1,
+		uint32_t *h2)
+{
+	__m512i k = _mm512_load_epi32(keys);
+	__m512i lo = mm512_mixhash_64(_mm512_cvtepu32_epi64(
+				_mm512_castsi512_si256(k)));
+	__m512i hi = mm512_mixhash_64(_mm512_cvtepu32_epi64(
+				_mm512_extracti64x4_epi64(k, 1)));
+
+	/* Odd 32-bit elements hold the high halves. */
+	__m512i odd = _mm512_set_epi32(31, 29, 27, 25, 23, 21, 19, 17,
+			15, 13, 11, 9, 7, 5, 3, 1);
+	__m512i even = _mm512_sub_epi32(odd, _mm512_set1_epi32(1));
+	_mm512_store_epi32(h1, _mm512_permutex2var_epi32(lo, odd, hi));
+	_mm512_store_epi32(h2, _mm512_permutex2var_epi32(lo, even, hi));
+}
+#else
+/* KNC has no 64-bit multiplies. */
+extern inline void mixhash_64_vec512(uint32_t *keys, uint32_t *h1,
+		uint32_t *h2)
+{
+	for (int i = 0; i < 16; i++) {
+		uint64_t h = mixhash_64(keys[i]);
+		h1[i] = h >> 32;
+		h2[i] = h;
+	}
+}
 #endif
 
 #endif
 
+#endif
@@ -0,0 +1,173 @@
+/*
+ * hugepages.c
+ */
+
+#define _GNU_SOURCE  /* MAP_ANONYMOUS, MAP_HUGETLB, MADV_HUGEPAGE */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "hugepages.h"
+
+#define HUGE_PAGE_2M (2UL << 20)
+#define HUGE_PAGE_1G (1UL << 30)
+
+/* Smallest array that gets huge pages (see hugepages.h). */
+#define HUGE_ALLOC_MIN HUGE_PAGE_2M
+
+#define CACHE_LINE 64
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+enum huge_source { HUGETLB, THP, ALIGNED, NUM_SOURCES };
+
+static const char *source_names[NUM_SOURCES] = {
+	"huge page pool", "transparent huge pages, advised", "regular pages"
+};
+
+/*
+ * Live allocations (the tables are allocated by the main thread only, and
+ * there are a few tens of them).
+ */
+struct huge_block {
+	void *ptr;
+	size_t len;  /* Mapped length. */
+	enum huge_source source;
+	struct huge_block *next;
+};
+
+static struct huge_block *blocks = NULL;
+static size_t allocated[NUM_SOURCES];
+
+bool huge_pages_enabled = true;
+
+static inline size_t round_up(size_t size, size_t align)
+{
+	return (size + align - 1) & ~(align - 1);
+}
+
+#ifdef MAP_HUGETLB
+static void *alloc_hugetlb(size_t size, size_t *len)
+{
+	size_t page = size >= HUGE_PAGE_1G ? HUGE_PAGE_1G : HUGE_PAGE_2M;
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+		(page == HUGE_PAGE_1G ? MAP_HUGE_1GB : MAP_HUGE_2MB);
+
+	*len = round_up(size, page);
+	void *ptr = mmap(NULL, *len, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (ptr == MAP_FAILED && page == HUGE_PAGE_1G) {  /* Try 2 MiB pages. */
+		*len = round_up(size, HUGE_PAGE_2M);
+		ptr = mmap(NULL, *len, PROT_READ | PROT_WRITE, MAP_PRIVATE |
+				MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+	}
+
+	return ptr == MAP_FAILED ? NULL : ptr;
+}
+#endif
+
+#ifdef MADV_HUGEPAGE
+static void *alloc_thp(size_t size, size_t *len)
+{
+	/* Map an extra page to align the start, then trim both ends. */
+	*len = round_up(size, HUGE_PAGE_2M);
+	size_t map_len = *len + HUGE_PAGE_2M;
+	uint8_t *map = mmap(NULL, map_len, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	uint8_t *ptr = (uint8_t *)round_up((uintptr_t)map, HUGE_PAGE_2M);
+	if (ptr > map)
+		munmap(map, ptr - map);
+	if (map + map_len > ptr + *len)
+		munmap(ptr + *len, map + map_len - (ptr + *len));
+
+	/* Just a hint: the kernel may ignore it (e.g. THP disabled). */
+	madvise(ptr, *len, MADV_HUGEPAGE);
+
+	return ptr;
+}
+#endif
+
+void *huge_alloc(size_t size)
+{
+	struct huge_block *block = malloc(sizeof(struct huge_block));
+	if (block == NULL)
+		return NULL;
+
+	block->ptr = NULL;
+	if (huge_pages_enabled && size >= HUGE_ALLOC_MIN) {
+#ifdef MAP_HUGETLB
+		block->ptr = alloc_hugetlb(size, &block->len);
+		block->source = HUGETLB;
+#endif
+#ifdef MADV_HUGEPAGE
+		if (block->ptr == NULL) {
+			block->ptr = alloc_thp(size, &block->len);
+			block->source = THP;
+		}
+#endif
+	}
+	if (block->ptr == NULL) {
+		/* Like the pages, on cache line boundaries (e.g. fused blocks). */
+		block->len = round_up(size > 0 ? size : 1, CACHE_LINE);
+		block->ptr = aligned_alloc(CACHE_LINE, block->len);
+		if (block->ptr != NULL)
+			memset(block->ptr, 0, block->len);
+		block->source = ALIGNED;
+	}
+
+	if (block->ptr == NULL) {
+		free(block);
+		return NULL;
+	}
+
+	allocated[block->source] += block->len;
+	block->next = blocks;
+	blocks = block;
+
+	return block->ptr;
+}
+
+void huge_free(void *ptr)
+{
+	if (ptr == NULL)
+		return;
+
+	struct huge_block **prev = &blocks;
+	while (*prev != NULL && (*prev)->ptr != ptr)
+		prev = &(*prev)->next;
+
+	struct huge_block *block = *prev;
+	if (block == NULL) {
+		fprintf(stderr, "hugepages.huge_free: %p wasn't allocated by huge_alloc().\n",
+				ptr);
+		exit(1);
+	}
+	*prev = block->next;
+
+	if (block->source == ALIGNED)
+		free(ptr);
+	else
+		munmap(ptr, block->len);
+
+	allocated[block->source] -= block->len;
+	free(block);
+}
+
+void huge_alloc_report(FILE *fp)
+{
+	for (int s = 0; s < NUM_SOURCES; s++)
+		fprintf(fp, "Table memory (%s): %.2lf MiB.\n", source_names[s],
+				allocated[s] / (double)(1 << 20));
+}
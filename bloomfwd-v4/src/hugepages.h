@@ -0,0 +1,41 @@
+/*
+ * hugepages.h
+ *
+ * Allocator for the big, randomly accessed arrays of the forwarding table (the
+ * DLA, the Bloom filter bitmaps, cuckoo filter buckets or fused filter blocks,
+ * the hash table slots and the perfect hash tables), which would otherwise take
+ * a TLB miss on almost every lookup. Memory for arrays of 2 MiB or more is
+ * taken, in order of preference, from:
+ *
+ * 	- the huge page pool (MAP_HUGETLB), with 1 GiB pages for arrays of 1 GiB
+ * 	or more and 2 MiB pages otherwise. The pool must have been reserved
+ * 	(/proc/sys/vm/nr_hugepages);
+ * 	- anonymous memory aligned to 2 MiB and advised to be backed by
+ * 	transparent huge pages (madvise(MADV_HUGEPAGE));
+ * 	- aligned_alloc(), on systems without either.
+ *
+ * Smaller arrays come from aligned_alloc() only, as they would mostly be
+ * padding. The memory is zeroed and 64-byte aligned, so that the layout of the
+ * arrays doesn't depend on where it comes from.
+ */
+
+#ifndef HUGEPAGES_H
+#define HUGEPAGES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Use huge pages (default). If false, 'huge_alloc()' is just aligned_alloc(). */
+extern bool huge_pages_enabled;
+
+/* Allocate 'size' zeroed bytes (NULL on failure). */
+void *huge_alloc(size_t size);
+
+/* Free 'ptr', which was allocated by 'huge_alloc()'. */
+void huge_free(void *ptr);
+
+/* Print how many bytes were allocated from each source to 'fp'. */
+void huge_alloc_report(FILE *fp);
+
+#endif
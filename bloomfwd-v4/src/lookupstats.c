@@ -0,0 +1,87 @@
+/*
+ * lookupstats.c
+ */
+
+#include <string.h>
+
+#include "lookupstats.h"
+
+struct lookup_stats lookup_stats[LOOKUP_STATS_MAX_THREADS];
+
+_Thread_local struct lookup_stats *lookup_stats_self = NULL;
+
+static unsigned int num_claimed = 0;
+
+struct lookup_stats *lookup_stats_claim(void)
+{
+	/* Not an OpenMP atomic: the threads may be plain pthreads. */
+	unsigned int t = __atomic_fetch_add(&num_claimed, 1, __ATOMIC_RELAXED);
+
+	lookup_stats_self = &lookup_stats[t < LOOKUP_STATS_SHARED ? t :
+		LOOKUP_STATS_SHARED];
+	return lookup_stats_self;
+}
+
+void lookup_stats_reset(void)
+{
+	memset(lookup_stats, 0, sizeof(lookup_stats));
+}
+
+void lookup_stats_sum(struct lookup_stats *total)
+{
+	memset(total, 0, sizeof(struct lookup_stats));
+
+	for (int t = 0; t < LOOKUP_STATS_MAX_THREADS; t++) {
+		const struct lookup_stats *s = &lookup_stats[t];
+
+		total->lookups += s->lookups;
+		for (int g = 0; g < 3; g++) {
+			total->bf_queries[g] += s->bf_queries[g];
+			total->bf_maybes[g] += s->bf_maybes[g];
+			total->ht_hits[g] += s->ht_hits[g];
+			total->false_positives[g] += s->false_positives[g];
+		}
+		total->chain_steps += s->chain_steps;
+		total->dla_hits += s->dla_hits;
+		total->default_route_hits += s->default_route_hits;
+		total->misses += s->misses;
+	}
+}
+
+static double ratio(unsigned long long a, unsigned long long b)
+{
+	return b > 0 ? (double)a / b : 0.0;
+}
+
+void lookup_stats_write_json(FILE *fp, const struct lookup_stats *total)
+{
+	static const char *group_names[3] = { "G2", "G1", "G0" };
+	unsigned long long maybes = 0;
+
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"lookups\": %llu,\n", total->lookups);
+	fprintf(fp, "  \"groups\": [\n");
+	for (int g = 0; g < 3; g++) {
+		maybes += total->bf_maybes[g];
+		fprintf(fp, "    { \"group\": \"%s\", \"bloom_queries\": %llu, "
+				"\"bloom_maybes\": %llu, "
+				"\"hash_table_hits\": %llu, "
+				"\"false_positives\": %llu, "
+				"\"false_positives_per_maybe\": %.6f }%s\n",
+				group_names[g], total->bf_queries[g],
+				total->bf_maybes[g],
+				total->ht_hits[g], total->false_positives[g],
+				ratio(total->false_positives[g],
+					total->bf_maybes[g]),
+				g < 2 ? "," : "");
+	}
+	fprintf(fp, "  ],\n");
+	fprintf(fp, "  \"chain_steps\": %llu,\n", total->chain_steps);
+	fprintf(fp, "  \"chain_steps_per_probe\": %.6f,\n",
+			ratio(total->chain_steps, maybes));
+	fprintf(fp, "  \"dla_hits\": %llu,\n", total->dla_hits);
+	fprintf(fp, "  \"default_route_hits\": %llu,\n",
+			total->default_route_hits);
+	fprintf(fp, "  \"misses\": %llu\n", total->misses);
+	fprintf(fp, "}\n");
+}
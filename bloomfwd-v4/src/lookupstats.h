@@ -0,0 +1,71 @@
+/*
+ * lookupstats.h
+ *
+ * Lookup counters. Every thread owns a block of counters on its own cache
+ * lines, claimed the first time it looks an address up: there are no locks or
+ * atomics in the lookup path, nor false sharing between threads. Past
+ * LOOKUP_STATS_SHARED claims, the threads share the last block and add to it
+ * atomically instead. The blocks are summed up on demand (e.g. at the end of a
+ * run).
+ *
+ * Build with LOOKUP_STATS undefined to compile the counters out.
+ */
+
+#ifndef LOOKUPSTATS_H
+#define LOOKUPSTATS_H
+
+#include <stdio.h>
+
+#include "config.h"  /* LOOKUP_STATS, LOOKUP_STATS_MAX_THREADS */
+
+/*
+ * Groups are indexed like the Bloom filters and hash tables of the forwarding
+ * table: 0 = G2 (/32), 1 = G1 (/24), 2 = G0 (/20, multi-VRF mode only).
+ */
+struct lookup_stats {
+	unsigned long long lookups;
+	unsigned long long bf_queries[3];  /* Bloom filter probed. */
+	unsigned long long bf_maybes[3];  /* ... and it said "maybe". */
+	unsigned long long ht_hits[3];  /* ... and the hash table had the key. */
+	unsigned long long false_positives[3];  /* ... but it hadn't. */
+	unsigned long long chain_steps;  /* Hash table entries visited. */
+	unsigned long long dla_hits;
+	unsigned long long default_route_hits;
+	unsigned long long misses;  /* No route at all. */
+} __attribute__((aligned(64)));
+
+extern struct lookup_stats lookup_stats[LOOKUP_STATS_MAX_THREADS];
+
+/* Index of the block shared by the threads that claim one too many. */
+#define LOOKUP_STATS_SHARED (LOOKUP_STATS_MAX_THREADS - 1)
+
+/* Block of the calling thread (NULL until it claims one). */
+extern _Thread_local struct lookup_stats *lookup_stats_self;
+
+/* Claim a block for the calling thread (the shared one if none is left). */
+struct lookup_stats *lookup_stats_claim(void);
+
+#ifdef LOOKUP_STATS
+/* Declare 'thread_stats', the counters of the calling thread. */
+#define LOOKUP_STATS_THREAD() \
+	struct lookup_stats *thread_stats = lookup_stats_self != NULL ? \
+		lookup_stats_self : lookup_stats_claim()
+#define LOOKUP_STATS_ADD(field, n) \
+	(thread_stats == &lookup_stats[LOOKUP_STATS_SHARED] ? \
+	 __atomic_fetch_add(&thread_stats->field, (n), __ATOMIC_RELAXED) : \
+	 (thread_stats->field += (n)))
+#else
+#define LOOKUP_STATS_THREAD()
+#define LOOKUP_STATS_ADD(field, n) ((void)(n))
+#endif
+
+/* Zero the counters of every thread. */
+void lookup_stats_reset(void);
+
+/* Sum the counters of every thread into 'total'. */
+void lookup_stats_sum(struct lookup_stats *total);
+
+/* Write 'total' to 'fp' as a JSON object. */
+void lookup_stats_write_json(FILE *fp, const struct lookup_stats *total);
+
+#endif
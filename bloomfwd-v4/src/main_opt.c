@@ -17,8 +17,19 @@
 #include <string.h>
 
 #include "bloomfwd_opt.h"
-#include "config.h"  /* LOOKUP_PARALLEL, LOOKUP_ADDRESS() */
+#include "bloomtune.h"
+#include "config.h"  /* LOOKUP_PARALLEL, LOOKUP_ADDRESS(), FLOW_CACHE */
+#include "hugepages.h"
+#include "lookupstats.h"
 #include "prettyprint.h"
+#include "replicas.h"
+#include "tlbmisses.h"
+#ifdef FLOW_CACHE
+#include "flowcache.h"
+#endif
+#ifdef LOOKUP_VECTOR
+#include <immintrin.h>  /* _mm_malloc(), _mm_free() */
+#endif
 
 /* Execution control macros. */
 #ifdef NOPRINTF
@@ -28,17 +39,50 @@
 /* Handy macro to perform string comparison. */
 #define STREQ(s1, s2) (strcmp((s1), (s2)) == 0)
 
+/* Maximum length of the file names in the VRF file. */
+#define VRF_FILENAME_LEN 4096
+
+/*
+ * VRFs listed in the file given by '-v' (none in single table mode). The i-th
+ * address is forwarded by VRF 'vrf_ids[i % num_vrf_ids]'.
+ */
+static uint32_t *vrf_ids = NULL;
+static uint32_t num_vrf_ids = 0;
+
+/* Per NUMA node copies of the table, given '-N' (NULL otherwise). */
+static struct table_replicas *replicas = NULL;
+
+/* Count the dTLB misses of the lookups, given '-t'. */
+static bool count_tlb_misses = false;
+
 void print_usage(char *argv[])
 {
 	printf("Usage: %s -d <file1> -p <file2> -r <file3> [-n <count>]\n", argv[0]);
+	printf("       %s -d <file1> -v <file2> -r <file3> [-n <count>]\n", argv[0]);
 	printf("\n");
 	printf("Options:\n");
 	printf("  -d --distribution-file \t Distribution of prefixes according to size (netmask).\n");
 	printf("  -dla --dla-file        \t Prefixes to initialize DLA in the forwarding table.\n");
 	printf("  -g1 --g1-file          \t Prefixes to initialize G1 in the forwarding table.\n");
 	printf("  -g2 --g2-file          \t Prefixes to initialize G2 in the forwarding table.\n");
+	printf("  -v --vrf-file          \t VRFs to initialize the forwarding table, one per line:\n");
+	printf("                         \t \"<vrf> <dla-file> <g1-file> <g2-file>\".\n");
 	printf("  -r --run-address-file  \t Forward IPv4 addresses in a dry-run fashion.\n");
 	printf("  -n --num-addresses     \t Number of addresses to forward.\n");
+	printf("  -s --stats-file        \t Write the lookup counters as JSON (\"-\" for stdout).\n");
+	printf("  -H --no-huge-pages     \t Back the table with regular pages only.\n");
+	printf("  -t --tlb-misses        \t Report the dTLB load misses of the lookups on stderr.\n");
+	printf("  -N --numa-replicas     \t Look up in a copy of the table local to each thread's\n");
+	printf("                         \t NUMA node (bind threads with OMP_PROC_BIND/OMP_PLACES).\n");
+	printf("  -f --fpr               \t False positive ratios of the Bloom filters:\n");
+	printf("                         \t \"<g2>[,<g1>[,<g0>]]\" (missing ones repeat the last;\n");
+	printf("                         \t 1 leaves the group without a filter).\n");
+	printf("  -a --auto-fpr          \t Look the addresses up once and resize the Bloom filters\n");
+	printf("                         \t for the lookups counted (see bloomtune.h).\n");
+	printf("  -b --bloom-budget      \t Total length of the Bloom filters for '-a' (default:\n");
+	printf("                         \t the length they have before).\n");
+	printf("  -C --no-counters       \t Drop the Bloom filter counters once the table is loaded\n");
+	printf("                         \t (and tuned): it's read-only from then on.\n");
 }
 
 /*
@@ -54,7 +98,7 @@ static unsigned long read_addresses(FILE *input_addr, uint32_t **addresses)
 	unsigned long len;
 	int rc = fscanf(input_addr, "%lu", &len);
 	
-#if defined(LOOKUP_VECTOR) && defined(__MIC__)
+#ifdef LOOKUP_VECTOR
 	*addresses = _mm_malloc(len * sizeof(uint32_t), 64);
 #else
 	*addresses = malloc(len * sizeof(uint32_t));
@@ -79,12 +123,56 @@ static unsigned long read_addresses(FILE *input_addr, uint32_t **addresses)
 
 	return len;
 }
+
+/*
+ * Memory of the membership filters (and of the snapshots), next to the huge
+ * pages report ('-t').
+ */
+static void report_filters_size(const struct forwarding_table *fw_tbl)
+{
+	unsigned long long keys = 0;
+	size_t snapshots = 0;
+	for (int g = 0; g < 3; g++) {
+		keys += group_num_keys(fw_tbl, g);
+		if (fw_tbl->perfect_hashes[g] != NULL)
+			snapshots += perfect_hash_size(fw_tbl->perfect_hashes[g]);
+	}
+
+	size_t size = membership_filters_size(fw_tbl);
+#ifdef CUCKOO_FILTER
+	const char *kind = "Cuckoo";
+#elif defined(FUSED_FILTER)
+	const char *kind = "Fused";
+#else
+	const char *kind = "Bloom";
+#endif
+	fprintf(stderr, "%s filters: %zu bytes (%.2lf bits per key).\n", kind,
+			size, keys > 0 ? 8.0 * size / keys : 0.0);
+#ifdef FUSED_FILTER
+	unsigned long long in_blocks = 0;
+	for (int g = 0; g < 3; g++) {
+		const struct counting_bloom_filter *bf =
+			fw_tbl->counting_bloom_filters[g];
+		if (bf != NULL && bf->fused != NULL)
+			in_blocks += bf->fused->count;
+	}
+	fprintf(stderr, "Keys in the fused filter blocks: %llu (%.2lf%%).\n",
+			in_blocks, keys > 0 ? 100.0 * in_blocks / keys : 0.0);
+#endif
+#ifdef PERFECT_HASH
+	fprintf(stderr, "Perfect hash tables: %zu bytes (%.2lf bytes per key).\n",
+			snapshots, keys > 0 ? (double)snapshots / keys : 0.0);
+#endif
+}
+
 /*
  * Simply forward IPv4 addresses read from 'input_addr' file 'count' times. If
  * the number of addresses in the file is smaller than 'count', this function
  * goes back to the beginning and forwards the same packets again until 'count'
- * is reached. If 'count' is 0, it forwards each address in the file once. The
- * 'input_addr' file must be formatted as follows:
+ * is reached. If 'count' is 0, it forwards each address in the file once. In
+ * multi-VRF mode, the i-th address is looked up in VRF 'vrf_ids[i %
+ * num_vrf_ids]'. With '-N', each thread looks up in the replica of its NUMA
+ * node. The 'input_addr' file must be formatted as follows:
  *
  * 	- First line is the number of addresses in the file;
  * 	- Remaining lines are addresses in the form A.B.C.D, where A, B, C and D
@@ -104,6 +192,10 @@ void forward(struct forwarding_table *fw_tbl, FILE *input_addr, unsigned long co
 
 #ifdef LOOKUP_VECTOR
 	assert(count % 16 == 0);
+	if (num_vrf_ids > 0) {
+		fprintf(stderr, "main.forward: Multi-VRF mode requires scalar lookups.\n");
+		exit(1);
+	}
 #endif
 
 #ifndef NDEBUG
@@ -111,6 +203,13 @@ void forward(struct forwarding_table *fw_tbl, FILE *input_addr, unsigned long co
 	printf("Forwarding %.2lf times (%lu addresses).\n", (double)count / len, count);
 #endif
 	
+#ifdef FLOW_CACHE
+	unsigned long long fc_hits = 0, fc_misses = 0, fc_invalidations = 0;
+#endif
+
+	unsigned long long tlb_misses = 0;
+	bool tlb_counted = true;
+
 #ifdef BENCHMARK
 	double exec_time = omp_get_wtime();
 #endif
@@ -120,6 +219,16 @@ void forward(struct forwarding_table *fw_tbl, FILE *input_addr, unsigned long co
 {
 #endif
 
+	/* The (first) node a thread runs on is its node for the whole loop. */
+	struct forwarding_table *tbl = replicas != NULL ?
+		local_replica(replicas) : fw_tbl;
+
+#ifdef FLOW_CACHE
+	struct flow_cache *fc = new_flow_cache(tbl);  /* One per thread. */
+#endif
+
+	int tlb_counter = count_tlb_misses ? dtlb_misses_start() : -1;
+
 #ifndef NDEBUG
 	char addr_str[16];
 	char next_hop_str[16];
@@ -151,29 +260,87 @@ void forward(struct forwarding_table *fw_tbl, FILE *input_addr, unsigned long co
 #endif
 #endif
 
-#ifndef NDEBUG
-	for (int i = 0; i < 2; i++) {
-		bloomf_match_addrs[i] = NULL;
-		bloomf_match_addrs_count[i] = 0;
-		bloomf_maybe_addrs[i] = NULL;
-		bloomf_maybe_addrs_count[i] = 0;
-	}
+#ifdef LOOKUP_PARALLEL
+#pragma omp for schedule(runtime)
 #endif
+#if defined(LOOKUP_BATCH)
+	/* A window that wraps around 'addresses' is looked up in two parts. */
+	for (unsigned long i = 0; i < count; i += LOOKUP_PREFETCH_DISTANCE) {
+		uint32_t n = LOOKUP_PREFETCH_DISTANCE;
+		if (count - i < n)
+			n = count - i;
+
+		unsigned long first = i % len;
+		uint32_t head = len - first < n ? len - first : n;
+		bool found[LOOKUP_PREFETCH_DISTANCE];
+		uint32_t next_hops[LOOKUP_PREFETCH_DISTANCE];
+		if (num_vrf_ids > 0) {
+			uint32_t vrfs[LOOKUP_PREFETCH_DISTANCE];
+			for (uint32_t j = 0; j < n; j++)
+				vrfs[j] = vrf_ids[(i + j) % num_vrf_ids];
+			lookup_address_vrf_batch(tbl, head, vrfs,
+					&addresses[first], found, next_hops);
+			if (head < n)
+				lookup_address_vrf_batch(tbl, n - head,
+						&vrfs[head], addresses,
+						&found[head], &next_hops[head]);
+		} else {
+			lookup_address_batch(tbl, head, &addresses[first],
+					found, next_hops);
+			if (head < n)
+				lookup_address_batch(tbl, n - head, addresses,
+						&found[head], &next_hops[head]);
+		}
 
+#ifndef NDEBUG
+		for (uint32_t j = 0; j < n; j++) {
+			/* I/O. */
+			straddr(addresses[(i + j) % len], addr_str);
+			straddr(next_hops[j], next_hop_str);
 #ifdef LOOKUP_PARALLEL
-#pragma omp for schedule(runtime)
+#pragma omp critical
+  {
+#endif
+			if (num_vrf_ids > 0)
+				printf("\t[%"PRIu32"]",
+						vrf_ids[(i + j) % num_vrf_ids]);
+			if (!found[j])
+				printf("\t%s -> (none)\n", addr_str);
+			else
+				printf("\t%s -> %s.\n", addr_str, next_hop_str);
+#ifdef LOOKUP_PARALLEL
+  }
+#endif
+		}
 #endif
-#ifdef LOOKUP_SCALAR
+	}
+#elif defined(LOOKUP_SCALAR)
 	for (unsigned long i = 0; i < count; i++) {
 		/* Decode address. */
 		uint32_t addr = addresses[i % len];
 
 		/* Lookup */
 		uint32_t next_hop;
+#if defined(FLOW_CACHE)
+		uint32_t vrf = num_vrf_ids > 0 ? vrf_ids[i % num_vrf_ids] : 0;
 #ifndef NDEBUG
-		bool found = LOOKUP_ADDRESS(fw_tbl, addr, &next_hop);
+		bool found = flow_cache_lookup(fc, tbl, vrf, addr, &next_hop);
 #else
-		LOOKUP_ADDRESS(fw_tbl, addr, &next_hop);
+		flow_cache_lookup(fc, tbl, vrf, addr, &next_hop);
+#endif
+#elif !defined(NDEBUG)
+		bool found;
+		if (num_vrf_ids > 0)
+			found = lookup_address_vrf(tbl,
+					vrf_ids[i % num_vrf_ids], addr, &next_hop);
+		else
+			found = LOOKUP_ADDRESS(tbl, addr, &next_hop);
+#else
+		if (num_vrf_ids > 0)
+			lookup_address_vrf(tbl, vrf_ids[i % num_vrf_ids], addr,
+					&next_hop);
+		else
+			LOOKUP_ADDRESS(tbl, addr, &next_hop);
 #endif
 
 #ifndef NDEBUG
@@ -184,6 +351,8 @@ void forward(struct forwarding_table *fw_tbl, FILE *input_addr, unsigned long co
 #pragma omp critical
   {
 #endif
+		if (num_vrf_ids > 0)
+			printf("\t[%"PRIu32"]", vrf_ids[i % num_vrf_ids]);
 		if (!found)
 			printf("\t%s -> (none)\n", addr_str);
 		else
@@ -199,12 +368,12 @@ void forward(struct forwarding_table *fw_tbl, FILE *input_addr, unsigned long co
 	 * correctly!
 	 */
 	for (unsigned long i = 0; i < count; i += 16) {
-		__declspec(align(64)) uint32_t next_hops[16];
-		__declspec(align(64)) bool found[16];
+		_Alignas(64) uint32_t next_hops[16];
 #ifndef NDEBUG
-		LOOKUP_ADDRESS(fw_tbl, &addresses[i % len], found, next_hops);
+		uint16_t found = LOOKUP_ADDRESS(tbl, &addresses[i % len],
+				next_hops);
 #else
-		LOOKUP_ADDRESS(fw_tbl, &addresses[i % len], found, next_hops);
+		LOOKUP_ADDRESS(tbl, &addresses[i % len], next_hops);
 #endif
 
 #ifndef NDEBUG
@@ -216,7 +385,7 @@ void forward(struct forwarding_table *fw_tbl, FILE *input_addr, unsigned long co
 #pragma omp critical
   {
 #endif
-			if (!found[j])
+			if (!(found & (1 << j)))
 				printf("\t%s -> (none)\n", addr_str);
 			else
 				printf("\t%s -> %s.\n", addr_str, next_hop_str);
@@ -227,6 +396,36 @@ void forward(struct forwarding_table *fw_tbl, FILE *input_addr, unsigned long co
 #endif
 	}
 
+#endif
+
+	if (count_tlb_misses) {
+		unsigned long long misses = dtlb_misses_stop(tlb_counter);
+#ifdef LOOKUP_PARALLEL
+#pragma omp atomic
+#endif
+		tlb_misses += misses;
+		if (tlb_counter == -1) {
+#ifdef LOOKUP_PARALLEL
+#pragma omp atomic write
+#endif
+			tlb_counted = false;
+		}
+	}
+
+#ifdef FLOW_CACHE
+#ifdef LOOKUP_PARALLEL
+#pragma omp atomic
+#endif
+	fc_hits += fc->hits;
+#ifdef LOOKUP_PARALLEL
+#pragma omp atomic
+#endif
+	fc_misses += fc->misses;
+#ifdef LOOKUP_PARALLEL
+#pragma omp atomic
+#endif
+	fc_invalidations += fc->invalidations;
+	free_flow_cache(fc);
 #endif
 #ifdef LOOKUP_PARALLEL
 }
@@ -237,61 +436,30 @@ void forward(struct forwarding_table *fw_tbl, FILE *input_addr, unsigned long co
 	printf("%lf", exec_time);
 #endif
 
-#if defined(LOOKUP_VECTOR) && defined(__MIC__)
+#ifdef FLOW_CACHE
+	/* On stderr, so that the bench scripts can keep reading the time. */
+	fprintf(stderr, "Flow cache: %llu hits, %llu misses, %.2lf%% hit rate, %llu invalidations.\n",
+			fc_hits, fc_misses,
+			100.0 * fc_hits / (fc_hits + fc_misses > 0 ?
+				fc_hits + fc_misses : 1),
+			fc_invalidations);
+#endif
+
+	if (count_tlb_misses) {
+		if (tlb_counted)
+			fprintf(stderr, "dTLB load misses: %llu (%.3lf per lookup).\n",
+					tlb_misses, (double)tlb_misses / count);
+		else
+			fprintf(stderr, "dTLB load misses: unavailable (no access to the performance counters).\n");
+		report_filters_size(fw_tbl);
+		huge_alloc_report(stderr);
+	}
+
+#ifdef LOOKUP_VECTOR
 	_mm_free(addresses);
 #else
 	free(addresses);
 #endif
-
-//#ifndef NDEBUG
-//	// MATCH
-//	printf("\nMatching addresses...\n");
-//	unsigned long long total_addrs = 0;
-//	for (int i = 0; i < 2; i++) {
-//		printf("#%2d = %llu\n", i, bloomf_match_addrs_count[i]);
-//		total_addrs += bloomf_match_addrs_count[i];
-//	}
-//	printf("TOTAL MATCH ADDRS: %llu\n", total_addrs);
-//
-//	char addr_s[16];
-//	/*
-//	printf("\n#3\n");
-//	for (struct addr_list *a = bloomf_match_addrs[3]; a != NULL; a = a->next) {
-//		straddr(a->addr, addr_s);
-//		printf("%s\n", addr_s);
-//	}
-//	*/
-//	FILE *fp = NULL;
-//	char filename[1000];
-//	char filename_fmt[] = "/Users/alexandrelucchesi/Development/c/bloomfwd/tmp/%d.txt";
-//	for (int i = 0; i < 2; i++) {
-//		sprintf(filename, filename_fmt, 32 - i);
-//		fp = fopen(filename, "w");
-//		assert(fp != NULL);
-//		struct addr_list *a = bloomf_match_addrs[i];
-//		while (a != NULL) {
-//			straddr(a->addr, addr_s);
-//			fprintf(fp, "%s\n", addr_s);
-//			a = a->next;
-//		}
-//		fclose(fp);
-//	}
-//
-//	// MAYBE
-//	printf("\nMaybe addresses...\n");
-//	total_addrs = 0;
-//	for (int i = 0; i < 2; i++) {
-//		printf("#%2d = %llu\n", i, bloomf_maybe_addrs_count[i]);
-//		total_addrs += bloomf_maybe_addrs_count[i];
-//	}
-//	printf("MAYBE COUNT: %llu\n", total_addrs);
-//
-//	printf("\n#3\n");
-//	for (struct addr_list *a = bloomf_maybe_addrs[3]; a != NULL; a = a->next) {
-//		straddr(a->addr, addr_s);
-//		printf("%s\n", addr_s);
-//	}
-//#endif
 }
 
 static inline int contains(int argc, char *argv[], const char *option)
@@ -307,11 +475,146 @@ static inline int contains(int argc, char *argv[], const char *option)
 	return index;
 }
 
-/* Options: -d, --distribution-file. */
+/*
+ * Options: -v, --vrf-file.
+ *
+ * Return the VRF file, or NULL if not in multi-VRF mode.
+ */
+static FILE *open_vrf_file(int argc, char *argv[])
+{
+	int index;
+
+	if ((index = contains(argc, argv, "--vrf-file")) == -1)
+		index = contains(argc, argv, "-v");
+
+	if (index == -1)
+		return NULL;
+
+	if (index + 1 >= argc) {
+		fprintf(stderr, "Please specify VRF file after '%s'.\n",
+				argv[index]);
+		exit(1);
+	}
+
+	FILE *vrfs = fopen(argv[index + 1], "r");
+	if (vrfs == NULL) {
+		fprintf(stderr, "Couldn't open VRF file: '%s'.\n",
+				argv[index + 1]);
+		exit(1);
+	}
+
+	return vrfs;
+}
+
+/*
+ * Read the next line of the VRF file. Return false at the end of the file.
+ */
+static bool read_vrf(FILE *vrfs, uint32_t *vrf, char dla[], char g1[],
+		char g2[])
+{
+	int rc = fscanf(vrfs, "%"SCNu32" %4095s %4095s %4095s", vrf, dla, g1,
+			g2);
+	if (rc == EOF)
+		return false;
+
+	if (rc != 4) {
+		fprintf(stderr, "Couldn't read VRF file.\n");
+		exit(1);
+	}
+
+	return true;
+}
+
+/*
+ * Fill in 'vrf_ids' with the VRFs in the VRF file and return the number of
+ * VRFs the table must hold (i.e. the largest VRF plus one).
+ */
+static uint32_t read_vrf_ids(FILE *vrfs)
+{
+	char dla[VRF_FILENAME_LEN], g1[VRF_FILENAME_LEN], g2[VRF_FILENAME_LEN];
+	uint32_t vrf, capacity = 0, num_vrfs = 0;
+
+	while (read_vrf(vrfs, &vrf, dla, g1, g2)) {
+		if (num_vrf_ids == capacity) {
+			capacity = capacity == 0 ? 64 : 2 * capacity;
+			vrf_ids = realloc(vrf_ids, capacity * sizeof(uint32_t));
+			if (vrf_ids == NULL) {
+				fprintf(stderr, "main.read_vrf_ids: Could not realloc VRF ids.\n");
+				exit(1);
+			}
+		}
+		vrf_ids[num_vrf_ids++] = vrf;
+		if (vrf >= num_vrfs)
+			num_vrfs = vrf + 1;
+	}
+
+	if (num_vrf_ids == 0) {
+		fprintf(stderr, "main.read_vrf_ids: Empty VRF file.\n");
+		exit(1);
+	}
+
+	return num_vrfs;
+}
+
+/*
+ * Options: -f, --fpr.
+ *
+ * Fill in 'fprs' (indexed like the Bloom filters) from "<g2>[,<g1>[,<g0>]]",
+ * or with FALSE_POSITIVE_RATIO. A ratio of 1 means no filter.
+ */
+static void read_false_positive_ratios(int argc, char *argv[], double fprs[3])
+{
+	int index;
+
+	for (int g = 0; g < 3; g++)
+		fprs[g] = FALSE_POSITIVE_RATIO;
+
+	if ((index = contains(argc, argv, "--fpr")) == -1)
+		index = contains(argc, argv, "-f");
+
+	if (index == -1)
+		return;
+
+	if (index + 1 >= argc) {
+		fprintf(stderr, "Please specify false positive ratios after '%s'.\n",
+				argv[index]);
+		exit(1);
+	}
+
+	const char *str = argv[index + 1];
+	for (int g = 0; g < 3; g++) {
+		char *end;
+		double fpr = strtod(str, &end);
+		if (end == str || fpr <= 0.0 || fpr > 1.0 ||
+				(*end != ',' && *end != '\0')) {
+			fprintf(stderr, "Invalid false positive ratios: '%s'.\n",
+					argv[index + 1]);
+			exit(1);
+		}
+
+		for (int i = g; i < 3; i++)
+			fprs[i] = fpr;
+		if (*end == '\0')
+			break;
+		str = end + 1;
+	}
+}
+
+/* Options: -d, --distribution-file (and -f, --fpr). */
 static void allocate_forwarding_table(int argc, char *argv[],
 		struct forwarding_table **fw_tbl)
 {
 	int index;
+	uint32_t num_vrfs = 1;
+	double fprs[3];
+
+	read_false_positive_ratios(argc, argv, fprs);
+
+	FILE *vrfs = open_vrf_file(argc, argv);
+	if (vrfs != NULL) {
+		num_vrfs = read_vrf_ids(vrfs);
+		fclose(vrfs);
+	}
 
 	if ((index = contains(argc, argv, "--distribution-file")) == -1)
 		index = contains(argc, argv, "-d");
@@ -329,7 +632,8 @@ static void allocate_forwarding_table(int argc, char *argv[],
 			 * TODO: Optionally get second argument for
 			 * 'new_forwarding_table' (gateway default) from 'argv'.
 			 */
-			*fw_tbl = new_forwarding_table(pfx_distribution, NULL);
+			*fw_tbl = new_forwarding_table_fpr(pfx_distribution,
+					num_vrfs, fprs);
 			fclose(pfx_distribution);
 		} else {
 			fprintf(stderr, "Please specify prefixes distribution file after '%s'.\n",
@@ -337,16 +641,50 @@ static void allocate_forwarding_table(int argc, char *argv[],
 			exit(1);
 		}
 	} else {
-		*fw_tbl = new_forwarding_table(NULL, NULL);
+		*fw_tbl = new_forwarding_table_fpr(NULL, num_vrfs, fprs);
 	}
 }
 
-/* Options: -g1, --g1-file and -g2, --g2-file. */
+static void load_prefixes_file(struct forwarding_table *fw_tbl, uint32_t vrf,
+		const char *filename)
+{
+	FILE *prefixes = fopen(filename, "r");
+	if (prefixes == NULL) {
+		fprintf(stderr, "Couldn't open prefixes file: '%s'.\n", filename);
+		exit(1);
+	}
+
+	load_prefixes_vrf(fw_tbl, vrf, prefixes);
+	fclose(prefixes);
+}
+
+/* Options: -v, --vrf-file. */
+static void initialize_forwarding_table_vrf(struct forwarding_table *fw_tbl,
+		FILE *vrfs)
+{
+	char dla[VRF_FILENAME_LEN], g1[VRF_FILENAME_LEN], g2[VRF_FILENAME_LEN];
+	uint32_t vrf;
+
+	while (read_vrf(vrfs, &vrf, dla, g1, g2)) {
+		load_prefixes_file(fw_tbl, vrf, dla);
+		load_prefixes_file(fw_tbl, vrf, g1);
+		load_prefixes_file(fw_tbl, vrf, g2);
+	}
+}
+
+/* Options: -g1, --g1-file and -g2, --g2-file (or -v, --vrf-file). */
 static void initialize_forwarding_table(struct forwarding_table *fw_tbl, int argc,
 		char *argv[])
 {
 	int index_dla, index_g1, index_g2;
 
+	FILE *vrfs = open_vrf_file(argc, argv);
+	if (vrfs != NULL) {
+		initialize_forwarding_table_vrf(fw_tbl, vrfs);
+		fclose(vrfs);
+		return;
+	}
+
 	if ((index_dla = contains(argc, argv, "--dla-file")) == -1)
 		index_dla = contains(argc, argv, "-dla");
 
@@ -440,6 +778,172 @@ static void run(struct forwarding_table *fw_tbl, int argc, char *argv[])
 	}
 }
 
+/*
+ * Options: -a, --auto-fpr, -b, --bloom-budget.
+ *
+ * Look the addresses of the run (-r) up once, serially, then resize the Bloom
+ * filters for the query mix counted (see bloomtune.h). The counters are zeroed
+ * afterwards, so that '-s' only reports the run.
+ */
+static void tune_forwarding_table(struct forwarding_table *fw_tbl, int argc,
+		char *argv[])
+{
+	int index;
+
+	if (contains(argc, argv, "--auto-fpr") == -1 &&
+			contains(argc, argv, "-a") == -1)
+		return;
+
+#ifndef LOOKUP_STATS
+	fprintf(stderr, "main.tune_forwarding_table: Built without LOOKUP_STATS.\n");
+	exit(1);
+#endif
+#ifdef CUCKOO_FILTER
+	fprintf(stderr, "main.tune_forwarding_table: The cost model is the Bloom filters' (built with CUCKOO_FILTER).\n");
+	exit(1);
+#endif
+#ifdef FUSED_FILTER
+	fprintf(stderr, "main.tune_forwarding_table: Fused filters can't be resized (built with FUSED_FILTER).\n");
+	exit(1);
+#endif
+
+	size_t budget = 0;
+	if ((index = contains(argc, argv, "--bloom-budget")) == -1)
+		index = contains(argc, argv, "-b");
+	if (index != -1) {
+		if (index + 1 >= argc) {
+			fprintf(stderr, "Please specify Bloom filters length after '%s'.\n",
+					argv[index]);
+			exit(1);
+		}
+		budget = strtoull(argv[index + 1], NULL, 10);
+	}
+
+	if ((index = contains(argc, argv, "--run-address-file")) == -1)
+		index = contains(argc, argv, "-r");
+	if (index == -1 || index + 1 >= argc) {
+		fprintf(stderr, "main.tune_forwarding_table: Missing address file.\n");
+		exit(1);
+	}
+
+	FILE *input_addr = fopen(argv[index + 1], "r");
+	if (input_addr == NULL) {
+		fprintf(stderr, "Couldn't open input addresses file: '%s'.\n",
+				argv[index + 1]);
+		exit(1);
+	}
+	uint32_t *addresses = NULL;
+	unsigned long len = read_addresses(input_addr, &addresses);
+	fclose(input_addr);
+
+	lookup_stats_reset();
+	for (unsigned long i = 0; i < len; i++) {
+		uint32_t next_hop;
+		if (num_vrf_ids > 0)
+			lookup_address_vrf(fw_tbl, vrf_ids[i % num_vrf_ids],
+					addresses[i], &next_hop);
+		else
+			lookup_address(fw_tbl, addresses[i], &next_hop);
+	}
+#ifdef LOOKUP_VECTOR
+	_mm_free(addresses);
+#else
+	free(addresses);
+#endif
+
+	struct lookup_stats total;
+	lookup_stats_sum(&total);
+	lookup_stats_reset();
+
+	struct bloom_tuning tuning;
+	tune_bloom_filters(fw_tbl, &total, budget, &tuning);
+	for (int g = 0; g < 3; g++)
+		resize_bloom_filter(fw_tbl, g, tuning.fprs[g]);
+
+	/* On stderr, so that the bench scripts can keep reading the time. */
+	fprintf(stderr, "Bloom filters: FPR G2 = %lg, G1 = %lg, G0 = %lg; %zu "
+			"positions; %.3lf accesses per lookup (were %.3lf).\n",
+			tuning.fprs[0], tuning.fprs[1], tuning.fprs[2],
+			bloom_filters_len(fw_tbl), tuning.cost,
+			tuning.cost_before);
+}
+
+/* Options: -H, --no-huge-pages, -t, --tlb-misses. */
+static void read_memory_options(int argc, char *argv[])
+{
+	if (contains(argc, argv, "--no-huge-pages") != -1 ||
+			contains(argc, argv, "-H") != -1)
+		huge_pages_enabled = false;
+
+	if (contains(argc, argv, "--tlb-misses") != -1 ||
+			contains(argc, argv, "-t") != -1)
+		count_tlb_misses = true;
+}
+
+/* Options: -C, --no-counters. */
+static void drop_counters(struct forwarding_table *fw_tbl, int argc,
+		char *argv[])
+{
+	if (contains(argc, argv, "--no-counters") != -1 ||
+			contains(argc, argv, "-C") != -1)
+		drop_bloom_counters(fw_tbl);
+}
+
+/* Options: -N, --numa-replicas. */
+static void replicate_forwarding_table(struct forwarding_table *fw_tbl,
+		int argc, char *argv[])
+{
+	if (contains(argc, argv, "--numa-replicas") == -1 &&
+			contains(argc, argv, "-N") == -1)
+		return;
+
+	if (omp_get_proc_bind() == omp_proc_bind_false)
+		fprintf(stderr, "main.replicate_forwarding_table: Threads aren't bound "
+				"to CPUs (set OMP_PROC_BIND and OMP_PLACES): they may "
+				"migrate away from their replica.\n");
+
+	replicas = new_table_replicas(fw_tbl);
+	fprintf(stderr, "NUMA replicas: %d node(s).\n", replicas->num_nodes);
+}
+
+/* Options: -s, --stats-file. */
+static void write_stats(int argc, char *argv[])
+{
+	int index;
+
+	if ((index = contains(argc, argv, "--stats-file")) == -1)
+		index = contains(argc, argv, "-s");
+
+	if (index == -1)
+		return;
+
+#ifndef LOOKUP_STATS
+	fprintf(stderr, "main.write_stats: Built without LOOKUP_STATS.\n");
+	exit(1);
+#endif
+
+	if (index + 1 >= argc) {
+		fprintf(stderr, "Please specify statistics file after '%s'.\n",
+				argv[index]);
+		exit(1);
+	}
+
+	FILE *fp = STREQ(argv[index + 1], "-") ? stdout :
+		fopen(argv[index + 1], "w");
+	if (fp == NULL) {
+		fprintf(stderr, "Couldn't open statistics file: '%s'.\n",
+				argv[index + 1]);
+		exit(1);
+	}
+
+	struct lookup_stats total;
+	lookup_stats_sum(&total);
+	lookup_stats_write_json(fp, &total);
+
+	if (fp != stdout)
+		fclose(fp);
+}
+
 int main(int argc, char *argv[])
 {
 	if (argc < 2 || STREQ(argv[1], "--help")) {
@@ -449,15 +953,15 @@ int main(int argc, char *argv[])
 
 	struct forwarding_table *fw_tbl = NULL;
 
-    stats.bf_match = 0;
-    stats.ht_match = 0;
-
+	read_memory_options(argc, argv);  /* Huge pages, dTLB misses. */
 	allocate_forwarding_table(argc, argv, &fw_tbl);  /* Prefixes distrib. */
 	initialize_forwarding_table(fw_tbl, argc, argv);  /* Load prefixes. */
+	pack_forwarding_table(fw_tbl);  /* Chains in bucket order. */
+	tune_forwarding_table(fw_tbl, argc, argv);  /* Bloom filters FPRs. */
+	drop_counters(fw_tbl, argc, argv);  /* Read-only from here. */
+	replicate_forwarding_table(fw_tbl, argc, argv);  /* NUMA replicas. */
 	run(fw_tbl, argc, argv);  /* Dry-run only. */
-
-    printf("\n\nstats.bf_match = %llu\n", stats.bf_match);
-    printf("\n\nstats.ht_match = %llu\n", stats.ht_match);
+	write_stats(argc, argv);  /* Lookup counters. */
 
 	return 0;
 }
@@ -0,0 +1,248 @@
+/*
+ * perfecthash.c
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hugepages.h"
+#include "perfecthash.h"
+
+/* Seeds to try before giving up (one fails with a negligible probability). */
+#define PERFECT_HASH_MAX_SEEDS 16
+
+/* Scratch state of a build. */
+struct build {
+	uint64_t *hashes;  /* Of the keys, in input order. */
+	uint32_t *bucket_start;  /* Keys of bucket b: [bucket_start[b], [b + 1]). */
+	uint32_t *keys;  /* Indexes of the keys, by bucket. */
+	uint32_t *buckets;  /* Buckets, biggest first. */
+	bool *taken;  /* Positions. */
+};
+
+static void *xcalloc(size_t n, size_t size)
+{
+	void *p = calloc(n, size);
+	if (p == NULL) {
+		fprintf(stderr, "perfecthash.new_perfect_hash: Couldn't calloc build arrays.\n");
+		exit(1);
+	}
+
+	return p;
+}
+
+/* Group the keys by bucket and sort the buckets by size, biggest first. */
+static void sort_buckets(const struct perfect_hash *ph, struct build *b)
+{
+	memset(b->bucket_start, 0, (ph->num_buckets + 1) * sizeof(uint32_t));
+	for (uint32_t i = 0; i < ph->count; i++)
+		b->bucket_start[perfect_hash_bucket(ph, b->hashes[i]) + 1]++;
+
+	uint32_t max_size = 0;
+	for (uint32_t i = 1; i <= ph->num_buckets; i++) {
+		if (b->bucket_start[i] > max_size)
+			max_size = b->bucket_start[i];
+		b->bucket_start[i] += b->bucket_start[i - 1];
+	}
+
+	uint32_t *fill = xcalloc(ph->num_buckets, sizeof(uint32_t));
+	for (uint32_t i = 0; i < ph->count; i++) {
+		uint32_t bucket = perfect_hash_bucket(ph, b->hashes[i]);
+		b->keys[b->bucket_start[bucket] + fill[bucket]++] = i;
+	}
+	free(fill);
+
+	/* Counting sort: 'by_size[s]' is where the buckets of size s start. */
+	uint32_t *by_size = xcalloc(max_size + 2, sizeof(uint32_t));
+	for (uint32_t i = 0; i < ph->num_buckets; i++) {
+		uint32_t size = b->bucket_start[i + 1] - b->bucket_start[i];
+		by_size[max_size - size + 1]++;
+	}
+	for (uint32_t s = 1; s <= max_size + 1; s++)
+		by_size[s] += by_size[s - 1];
+	for (uint32_t i = 0; i < ph->num_buckets; i++) {
+		uint32_t size = b->bucket_start[i + 1] - b->bucket_start[i];
+		b->buckets[by_size[max_size - size]++] = i;
+	}
+	free(by_size);
+}
+
+/*
+ * Find a pilot that sends the keys of 'bucket' to free, distinct positions and
+ * take them. Return false if there is none.
+ */
+static bool place_bucket(struct perfect_hash *ph, struct build *b,
+		uint32_t bucket, uint32_t *positions)
+{
+	const uint32_t *keys = &b->keys[b->bucket_start[bucket]];
+	uint32_t size = b->bucket_start[bucket + 1] - b->bucket_start[bucket];
+
+	for (uint32_t pilot = 0; pilot <= UINT16_MAX; pilot++) {
+		uint32_t j;
+		for (j = 0; j < size; j++) {
+			uint32_t p = perfect_hash_position(ph, b->hashes[keys[j]],
+					pilot);
+			if (b->taken[p])
+				break;
+
+			uint32_t k;
+			for (k = 0; k < j && positions[k] != p; k++)
+				;
+			if (k < j)
+				break;
+			positions[j] = p;
+		}
+
+		if (j == size) {
+			for (j = 0; j < size; j++)
+				b->taken[positions[j]] = true;
+			ph->pilots[bucket] = pilot;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Hash the keys with 'ph->seed' and find every pilot. */
+static bool place_keys(struct perfect_hash *ph, struct build *b,
+		const struct perfect_hash_entry *entries)
+{
+	for (uint32_t i = 0; i < ph->count; i++)
+		b->hashes[i] = perfect_hash_hash(ph, entries[i].vrf,
+				entries[i].prefix);
+	sort_buckets(ph, b);
+
+	uint32_t max_size = b->bucket_start[b->buckets[0] + 1] -
+		b->bucket_start[b->buckets[0]];
+	uint32_t *positions = xcalloc(max_size, sizeof(uint32_t));
+
+	memset(b->taken, 0, ph->num_positions * sizeof(bool));
+	memset(ph->pilots, 0, ph->num_buckets * sizeof(uint16_t));
+	bool placed = true;
+	for (uint32_t i = 0; placed && i < ph->num_buckets; i++) {
+		uint32_t bucket = b->buckets[i];
+		if (b->bucket_start[bucket + 1] == b->bucket_start[bucket])
+			break;  /* Only empty buckets left. */
+		placed = place_bucket(ph, b, bucket, positions);
+	}
+	free(positions);
+
+	return placed;
+}
+
+struct perfect_hash *new_perfect_hash(const struct perfect_hash_entry *entries,
+		uint32_t count)
+{
+	struct perfect_hash *ph = malloc(sizeof(struct perfect_hash));
+	if (ph == NULL) {
+		fprintf(stderr, "perfecthash.new_perfect_hash: Couldn't malloc perfect hash.\n");
+		exit(1);
+	}
+
+	ph->count = count;
+	ph->num_buckets = ceil((double)count / PERFECT_HASH_BUCKET_SIZE);
+	ph->num_positions = ceil(count / PERFECT_HASH_LOAD);
+	if (ph->num_positions < count)
+		ph->num_positions = count;
+
+	/* The remapping may be empty: allocate one more element. */
+	ph->pilots = huge_alloc(ph->num_buckets * sizeof(uint16_t));
+	ph->remap = huge_alloc((ph->num_positions - count + 1) *
+			sizeof(uint32_t));
+	ph->entries = huge_alloc(count * sizeof(struct perfect_hash_entry));
+	if (ph->pilots == NULL || ph->remap == NULL || ph->entries == NULL) {
+		fprintf(stderr, "perfecthash.new_perfect_hash: Couldn't allocate a table of %"PRIu32" keys.\n",
+				count);
+		exit(1);
+	}
+
+	struct build b = {
+		.hashes = xcalloc(count, sizeof(uint64_t)),
+		.bucket_start = xcalloc(ph->num_buckets + 1, sizeof(uint32_t)),
+		.keys = xcalloc(count, sizeof(uint32_t)),
+		.buckets = xcalloc(ph->num_buckets, sizeof(uint32_t)),
+		.taken = xcalloc(ph->num_positions, sizeof(bool))
+	};
+
+	int s;
+	for (s = 0; s < PERFECT_HASH_MAX_SEEDS; s++) {
+		ph->seed = perfect_hash_mix(s + UINT64_C(0x9e3779b97f4a7c15));
+		if (place_keys(ph, &b, entries))
+			break;
+	}
+	if (s == PERFECT_HASH_MAX_SEEDS) {
+		fprintf(stderr, "perfecthash.new_perfect_hash: No pilots found for %"PRIu32" keys (duplicate keys?).\n",
+				count);
+		exit(1);
+	}
+
+	/* The taken positions past 'count' go to the free ones below it. */
+	uint32_t free_pos = 0;
+	for (uint32_t p = count; p < ph->num_positions; p++) {
+		if (!b.taken[p])
+			continue;
+		while (b.taken[free_pos])
+			free_pos++;
+		ph->remap[p - count] = free_pos++;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+		*perfect_hash_slot(ph, b.hashes[i]) = entries[i];
+
+	free(b.hashes);
+	free(b.bucket_start);
+	free(b.keys);
+	free(b.buckets);
+	free(b.taken);
+
+	return ph;
+}
+
+struct perfect_hash *copy_perfect_hash(const struct perfect_hash *src)
+{
+	struct perfect_hash *ph = malloc(sizeof(struct perfect_hash));
+	if (ph == NULL) {
+		fprintf(stderr, "perfecthash.copy_perfect_hash: Couldn't malloc perfect hash.\n");
+		exit(1);
+	}
+	*ph = *src;
+
+	size_t pilots = src->num_buckets * sizeof(uint16_t);
+	size_t remap = (src->num_positions - src->count + 1) * sizeof(uint32_t);
+	size_t entries = src->count * sizeof(struct perfect_hash_entry);
+	ph->pilots = huge_alloc(pilots);
+	ph->remap = huge_alloc(remap);
+	ph->entries = huge_alloc(entries);
+	if (ph->pilots == NULL || ph->remap == NULL || ph->entries == NULL) {
+		fprintf(stderr, "perfecthash.copy_perfect_hash: Couldn't allocate a table of %"PRIu32" keys.\n",
+				src->count);
+		exit(1);
+	}
+	memcpy(ph->pilots, src->pilots, pilots);
+	memcpy(ph->remap, src->remap, remap);
+	memcpy(ph->entries, src->entries, entries);
+
+	return ph;
+}
+
+void free_perfect_hash(struct perfect_hash *ph)
+{
+	if (ph == NULL)
+		return;
+
+	huge_free(ph->pilots);
+	huge_free(ph->remap);
+	huge_free(ph->entries);
+	free(ph);
+}
+
+size_t perfect_hash_size(const struct perfect_hash *ph)
+{
+	return ph->num_buckets * sizeof(uint16_t) +
+		(ph->num_positions - ph->count) * sizeof(uint32_t) +
+		ph->count * sizeof(struct perfect_hash_entry);
+}
@@ -0,0 +1,132 @@
+/*
+ * perfecthash.h
+ *
+ * Minimal perfect hash tables ("PTHash: Revisiting FCH Minimal Perfect
+ * Hashing", Pibiri and Trani), the static snapshot of a group in PERFECT_HASH
+ * builds (see bloomfwd_opt.h). The 64-bit hash of a key picks one of
+ * 'num_buckets' buckets, about PERFECT_HASH_BUCKET_SIZE keys each, and the
+ * pilot of that bucket moves the key to a position of its own among
+ * 'num_positions' = count / PERFECT_HASH_LOAD. The pilots are found at build
+ * time, biggest buckets first, trying 0, 1, 2, ... until every key of the
+ * bucket lands in a free position. The positions past 'count' are then
+ * remapped to the ones left free below it, so that the entries take exactly
+ * 'count' slots.
+ *
+ * A lookup reads the pilot of its bucket (2 bytes per bucket, about 4 bits
+ * per key) and then a single entry, which holds the key to check it against:
+ * there are no chains and no probes. Keys are (vrf, prefix) pairs; the set is
+ * fixed once built, only the next hops may change.
+ */
+
+#ifndef PERFECTHASH_H
+#define PERFECTHASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PERFECT_HASH_BUCKET_SIZE 4  /* Average keys per bucket. */
+#define PERFECT_HASH_LOAD 0.98  /* Keys per position before the remapping. */
+
+struct perfect_hash_entry {
+	uint32_t prefix;
+	uint32_t vrf;
+	uint32_t next_hop;
+};
+
+struct perfect_hash {
+	uint16_t *pilots;  /* One per bucket. */
+	uint32_t *remap;  /* Of the positions from 'count' on. */
+	struct perfect_hash_entry *entries;  /* 'count' of them. */
+	uint32_t num_buckets;
+	uint32_t num_positions;
+	uint32_t count;
+	uint64_t seed;
+};
+
+/*
+ * A table of the 'count' entries of 'entries' (any order; the keys must be
+ * distinct). 'count' must not be 0.
+ */
+struct perfect_hash *new_perfect_hash(const struct perfect_hash_entry *entries,
+		uint32_t count);
+
+struct perfect_hash *copy_perfect_hash(const struct perfect_hash *src);
+
+void free_perfect_hash(struct perfect_hash *ph);
+
+/* Bytes of the pilots, the remapping and the entries of 'ph'. */
+size_t perfect_hash_size(const struct perfect_hash *ph);
+
+/* The finalizer of MurmurHash3 (a bijection). */
+static inline uint64_t perfect_hash_mix(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= UINT64_C(0xff51afd7ed558ccd);
+	x ^= x >> 33;
+	x *= UINT64_C(0xc4ceb9fe1a85ec53);
+	x ^= x >> 33;
+
+	return x;
+}
+
+/* Hash of the key (vrf, prefix): distinct keys never share one. */
+static inline uint64_t perfect_hash_hash(const struct perfect_hash *ph,
+		uint32_t vrf, uint32_t prefix)
+{
+	return perfect_hash_mix(((uint64_t)vrf << 32 | prefix) ^ ph->seed);
+}
+
+/* Bucket of the key hashed to 'h', from its high half. */
+static inline uint32_t perfect_hash_bucket(const struct perfect_hash *ph,
+		uint64_t h)
+{
+	return ((h >> 32) * ph->num_buckets) >> 32;
+}
+
+/* Position of the key hashed to 'h' for the pilot 'pilot'. */
+static inline uint32_t perfect_hash_position(const struct perfect_hash *ph,
+		uint64_t h, uint16_t pilot)
+{
+	uint64_t x = perfect_hash_mix(h ^ (pilot * UINT64_C(0x9e3779b97f4a7c15)));
+
+	return ((x >> 32) * ph->num_positions) >> 32;
+}
+
+static inline const uint16_t *perfect_hash_pilot(const struct perfect_hash *ph,
+		uint64_t h)
+{
+	return &ph->pilots[perfect_hash_bucket(ph, h)];
+}
+
+/*
+ * Entry of the key hashed to 'h', if it is in 'ph' at all: the caller checks
+ * the key.
+ */
+static inline struct perfect_hash_entry *perfect_hash_slot(
+		const struct perfect_hash *ph, uint64_t h)
+{
+	uint32_t p = perfect_hash_position(ph, h, *perfect_hash_pilot(ph, h));
+	if (p >= ph->count)
+		p = ph->remap[p - ph->count];
+
+	return &ph->entries[p];
+}
+
+static inline bool perfect_hash_match(const struct perfect_hash_entry *entry,
+		uint32_t vrf, uint32_t prefix)
+{
+	return entry->prefix == prefix && entry->vrf == vrf;
+}
+
+/* Entry of (vrf, prefix), or NULL if it isn't in 'ph'. */
+static inline struct perfect_hash_entry *perfect_hash_get(
+		const struct perfect_hash *ph, uint32_t vrf, uint32_t prefix)
+{
+	struct perfect_hash_entry *entry = perfect_hash_slot(ph,
+			perfect_hash_hash(ph, vrf, prefix));
+
+	return perfect_hash_match(entry, vrf, prefix) ? entry : NULL;
+}
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ * replicas.c
+ */
+
+#define _GNU_SOURCE  /* sched_getcpu(), sched_setaffinity() */
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "replicas.h"
+
+#define NODE_DIR "/sys/devices/system/node"
+
+/* NUMA node of each CPU (-1 if unknown), read once. */
+static int cpu_nodes[CPU_SETSIZE];
+static cpu_set_t node_cpus[REPLICAS_MAX_NODES];
+static int num_nodes = 0;
+
+/*
+ * Parse a sysfs list (e.g. "0-3,8-11") into 'set'. Return false if the file
+ * can't be read.
+ */
+static bool read_list(const char *path, cpu_set_t *set)
+{
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL)
+		return false;
+
+	CPU_ZERO(set);
+
+	unsigned int first, last;
+	int rc;
+	while ((rc = fscanf(fp, "%u", &first)) == 1) {
+		last = first;
+		int c = fgetc(fp);
+		if (c == '-') {
+			if (fscanf(fp, "%u", &last) != 1)
+				break;
+			c = fgetc(fp);
+		}
+		for (unsigned int i = first; i <= last && i < CPU_SETSIZE; i++)
+			CPU_SET(i, set);
+		if (c != ',')
+			break;
+	}
+
+	fclose(fp);
+	return true;
+}
+
+static void read_topology(void)
+{
+	if (num_nodes > 0)
+		return;
+
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		cpu_nodes[cpu] = -1;
+
+	cpu_set_t online;
+	if (!read_list(NODE_DIR "/online", &online)) {
+		/* No NUMA information: a single node with every CPU. */
+		num_nodes = 1;
+		CPU_ZERO(&node_cpus[0]);
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+			cpu_nodes[cpu] = 0;
+			CPU_SET(cpu, &node_cpus[0]);
+		}
+		return;
+	}
+
+	for (int node = 0; node < REPLICAS_MAX_NODES; node++) {
+		CPU_ZERO(&node_cpus[node]);
+		if (!CPU_ISSET(node, &online))
+			continue;
+
+		char path[64];
+		snprintf(path, sizeof(path), NODE_DIR "/node%d/cpulist", node);
+		if (!read_list(path, &node_cpus[node]))
+			continue;
+
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+			if (CPU_ISSET(cpu, &node_cpus[node]))
+				cpu_nodes[cpu] = node;
+		}
+		num_nodes = node + 1;
+	}
+
+	if (num_nodes == 0) {
+		fprintf(stderr, "replicas.read_topology: No online NUMA node.\n");
+		exit(1);
+	}
+}
+
+int current_numa_node(void)
+{
+	read_topology();
+
+	int cpu = sched_getcpu();
+	if (cpu < 0 || cpu >= CPU_SETSIZE || cpu_nodes[cpu] < 0)
+		return 0;
+
+	return cpu_nodes[cpu];
+}
+
+struct table_replicas *new_table_replicas(struct forwarding_table *fw_tbl)
+{
+	read_topology();
+
+	struct table_replicas *replicas = malloc(sizeof(struct table_replicas));
+	if (replicas == NULL) {
+		fprintf(stderr, "replicas.new_table_replicas: Couldn't malloc replicas.\n");
+		exit(1);
+	}
+	replicas->num_nodes = num_nodes;
+
+	cpu_set_t saved;
+	if (sched_getaffinity(0, sizeof(cpu_set_t), &saved) != 0) {
+		fprintf(stderr, "replicas.new_table_replicas: Couldn't get the CPU affinity.\n");
+		exit(1);
+	}
+
+	/* The table itself serves the node it was (most likely) loaded on. */
+	int home = current_numa_node();
+	for (int node = 0; node < num_nodes; node++) {
+		if (node == home || CPU_COUNT(&node_cpus[node]) == 0) {
+			replicas->tables[node] = fw_tbl;
+			continue;
+		}
+
+		if (sched_setaffinity(0, sizeof(cpu_set_t), &node_cpus[node]) != 0) {
+			fprintf(stderr, "replicas.new_table_replicas: Couldn't run on node %d.\n",
+					node);
+			exit(1);
+		}
+		replicas->tables[node] = copy_forwarding_table(fw_tbl);
+	}
+
+	if (sched_setaffinity(0, sizeof(cpu_set_t), &saved) != 0) {
+		fprintf(stderr, "replicas.new_table_replicas: Couldn't restore the CPU affinity.\n");
+		exit(1);
+	}
+
+	return replicas;
+}
+
+struct forwarding_table *local_replica(const struct table_replicas *replicas)
+{
+	int node = current_numa_node();
+
+	return replicas->tables[node < replicas->num_nodes ? node : 0];
+}
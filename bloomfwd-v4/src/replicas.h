@@ -0,0 +1,39 @@
+/*
+ * replicas.h
+ *
+ * Per NUMA node copies of the (read-only) forwarding table. Each copy is made
+ * by the main thread while bound to the CPUs of its node, so that the default
+ * first-touch policy of the kernel places its pages there; lookup threads then
+ * use the copy of the node they run on. Threads must be bound to CPUs for that
+ * to hold (e.g. OMP_PROC_BIND=spread OMP_PLACES=cores).
+ *
+ * The topology is read from /sys/devices/system/node: without it (or on a
+ * single node machine), there is a single replica, which is the table itself.
+ */
+
+#ifndef REPLICAS_H
+#define REPLICAS_H
+
+#include "bloomfwd_opt.h"
+
+/* Largest number of NUMA nodes handled. */
+#define REPLICAS_MAX_NODES 64
+
+struct table_replicas {
+	int num_nodes;
+	struct forwarding_table *tables[REPLICAS_MAX_NODES];  /* By node. */
+};
+
+/*
+ * Replicate 'fw_tbl' on every node with CPUs. The table itself serves as the
+ * replica of the calling thread's node and of the nodes without CPUs.
+ */
+struct table_replicas *new_table_replicas(struct forwarding_table *fw_tbl);
+
+/* Return the replica of the node of the CPU the calling thread runs on. */
+struct forwarding_table *local_replica(const struct table_replicas *replicas);
+
+/* Return the NUMA node of the CPU the calling thread runs on. */
+int current_numa_node(void);
+
+#endif
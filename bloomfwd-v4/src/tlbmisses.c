@@ -0,0 +1,66 @@
+/*
+ * tlbmisses.c
+ */
+
+#define _GNU_SOURCE  /* syscall() */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tlbmisses.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+int dtlb_misses_start(void)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_DTLB |
+		(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		(PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	if (fd == -1)
+		return -1;
+
+	ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+
+	return fd;
+}
+
+unsigned long long dtlb_misses_stop(int counter)
+{
+	if (counter == -1)
+		return 0;
+
+	ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+
+	uint64_t count = 0;
+	if (read(counter, &count, sizeof(count)) != sizeof(count))
+		count = 0;
+	close(counter);
+
+	return count;
+}
+#else
+int dtlb_misses_start(void)
+{
+	return -1;
+}
+
+unsigned long long dtlb_misses_stop(int counter)
+{
+	(void)counter;
+	return 0;
+}
+#endif
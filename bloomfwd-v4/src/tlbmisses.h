@@ -0,0 +1,21 @@
+/*
+ * tlbmisses.h
+ *
+ * Count the data TLB load misses of the calling thread with the Linux
+ * performance counters (perf_event_open(2)), in user mode only, so that it
+ * works with the default /proc/sys/kernel/perf_event_paranoid.
+ */
+
+#ifndef TLBMISSES_H
+#define TLBMISSES_H
+
+/*
+ * Start counting for the calling thread. Return the counter, or -1 if there
+ * is none (no PMU access, e.g. in most VMs, or not Linux).
+ */
+int dtlb_misses_start(void);
+
+/* Stop 'counter' and return its count. */
+unsigned long long dtlb_misses_stop(int counter);
+
+#endif
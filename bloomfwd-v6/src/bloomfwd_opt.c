@@ -113,7 +113,7 @@ static bool store_next_hop(struct hash_table *tbl, uint64_t pfx_key,
 		uint128 next_hop)
 {
 	uint32_t hash = HASHTBL_HASH_FUNCTION_64(pfx_key);
-	uint32_t idx = hash % tbl->range;
+	uint32_t idx = fastrange_32(hash, tbl->range);
 
 	/* Find key. */
 	struct hash_table_entry *entry;
@@ -154,7 +154,7 @@ static bool store_next_hop(struct hash_table *tbl, uint64_t pfx_key,
 static inline bool find_next_hop_with_hash(struct hash_table *tbl, uint32_t hash,
 		uint64_t pfx_key, uint128 *next_hop)
 {
-	uint32_t idx = hash % tbl->range;
+	uint32_t idx = fastrange_32(hash, tbl->range);
 
 	struct hash_table_entry *entry;
 	for (entry = tbl->slots[idx]; entry != NULL; entry = entry->next) {
@@ -173,7 +173,7 @@ static bool find_next_hop(struct hash_table *tbl, uint64_t pfx_key,
 		uint128 *next_hop)
 {
 	uint32_t hash = HASHTBL_HASH_FUNCTION_64(pfx_key);
-	uint32_t idx = hash % tbl->range;
+	uint32_t idx = fastrange_32(hash, tbl->range);
 
 	struct hash_table_entry *entry;
 	for (entry = tbl->slots[idx]; entry != NULL; entry = entry->next) {
@@ -356,6 +356,7 @@ struct forwarding_table *new_forwarding_table(FILE *pfx_distribution,
 	}
 
 	fw_tbl->default_route = NULL;  /* Init default route. */
+	fw_tbl->distinct_lengths = 0;
 	init_counting_bloom_filters_array(pfx_distribution,
 			fw_tbl->has_prefix_length, &fw_tbl->distinct_lengths,
 			&fw_tbl->bf_ids, fw_tbl->counting_bloom_filters);
@@ -411,7 +412,7 @@ static bool store_prefix(struct forwarding_table *fw_tbl,
 	uint32_t bitmap_idxs[num_hashes];
 	hashes(pfx->prefix, num_hashes, bitmap_idxs);
 	for (int i = 0; i < num_hashes; i++) {
-		uint32_t idx = bitmap_idxs[i] % bitmap_len;
+		uint32_t idx = fastrange_32(bitmap_idxs[i], bitmap_len);
 		bitmap[idx] = true;
 		counters[idx] += 1;
 	}
@@ -479,13 +480,13 @@ bool lookup_address(const struct forwarding_table *fw_tbl, uint128 addr,
 //            printf("%u\n", h1);
 //            continue;
         // ENDTMP
-		bool maybe = bitmap[h1 % bitmap_len];
+		bool maybe = bitmap[fastrange_32(h1, bitmap_len)];
 		if (maybe) {
 			if (num_hashes > 1) {
 				uint32_t h2 = BLOOM_HASH_FUNCTION(h1);
-				maybe = bitmap[h2 % bitmap_len];
+				maybe = bitmap[fastrange_32(h2, bitmap_len)];
 				for (int j = 2; maybe && j < num_hashes; j++) {
-					uint32_t idx = (h1 + j * h2) % bitmap_len;
+					uint32_t idx = fastrange_32(h1 + j * h2, bitmap_len);
 					maybe = bitmap[idx];
 				}
 			}
@@ -516,6 +517,75 @@ bool lookup_address(const struct forwarding_table *fw_tbl, uint128 addr,
 	return found;
 }
 
+void lookup_address_batch(const struct forwarding_table *fw_tbl,
+		const uint128 *addrs, uint128 *next_hops, bool *found, size_t len)
+{
+	_Alignas(64) uint64_t pfx_keys[16];
+	_Alignas(64) uint32_t h1[16];
+
+	for (size_t i = 0; i < len; i += 16) {
+		int m = len - i < 16 ? len - i : 16;
+		uint32_t pending = (UINT32_C(1) << m) - 1;  /* Not found yet. */
+
+		for (int j = 0; pending != 0 && j < fw_tbl->distinct_lengths; j++) {
+			int id = fw_tbl->bf_ids[j];
+			struct counting_bloom_filter *bf =
+				fw_tbl->counting_bloom_filters[id];
+			bool *bitmap = bf->bitmap;
+			uint32_t bitmap_len = bf->bitmap_len;
+			uint8_t num_hashes = bf->num_hashes;
+
+			/* The lanes past 'm' hash the last key again. */
+			for (int k = 0; k < 16; k++) {
+				int a = k < m ? k : m - 1;
+				pfx_keys[k] = prefix_key(addrs[i + a].hi, 64 - id);
+			}
+			BLOOM_HASH_FUNCTION_INTRIN_64(pfx_keys, h1);
+
+			/* Have the first bits of all the keys in flight at once. */
+			for (int k = 0; k < m; k++)
+				if (pending & (UINT32_C(1) << k))
+					__builtin_prefetch(&bitmap[fastrange_32(h1[k],
+								bitmap_len)]);
+
+			for (int k = 0; k < m; k++) {
+				if (!(pending & (UINT32_C(1) << k)))
+					continue;
+
+				bool maybe = bitmap[fastrange_32(h1[k], bitmap_len)];
+				if (maybe && num_hashes > 1) {
+					uint32_t h2 = BLOOM_HASH_FUNCTION(h1[k]);
+					maybe = bitmap[fastrange_32(h2, bitmap_len)];
+					for (int l = 2; maybe && l < num_hashes; l++) {
+						uint32_t idx = fastrange_32(h1[k] + l * h2,
+								bitmap_len);
+						maybe = bitmap[idx];
+					}
+				}
+				if (!maybe)
+					continue;
+
+				struct hash_table *ht = fw_tbl->hash_tables[id];
+#ifdef SAME_HASH_FUNCTIONS
+				if (find_next_hop_with_hash(ht, h1[k], pfx_keys[k],
+							&next_hops[i + k]))
+#else
+				if (find_next_hop(ht, pfx_keys[k], &next_hops[i + k]))
+#endif
+					pending &= ~(UINT32_C(1) << k);
+			}
+		}
+
+		for (int k = 0; k < m; k++) {
+			found[i + k] = !(pending & (UINT32_C(1) << k));
+			if (!found[i + k] && fw_tbl->default_route != NULL) {
+				next_hops[i + k] = fw_tbl->default_route->next_hop;
+				found[i + k] = true;
+			}
+		}
+	}
+}
+
 // Initialize in main()
 //struct stats stats;
 
@@ -535,7 +605,6 @@ void lookup_address_intrin(const struct forwarding_table *fw_tbl,
 
 	__declspec(align(64)) uint64_t pfx_keys[prefix_keys_len];
 	__declspec(align(64)) uint32_t h1[prefix_keys_len];
-	__declspec(align(64)) uint32_t h1_tmp[32];
 	__declspec(align(64)) uint32_t h2[prefix_keys_len];
 
 	/* Calculate keys. */
@@ -545,36 +614,8 @@ void lookup_address_intrin(const struct forwarding_table *fw_tbl,
 
 	/* Calculate hashes. */
 	/* `prefix_keys_len` is always a multiple of 16! */
-	/* max(120) (bigger case) = 960 (prefix_key_len) / 8 (iterations):
-	 * 	prefix_key_len = 960: (distinct_lengths = 60) * (len = 16)
-	 * Then: 16 <= prefix_key_len <= 960, prefix_keys_len `mod` 64 == 0.
-	 */
-	/* IMPORTANT: Pragma `loop_count min(2) max(120)` didn't make any
-	 * difference.  Even with `unroll(2)` it didn't generate the desired
-	 * result. Just add those pragmas and check the compiler's optimization
-	 * report (*.optrpt) in case of doubt.  Thus, I perform a manual
-	 * unrolling below. */
-	//for (int i = 0; i < prefix_keys_len; i += 8) {
-	for (int i = 0; i < prefix_keys_len; i += 16) {
-		BLOOM_HASH_FUNCTION_INTRIN_64(pfx_keys + i, h1_tmp);
-		BLOOM_HASH_FUNCTION_INTRIN_64(pfx_keys + i + 8, h1_tmp + 16);
-		h1[i] = h1_tmp[1];
-		h1[i + 1] = h1_tmp[3];
-		h1[i + 2] = h1_tmp[5];
-		h1[i + 3] = h1_tmp[7];
-		h1[i + 4] = h1_tmp[9];
-		h1[i + 5] = h1_tmp[11];
-		h1[i + 6] = h1_tmp[13];
-		h1[i + 7] = h1_tmp[15];
-		h1[i + 8] = h1_tmp[17];
-		h1[i + 9] = h1_tmp[19];
-		h1[i + 10] = h1_tmp[21];
-		h1[i + 11] = h1_tmp[23];
-		h1[i + 12] = h1_tmp[25];
-		h1[i + 13] = h1_tmp[27];
-		h1[i + 14] = h1_tmp[29];
-		h1[i + 15] = h1_tmp[31];
-	}
+	for (int i = 0; i < prefix_keys_len; i += 16)
+		BLOOM_HASH_FUNCTION_INTRIN_64(pfx_keys + i, h1 + i);
 
     // TMP
 //    for (int i = 0; i < prefix_keys_len; i++) {
@@ -602,11 +643,11 @@ void lookup_address_intrin(const struct forwarding_table *fw_tbl,
 			uint32_t bitmap_len = bf->bitmap_len;
 			uint8_t num_hashes = bf->num_hashes;
 
-			bool maybe = bitmap[h1[j + k] % bitmap_len];
+			bool maybe = bitmap[fastrange_32(h1[j + k], bitmap_len)];
 			if (maybe && num_hashes > 1)
-				maybe = bitmap[h2[j + k] % bitmap_len];
+				maybe = bitmap[fastrange_32(h2[j + k], bitmap_len)];
 			for (int l = 2; maybe && l < num_hashes; l++) {
-				uint32_t idx = (h1[j + k] + l * h2[j + k]) % bitmap_len;
+				uint32_t idx = fastrange_32(h1[j + k] + l * h2[j + k], bitmap_len);
 				maybe = bitmap[idx];
 			}
 
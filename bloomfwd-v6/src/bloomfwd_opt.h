@@ -63,6 +63,15 @@ void load_prefixes(struct forwarding_table *fw_tbl, FILE *pfxs);
 bool lookup_address(const struct forwarding_table *fw_tbl,
 		uint128 addr, uint128 *next_hop);
 
+/*
+ * Look up 'len' addresses, sixteen at a time and one prefix length after the
+ * other: the keys of the sixteen are hashed at once (see
+ * 'murmurhash3_64_32_vec()'), and the first Bloom filter bits of those not
+ * found yet are prefetched before any is tested. Any target (SIMD or not).
+ */
+void lookup_address_batch(const struct forwarding_table *fw_tbl,
+		const uint128 *addrs, uint128 *next_hops, bool *found, size_t len);
+
 /* MIC */
 void lookup_address_intrin(const struct forwarding_table *fw_tbl,
 		uint128 *addrs, uint128 *next_hops, bool *found_vec, size_t len);
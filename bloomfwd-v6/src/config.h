@@ -35,7 +35,7 @@
 #define BLOOM_HASH_FUNCTION_128 murmurhash3_128_32
 // TODO: Rename '*INTRIN*' hash functions.
 #define BLOOM_HASH_FUNCTION_INTRIN murmurhash3_32_vec512_v3
-#define BLOOM_HASH_FUNCTION_INTRIN_64 murmurhash3_64_vec512_v3
+#define BLOOM_HASH_FUNCTION_INTRIN_64 murmurhash3_64_32_vec
 #define BLOOM_HASH_FUNCTION_INTRIN_128 murmurhash3_128_vec512_v3
 #define BLOOM_HASH_FUNCTION_MURMUR
 //#if defined(BLOOM_H2_HASH)
@@ -57,7 +57,7 @@
 #define HASHTBL_HASH_FUNCTION_128 murmurhash3_128_32
 // TODO: Rename '*INTRIN*' hash functions.
 #define HASHTBL_HASH_FUNCTION_INTRIN murmurhash3_32_vec512_v3
-#define HASHTBL_HASH_FUNCTION_INTRIN_64 murmurhash3_64_vec512_v3
+#define HASHTBL_HASH_FUNCTION_INTRIN_64 murmurhash3_64_32_vec
 #define HASHTBL_HASH_FUNCTION_INTRIN_128 murmurhash3_128_vec512_v3
 #ifdef BLOOM_HASH_FUNCTION_MURMUR
 #define SAME_HASH_FUNCTIONS
@@ -100,6 +100,17 @@
 #define LOOKUP_ADDRESS lookup_address
 #endif
 
+/*
+ * Enable or disable batched lookups (see 'lookup_address_batch()') in the
+ * benchmark engine. The prefix keys are hashed sixteen at a time with the
+ * SIMD instructions the build targets (see 'murmurhash3_64_32_vec()').
+ *
+ * Default: disable.
+ */
+#ifndef LOOKUP_BATCH
+#undef LOOKUP_BATCH
+#endif
+
 /*
  * Enable or disable benchmark.
  *
@@ -148,6 +148,19 @@ extern inline uint32_t h2hash_32(uint32_t key)
 	return key;
 }
 
+/*
+ * Map the hash 'x' to [0, len) with the high half of 'x * len' instead of
+ * 'x % len', which takes an integer division on every probe. As with the
+ * modulo, each index gets floor(2^32 / len) or ceil(2^32 / len) of the hash
+ * values, so the false positive ratio of a filter of 'len' bits is unchanged;
+ * the index comes from the high bits of the hash rather than the low ones.
+ * See: https://lemire.me/blog/2016/06/27/a-fast-alternative-to-the-modulo-reduction/
+ */
+extern inline uint32_t fastrange_32(uint32_t x, uint32_t len)
+{
+	return ((uint64_t)x * len) >> 32;
+}
+
 #ifdef __MIC__
 #include <immintrin.h>
 
@@ -463,5 +476,115 @@ extern inline void h2hash_32_vec512(uint32_t *keys, uint32_t *hashes)
 
 #endif
 
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__AVX512F__)
+/* A 32-bit block of MurmurHash3, mixed into 'h' (h * 5 as a shift and add). */
+static inline __m512i mm512_murmurhash3_block(__m512i h, __m512i k)
+{
+	k = _mm512_mullo_epi32(k, _mm512_set1_epi32(0xcc9e2d51));
+	k = _mm512_rol_epi32(k, 15);
+	k = _mm512_mullo_epi32(k, _mm512_set1_epi32(0x1b873593));
+	h = _mm512_rol_epi32(_mm512_xor_epi32(h, k), 13);
+
+	return _mm512_add_epi32(_mm512_add_epi32(_mm512_slli_epi32(h, 2), h),
+			_mm512_set1_epi32(0xe6546b64));
+}
+
+static inline __m512i mm512_murmurhash3_fmix(__m512i h)
+{
+	h = _mm512_xor_epi32(h, _mm512_srli_epi32(h, 16));
+	h = _mm512_mullo_epi32(h, _mm512_set1_epi32(0x85ebca6b));
+	h = _mm512_xor_epi32(h, _mm512_srli_epi32(h, 13));
+	h = _mm512_mullo_epi32(h, _mm512_set1_epi32(0xc2b2ae35));
+
+	return _mm512_xor_epi32(h, _mm512_srli_epi32(h, 16));
+}
+#elif defined(__AVX2__)
+#define MM256_ROL_EPI32(x, r) \
+	_mm256_or_si256(_mm256_slli_epi32(x, r), _mm256_srli_epi32(x, 32 - (r)))
+
+static inline __m256i mm256_murmurhash3_block(__m256i h, __m256i k)
+{
+	k = _mm256_mullo_epi32(k, _mm256_set1_epi32(0xcc9e2d51));
+	k = MM256_ROL_EPI32(k, 15);
+	k = _mm256_mullo_epi32(k, _mm256_set1_epi32(0x1b873593));
+	h = _mm256_xor_si256(h, k);
+	h = MM256_ROL_EPI32(h, 13);
+
+	return _mm256_add_epi32(_mm256_add_epi32(_mm256_slli_epi32(h, 2), h),
+			_mm256_set1_epi32(0xe6546b64));
+}
+
+static inline __m256i mm256_murmurhash3_fmix(__m256i h)
+{
+	h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+	h = _mm256_mullo_epi32(h, _mm256_set1_epi32(0x85ebca6b));
+	h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 13));
+	h = _mm256_mullo_epi32(h, _mm256_set1_epi32(0xc2b2ae35));
+
+	return _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+}
+#endif
+
+/*
+ * 'murmurhash3_64_32()' of sixteen 64-bit keys, into sixteen packed 32-bit
+ * hashes (both arrays 64-byte aligned). The low and high halves of the keys
+ * (the 1st and 2nd blocks) are gathered by permutes before hashing, so that a
+ * lane holds one key throughout and the hashes come out in key order. With
+ * AVX-512F, the sixteen keys at once; with AVX2, eight at a time. KNC has no
+ * two-source permute: its hashes are picked out of the odd elements of
+ * 'murmurhash3_64_vec512_v3()'. Elsewhere, one key at a time.
+ */
+extern inline void murmurhash3_64_32_vec(const uint64_t *keys,
+		uint32_t *hashes)
+{
+#if defined(__AVX512F__)
+	__m512i a = _mm512_load_si512(keys);
+	__m512i b = _mm512_load_si512(keys + 8);
+
+	/* Even 32-bit elements hold the low halves. */
+	__m512i even = _mm512_set_epi32(30, 28, 26, 24, 22, 20, 18, 16,
+			14, 12, 10, 8, 6, 4, 2, 0);
+	__m512i odd = _mm512_add_epi32(even, _mm512_set1_epi32(1));
+	__m512i lo = _mm512_permutex2var_epi32(a, even, b);
+	__m512i hi = _mm512_permutex2var_epi32(a, odd, b);
+
+	__m512i h = mm512_murmurhash3_block(_mm512_setzero_si512(), lo);
+	h = mm512_murmurhash3_block(h, hi);
+	h = _mm512_xor_epi32(h, _mm512_set1_epi32(8));
+	_mm512_store_si512(hashes, mm512_murmurhash3_fmix(h));
+#elif defined(__AVX2__)
+	/* The low halves of a 128-bit lane first, then the high ones. */
+	__m256i split = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+	for (int i = 0; i < 16; i += 8) {
+		__m256i a = _mm256_permutevar8x32_epi32(_mm256_load_si256(
+					(const __m256i *)(keys + i)), split);
+		__m256i b = _mm256_permutevar8x32_epi32(_mm256_load_si256(
+					(const __m256i *)(keys + i + 4)), split);
+		__m256i lo = _mm256_permute2x128_si256(a, b, 0x20);
+		__m256i hi = _mm256_permute2x128_si256(a, b, 0x31);
+
+		__m256i h = mm256_murmurhash3_block(_mm256_setzero_si256(), lo);
+		h = mm256_murmurhash3_block(h, hi);
+		h = _mm256_xor_si256(h, _mm256_set1_epi32(8));
+		_mm256_store_si256((__m256i *)(hashes + i),
+				mm256_murmurhash3_fmix(h));
+	}
+#elif defined(__MIC__)
+	_Alignas(64) uint32_t tmp[16];
+	for (int i = 0; i < 16; i += 8) {
+		murmurhash3_64_vec512_v3((uint64_t *)keys + i, tmp);
+		for (int j = 0; j < 8; j++)
+			hashes[i + j] = tmp[2 * j + 1];
+	}
+#else
+	for (int i = 0; i < 16; i++)
+		hashes[i] = murmurhash3_64_32(keys[i]);
+#endif
+}
+
 #endif
 
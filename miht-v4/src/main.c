@@ -19,14 +19,31 @@
 
 typedef struct miht fwdtbl;
 
+/* Maximum number of tables (VRFs), i.e. of `-p` options. */
+#define MAX_VRFS 64
+
+/* Default (k, m) pair. */
+#define DEFAULT_K 16
+#define DEFAULT_M 16
+
+/* Candidates evaluated by `--analyze`. */
+static const int candidate_ks[] = { 8, 12, 16, 20, 24 };
+static const int candidate_ms[] = { 4, 8, 16, 32, 64 };
+
 void print_usage(char *argv[])
 {
-	printf("Usage: %s -p <file1> -r <file2> [-n <count>]\n", argv[0]);
+	printf("Usage: %s -p <file1> [-p <file1> ...] -r <file2> [-n <count>] [-k <k>] [-m <m>]\n", argv[0]);
+	printf("       %s -p <file1> -a\n", argv[0]);
 	printf("\n");
 	printf("Options:\n");
 	printf("  -p --prefixes-file     \t Prefixes to initialize the forwarding table.\n");
+	printf("                         \t Repeat to load one table (VRF) per file; the\n");
+	printf("                         \t i-th address is forwarded by VRF i mod #VRFs.\n");
 	printf("  -r --run-address-file  \t Forward IPv4 addresses in a dry-run fashion.\n");
 	printf("  -n --num-addresses     \t Number of addresses to forward.\n");
+	printf("  -k --key-length        \t Length of prefix keys (default: %d).\n", DEFAULT_K);
+	printf("  -m --bplus-order       \t Order of the B+ tree (default: %d).\n", DEFAULT_M);
+	printf("  -a --analyze           \t Report the shape of candidate (k, m) pairs and recommend one.\n");
 }
 
 /*
@@ -67,17 +84,20 @@ static unsigned long read_addresses(FILE *input_addr, uint32_t **addresses)
  * Simply forward IPv4 addresses read from 'input_addr' file 'count' times. If
  * the number of addresses in the file is smaller than 'count', this function
  * goes back to the beginning and forwards the same packets again until 'count'
- * is reached. If 'count' is 0, it forwards each address in the file once. The
+ * is reached. If 'count' is 0, it forwards each address in the file once. When
+ * 'num_vrfs' > 1, the i-th lookup is done on table 'fw_tbls[i % num_vrfs]', so
+ * all the VRFs share the same worker threads. The
  * 'input_addr' file must be formatted as follows:
  *
  * 	- First line is the number of addresses in the file;
  * 	- Remaining lines are addresses in the form A.B.C.D, where A, B, C and D
  * 	are numbers from 0 to 255.
  */
-void forward(fwdtbl *fw_tbl, FILE *input_addr, unsigned long count)
+void forward(fwdtbl **fw_tbls, int num_vrfs, FILE *input_addr,
+		unsigned long count)
 {
-	if (fw_tbl == NULL) {
-		fprintf(stderr, "main.forward: 'fw_tbl' is NULL.\n");
+	if (fw_tbls == NULL || num_vrfs < 1) {
+		fprintf(stderr, "main.forward: 'fw_tbls' is empty.\n");
 		exit(1);
 	}
 
@@ -89,6 +109,8 @@ void forward(fwdtbl *fw_tbl, FILE *input_addr, unsigned long count)
 #ifndef NDEBUG
 	printf("Number of addresses is %lu.\n", len);
 	printf("Forwarding %.2lf times (%lu addresses).\n", (double)count / len, count);
+	if (num_vrfs > 1)
+		printf("Number of VRFs is %d.\n", num_vrfs);
 #endif
 	
 #ifdef BENCHMARK
@@ -137,6 +159,7 @@ void forward(fwdtbl *fw_tbl, FILE *input_addr, unsigned long count)
 	for (unsigned long i = 0; i < count; i++) {
 		/* Decode address. */
 		uint32_t addr = addresses[i % len];
+		fwdtbl *fw_tbl = fw_tbls[i % num_vrfs];
 
 		/* Lookup */
 		unsigned int next_hop;
@@ -154,6 +177,8 @@ void forward(fwdtbl *fw_tbl, FILE *input_addr, unsigned long count)
 #pragma omp critical
   {
 #endif
+		if (num_vrfs > 1)
+			printf("\t[%lu]", i % num_vrfs);
 		if (!found)
 			printf("\t%s -> (none)\n", addr_str);
 		else
@@ -188,34 +213,105 @@ static inline int contains(int argc, char *argv[], const char *option)
 	return index;
 }
 
-/* Options: -d, --distribution-file. */
-static void allocate_forwarding_table(int argc, char *argv[],
-		fwdtbl **fw_tbl)
+/*
+ * Return the integer value following the option `lopt` (or `sopt`), or `def`
+ * if the option is not present.
+ */
+static int int_option(int argc, char *argv[], const char *lopt,
+		const char *sopt, int def)
 {
-	*fw_tbl = miht_create(16, 16);
+	int index;
+
+	if ((index = contains(argc, argv, lopt)) == -1)
+		index = contains(argc, argv, sopt);
+
+	if (index == -1)
+		return def;
+
+	if (index + 1 >= argc) {
+		fprintf(stderr, "main: Missing value for '%s'.\n", argv[index]);
+		exit(1);
+	}
+
+	return (int)strtol(argv[index + 1], NULL, 10);
 }
 
-/* Options: -p, --prefixes-file. */
-static void initialize_forwarding_table(fwdtbl *fw_tbl, int argc,
-		char *argv[])
+/*
+ * Return the number of prefixes files (i.e. of VRFs) and store their names in
+ * `files`.
+ */
+static int prefixes_files(int argc, char *argv[], char *files[])
 {
-	int index;
+	int count = 0;
 
-	if ((index = contains(argc, argv, "--prefixes-file")) == -1)
-		index = contains(argc, argv, "-p");
-
-	if (index != -1) {
-		if (index + 1 < argc) {
-			FILE *prefixes = fopen(argv[index + 1], "r");
-			if (prefixes == NULL) {
-				fprintf(stderr, "Couldn't open prefixes file: '%s'.\n",
-						argv[index + 1]);
+	for (int i = 1; i < argc; i++) {
+		if (STREQ(argv[i], "--prefixes-file") || STREQ(argv[i], "-p")) {
+			if (i + 1 >= argc) {
+				fprintf(stderr, "main: Missing prefixes file.\n");
 				exit(1);
 			}
+			if (count == MAX_VRFS) {
+				fprintf(stderr, "main: At most %d prefixes files are allowed.\n",
+						MAX_VRFS);
+				exit(1);
+			}
+			files[count++] = argv[++i];
+		}
+	}
 
-			miht_load(fw_tbl, prefixes);
-			fclose(prefixes);
+	return count;
+}
+
+/*
+ * Options: -k, --key-length and -m, --bplus-order.
+ *
+ * Allocate one table per prefixes file (at least one) and return how many.
+ */
+static int allocate_forwarding_tables(int argc, char *argv[],
+		fwdtbl *fw_tbls[])
+{
+	int k = int_option(argc, argv, "--key-length", "-k", DEFAULT_K);
+	int m = int_option(argc, argv, "--bplus-order", "-m", DEFAULT_M);
+
+	if (k < 1 || k > MIHT_MAX_K) {
+		fprintf(stderr, "main: 'k' must be in the range [1, %d].\n",
+				MIHT_MAX_K);
+		exit(1);
+	}
+	if (m < MIHT_MIN_M) {
+		fprintf(stderr, "main: 'm' must be at least %d.\n", MIHT_MIN_M);
+		exit(1);
+	}
+
+	char *files[MAX_VRFS];
+	int num_vrfs = prefixes_files(argc, argv, files);
+	if (num_vrfs == 0)
+		num_vrfs = 1;
+
+	for (int i = 0; i < num_vrfs; i++)
+		fw_tbls[i] = miht_create(k, m);
+
+	return num_vrfs;
+}
+
+/* Options: -p, --prefixes-file (VRF i is loaded from the i-th file). */
+static void initialize_forwarding_tables(fwdtbl *fw_tbls[], int argc,
+		char *argv[])
+{
+	char *files[MAX_VRFS];
+	int num_vrfs = prefixes_files(argc, argv, files);
+
+	for (int i = 0; i < num_vrfs; i++) {
+		FILE *prefixes = fopen(files[i], "r");
+		if (prefixes == NULL) {
+			fprintf(stderr, "Couldn't open prefixes file: '%s'.\n",
+					files[i]);
+			exit(1);
 		}
+
+		miht_load(fw_tbls[i], prefixes);
+		miht_pack(fw_tbls[i]);  /* Tries in depth-first order. */
+		fclose(prefixes);
 	}
 }
 
@@ -223,7 +319,7 @@ static void initialize_forwarding_table(fwdtbl *fw_tbl, int argc,
  *   -r, --run-address-file
  *   -n, --num-addresses
  */
-static void run(fwdtbl *fw_tbl, int argc, char *argv[])
+static void run(fwdtbl *fw_tbls[], int num_vrfs, int argc, char *argv[])
 {
 	int index;
 
@@ -254,7 +350,7 @@ static void run(fwdtbl *fw_tbl, int argc, char *argv[])
 				}
 			}
 
-			forward(fw_tbl, input_addr, count);
+			forward(fw_tbls, num_vrfs, input_addr, count);
 
 			fclose(input_addr);
 		} else {
@@ -266,6 +362,80 @@ static void run(fwdtbl *fw_tbl, int argc, char *argv[])
 	}
 }
 
+static void print_stats(const struct miht_stats *stats)
+{
+	printf("%3d %4d %6d %8lu %8lu %10lu %12.1lf %8.2lf\n",
+			stats->k, stats->m, stats->bplus_depth,
+			stats->bplus_nodes, stats->ptries,
+			stats->ptrie_nodes + stats->ptminusone_nodes,
+			stats->memory / 1024.0, stats->cache_lines);
+
+	printf("    heights:");
+	for (int h = 0; h <= MIHT_MAX_PTRIE_HEIGHT; h++)
+		if (stats->ptrie_height_hist[h] > 0)
+			printf(" %d:%lu", h, stats->ptrie_height_hist[h]);
+	printf("\n");
+}
+
+/*
+ * Options: -a, --analyze (requires -p).
+ *
+ * Build the table for every candidate (k, m) pair and recommend the one with
+ * the fewest expected cache lines per lookup (ties are broken by memory).
+ */
+static void analyze(int argc, char *argv[])
+{
+	int index;
+
+	if ((index = contains(argc, argv, "--prefixes-file")) == -1)
+		index = contains(argc, argv, "-p");
+
+	if (index == -1 || index + 1 >= argc) {
+		fprintf(stderr, "main.analyze: Missing prefixes file.\n");
+		exit(1);
+	}
+
+	FILE *prefixes = fopen(argv[index + 1], "r");
+	if (prefixes == NULL) {
+		fprintf(stderr, "Couldn't open prefixes file: '%s'.\n",
+				argv[index + 1]);
+		exit(1);
+	}
+
+	struct miht_stats best;
+	memset(&best, 0, sizeof(struct miht_stats));
+	best.cache_lines = -1.0;
+
+	printf("  k    m  depth    bplus   ptries      nodes  memory(KiB)    lines\n");
+	for (size_t i = 0; i < sizeof(candidate_ks) / sizeof(int); i++) {
+		for (size_t j = 0; j < sizeof(candidate_ms) / sizeof(int); j++) {
+			fwdtbl *fw_tbl = miht_create(candidate_ks[i],
+					candidate_ms[j]);
+			rewind(prefixes);
+			miht_load(fw_tbl, prefixes);
+			miht_pack(fw_tbl);
+
+			struct miht_stats stats;
+			miht_stats(fw_tbl, &stats);
+			print_stats(&stats);
+
+			if (best.cache_lines < 0.0 ||
+					stats.cache_lines < best.cache_lines ||
+					(stats.cache_lines == best.cache_lines &&
+					 stats.memory < best.memory))
+				best = stats;
+
+			miht_destroy(fw_tbl);
+		}
+	}
+	fclose(prefixes);
+
+	printf("\nlines: B+ tree levels, plus the priority trie nodes visited averaged over\n"
+			"the prefixes (leaf tries and PT[-1] weighted by their share of them).\n");
+	printf("\nRecommended: -k %d -m %d (%.2lf cache lines per lookup, %.1lf KiB).\n",
+			best.k, best.m, best.cache_lines, best.memory / 1024.0);
+}
+
 int main(int argc, char *argv[])
 {
 	if (argc < 3 || STREQ(argv[1], "--help")) {
@@ -273,11 +443,17 @@ int main(int argc, char *argv[])
 		return 0;
 	}
 
-	fwdtbl *fw_tbl = NULL;
+	if (contains(argc, argv, "--analyze") != -1 ||
+			contains(argc, argv, "-a") != -1) {
+		analyze(argc, argv);
+		return 0;
+	}
+
+	fwdtbl *fw_tbls[MAX_VRFS];
 
-	allocate_forwarding_table(argc, argv, &fw_tbl);
-	initialize_forwarding_table(fw_tbl, argc, argv);  /* Load prefixes. */
-	run(fw_tbl, argc, argv);  /* Dry-run only. */
+	int num_vrfs = allocate_forwarding_tables(argc, argv, fw_tbls);
+	initialize_forwarding_tables(fw_tbls, argc, argv);  /* Load prefixes. */
+	run(fw_tbls, num_vrfs, argc, argv);  /* Dry-run only. */
 
 	return 0;
 }
@@ -0,0 +1,109 @@
+/*
+ * arena.c
+ */
+
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN alignof(void *)
+
+struct arena_block {
+	struct arena_block *next;
+	size_t len;
+	size_t used;
+	alignas(ARENA_ALIGN) unsigned char data[];
+};
+
+static inline size_t round_up(size_t size)
+{
+	return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+static struct arena_block *new_arena_block(size_t len)
+{
+	struct arena_block *block = malloc(sizeof(struct arena_block) + len);
+	if (block == NULL) {
+		fprintf(stderr, "arena.new_arena_block: Couldn't malloc %zu bytes.\n",
+				len);
+		exit(1);
+	}
+	block->next = NULL;
+	block->len = len;
+	block->used = 0;
+
+	return block;
+}
+
+struct arena *new_arena(size_t block_size)
+{
+	struct arena *arena = malloc(sizeof(struct arena));
+	if (arena == NULL) {
+		fprintf(stderr, "arena.new_arena: Couldn't malloc arena.\n");
+		exit(1);
+	}
+	arena->blocks = NULL;
+	arena->block_size = round_up(block_size > 0 ? block_size : 1);
+	arena->used = 0;
+
+	return arena;
+}
+
+/* Bytes to skip in 'block' for its next node to be aligned to 'align'. */
+static inline size_t padding(const struct arena_block *block, size_t align)
+{
+	uintptr_t next = (uintptr_t)(block->data + block->used);
+
+	return (align - (next & (align - 1))) & (align - 1);
+}
+
+void *arena_alloc_aligned(struct arena *arena, size_t size, size_t align)
+{
+	size = round_up(size);
+	if (align < ARENA_ALIGN)
+		align = ARENA_ALIGN;
+
+	struct arena_block *block = arena->blocks;
+	size_t pad = block != NULL ? padding(block, align) : 0;
+	if (block == NULL || block->len - block->used < pad + size) {
+		size_t len = size + (align > ARENA_ALIGN ? align : 0);
+		block = new_arena_block(len > arena->block_size ? len :
+				arena->block_size);
+		block->next = arena->blocks;
+		arena->blocks = block;
+		pad = padding(block, align);
+	}
+
+	void *ptr = block->data + block->used + pad;
+	block->used += pad + size;
+	arena->used += pad + size;
+
+	return ptr;
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	return arena_alloc_aligned(arena, size, ARENA_ALIGN);
+}
+
+size_t arena_node_size(size_t size)
+{
+	return round_up(size);
+}
+
+void free_arena(struct arena *arena)
+{
+	if (arena == NULL)
+		return;
+
+	struct arena_block *block = arena->blocks;
+	while (block != NULL) {
+		struct arena_block *next = block->next;
+		free(block);
+		block = next;
+	}
+	free(arena);
+}
@@ -16,11 +16,9 @@ enum miht_node_type {
 
 static const uint128 zero128 = (uint128){ .hi = 0, .lo = 0 };
 
-uint128 default_route = (uint128){ .hi = 0, .lo = 0 };
-
-struct ptrie_node *ptrie_node()
+struct ptrie_node *ptrie_node(struct arena *arena)
 {
-	struct ptrie_node *ptrie_node = malloc(sizeof(struct ptrie_node));
+	struct ptrie_node *ptrie_node = arena_alloc(arena, sizeof(struct ptrie_node));
 	ptrie_node->is_priority = true;
 	ptrie_node->suffix = 0;
 	ptrie_node->len = 0;
@@ -31,30 +29,35 @@ struct ptrie_node *ptrie_node()
 	return ptrie_node;
 }
 
-struct bplus_node *bplus_node(int m, enum miht_node_type type)
+struct bplus_node *bplus_node(struct arena *arena, int m,
+		enum miht_node_type type)
 {
-	struct bplus_node *bplus_node = malloc(sizeof(struct bplus_node));
+	struct bplus_node *bplus_node = arena_alloc(arena, sizeof(struct bplus_node));
 	bplus_node->num_indices = 0;
 	/* Allocate extra node to ease implementation: `indices[0]` won't be
 	 * used.
 	 */
 #if defined(__MIC__)
-	bplus_node->indices = _mm_malloc(m * sizeof(uint64_t), 64);
+	bplus_node->indices = arena_alloc_aligned(arena, m * sizeof(uint64_t), 64);
 #else
-	bplus_node->indices = malloc(m * sizeof(uint64_t));
+	bplus_node->indices = arena_alloc(arena, m * sizeof(uint64_t));
 #endif
 	for (int i = 0; i < m; i++) {
 		bplus_node->indices[i] = UINT64_MAX;
 	}
 	if (type == MIHT_INTERNAL) {
 		bplus_node->is_leaf = false;
-		bplus_node->children = calloc(m, sizeof(struct bplus_node *));
+		bplus_node->children = arena_alloc(arena,
+				m * sizeof(struct bplus_node *));
+		memset(bplus_node->children, 0, m * sizeof(struct bplus_node *));
 	} else {  /* type == MIHT_EXTERNAL */
 		bplus_node->is_leaf = true;
 		/* Allocate extra node to ease implementation: `data[0]` won't be
 		 * used.
 		 */
-		bplus_node->data = calloc(m, sizeof(struct ptrie_node *));
+		bplus_node->data = arena_alloc(arena,
+				m * sizeof(struct ptrie_node *));
+		memset(bplus_node->data, 0, m * sizeof(struct ptrie_node *));
 	}
 
 	return bplus_node;
@@ -65,12 +68,69 @@ struct miht *miht_create(int k, int m)
 	struct miht *miht = malloc(sizeof(struct miht));
 	miht->k = k;
 	miht->m = m;
+	miht->has_default_route = false;
+	miht->default_route = zero128;
 	miht->root0 = NULL;
-	miht->root1 = bplus_node(m, MIHT_EXTERNAL);
+	miht->arena = new_arena(MIHT_ARENA_BLOCK_SIZE);
+	miht->root1 = bplus_node(miht->arena, m, MIHT_EXTERNAL);
 
 	return miht;
 }
 
+void miht_destroy(struct miht *miht)
+{
+	free_arena(miht->arena);  /* Every node at once. */
+	free(miht);
+}
+
+/* Copy `src` to `arena` in preorder: each trie is contiguous. */
+static struct ptrie_node *ptrie_copy(struct arena *arena,
+		const struct ptrie_node *src)
+{
+	if (src == NULL)
+		return NULL;
+
+	struct ptrie_node *ptrie = arena_alloc(arena, sizeof(struct ptrie_node));
+	*ptrie = *src;
+	ptrie->left = ptrie_copy(arena, src->left);
+	ptrie->right = ptrie_copy(arena, src->right);
+
+	return ptrie;
+}
+
+/* Copy `src` to `arena` in preorder, with the tries of a leaf after it. */
+static struct bplus_node *bplus_copy(struct arena *arena, int m,
+		const struct bplus_node *src)
+{
+	struct bplus_node *bplus = bplus_node(arena, m,
+			src->is_leaf ? MIHT_EXTERNAL : MIHT_INTERNAL);
+	bplus->num_indices = src->num_indices;
+	memcpy(bplus->indices, src->indices, m * sizeof(*src->indices));
+	if (src->is_leaf) {
+		for (int i = 1; i <= src->num_indices; i++)
+			bplus->data[i] = ptrie_copy(arena, src->data[i]);
+	} else {
+		for (int i = 0; i <= src->num_indices; i++)
+			bplus->children[i] = bplus_copy(arena, m,
+					src->children[i]);
+	}
+
+	return bplus;
+}
+
+void miht_pack(struct miht *miht)
+{
+	struct arena *old = miht->arena;
+
+	/* One block for everything: later inserts get blocks of their own. */
+	miht->arena = new_arena(old->used);
+	miht->root1 = bplus_copy(miht->arena, miht->m, miht->root1);
+	miht->root0 = ptrie_copy(miht->arena, miht->root0);
+	miht->arena->block_size = MIHT_ARENA_BLOCK_SIZE;
+
+	free_arena(old);
+}
+
 static inline uint64_t prefix_key(int k, uint64_t p, int len)
 {
 	uint64_t ret = len > k ? p >> (len - k) : p;
@@ -80,7 +140,7 @@ static inline uint64_t prefix_key(int k, uint64_t p, int len)
 /*
  * Assumes len > k.
  */
-int suffix(int k, uint64_t p, int len)
+uint64_t suffix(int k, uint64_t p, int len)
 {
 	uint64_t ret = p & ~(0xffffffffffffffff << (len - k));
 	return ret;
@@ -126,8 +186,9 @@ void sort(struct bplus_node *node, int count)
 void miht_node_split(int m, struct bplus_node *x, int y_pos, struct bplus_node *y,
 		uint64_t pkey, struct miht *miht)
 {
-	struct bplus_node *z = y->is_leaf ? bplus_node(m, MIHT_EXTERNAL) :
-		bplus_node(m, MIHT_INTERNAL);
+	struct bplus_node *z = y->is_leaf ?
+		bplus_node(miht->arena, m, MIHT_EXTERNAL) :
+		bplus_node(miht->arena, m, MIHT_INTERNAL);
 
 	int count = x->num_indices - y_pos;
 	if (count > 0) {  /* x is always an internal node. */
@@ -149,7 +210,8 @@ void miht_node_split(int m, struct bplus_node *x, int y_pos, struct bplus_node *
 			memmove(&z->data[1],
 				&y->data[g + 1],
 				(m - g - 1) * sizeof(struct ptrie_node *));
-			memset(&y->data[g + 1], 0, m - g - 1);  /* Set NULL. */
+			memset(&y->data[g + 1], 0,
+				(m - g - 1) * sizeof(struct ptrie_node *));  /* Set NULL. */
 			z->indices[m - g] = pkey;
 			sort(z, m - g);
 		} else {
@@ -159,7 +221,8 @@ void miht_node_split(int m, struct bplus_node *x, int y_pos, struct bplus_node *
 			memmove(&z->data[1],
 				&y->data[g],
 				(m - g) * sizeof(struct ptrie_node *));
-			memset(&y->data[g], 0, m - g);  /* Set NULL. */
+			memset(&y->data[g], 0,
+				(m - g) * sizeof(struct ptrie_node *));  /* Set NULL. */
 			y->indices[g] = pkey;
 			sort(y, g);
 		}
@@ -173,7 +236,8 @@ void miht_node_split(int m, struct bplus_node *x, int y_pos, struct bplus_node *
 		memmove(&z->children[0],
 			&y->children[g],
 			(m - g) * sizeof(struct bplus_node *));
-		memset(&y->children[g], 0, m - g);
+		memset(&y->children[g], 0,
+			(m - g) * sizeof(struct bplus_node *));
 		y->num_indices = g - 1;
 		z->num_indices = m - g - 1;
 		x->indices[y_pos + 1] = y->indices[g];
@@ -207,11 +271,12 @@ static inline bool ptrie_check_bit(int pos, uint64_t suffix, int len)
 }
 
 
-struct ptrie_node *ptrie_insert_prime(struct ptrie_node *ptrie, uint64_t suffix,
+struct ptrie_node *ptrie_insert_prime(struct arena *arena,
+		struct ptrie_node *ptrie, uint64_t suffix,
 		int len, uint128 next_hop, int level)
 {
 	if (ptrie == NULL) {
-		ptrie = ptrie_node();
+		ptrie = ptrie_node(arena);
 		ptrie->is_priority = len > level;
 		ptrie->suffix = suffix;
 		ptrie->len = len;
@@ -249,10 +314,10 @@ struct ptrie_node *ptrie_insert_prime(struct ptrie_node *ptrie, uint64_t suffix,
 		}
 
 		if (ptrie_check_bit(level + 1, suffix, len)) {
-			ptrie->right = ptrie_insert_prime(ptrie->right,
+			ptrie->right = ptrie_insert_prime(arena, ptrie->right,
 					suffix, len, next_hop, level + 1);
 		} else {
-			ptrie->left = ptrie_insert_prime(ptrie->left,
+			ptrie->left = ptrie_insert_prime(arena, ptrie->left,
 					suffix, len, next_hop, level + 1);
 		}
 	}
@@ -260,16 +325,17 @@ struct ptrie_node *ptrie_insert_prime(struct ptrie_node *ptrie, uint64_t suffix,
 	return ptrie;
 }
 
-void ptrie_insert(struct ptrie_node **ptrie, uint64_t suffix, int len, uint128 next_hop)
+void ptrie_insert(struct arena *arena, struct ptrie_node **ptrie,
+		uint64_t suffix, int len, uint128 next_hop)
 {
 	if (*ptrie == NULL) {
-		*ptrie = ptrie_node();
+		*ptrie = ptrie_node(arena);
 		(*ptrie)->is_priority = len > 0;
 		(*ptrie)->suffix = suffix;
 		(*ptrie)->len = len;
 		(*ptrie)->next_hop = next_hop;
 	} else {
-		ptrie_insert_prime(*ptrie, suffix, len, next_hop, 0);
+		ptrie_insert_prime(arena, *ptrie, suffix, len, next_hop, 0);
 	}
 }
 
@@ -291,7 +357,8 @@ void miht_insert(struct miht *miht, struct bplus_node *bplus,
 		struct ip_prefix prefix)
 {
 	if (prefix.len == 0) {
-		default_route = prefix.next_hop;
+		miht->has_default_route = true;
+		miht->default_route = prefix.next_hop;
 		return;
 	}
 
@@ -299,16 +366,26 @@ void miht_insert(struct miht *miht, struct bplus_node *bplus,
 	int m = miht->m;
 
 	if (prefix.len >= k) {
-		if (miht->root1->num_indices == m - 1) {
-			struct bplus_node *new_root = bplus_node(m, MIHT_INTERNAL);
-			new_root->children[0] = miht->root1;
-			miht->root1 = new_root;
-			miht_node_split(m, miht->root1, 0,
-				miht->root1->children[0], prefix_key(k, prefix.prefix, prefix.len), miht);
-			bplus = miht->root1;
+		uint64_t p = prefix_key(k, prefix.prefix, prefix.len);
+		struct bplus_node *root = miht->root1;
+		if (root->num_indices == m - 1) {
+			/*
+			 * As for the children below: a full leaf is only split
+			 * if `p` is a new key, since the split inserts it.
+			 */
+			int j = miht_bsearch(&root->indices[1],
+					root->num_indices, p);
+			bool prefix_exists = root->indices[j] == p;
+			if ((root->is_leaf && !prefix_exists) || !root->is_leaf) {
+				struct bplus_node *new_root = bplus_node(miht->arena,
+						m, MIHT_INTERNAL);
+				new_root->children[0] = root;
+				miht->root1 = new_root;
+				miht_node_split(m, miht->root1, 0, root, p, miht);
+				bplus = miht->root1;
+			}
 		}
 
-		uint64_t p = prefix_key(k, prefix.prefix, prefix.len);
 		/* Find the index i in B+ tree node. */
 		int i = miht_bsearch(&bplus->indices[1], bplus->num_indices, p);
 
@@ -328,7 +405,8 @@ void miht_insert(struct miht *miht, struct bplus_node *bplus,
 				bplus->data[i] = NULL;
 				bplus->num_indices = bplus->num_indices + 1;
 			}
-			ptrie_insert(&bplus->data[i], suffix(k, prefix.prefix, prefix.len),
+			ptrie_insert(miht->arena, &bplus->data[i],
+					suffix(k, prefix.prefix, prefix.len),
 					prefix.len - k, prefix.next_hop);
 		} else {  /* Internal node. */
 			struct bplus_node *child = bplus->children[i];
@@ -347,7 +425,8 @@ void miht_insert(struct miht *miht, struct bplus_node *bplus,
 		}
 	} else {
 		/* Insert into PT[-1]. */
-		ptrie_insert(&miht->root0, prefix.prefix, prefix.len, prefix.next_hop);
+		ptrie_insert(miht->arena, &miht->root0, prefix.prefix, prefix.len,
+				prefix.next_hop);
 	}
 }
 
@@ -381,14 +460,20 @@ void miht_load(struct miht *miht, FILE *pfxs)
 	}
 }
 
-static inline uint128 ptrie_lookup(const struct ptrie_node *ptrie, uint64_t suffix, int len)
+/*
+ * Return true and set `next_hop` if some prefix in `ptrie` matches `suffix`.
+ * Otherwise, return false and leave `next_hop` untouched.
+ */
+static inline bool ptrie_lookup(const struct ptrie_node *ptrie,
+		uint64_t suffix, int len, uint128 *next_hop)
 {
-	uint128 next_hop = default_route; 
+	bool found = false;
 	int level = 0;
 
 	while (ptrie != NULL) {
 		if (ptrie_prefix_match(ptrie->suffix, ptrie->len, suffix, len)) {
-			next_hop = ptrie->next_hop;
+			*next_hop = ptrie->next_hop;
+			found = true;
 			if (ptrie->is_priority)
 				break;
 		}
@@ -396,7 +481,7 @@ static inline uint128 ptrie_lookup(const struct ptrie_node *ptrie, uint64_t suff
 			ptrie->right : ptrie->left;
 	}
 
-	return next_hop;
+	return found;
 }
 
 void ptrie_printhex(const struct ptrie_node *ptrie)
@@ -419,7 +504,6 @@ void ptrie_printhex(const struct ptrie_node *ptrie)
 bool miht_lookup(const struct miht *miht, uint128 addr, uint128 *nhop)
 {
 	uint64_t addr_hi = addr.hi;
-	uint128 next_hop;
 	const struct ptrie_node *ptminusone = miht->root0;
 	const struct bplus_node *bplus = miht->root1;
 	int k = miht->k;
@@ -430,16 +514,15 @@ bool miht_lookup(const struct miht *miht, uint128 addr, uint128 *nhop)
 	}
 
 	int i = miht_bsearch(&bplus->indices[1], bplus->num_indices, p);
-	if (p == bplus->indices[i]) {
-		next_hop = ptrie_lookup(bplus->data[i], suffix(k, addr_hi, 64), 64 - k);
-		if (!UINT128_EQ(next_hop, default_route)) {
-			*nhop = next_hop;
-			return true;
-		}
-	}
+	if (p == bplus->indices[i] &&
+			ptrie_lookup(bplus->data[i], suffix(k, addr_hi, 64), 64 - k, nhop))
+		return true;
 
-	*nhop = ptrie_lookup(ptminusone, addr_hi, 64);
-	return !(UINT128_EQ(*nhop, default_route) && UINT128_EQ(default_route, zero128));
+	if (ptrie_lookup(ptminusone, addr_hi, 64, nhop))
+		return true;
+
+	*nhop = miht->default_route;
+	return miht->has_default_route;
 }
 
 void ptrie_print(const struct ptrie_node *ptrie)
@@ -480,4 +563,75 @@ void miht_print(const struct miht *miht)
 	miht_print_prime(miht->root1, 0);
 }
 
+/*
+ * Count the nodes of `ptrie` and accumulate the number of nodes visited to
+ * reach each one of them (i.e. depth + 1) into `visits`.
+ */
+static int ptrie_stats(const struct ptrie_node *ptrie, int depth,
+		unsigned long *nodes, unsigned long *visits)
+{
+	if (ptrie == NULL)
+		return 0;
+
+	*nodes += 1;
+	*visits += depth + 1;
+	int l = ptrie_stats(ptrie->left, depth + 1, nodes, visits);
+	int r = ptrie_stats(ptrie->right, depth + 1, nodes, visits);
+
+	return 1 + (l > r ? l : r);
+}
+
+static void bplus_stats(const struct bplus_node *bplus, int level,
+		struct miht_stats *stats, unsigned long *visits)
+{
+	stats->bplus_nodes++;
+	if (level > stats->bplus_depth)
+		stats->bplus_depth = level;
+
+	if (bplus->is_leaf) {
+		for (int i = 1; i <= bplus->num_indices; i++) {
+			int h = ptrie_stats(bplus->data[i], 0,
+					&stats->ptrie_nodes, visits);
+			stats->ptries++;
+			stats->ptrie_height_hist[h]++;
+		}
+	} else {
+		for (int i = 0; i <= bplus->num_indices; i++)
+			bplus_stats(bplus->children[i], level + 1, stats, visits);
+	}
+}
+
+void miht_stats(const struct miht *miht, struct miht_stats *stats)
+{
+	memset(stats, 0, sizeof(struct miht_stats));
+	stats->k = miht->k;
+	stats->m = miht->m;
+
+	unsigned long visits = 0;
+	bplus_stats(miht->root1, 1, stats, &visits);
+
+	unsigned long ptminusone_visits = 0;
+	ptrie_stats(miht->root0, 0, &stats->ptminusone_nodes,
+			&ptminusone_visits);
+
+	int m = miht->m;
+	stats->memory = sizeof(struct miht) + miht->arena->used;
+
+	/* Binary search over `indices` touches ~log2(lines) + 1 lines. */
+	int index_lines = (m * sizeof(uint64_t) + 63) / 64;
+	int bsearch_lines = 1;
+	while ((1 << (bsearch_lines - 1)) < index_lines)
+		bsearch_lines++;
+	double lines = stats->bplus_depth * (1 + bsearch_lines + 1);
+
+	/*
+	 * One node per stored prefix: the leaf tries and PT[-1] are both
+	 * weighted by their share of the prefixes, i.e. the visits are averaged
+	 * over all the nodes.
+	 */
+	unsigned long total = stats->ptrie_nodes + stats->ptminusone_nodes;
+	if (total > 0)
+		lines += (double)(visits + ptminusone_visits) / total;
+	stats->cache_lines = lines;
+}
 
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 
+#include "arena.h"
 #include "ip.h"
 
 struct ptrie_node {
@@ -27,22 +28,59 @@ struct bplus_node {
 struct miht {
 	int k;
 	int m;
+	bool has_default_route;
+	uint128 default_route;
 	struct ptrie_node *root0;
 	struct bplus_node *root1;
+	struct arena *arena;  /* Every node of both. */
 };
 
+/* Size of the blocks the nodes are allocated from (see arena.h). */
+#define MIHT_ARENA_BLOCK_SIZE (1 << 20)
+
 //extern unsigned long long bplus_only_count;
 //
 //extern unsigned long long pt_count;
 
 
+/* A priority trie holds at most one node per suffix bit (plus the root). */
+#define MIHT_MAX_PTRIE_HEIGHT 65
+
+/*
+ * Shape of a loaded MIHT, as reported by `miht_stats`.
+ */
+struct miht_stats {
+	int k;
+	int m;
+	int bplus_depth;  /* Number of B+ tree levels, leaves included. */
+	unsigned long bplus_nodes;
+	unsigned long ptries;  /* Priority tries hanging from the leaves. */
+	unsigned long ptrie_nodes;  /* Nodes in those tries. */
+	unsigned long ptminusone_nodes;  /* Nodes in PT[-1]. */
+	/* ptrie_height_hist[h]: number of leaf priority tries of height h. */
+	unsigned long ptrie_height_hist[MIHT_MAX_PTRIE_HEIGHT + 1];
+	size_t memory;  /* Bytes allocated for the whole structure. */
+	double cache_lines;  /* Expected cache lines touched per lookup. */
+};
+
 /*
- * \brief Recommended value for both \c k and \c m is 16 for IPv4.
- * \param k Length of prefix keys.
- * \param m Order of B+ tree.
+ * \brief Recommended value for both \c k and \c m is 32 for IPv6.
+ * \param k Length of prefix keys (1 <= k <= MIHT_MAX_K).
+ * \param m Order of B+ tree (m >= MIHT_MIN_M).
  */
+#define MIHT_MAX_K 63
+#define MIHT_MIN_M 3
 struct miht *miht_create(int k, int m);
 
+void miht_destroy(struct miht *miht);
+
+/*
+ * Move the nodes of `miht` to a single block of memory, in depth-first order,
+ * so that the nodes of each priority trie are next to each other. Call it once
+ * the prefixes are loaded.
+ */
+void miht_pack(struct miht *miht);
+
 void miht_insert(struct miht *miht, struct bplus_node *bplus,
 		struct ip_prefix prefix);
 
@@ -52,5 +90,15 @@ bool miht_lookup(const struct miht *miht, uint128 addr, uint128 *next_hop);
 
 void miht_print(const struct miht *miht);
 
+/*
+ * Walk the whole structure and fill in `stats`. The expected number of cache
+ * lines per lookup is a static estimate: every B+ tree level costs the node
+ * header, the lines touched by the binary search over `indices` and the
+ * pointer array; the priority tries (leaf ones and PT[-1]) cost one line per
+ * visited node, averaged over the stored prefixes (one per node), so that each
+ * kind of trie is weighted by its share of them.
+ */
+void miht_stats(const struct miht *miht, struct miht_stats *stats);
+
 #endif
 